@@ -0,0 +1,341 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "arena.h"
+#include "log.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/*
+	Storage that lives for a whole run (Frequency arrays, difference
+	arrays) comes from the arena in config and is released at once in
+	ReleaseAudioBlockStructure. Transient buffers use the per thread
+	scratch arenas, which are rewound to a mark after each use.
+*/
+
+typedef struct scratch_list_st {
+	memoryArena				arena;
+	struct scratch_list_st	*next;
+} scratchArena;
+
+static scratchArena	*scratchList = NULL;
+static scratchArena	*scratch = NULL;
+#ifdef OPENMP_ENABLE
+#pragma omp threadprivate(scratch)
+#endif
+
+static size_t ArenaAlign(size_t size)
+{
+	return (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+}
+
+static arenaChunk *CreateArenaChunk(size_t size, int hugePages)
+{
+	arenaChunk	*chunk = NULL;
+	int			mapped = 0;
+
+	if(hugePages)
+	{
+#if defined(__linux__)
+		void *memory = NULL;
+
+		size = (size + ARENA_HUGE_PAGE - 1) & ~((size_t)ARENA_HUGE_PAGE - 1);
+		memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(memory != MAP_FAILED)
+		{
+#ifdef MADV_HUGEPAGE
+			madvise(memory, size, MADV_HUGEPAGE);
+#endif
+			chunk = (arenaChunk*)memory;
+			mapped = 1;
+		}
+#endif
+	}
+
+	if(!chunk)
+	{
+		chunk = (arenaChunk*)malloc(size);
+		if(!chunk)
+			return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = ArenaAlign(sizeof(arenaChunk));
+	chunk->mapped = mapped;
+	return chunk;
+}
+
+static void ReleaseArenaChunk(arenaChunk *chunk)
+{
+#if defined(__linux__)
+	if(chunk->mapped)
+	{
+		munmap(chunk, chunk->size);
+		return;
+	}
+#endif
+	free(chunk);
+}
+
+void InitArena(memoryArena *arena, int hugePages, int shared)
+{
+	if(!arena)
+		return;
+
+	memset(arena, 0, sizeof(memoryArena));
+	arena->hugePages = hugePages;
+	arena->shared = shared;
+#ifdef OPENMP_ENABLE
+	// Each shared arena has its own lock, batch comparisons don't wait on each other
+	if(shared)
+		omp_init_lock(&arena->lock);
+#endif
+}
+
+static void *ArenaAllocInternal(memoryArena *arena, size_t size)
+{
+	void	*memory = NULL;
+
+	size = ArenaAlign(size);
+	while(arena->current && arena->current->used + size > arena->current->size)
+	{
+		/* chunks after current are free after a rewind */
+		if(!arena->current->next)
+			break;
+		arena->current = arena->current->next;
+		arena->current->used = ArenaAlign(sizeof(arenaChunk));
+	}
+
+	if(!arena->current || arena->current->used + size > arena->current->size)
+	{
+		arenaChunk	*chunk = NULL;
+		size_t		chunkSize = ARENA_CHUNK_SIZE;
+
+		if(size + ArenaAlign(sizeof(arenaChunk)) > chunkSize)
+			chunkSize = size + ArenaAlign(sizeof(arenaChunk));
+
+		chunk = CreateArenaChunk(chunkSize, arena->hugePages);
+		if(!chunk)
+			return NULL;
+
+		if(arena->current)
+		{
+			chunk->next = arena->current->next;
+			arena->current->next = chunk;
+		}
+		else
+		{
+			chunk->next = arena->first;
+			arena->first = chunk;
+		}
+		arena->current = chunk;
+		arena->reserved += chunk->size;
+	}
+
+	memory = (char*)arena->current + arena->current->used;
+	arena->current->used += size;
+	arena->allocated += size;
+	if(arena->allocated > arena->highWater)
+		arena->highWater = arena->allocated;
+	return memory;
+}
+
+void *ArenaAlloc(memoryArena *arena, size_t size)
+{
+	void	*memory = NULL;
+
+	if(!arena)
+		return NULL;
+
+	/* same as malloc(0) in glibc, a valid pointer for empty arrays */
+	if(!size)
+		size = 1;
+
+	if(arena->shared)
+	{
+#ifdef OPENMP_ENABLE
+		omp_set_lock(&arena->lock);
+#endif
+		memory = ArenaAllocInternal(arena, size);
+#ifdef OPENMP_ENABLE
+		omp_unset_lock(&arena->lock);
+#endif
+	}
+	else
+		memory = ArenaAllocInternal(arena, size);
+
+	if(!memory)
+		logmsg("ERROR: Not enough memory for arena (%ld bytes)\n", (long int)size);
+	return memory;
+}
+
+void *ArenaCalloc(memoryArena *arena, size_t size)
+{
+	void	*memory = NULL;
+
+	memory = ArenaAlloc(arena, size);
+	if(memory)
+		memset(memory, 0, size);
+	return memory;
+}
+
+arenaMark GetArenaMark(memoryArena *arena)
+{
+	arenaMark	mark;
+
+	memset(&mark, 0, sizeof(arenaMark));
+	if(!arena || !arena->current)
+		return mark;
+
+	mark.chunk = arena->current;
+	mark.used = arena->current->used;
+	mark.allocated = arena->allocated;
+	return mark;
+}
+
+void RewindArena(memoryArena *arena, arenaMark mark)
+{
+	if(!arena)
+		return;
+
+	if(!mark.chunk)
+	{
+		ResetArena(arena);
+		return;
+	}
+
+	arena->current = mark.chunk;
+	arena->current->used = mark.used;
+	arena->allocated = mark.allocated;
+}
+
+void ResetArena(memoryArena *arena)
+{
+	if(!arena || !arena->first)
+		return;
+
+	arena->current = arena->first;
+	arena->current->used = ArenaAlign(sizeof(arenaChunk));
+	arena->allocated = 0;
+}
+
+void ReleaseArena(memoryArena *arena)
+{
+	arenaChunk	*chunk = NULL;
+
+	if(!arena)
+		return;
+
+	chunk = arena->first;
+	while(chunk)
+	{
+		arenaChunk	*next = NULL;
+
+		next = chunk->next;
+		ReleaseArenaChunk(chunk);
+		chunk = next;
+	}
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->allocated = 0;
+	arena->reserved = 0;
+
+	// The lock goes with the chunks, InitArena again before reusing it
+	if(arena->shared)
+	{
+#ifdef OPENMP_ENABLE
+		omp_destroy_lock(&arena->lock);
+#endif
+		arena->shared = 0;
+	}
+}
+
+memoryArena *GetScratchArena(void)
+{
+	if(!scratch)
+	{
+		scratchArena	*created = NULL;
+
+		created = (scratchArena*)malloc(sizeof(scratchArena));
+		if(!created)
+		{
+			logmsg("ERROR: Not enough memory for scratch arena\n");
+			return NULL;
+		}
+		InitArena(&created->arena, 0, 0);
+
+#ifdef OPENMP_ENABLE
+		#pragma omp critical (scratch_arenas)
+#endif
+		{
+			created->next = scratchList;
+			scratchList = created;
+		}
+		scratch = created;
+	}
+	return &scratch->arena;
+}
+
+size_t GetScratchHighWater(void)
+{
+	size_t			highWater = 0;
+	scratchArena	*list = NULL;
+
+	for(list = scratchList; list; list = list->next)
+	{
+		if(list->arena.highWater > highWater)
+			highWater = list->arena.highWater;
+	}
+	return highWater;
+}
+
+/*
+	Each thread keeps pointing to its scratchArena, so only the chunks
+	are released here and the arenas grow again if used after this.
+*/
+void ReleaseScratchArenas(void)
+{
+	scratchArena	*list = NULL;
+
+	for(list = scratchList; list; list = list->next)
+		ReleaseArena(&list->arena);
+}
+
+void ReportArenas(parameters *config)
+{
+	if(!config)
+		return;
+
+	logmsg(" - clk: Arena high-water mark %0.2f MiB (%0.2f MiB reserved), scratch %0.2f MiB per thread\n",
+		(double)config->arena.highWater/(1024*1024),
+		(double)config->arena.reserved/(1024*1024),
+		(double)GetScratchHighWater()/(1024*1024));
+}
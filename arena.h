@@ -0,0 +1,52 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_ARENA_H
+#define MDFOURIER_ARENA_H
+
+#include "mdfourier.h"
+
+#define ARENA_CHUNK_SIZE	(4*1024*1024)
+#define ARENA_ALIGNMENT		64
+#define ARENA_HUGE_PAGE		(2*1024*1024)
+
+void InitArena(memoryArena *arena, int hugePages, int shared);
+void *ArenaAlloc(memoryArena *arena, size_t size);
+void *ArenaCalloc(memoryArena *arena, size_t size);
+arenaMark GetArenaMark(memoryArena *arena);
+void RewindArena(memoryArena *arena, arenaMark mark);
+void ResetArena(memoryArena *arena);
+void ReleaseArena(memoryArena *arena);
+
+memoryArena *GetScratchArena(void);
+size_t GetScratchHighWater(void);
+void ReleaseScratchArenas(void);
+
+void ReportArenas(parameters *config);
+
+#endif
@@ -33,13 +33,13 @@
 #include "log.h"
 #include "cline.h"
 #include "profile.h"
+#include "plans.h"
+#include "loadfile.h"
 
 int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*buffer;
-	long int		buffersize = 0;
 	windowManager	windows;
 	double			*windowUsed = NULL;
 	long int		loadedBlockSize = 0, i = 0, matchIndex = 0;
@@ -76,14 +76,6 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 		return 0;
 	}
 
-	buffersize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	buffer = (double*)malloc(sizeof(double)*buffersize);
-	if(!buffer)
-	{
-		logmsg("\tmalloc failed\n");
-		return(0);
-	}
-
 	// Use flattop for Amplitude accuracy
 	if(!initWindows(&windows, Signal->SampleRate, 'f', config))
 		return 0;
@@ -116,37 +108,26 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 			Channels[1].type = Channels[0].type;
 			Channels[1].seconds = 0;
 
-			memset(buffer, 0, buffersize);
 			if((uint32_t)(pos + loadedBlockSize) > Signal->header.data.DataSize)
 			{
 				logmsg("\tunexpected end of File, please record the full Audio Test from the 240p Test Suite\n");
 				break;
 			}
-			
-			memcpy(buffer, Signal->Samples + pos, sizeof(double)*(loadedBlockSize-difference));
-	
-			if(!ExecuteBalanceDFFT(&Channels[0], buffer, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, CHANNEL_LEFT, config))
+
+			if(!ExecuteBalanceDFFT(&Channels[0], Signal->Planar[PLANAR_LEFT] + pos/2, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, config))
 				return 0;
 
-			if(!ExecuteBalanceDFFT(&Channels[1], buffer, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, CHANNEL_RIGHT, config))
+			if(!ExecuteBalanceDFFT(&Channels[1], Signal->Planar[PLANAR_RIGHT] + pos/2, (loadedBlockSize-difference), Signal->SampleRate, windowUsed, config))
 				return 0;
 
-			Channels[0].freq = (Frequency*)malloc(sizeof(Frequency)*config->MaxFreq);
-			if(!Channels[0].freq)
-			{
-				logmsg("ERROR: Not enough memory for Data Structures\n");
+			if(!InitFreqStruc(&Channels[0].freq, config))
 				return 0;
-			}
-			memset(Channels[0].freq, 0, sizeof(Frequency)*config->MaxFreq);
 
-			Channels[1].freq = (Frequency*)malloc(sizeof(Frequency)*config->MaxFreq);
-			if(!Channels[1].freq)
+			if(!InitFreqStruc(&Channels[1].freq, config))
 			{
 				ReleaseBlock(&Channels[0]);
-				logmsg("ERROR: Not enough memory for Data Structures\n");
 				return 0;
 			}
-			memset(Channels[1].freq, 0, sizeof(Frequency)*config->MaxFreq);
 			if(!FillFrequencyStructures(Signal, &Channels[0], config))
 			{
 				ReleaseBlock(&Channels[0]);
@@ -200,6 +181,9 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 		ReleaseBlock(&Channels[0]);
 		ReleaseBlock(&Channels[1]);
 
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic
+#endif
 		config->noBalance |= Signal->role;
 
 		return 0;
@@ -289,15 +273,16 @@ int CheckBalance(AudioSignal *Signal, int block, parameters *config)
 	ReleaseBlock(&Channels[0]);
 	ReleaseBlock(&Channels[1]);
 
-	free(buffer);
 	freeWindows(&windows);
 
 	return 1;
 }
 
-int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, char channel, parameters *config)
+/* samples is a single channel, size counts both as in the stereo signal */
+int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, parameters *config)
 {
 	fftw_plan		p = NULL;
+	planBuffer		buffer;
 	long		  	stereoSignalSize = 0;	
 	long		  	i = 0, monoSignalSize = 0, zeropadding = 0;
 	double		  	*signal = NULL;
@@ -317,49 +302,31 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, do
 	if(config->ZeroPad)  /* disabled by default */
 		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate, 1);
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
-	if(!signal)
+	memset(&buffer, 0, sizeof(planBuffer));
+	if(!AcquirePlanBuffer(&buffer, monoSignalSize, config))
+		return 0;
+
+	p = GetPlanForSize(monoSignalSize, &buffer, config);
+	if(!p)
 	{
-		logmsg("Not enough memory\n");
-		return(0);
+		ReleasePlanBuffer(&buffer, config);
+		return 0;
 	}
+
 	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
 	if(!spectrum)
 	{
+		ReleasePlanBuffer(&buffer, config);
 		logmsg("Not enough memory\n");
 		return(0);
 	}
 
-	if(!config->model_plan)
-	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
-	}
-
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
-	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
-		return 0;
-	}
-
+	signal = buffer.signal;
 	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
 
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
-		if(channel == CHANNEL_LEFT)
-			signal[i] = (double)samples[i*2];
-		if(channel == CHANNEL_RIGHT)
-			signal[i] = (double)samples[i*2+1];
+		signal[i] = samples[i];
 
 		if(window)
 		{
@@ -368,11 +335,10 @@ int ExecuteBalanceDFFT(AudioBlocks *AudioArray, double *samples, size_t size, do
 		}
 	}
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
+	fftw_execute_dft_r2c(p, signal, spectrum);
 	p = NULL;
 
-	free(signal);
+	ReleasePlanBuffer(&buffer, config);
 	signal = NULL;
 
 	AudioArray->fftwValues.spectrum = spectrum;
@@ -405,4 +371,5 @@ void BalanceAudioChannel(AudioSignal *Signal, char channel, double ratio)
 		if(channel == CHANNEL_RIGHT)
 			samples[i+1] = samples[i+1]*ratio;
 	}
+	UpdatePlanarSamples(Signal, start, end - start);
 }
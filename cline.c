@@ -30,6 +30,30 @@
 #include "log.h"
 #include "plot.h"
 #include "profile.h"
+#include "plans.h"
+#include "arena.h"
+#include "pcmcache.h"
+#include "serve.h"
+
+#include <getopt.h>
+
+#define OPT_TRAIN_WISDOM	256
+#define OPT_FLOAT			257
+#define OPT_VALIDATE_FLOAT	258
+#define OPT_SYNC_GOERTZEL	259
+#define OPT_HUGE_PAGES		260
+#define OPT_PCM_CACHE		261
+#define OPT_PCM_CACHE_SIZE	262
+#define OPT_COMPARE_LIST	263
+#define OPT_ANALYSIS_CACHE	264
+#define OPT_SERVE			265
+#define OPT_SERVE_WORKERS	266
+#define OPT_SERVE_MEMORY	267
+#define OPT_PNG_LEVEL		268
+#define OPT_PNG_FILTER		269
+#define OPT_PNG_PALETTE		270
+#define OPT_PNG_THREADS		271
+#define OPT_FLAC_SLICES		272
 
 #define CHAR_FOLDER_REMOVE		0
 #define CHAR_FOLDER_OK			1
@@ -66,6 +90,24 @@ void PrintUsage(void)
 	logmsg("	 -R: Adjust sample <R>ate if duration difference is found\n");
 	logmsg("	 -j: Ad<j>ust clock (profile defined) via FFTW if difference is found\n");
 	logmsg("	 -k: cloc<k> FFTW operations\n");
+	logmsg("	 --train-wisdom: Plan all FFTW sizes used by the profile (-P) and store them\n");
+	logmsg("	 --float: Use single precision FFTW transforms for the blocks\n");
+	logmsg("	 --validate-float: Report the max dB deviation of single vs double precision\n");
+	logmsg("	 --sync-goertzel: Detect sync pulses tracking only the sync frequency bins\n");
+	logmsg("	 --huge-pages: Back the analysis memory arena with huge pages (Linux)\n");
+	logmsg("	 --pcm-cache: Keep decoded samples in <folder> and map them on later runs\n");
+	logmsg("	 --pcm-cache-size: Maximum PCM cache size in MB, 0 is unlimited (default %d)\n", PCM_CACHE_DEFAULT_MB);
+	logmsg("	 --flac-slices: Decode long FLAC files in parallel slices, skips their MD5 check\n");
+	logmsg("	 --analysis-cache: Keep the processed reference in <folder> and reuse it on later runs\n");
+	logmsg("	 --compare-list: Compare the reference against each file in <list>, one per line\n");
+	logmsg("	 	-c can also be repeated, the reference is processed only once\n");
+	logmsg("	 --serve: Run as a daemon taking comparison jobs on the UNIX <socket>\n");
+	logmsg("	 --serve-workers: Maximum jobs running at once (default %d)\n", SERVE_DEFAULT_WORKERS);
+	logmsg("	 --serve-memory: Memory budget in MB for jobs and loaded references, 0 is unlimited (default %d)\n", SERVE_DEFAULT_MB);
+	logmsg("	 --png-level: zlib compression <level> for the plots, 0 to 9 (default %d)\n", PNG_DEFAULT_LEVEL);
+	logmsg("	 --png-filter: PNG row filter: none, sub, up, avg, paeth or adaptive (default)\n");
+	logmsg("	 --png-palette: Write plots with 256 colors or less as indexed PNG\n");
+	logmsg("	 --png-threads: Compress each PNG in <n> segments at once (default %d)\n", PNG_DEFAULT_THREADS);
 	logmsg("	 -X: Do not use E<x>tra Data from the Profile\n");
 	logmsg("   Output options:\n");
 	logmsg("	 -l: Do not <l>og output to file [reference]_vs_[compare].txt\n");
@@ -215,7 +257,6 @@ void CleanParameters(parameters *config)
 		config->syncAlignPct[i] = 0;
 		config->syncAlignTolerance[i] = 0;
 	}
-	config->syncAlignIterator = 0;
 
 	config->logScale = 1;
 	config->logScaleTS = 0;
@@ -267,9 +308,27 @@ void CleanParameters(parameters *config)
 	config->thresholdMissingHiDif = MISS_HIDIFF;
 	config->thresholdExtraHiDif = EXTRA_HIDIFF;
 
-	config->sync_plan = NULL;
+	InitPlanCache(&config->plans);
+	InitArena(&config->arena, 0, 1);
+	config->trainWisdom = 0;
+	config->floatPipeline = FLOAT_PIPELINE_OFF;
+	config->syncEngine = SYNC_ENGINE_FFT;
+	config->pcmCachePath[0] = '\0';
+	config->pcmCacheMaxMB = PCM_CACHE_DEFAULT_MB;
+	config->flacSlices = 0;
+	config->analysisCachePath[0] = '\0';
+	config->analysisCacheKey = 0;
+	config->referenceFromCache = 0;
+	config->referenceReused = 0;
 	config->model_plan = NULL;
 	config->reverse_plan = NULL;
+	config->comparisonList = NULL;
+	config->comparisonCount = 0;
+	config->refCache = NULL;
+	config->serveSocket[0] = '\0';
+	config->serveWorkers = SERVE_DEFAULT_WORKERS;
+	config->serveMemoryMB = SERVE_DEFAULT_MB;
+	InitPNGProfile(&config->png);
 
 	config->referenceSignal = NULL;
 	config->comparisonSignal = NULL;
@@ -308,21 +367,229 @@ void CleanParameters(parameters *config)
 	EnableLog();
 }
 
+/*
+	Relative file names on the command line are taken from this folder
+	instead of the current one, a server parses the arguments of every
+	client without changing its own folder. NULL goes back to the current.
+*/
+static char *commandLineFolder = NULL;
+
+void SetCommandLineFolder(char *folder)
+{
+	commandLineFolder = folder;
+}
+
+void ResolveCommandLinePath(char *path, int size, char *name)
+{
+	if(!commandLineFolder || !name[0] || name[0] == FOLDERCHAR)
+		snprintf(path, size, "%s", name);
+	else
+		snprintf(path, size, "%s%c%s", commandLineFolder, FOLDERCHAR, name);
+}
+
+int AddComparisonFile(char *name, parameters *config)
+{
+	char	**list = NULL;
+	char	*copy = NULL;
+
+	list = (char**)realloc(config->comparisonList, sizeof(char*)*(config->comparisonCount+1));
+	if(!list)
+	{
+		logmsg("-ERROR: Not enough memory for the comparison list\n");
+		return 0;
+	}
+	config->comparisonList = list;
+
+	copy = (char*)malloc(sizeof(char)*BUFFER_SIZE);
+	if(!copy)
+	{
+		logmsg("-ERROR: Not enough memory for the comparison list\n");
+		return 0;
+	}
+	ResolveCommandLinePath(copy, BUFFER_SIZE, name);
+	config->comparisonList[config->comparisonCount++] = copy;
+
+	// The first one names the output folder before the batch starts
+	if(config->comparisonCount == 1)
+		sprintf(config->comparisonFile, "%s", copy);
+	return 1;
+}
+
+int LoadComparisonList(char *listFile, parameters *config)
+{
+	FILE	*file = NULL;
+	char	lineBuffer[BUFFER_SIZE], listPath[BUFFER_SIZE];
+	int		added = 0;
+
+	ResolveCommandLinePath(listPath, BUFFER_SIZE, listFile);
+	file = fopen(listPath, "rb");
+	if(!file)
+	{
+		logmsg("-ERROR: Could not open comparison list \"%s\"\n", listFile);
+		return 0;
+	}
+
+	while(fgets(lineBuffer, BUFFER_SIZE, file))
+	{
+		int len = 0;
+
+		len = strlen(lineBuffer);
+		while(len && (lineBuffer[len-1] == '\n' || lineBuffer[len-1] == '\r'))
+			lineBuffer[--len] = '\0';
+		if(!len)
+			continue;
+
+		if(!AddComparisonFile(lineBuffer, config))
+		{
+			fclose(file);
+			return 0;
+		}
+		added++;
+	}
+	fclose(file);
+
+	if(!added)
+	{
+		logmsg("-ERROR: Comparison list \"%s\" has no files\n", listFile);
+		return 0;
+	}
+	return 1;
+}
+
+void ReleaseComparisonList(parameters *config)
+{
+	if(!config->comparisonList)
+		return;
+
+	for(int i = 0; i < config->comparisonCount; i++)
+		free(config->comparisonList[i]);
+	free(config->comparisonList);
+	config->comparisonList = NULL;
+	config->comparisonCount = 0;
+}
+
 int commandline(int argc , char *argv[], parameters *config)
 {
 	FILE *file = NULL;
 	int c, index, ref = 0, tar = 0;
 	int profileLoaded = 0;
 	char param = '\0';
+	struct option long_options[] = {
+		{ "train-wisdom", no_argument, NULL, OPT_TRAIN_WISDOM },
+		{ "float", no_argument, NULL, OPT_FLOAT },
+		{ "validate-float", no_argument, NULL, OPT_VALIDATE_FLOAT },
+		{ "sync-goertzel", no_argument, NULL, OPT_SYNC_GOERTZEL },
+		{ "huge-pages", no_argument, NULL, OPT_HUGE_PAGES },
+		{ "pcm-cache", required_argument, NULL, OPT_PCM_CACHE },
+		{ "pcm-cache-size", required_argument, NULL, OPT_PCM_CACHE_SIZE },
+		{ "compare-list", required_argument, NULL, OPT_COMPARE_LIST },
+		{ "analysis-cache", required_argument, NULL, OPT_ANALYSIS_CACHE },
+		{ "serve", required_argument, NULL, OPT_SERVE },
+		{ "serve-workers", required_argument, NULL, OPT_SERVE_WORKERS },
+		{ "serve-memory", required_argument, NULL, OPT_SERVE_MEMORY },
+		{ "png-level", required_argument, NULL, OPT_PNG_LEVEL },
+		{ "png-filter", required_argument, NULL, OPT_PNG_FILTER },
+		{ "png-palette", no_argument, NULL, OPT_PNG_PALETTE },
+		{ "png-threads", required_argument, NULL, OPT_PNG_THREADS },
+		{ "flac-slices", no_argument, NULL, OPT_FLAC_SLICES },
+		{ NULL, 0, NULL, 0 }
+	};
 	
 	opterr = 0;
 	
 	CleanParameters(config);
 
 	// Available: KU123456
-	while ((c = getopt (argc, argv, "Aa:Bb:Cc:Dd:Ee:Ff:GgH:hIiJjkL:lMm:Nn:Oo:P:p:Qq:R:r:Ss:TtuVvWw:XxY:yZ:z0:789")) != -1)
+	while ((c = getopt_long (argc, argv, "Aa:Bb:Cc:Dd:Ee:Ff:GgH:hIiJjkL:lMm:Nn:Oo:P:p:Qq:R:r:Ss:TtuVvWw:XxY:yZ:z0:789", long_options, NULL)) != -1)
 	switch (c)
 	  {
+	  case OPT_TRAIN_WISDOM:
+		config->trainWisdom = 1;
+		break;
+	  case OPT_FLOAT:
+		config->floatPipeline = FLOAT_PIPELINE_ON;
+		break;
+	  case OPT_VALIDATE_FLOAT:
+		config->floatPipeline = FLOAT_PIPELINE_VALIDATE;
+		break;
+	  case OPT_SYNC_GOERTZEL:
+		config->syncEngine = SYNC_ENGINE_GOERTZEL;
+		break;
+	  case OPT_HUGE_PAGES:
+		config->arena.hugePages = 1;
+		break;
+	  case OPT_PCM_CACHE:
+		ResolveCommandLinePath(config->pcmCachePath, BUFFER_SIZE, optarg);
+		break;
+	  case OPT_PCM_CACHE_SIZE:
+		config->pcmCacheMaxMB = atol(optarg);
+		if(config->pcmCacheMaxMB < 0)
+		{
+			logmsg("-ERROR: PCM cache size must be 0 (unlimited) or a size in MB\n");
+			return 0;
+		}
+		break;
+	  case OPT_FLAC_SLICES:
+		config->flacSlices = 1;
+		break;
+	  case OPT_ANALYSIS_CACHE:
+		ResolveCommandLinePath(config->analysisCachePath, BUFFER_SIZE, optarg);
+		break;
+	  case OPT_SERVE:
+		sprintf(config->serveSocket, "%s", optarg);
+		break;
+	  case OPT_SERVE_WORKERS:
+		config->serveWorkers = atoi(optarg);
+		if(config->serveWorkers < 1)
+		{
+			logmsg("-ERROR: At least one worker is needed to serve comparisons\n");
+			return 0;
+		}
+		break;
+	  case OPT_SERVE_MEMORY:
+		config->serveMemoryMB = atol(optarg);
+		if(config->serveMemoryMB < 0)
+		{
+			logmsg("-ERROR: Serve memory must be 0 (unlimited) or a size in MB\n");
+			return 0;
+		}
+		break;
+	  case OPT_PNG_LEVEL:
+		config->png.level = atoi(optarg);
+		if(config->png.level < 0 || config->png.level > 9)
+		{
+			logmsg("-ERROR: PNG compression level must be between 0 and 9\n");
+			return 0;
+		}
+		config->png.enabled = 1;
+		break;
+	  case OPT_PNG_FILTER:
+		config->png.filter = ParsePNGFilter(optarg);
+		if(config->png.filter < 0)
+		{
+			logmsg("-ERROR: Unknown PNG filter '%s'\n", optarg);
+			return 0;
+		}
+		config->png.enabled = 1;
+		break;
+	  case OPT_PNG_PALETTE:
+		config->png.palette = 1;
+		config->png.enabled = 1;
+		break;
+	  case OPT_PNG_THREADS:
+		config->png.threads = atoi(optarg);
+		if(config->png.threads < 1 || config->png.threads > PNG_MAX_THREADS)
+		{
+			logmsg("-ERROR: PNG threads must be between 1 and %d\n", PNG_MAX_THREADS);
+			return 0;
+		}
+		config->png.enabled = 1;
+		break;
+	  case OPT_COMPARE_LIST:
+		if(!LoadComparisonList(optarg, config))
+			return 0;
+		tar = 1;
+		break;
 	  case 'A':
 		config->averagePlot = 1;
 		config->weightedAveragePlot = 0;
@@ -358,7 +625,8 @@ int commandline(int argc , char *argv[], parameters *config)
 		config->outputCSV = 1;
 		break;
 	  case 'c':
-		sprintf(config->comparisonFile, "%s", optarg);
+		if(!AddComparisonFile(optarg, config))
+			return 0;
 		tar = 1;
 		break;
 	  case 'D':
@@ -590,7 +858,7 @@ int commandline(int argc , char *argv[], parameters *config)
 		}
 		break;
 	  case 'P':
-		sprintf(config->profileFile, "%s", optarg);
+		ResolveCommandLinePath(config->profileFile, BUFFER_SIZE, optarg);
 		if (!LoadProfile(config))
 		{
 			logmsg("Invalid Profile, aborting\n");
@@ -655,7 +923,7 @@ int commandline(int argc , char *argv[], parameters *config)
 		}
 		break;
 	  case 'r':
-		sprintf(config->referenceFile, "%s", optarg);
+		ResolveCommandLinePath(config->referenceFile, BUFFER_SIZE, optarg);
 		ref = 1;
 		break;
 	  case 'S':
@@ -780,7 +1048,7 @@ int commandline(int argc , char *argv[], parameters *config)
 		logmsg("\t-FFT bins will be aligned to 1Hz, this is slower\n");
 		break;
 	  case '0':
-		sprintf(config->outputPath, "%s", optarg);
+		ResolveCommandLinePath(config->outputPath, BUFFER_SIZE, optarg);
 		break;
 	  case '7':
 		config->drawWindows = 1;
@@ -846,6 +1114,21 @@ int commandline(int argc , char *argv[], parameters *config)
 		return 0;
 	}
 
+	if(config->trainWisdom)
+	{
+		if(!profileLoaded)
+		{
+			logmsg("  usage: mdfourier --train-wisdom -P profile.mdf\n");
+			logmsg("  ERROR: Please define the profile to train FFTW wisdom for\n");
+			return 0;
+		}
+		return 1;
+	}
+
+	// Profile and files come with each job
+	if(config->serveSocket[0])
+		return 1;
+
 	if(!ref || !tar)
 	{
 		logmsg("  usage: mdfourier -P profile.mdf -r reference.wav -c compare.wav\n");
@@ -888,13 +1171,16 @@ int commandline(int argc , char *argv[], parameters *config)
 	}
 	fclose(file);
 
-	file = fopen(config->comparisonFile, "rb");
-	if(!file)
+	for(int i = 0; i < config->comparisonCount; i++)
 	{
-		logmsg("- ERROR: Could not open COMPARE file: \"%s\"\n", config->comparisonFile);
-		return 0;
+		file = fopen(config->comparisonList[i], "rb");
+		if(!file)
+		{
+			logmsg("- ERROR: Could not open COMPARE file: \"%s\"\n", config->comparisonList[i]);
+			return 0;
+		}
+		fclose(file);
 	}
-	fclose(file);
 
 	if(config->verbose)
 	{
@@ -967,7 +1253,6 @@ int commandline(int argc , char *argv[], parameters *config)
 int checkPath(char *path)
 {
 	int		len = 0;
-	char 	*CurrentPath = NULL;
 
 	if(!path || strlen(path) == 0)
 		return 1;
@@ -987,25 +1272,11 @@ int checkPath(char *path)
 		}
 	}
 
-	CurrentPath = (char*)malloc(sizeof(char)*FILENAME_MAX);
-	if(!CurrentPath)
-		return 0;
-
-	if(!GetCurrentDir(CurrentPath, sizeof(char)*FILENAME_MAX))
-	{
-		free(CurrentPath);
-		logmsg("Could not get current path\n");
-		return 0;
-	}
-
-	if(chdir(path) == -1)
+	if(!IsFolder(path))
 	{
-		free(CurrentPath);
 		logmsg("Could not open selected path '%s'\n", path);
 		return 0;
 	}
-
-	PopMainPath(&CurrentPath);
 	return 1;
 }
 
@@ -1016,59 +1287,20 @@ int checkAlternatePaths(parameters *config)
 	return 1;
 }
 
-char *PushMainPath(parameters *config)
-{
-	char 	*CurrentPath = NULL;
-
-	if(strlen(config->outputPath) == 0)
-		return NULL;
-
-	CurrentPath = (char*)malloc(sizeof(char)*FILENAME_MAX);
-	if(!CurrentPath)
-		return NULL;
-
-	if(!GetCurrentDir(CurrentPath, sizeof(char)*FILENAME_MAX))
-	{
-		free(CurrentPath);
-		logmsg("Could not get current path\n");
-		return NULL;
-	}
-
-	if(chdir(config->outputPath) == -1)
-	{
-		free(CurrentPath);
-		logmsg("Could not change to selected path '%s'\n", config->outputPath);
-		return NULL;
-	}
-	return CurrentPath;
-}
-
-void PopMainPath(char **CurrentPath)
-{
-	if(!CurrentPath || !*CurrentPath)
-		return;
-
-	if(chdir(*CurrentPath) == -1)
-		logmsg("Could not open working folder %s\n", CurrentPath);
-
-	free(*CurrentPath);
-	*CurrentPath = NULL;
-}
-
 int SetupFolders(char *folder, char *logname, parameters *config)
 {
-	char *mainDir = NULL;
-
 	if(!checkAlternatePaths(config))
 		return 0;
 
-	mainDir = PushMainPath(config);
 	if(!CreateFolderName(folder, config))
-	{
-		PopMainPath(&mainDir);
 		return 0;
-	}
 
+	return SetupLogFile(logname, config);
+}
+
+// Opens the log inside the output folder, it must exist already
+int SetupLogFile(char *logname, parameters *config)
+{
 	if(IsLogEnabled())
 	{
 		char tmp[BUFFER_SIZE*4+256];
@@ -1079,15 +1311,10 @@ int SetupFolders(char *folder, char *logname, parameters *config)
 		ComposeFileName(tmp, logfname, ".txt", config);
 
 		if(!setLogName(tmp))
-		{
-			PopMainPath(&mainDir);
 			return 0;
-		}
 
 		Header(1, 0, NULL);
 	}
-
-	PopMainPath(&mainDir);
 	return 1;
 }
 
@@ -1129,6 +1356,15 @@ int CreateFolder(char *name)
 	return 1;
 }
 
+int IsFolder(char *name)
+{
+	struct stat	st;
+
+	if(stat(name, &st) != 0)
+		return 0;
+	return S_ISDIR(st.st_mode);
+}
+
 int IsValidFolderCharacter(char c)
 {
 	switch(c)
@@ -1193,7 +1429,7 @@ int CleanFolderName(char *name, char *origName)
 int CreateFolderName(char *mainfolder, parameters *config)
 {
 	int len = 0;
-	char tmp[BUFFER_SIZE-10], fn[BUFFER_SIZE-20], pname[BUFFER_SIZE], popfolder[FILENAME_MAX];
+	char tmp[BUFFER_SIZE-10], fn[BUFFER_SIZE-20], pname[BUFFER_SIZE], path[T_BUFFER_SIZE];
 
 	if(!config)
 		return 0;
@@ -1224,57 +1460,39 @@ int CreateFolderName(char *mainfolder, parameters *config)
 	}
 
 	sprintf(config->compareName, "%s", tmp);
-	sprintf(config->folderName, "%s%c%s", mainfolder, FOLDERCHAR, pname);
 
-	// Create the top level folder "MDFResults"
-	if(!CreateFolder(mainfolder))
+	// Create the top level folder "MDFResults", all below the output path
+	sprintf(path, "%s%s", config->outputPath, mainfolder);
+	if(!CreateFolder(path))
 	{
-		logmsg("ERROR: Could not create '%s'\n", mainfolder);
+		logmsg("ERROR: Could not create '%s'\n", path);
 		return 0;
 	}
 	// Create the top level folder for profile if it doesn't exist
-	if(!CreateFolder(config->folderName))
+	sprintf(path, "%s%s%c%s", config->outputPath, mainfolder, FOLDERCHAR, pname);
+	if(!CreateFolder(path))
 	{
-		logmsg("ERROR: Could not create '%s'\n", config->folderName);
+		logmsg("ERROR: Could not create '%s'\n", path);
 		return 0;
 	}
 
 	// Finally, set the current results folder name
 	sprintf(config->folderName, "%s%c%s%c%s", mainfolder, FOLDERCHAR, pname, FOLDERCHAR, tmp);
-	// get top folder if in case we need to pop out of it
-	if(!GetCurrentDir(popfolder, sizeof(char)*FILENAME_MAX))
-	{
-		logmsg("ERROR: Could not get current path\n");
-		return 0;
-	}
 	// Check if folder already exists
-	if(chdir(config->folderName) != -1)
+	sprintf(path, "%s%s", config->outputPath, config->folderName);
+	if(IsFolder(path))
 	{
 		int value = 0, found = 0;
 
-		if(chdir(popfolder) == -1)  // return to proper parent folder
-		{
-			// what we failed?!?!?!
-			logmsg("ERROR: Could not change folder to '%s'\n", popfolder);
-			return 0;
-		}
-
 		len = strlen(config->folderName);
 		value = atoi(config->folderName+len-4);
 		do
 		{
 			value++;
 			sprintf(config->folderName+len-4, "%04d", value);
-			if(chdir(config->folderName) == -1) // we couldn't push to it, got it
+			sprintf(path, "%s%s", config->outputPath, config->folderName);
+			if(!IsFolder(path))
 				found = 1;
-			else
-			{
-				if(chdir(popfolder) == -1)  // return to proper parent folder
-				{
-					logmsg("ERROR: Could not change folder to '%s'\n", popfolder);
-					return 0;
-				}
-			}
 		}while(!found && value < 10000);
 
 		if(value >= 10000)
@@ -1284,9 +1502,9 @@ int CreateFolderName(char *mainfolder, parameters *config)
 		}
 	}
 
-	if(!CreateFolder(config->folderName))
+	if(!CreateFolder(path))
 	{
-		logmsg("ERROR: Could not create '%s'\n", config->folderName);
+		logmsg("ERROR: Could not create '%s'\n", path);
 		return 0;
 	}
 	return 1;
@@ -1332,16 +1550,8 @@ void ComposeFileName(char *target, char *subname, char *ext, parameters *config)
 	if(!config)
 		return;
 
-	sprintf(target, "%s%c%s%s",
-		config->folderName, FOLDERCHAR, subname, ext); 
-}
-
-void ComposeFileNameoPath(char *target, char *subname, char *ext, parameters *config)
-{
-	if(!config)
-		return;
-
-	sprintf(target, "%s%s", subname, ext); 
+	sprintf(target, "%s%s%c%s%s",
+		config->outputPath, config->folderName, FOLDERCHAR, subname, ext); 
 }
 
 double TimeSpecToSeconds(struct timespec* ts)
@@ -47,13 +47,19 @@
 #endif
 
 int SetupFolders(char *folder, char *logname, parameters *config);
+int SetupLogFile(char *logname, parameters *config);
 int CreateFolder(char *name);
+int IsFolder(char *name);
 int CreateFolderName(char *mainfolder, parameters *config);
 void InvertComparedName(parameters *config);
 void ComposeFileName(char *target, char *subname, char *ext, parameters *config);
-void ComposeFileNameoPath(char *target, char *subname, char *ext, parameters *config);
 void CleanParameters(parameters *config);
 int commandline(int argc , char *argv[], parameters *config);
+void SetCommandLineFolder(char *folder);
+void ResolveCommandLinePath(char *path, int size, char *name);
+int AddComparisonFile(char *name, parameters *config);
+int LoadComparisonList(char *listFile, parameters *config);
+void ReleaseComparisonList(parameters *config);
 char *GetChannel(char c);
 char *GetWindow(char c);
 int Header(int log, int argc, char *argv[]);
@@ -64,9 +70,6 @@ int getExtensionLength(char *filename);
 void ShortenFileName(char *filename, char *copy, int maxlen);
 int CleanFolderName(char *name, char *origName);
 
-char *PushMainPath(parameters *config);
-void PopMainPath(char **CurrentPath);
-
 #endif
 
 // clock_gettime is not implemented on older versions of OS X (< 10.12).
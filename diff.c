@@ -29,6 +29,7 @@
 #include "diff.h"
 #include "log.h"
 #include "freq.h"
+#include "arena.h"
 
 #define STEREO_DIFF_SIZE	2*config->MaxFreq
 #define MONO_DIFF_SIZE		config->MaxFreq
@@ -60,13 +61,12 @@ AmplDifference *CreateAmplDifferences(int block, parameters *config)
 		else
 			size = MONO_DIFF_SIZE;
 	}
-	ad = (AmplDifference*)malloc(sizeof(AmplDifference)*size);
+	ad = (AmplDifference*)ArenaCalloc(&config->arena, sizeof(AmplDifference)*size);
 	if(!ad)
 	{
 		logmsg("Insufficient memory for AmplDifference (%ld bytes)\n", sizeof(AmplDifference)*size);
 		return 0;
 	}
-	memset(ad, 0, sizeof(AmplDifference)*size);
 	return ad;
 }
 
@@ -84,13 +84,12 @@ FreqDifference *CreateFreqDifferences(int block, parameters *config)
 		else
 			size = MONO_DIFF_SIZE;
 	}
-	fd = (FreqDifference*)malloc(sizeof(FreqDifference)*size);
+	fd = (FreqDifference*)ArenaCalloc(&config->arena, sizeof(FreqDifference)*size);
 	if(!fd)
 	{
 		logmsg("Insufficient memory for FreqDifference (%ld bytes)\n", sizeof(sizeof(FreqDifference)*size));
 		return 0;
 	}
-	memset(fd, 0, sizeof(FreqDifference)*size);
 	return fd;
 }
 
@@ -108,13 +107,12 @@ PhaseDifference *CreatePhaseDifferences(int block, parameters *config)
 		else
 			size = MONO_DIFF_SIZE;
 	}
-	pd = (PhaseDifference*)malloc(sizeof(PhaseDifference)*size);
+	pd = (PhaseDifference*)ArenaCalloc(&config->arena, sizeof(PhaseDifference)*size);
 	if(!pd)
 	{
 		logmsg("Insufficient memory for FreqDifference (%ld bytes)\n", sizeof(sizeof(PhaseDifference)*size));
 		return 0;
 	}
-	memset(pd, 0, sizeof(PhaseDifference)*size);
 	return pd;
 }
 
@@ -125,15 +123,13 @@ int CreateDifferenceArray(parameters *config)
 	if(!config)
 		return 0;
 
-	BlockDiffArray = (BlockDifference*)malloc(sizeof(BlockDifference)*config->types.totalBlocks);
+	BlockDiffArray = (BlockDifference*)ArenaCalloc(&config->arena, sizeof(BlockDifference)*config->types.totalBlocks);
 	if(!BlockDiffArray)
 	{
 		logmsg("Insufficient memory for AudioDiffArray(%ld bytes)\n", sizeof(sizeof(BlockDifference)*config->types.totalBlocks));
 		return 0;
 	}
 
-	memset(BlockDiffArray, 0, sizeof(BlockDifference)*config->types.totalBlocks);
-
 	for(int i = 0; i < config->types.totalBlocks; i++)
 	{
 		int type = TYPE_NOTYPE;
@@ -143,24 +139,15 @@ int CreateDifferenceArray(parameters *config)
 		{
 			BlockDiffArray[i].freqMissArray = CreateFreqDifferences(i, config);
 			if(!BlockDiffArray[i].freqMissArray)
-			{
-				free(BlockDiffArray);
 				return 0;
-			}
 	
 			BlockDiffArray[i].amplDiffArray = CreateAmplDifferences(i, config);
 			if(!BlockDiffArray[i].amplDiffArray)
-			{
-				free(BlockDiffArray);
 				return 0;
-			}
 
 			BlockDiffArray[i].phaseDiffArray = CreatePhaseDifferences(i, config);
 			if(!BlockDiffArray[i].phaseDiffArray)
-			{
-				free(BlockDiffArray);
 				return 0;
-			}
 		}
 		else
 		{
@@ -227,36 +214,54 @@ int CreateDifferenceArray(parameters *config)
 	return 1;
 }
 
-void ReleaseDifferenceArray(parameters *config)
+/*
+	The Insert and Increment functions only touch their own block, so
+	blocks can be compared in parallel. The totals are added up here in
+	block order once all blocks are done.
+*/
+void ReduceDifferenceArray(parameters *config)
 {
-	if(!config)
-		return;
+	AudioDifference	*diff = NULL;
 
-	if(!config->Differences.BlockDiffArray)
+	if(!config || !config->Differences.BlockDiffArray)
 		return;
 
+	diff = &config->Differences;
 	for(int i = 0; i < config->types.totalBlocks; i++)
 	{
-		if(config->Differences.BlockDiffArray[i].amplDiffArray)
-		{
-			free(config->Differences.BlockDiffArray[i].amplDiffArray);
-			config->Differences.BlockDiffArray[i].amplDiffArray = NULL;
-		}
+		BlockDifference *blkDiff = &diff->BlockDiffArray[i];
 
-		if(config->Differences.BlockDiffArray[i].freqMissArray)
-		{
-			free(config->Differences.BlockDiffArray[i].freqMissArray);
-			config->Differences.BlockDiffArray[i].freqMissArray = NULL;
-		}
+		diff->cntFreqAudioDiff += blkDiff->cntFreqBlkDiff;
+		diff->cntAmplAudioDiff += blkDiff->cntAmplBlkDiff;
+		diff->cntPhaseAudioDiff += blkDiff->cntPhaseBlkDiff;
+		diff->cmpPhaseAudioDiff += blkDiff->cmpPhaseBlkDiff;
+		diff->cntPerfectAmplMatch += blkDiff->perfectAmplMatch;
+		diff->cntTotalCompared += blkDiff->cmpAmplBlkDiff;
+		diff->cntTotalAudioDiff += blkDiff->cntAmplBlkDiff + blkDiff->cntFreqBlkDiff;
 
-		if(config->Differences.BlockDiffArray[i].phaseDiffArray)
-		{
-			free(config->Differences.BlockDiffArray[i].phaseDiffArray);
-			config->Differences.BlockDiffArray[i].phaseDiffArray = NULL;
-		}
+		// Left
+		diff->cntAmplAudioDiffLeft += blkDiff->cntAmplBlkDiffLeft;
+		diff->cntPerfectAmplMatchLeft += blkDiff->perfectAmplMatchLeft;
+		diff->cntTotalComparedLeft += blkDiff->cmpAmplBlkDiffLeft;
+		diff->cntTotalAudioDiffLeft += blkDiff->cntAmplBlkDiffLeft;
+
+		// Right
+		diff->cntAmplAudioDiffRight += blkDiff->cntAmplBlkDiffRight;
+		diff->cntPerfectAmplMatchRight += blkDiff->perfectAmplMatchRight;
+		diff->cntTotalComparedRight += blkDiff->cmpAmplBlkDiffRight;
+		diff->cntTotalAudioDiffRight += blkDiff->cntAmplBlkDiffRight;
 	}
+}
+
+/* The arrays belong to the run arena, released in ReleaseAudioBlockStructure */
+void ReleaseDifferenceArray(parameters *config)
+{
+	if(!config)
+		return;
+
+	if(!config->Differences.BlockDiffArray)
+		return;
 
-	free(config->Differences.BlockDiffArray);
 	config->Differences.BlockDiffArray = NULL;
 
 	config->Differences.cntFreqAudioDiff = 0;
@@ -300,7 +305,6 @@ int IncrementCmpPhase(int block, parameters *config)
 		return 0;
 
 	config->Differences.BlockDiffArray[block].cmpPhaseBlkDiff ++;
-	config->Differences.cmpPhaseAudioDiff ++;
 	return 1;
 }
 
@@ -355,22 +359,12 @@ int InsertAmplDifference(int block, Frequency ref, Frequency comp, char channel,
 	config->Differences.BlockDiffArray[block].amplDiffArray[position].channel = channel;
 
 	config->Differences.BlockDiffArray[block].cntAmplBlkDiff ++;
-	config->Differences.cntAmplAudioDiff ++;
-	config->Differences.cntTotalAudioDiff ++;
 
 	if(channel == CHANNEL_LEFT || channel == CHANNEL_MONO)
-	{
 		config->Differences.BlockDiffArray[block].cntAmplBlkDiffLeft ++;
-		config->Differences.cntAmplAudioDiffLeft ++;
-		config->Differences.cntTotalAudioDiffLeft ++;
-	}
 
 	if(channel == CHANNEL_RIGHT)
-	{
 		config->Differences.BlockDiffArray[block].cntAmplBlkDiffRight ++;
-		config->Differences.cntAmplAudioDiffRight ++;
-		config->Differences.cntTotalAudioDiffRight ++;
-	}
 	
 	return 1;
 }
@@ -432,8 +426,6 @@ int InsertPhaseDifference(int block, Frequency ref, Frequency comp, char channel
 	config->Differences.BlockDiffArray[block].phaseDiffArray[position].channel = channel;
 
 	config->Differences.BlockDiffArray[block].cntPhaseBlkDiff ++;
-	config->Differences.cntPhaseAudioDiff ++;
-	//config->Differences.cntTotalAudioDiff ++;
 	
 	return 1;
 }
@@ -443,11 +435,6 @@ int IncrementCompared(int block, char channel, parameters *config)
 	if(!config)
 		return 0;
 
-	config->Differences.cntTotalCompared ++;
-	if(channel == CHANNEL_LEFT || channel == CHANNEL_MONO)
-		config->Differences.cntTotalComparedLeft++;
-	if(channel == CHANNEL_RIGHT)
-		config->Differences.cntTotalComparedRight++;
 	if(!IncrementCmpAmpl(block, channel, config))
 		return 0;
 	if(!IncrementCmpFreq(block, config))
@@ -469,19 +456,12 @@ int IncrementPerfectMatch(int block, char channel, parameters *config)
 		return 0;
 
 	config->Differences.BlockDiffArray[block].perfectAmplMatch ++;
-	config->Differences.cntPerfectAmplMatch ++;
 
 	if(channel == CHANNEL_LEFT || channel == CHANNEL_MONO)
-	{
 		config->Differences.BlockDiffArray[block].perfectAmplMatchLeft ++;
-		config->Differences.cntPerfectAmplMatchLeft ++;
-	}
 
 	if(channel == CHANNEL_RIGHT)
-	{
 		config->Differences.BlockDiffArray[block].perfectAmplMatchRight ++;
-		config->Differences.cntPerfectAmplMatchRight ++;
-	}
 	
 	return 1;
 }
@@ -529,8 +509,6 @@ int InsertFreqNotFound(int block, double freq, double amplitude, char channel, p
 	config->Differences.BlockDiffArray[block].freqMissArray[position].channel = channel;
 
 	config->Differences.BlockDiffArray[block].cntFreqBlkDiff ++;
-	config->Differences.cntFreqAudioDiff ++;
-	config->Differences.cntTotalAudioDiff ++;
 
 	return 1;
 }
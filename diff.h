@@ -46,6 +46,7 @@ int IncrementPerfectMatch(int block, char channel, parameters *config);
 void PrintDifferentFrequencies(int block, parameters *config);
 void PrintDifferentAmplitudes(int block, parameters *config);
 void PrintDifferenceArray(parameters *config);
+void ReduceDifferenceArray(parameters *config);
 void ReleaseDifferenceArray(parameters *config);
 
 long int FindDifferenceAveragesperBlock(double thresholdAmplitude, double thresholdMissing, double thresholdExtra, parameters *config);
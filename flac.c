@@ -43,20 +43,47 @@
 #include "flac.h"
 #include "log.h"
 #include "freq.h"
+#include "kernels.h"
 #include "FLAC/stream_decoder.h"
 
 #include <ctype.h>
+#ifdef OPENMP_ENABLE
+#include <omp.h>
+#endif
 
 #define FLAC_ERR_STR 1024
 
+// Parallel decoding seeks each slice, only worth it with a seektable and long files
+#define FLAC_SLICE_MIN_SECONDS	10
+#define FLAC_SLICE_MAX			16
+
+typedef struct flac_slice_st {
+	AudioSignal		*Signal;
+	FLAC__uint64	start;		// first sample (per channel) of the slice
+	FLAC__uint64	end;		// one past the last one
+	FLAC__uint64	decoded;
+	int				errors;
+	int				ok;
+} flacSlice;
+
 int flacInternalMDFErrors = 0;
 char flacInternalErrorStr[FLAC_ERR_STR];
+#ifdef OPENMP_ENABLE
+	#pragma omp threadprivate(flacInternalMDFErrors, flacInternalErrorStr)
+#endif
 
 extern char *getFilenameExtension(char *filename);
 extern int getExtensionLength(char *filename);
 static FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data);
 static void error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__StreamDecoderWriteStatus slice_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+static void slice_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static int CheckFLACStream(AudioSignal *Signal);
+static int AllocateFLACSamples(AudioSignal *Signal);
+static int GetFLACSliceCount(AudioSignal *Signal);
+static int DecodeFLACSlices(char *input, AudioSignal *Signal, int slices);
+static int DecodeFLACSlice(char *input, flacSlice *slice);
 
 char* getflacErrorStr(void)
 {
@@ -128,7 +155,7 @@ int FillRIFFHeader(wav_hdr *header)
 	return 1;
 }
 
-int FLACtoSignal(char *input, AudioSignal *Signal)
+int FLACtoSignal(char *input, AudioSignal *Signal, int useSlices)
 {
 	FLAC__bool ok = true;
 	FLAC__StreamDecoder *decoder = 0;
@@ -147,6 +174,7 @@ int FLACtoSignal(char *input, AudioSignal *Signal)
 	}
 
 	(void)FLAC__stream_decoder_set_md5_checking(decoder, true);
+	(void)FLAC__stream_decoder_set_metadata_respond(decoder, FLAC__METADATA_TYPE_SEEKTABLE);
 
 	init_status = FLAC__stream_decoder_init_file(decoder, input, write_callback, metadata_callback, error_callback, /*client_data=*/Signal);
 	if(init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
@@ -154,6 +182,34 @@ int FLACtoSignal(char *input, AudioSignal *Signal)
 		ok = false;
 	}
 
+	/*
+		When requested, long files with a seektable are decoded in slices by
+		independent decoders, this one only reads the metadata then. Slices
+		can't verify the MD5 signature of the stream. If any slice fails it
+		continues from the first frame and decodes the whole stream.
+	*/
+	if(ok && FLAC__stream_decoder_process_until_end_of_metadata(decoder)) {
+		int slices = 0;
+
+		if(useSlices)
+			slices = GetFLACSliceCount(Signal);
+		if(slices > 1 && CheckFLACStream(Signal) && AllocateFLACSamples(Signal))
+		{
+			if(DecodeFLACSlices(input, Signal, slices))
+			{
+				FLAC__stream_decoder_delete(decoder);
+				logmsgFileOnly(" - FLAC decoded in %d slices, MD5 signature not verified\n", slices);
+				Signal->samplesPosFLAC = Signal->numSamples;
+				if(!FillRIFFHeader(&Signal->header))
+					return 0;
+				return 1;
+			}
+			logmsgFileOnly("FLAC slices could not be decoded, using a single decoder\n");
+		}
+		if(flacInternalMDFErrors)
+			ok = false;
+	}
+
 	if(ok) {
 		ok = FLAC__stream_decoder_process_until_end_of_stream(decoder);
 		if(!ok)
@@ -193,7 +249,6 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 {
 	AudioSignal *Signal = (AudioSignal*)client_data;
 	long int pos = 0;
-	size_t i;
 
 	(void)decoder;
 
@@ -222,40 +277,52 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 	/* write header data before we write the first frame */
 	if(frame->header.number.sample_number == 0) 
 	{
-		if(Signal->header.data.DataSize == 0) {
-			logmsg("ERROR: MDFourier only works for FLAC files that have total_samples count in STREAMINFO\n");
-			flacInternalMDFErrors = 1;
+		if(!CheckFLACStream(Signal) || !AllocateFLACSamples(Signal))
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		}
-		if(Signal->header.fmt.bitsPerSample != 16 && Signal->header.fmt.bitsPerSample != 24) {
-			logmsg("ERROR: Only 16/24 bit flac supported.\n\tPlease convert file to 16/24 bit flac.\n");
-			flacInternalMDFErrors = 1;
-			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		}
-		if(Signal->header.fmt.NumOfChan != 2 && Signal->header.fmt.NumOfChan != 1) {
-			logmsg("ERROR: Only Mono and Stereo files are supported.\n");
-			flacInternalMDFErrors = 1;
-			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		}
-		Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
-		if(!Signal->Samples)
-		{
-			logmsg("\tERROR: FLAC data chunks malloc failed!\n");
-			flacInternalMDFErrors = 1;
-			return(FLAC__STREAM_DECODER_WRITE_STATUS_ABORT);
-		}
-		memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
 	}
 
 	/* save decoded PCM samples */
 	pos = Signal->samplesPosFLAC;
-	for(i = 0; i < frame->header.blocksize; i++)
+	ConvertInt32Interleave(buffer[0], Signal->header.fmt.NumOfChan == 2 ? buffer[1] : NULL,
+		frame->header.blocksize, Signal->Samples + pos);
+	Signal->samplesPosFLAC = pos + frame->header.blocksize*Signal->header.fmt.NumOfChan;
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus slice_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	flacSlice		*slice = (flacSlice*)client_data;
+	AudioSignal		*Signal = NULL;
+	FLAC__uint64	first = 0, skip = 0, count = 0;
+
+	(void)decoder;
+
+	Signal = slice->Signal;
+	if(Signal->header.fmt.NumOfChan != frame->header.channels || buffer[0] == NULL ||
+		(Signal->header.fmt.NumOfChan == 2 && buffer[1] == NULL))
+	{
+		slice->errors ++;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	/* Only keep what falls inside the slice, the neighbours write the rest */
+	first = frame->header.number.sample_number;
+	count = frame->header.blocksize;
+	if(first + count <= slice->start || first >= slice->end)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	if(first < slice->start)
 	{
-		Signal->Samples[pos++] = (double)(FLAC__int32)buffer[0][i];
-		if(Signal->header.fmt.NumOfChan == 2)
-			Signal->Samples[pos++] = (double)(FLAC__int32)buffer[1][i];
+		skip = slice->start - first;
+		first = slice->start;
+		count -= skip;
 	}
-	Signal->samplesPosFLAC = pos;
+	if(first + count > slice->end)
+		count = slice->end - first;
+
+	ConvertInt32Interleave(buffer[0] + skip, Signal->header.fmt.NumOfChan == 2 ? buffer[1] + skip : NULL,
+		count, Signal->Samples + first*Signal->header.fmt.NumOfChan);
+	slice->decoded += count;
 
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -290,6 +357,9 @@ void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMet
 		Signal->SamplesStart = 0;
 		Signal->samplesPosFLAC = 0;
 	}
+
+	if(metadata->type == FLAC__METADATA_TYPE_SEEKTABLE)
+		Signal->seekTableFLAC = metadata->data.seek_table.num_points > 0;
 }
 
 void error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
@@ -303,3 +373,161 @@ void error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderError
 	if(Signal)
 		Signal->errorFLAC ++;
 }
+
+void slice_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	flacSlice *slice = (flacSlice*)client_data;
+
+	(void)decoder;
+	(void)status;
+
+	/* reported by the single decoder if we fall back to it */
+	slice->errors ++;
+}
+
+int CheckFLACStream(AudioSignal *Signal)
+{
+	if(Signal->header.data.DataSize == 0) {
+		logmsg("ERROR: MDFourier only works for FLAC files that have total_samples count in STREAMINFO\n");
+		flacInternalMDFErrors = 1;
+		return 0;
+	}
+	if(Signal->header.fmt.bitsPerSample != 16 && Signal->header.fmt.bitsPerSample != 24) {
+		logmsg("ERROR: Only 16/24 bit flac supported.\n\tPlease convert file to 16/24 bit flac.\n");
+		flacInternalMDFErrors = 1;
+		return 0;
+	}
+	if(Signal->header.fmt.NumOfChan != 2 && Signal->header.fmt.NumOfChan != 1) {
+		logmsg("ERROR: Only Mono and Stereo files are supported.\n");
+		flacInternalMDFErrors = 1;
+		return 0;
+	}
+	return 1;
+}
+
+int AllocateFLACSamples(AudioSignal *Signal)
+{
+	if(!Signal->Samples)
+	{
+		Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
+		if(!Signal->Samples)
+		{
+			logmsg("\tERROR: FLAC data chunks malloc failed!\n");
+			flacInternalMDFErrors = 1;
+			return 0;
+		}
+	}
+	memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples*Signal->header.fmt.NumOfChan);
+	return 1;
+}
+
+int GetFLACSliceCount(AudioSignal *Signal)
+{
+	int				slices = 1;
+	FLAC__uint64	frames = 0, minFrames = 0;
+
+	/* without a seektable libFLAC has to bisect the file for every slice */
+	if(!Signal->seekTableFLAC || !Signal->header.fmt.NumOfChan)
+		return 1;
+
+#ifdef OPENMP_ENABLE
+	// Inside a parallel region the slices are tasks for that team
+	if(omp_in_parallel())
+		slices = omp_get_num_threads();
+	else
+		slices = omp_get_max_threads();
+#endif
+	if(slices > FLAC_SLICE_MAX)
+		slices = FLAC_SLICE_MAX;
+
+	frames = Signal->numSamples/Signal->header.fmt.NumOfChan;
+	minFrames = (FLAC__uint64)Signal->header.fmt.SamplesPerSec*FLAC_SLICE_MIN_SECONDS;
+	if(!minFrames)
+		return 1;
+	if((FLAC__uint64)slices > frames/minFrames)
+		slices = frames/minFrames;
+	if(slices < 1)
+		slices = 1;
+	return slices;
+}
+
+int DecodeFLACSlices(char *input, AudioSignal *Signal, int slices)
+{
+	int				i = 0, failed = 0;
+	flacSlice		*slice = NULL;
+	FLAC__uint64	frames = 0, length = 0;
+
+	slice = (flacSlice*)malloc(sizeof(flacSlice)*slices);
+	if(!slice)
+		return 0;
+
+	frames = Signal->numSamples/Signal->header.fmt.NumOfChan;
+	length = frames/slices;
+	for(i = 0; i < slices; i++)
+	{
+		slice[i].Signal = Signal;
+		slice[i].start = i*length;
+		slice[i].end = i == slices - 1 ? frames : (i+1)*length;
+		slice[i].decoded = 0;
+		slice[i].errors = 0;
+		slice[i].ok = 0;
+	}
+
+	/*
+		Each slice writes to its own range of Samples. Files are loaded
+		from tasks, where a nested parallel region would get a single
+		thread, so the slices are handed to the idle threads of the team.
+	*/
+#ifdef OPENMP_ENABLE
+	if(omp_in_parallel())
+	{
+		#pragma omp taskloop grainsize(1)
+		for(i = 0; i < slices; i++)
+			slice[i].ok = DecodeFLACSlice(input, &slice[i]);
+	}
+	else
+	{
+		#pragma omp parallel for
+		for(i = 0; i < slices; i++)
+			slice[i].ok = DecodeFLACSlice(input, &slice[i]);
+	}
+#else
+	for(i = 0; i < slices; i++)
+		slice[i].ok = DecodeFLACSlice(input, &slice[i]);
+#endif
+
+	for(i = 0; i < slices; i++)
+	{
+		if(!slice[i].ok)
+			failed++;
+	}
+
+	free(slice);
+	return !failed;
+}
+
+int DecodeFLACSlice(char *input, flacSlice *slice)
+{
+	FLAC__bool			ok = false;
+	FLAC__StreamDecoder	*decoder = NULL;
+
+	decoder = FLAC__stream_decoder_new();
+	if(!decoder)
+		return 0;
+
+	if(FLAC__stream_decoder_init_file(decoder, input, slice_write_callback, NULL, slice_error_callback, slice) == FLAC__STREAM_DECODER_INIT_STATUS_OK)
+	{
+		ok = FLAC__stream_decoder_seek_absolute(decoder, slice->start);
+		while(ok && !slice->errors && slice->decoded < slice->end - slice->start)
+		{
+			if(FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+				break;
+			ok = FLAC__stream_decoder_process_single(decoder);
+		}
+		if(slice->errors || slice->decoded != slice->end - slice->start)
+			ok = false;
+	}
+
+	FLAC__stream_decoder_delete(decoder);
+	return ok ? 1 : 0;
+}
@@ -35,6 +35,6 @@ char* getflacErrorStr(void);
 int flacErrorReported(void);
 int IsFlac(char *name);
 void renameFLAC(char *flac, char *wav, char *path);
-int FLACtoSignal(char *input, AudioSignal *Signal);
+int FLACtoSignal(char *input, AudioSignal *Signal, int useSlices);
 
 #endif
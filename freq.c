@@ -32,12 +32,25 @@
 #include "plot.h"
 #include "float.h"
 #include "profile.h"
+#include "plans.h"
+#include "kernels.h"
+#include "arena.h"
+#include "pcmcache.h"
 
 #define SORT_NAME FFT_Frequency_Magnitude
 #define SORT_TYPE Frequency
 #define SORT_CMP(x, y)  ((x).magnitude > (y).magnitude ? -1 : ((x).magnitude == (y).magnitude ? 0 : 1))
 #include "sort.h"  // https://github.com/swenson/sort/
 
+// Same order as the stable sort above, ties are kept in bin order
+#define BIN_MAGNITUDE_CMP(x, y)  ((x).magnitude > (y).magnitude ? -1 : ((x).magnitude < (y).magnitude ? 1 : \
+									((x).bin < (y).bin ? -1 : ((x).bin == (y).bin ? 0 : 1))))
+
+#define SORT_NAME BinMagnitude_Top
+#define SORT_TYPE BinMagnitude
+#define SORT_CMP(x, y)  BIN_MAGNITUDE_CMP(x, y)
+#include "sort.h"  // https://github.com/swenson/sort/
+
 inline int areDoublesEqual(double a, double b)
 {
 	double diff = 0;
@@ -237,13 +250,12 @@ int InitFreqStruc(Frequency **freq, parameters *config)
 		logmsg("ERROR: InitFreqStruc, frequency block already full\n");
 		return 0;
 	}
-	*freq = (Frequency*)malloc(sizeof(Frequency)*config->MaxFreq);
+	*freq = (Frequency*)ArenaCalloc(&config->arena, sizeof(Frequency)*config->MaxFreq);
 	if(!*freq)
 	{
 		logmsg("ERROR: InitFreqStruc, not enough memory for Data Structures\n");
 		return 0;
 	}
-	memset(*freq, 0, sizeof(Frequency)*config->MaxFreq);
 	return 1;
 }
 
@@ -415,12 +427,16 @@ void InitAudio(AudioSignal *Signal, parameters *config)
 	Signal->floorAmplitude = 0.0;	
 
 	Signal->Samples = NULL;
+	memset(Signal->Planar, 0, sizeof(double*)*PLANAR_COUNT);
 	Signal->SampleRate = 0;
 	Signal->bytesPerSample = 0;
 	Signal->numSamples = 0;
 	Signal->SamplesStart = 0;
 	Signal->samplesPosFLAC = 0;
 	Signal->errorFLAC = 0;
+	Signal->seekTableFLAC = 0;
+	Signal->mappedPCM = NULL;
+	Signal->mappedPCMSize = 0;
 	Signal->framerate = 0.0;
 	memset(&Signal->header, 0, sizeof(wav_hdr));
 	memset(&Signal->fmtExtra, 0, sizeof(uint8_t)*FMT_EXTRA_SIZE);
@@ -571,22 +587,14 @@ void ReleaseSamples(AudioBlocks * AudioArray)
 	AudioArray->internalSyncCount = 0;
 }
 
+/* Frequency arrays belong to the run arena, released in ReleaseAudioBlockStructure */
 void ReleaseFrequencies(AudioBlocks * AudioArray)
 {
 	if(!AudioArray)
 		return;
 
-	if(AudioArray->freq)
-	{
-		free(AudioArray->freq);
-		AudioArray->freq = NULL;
-	}
-
-	if(AudioArray->freqRight)
-	{
-		free(AudioArray->freqRight);
-		AudioArray->freqRight = NULL;
-	}
+	AudioArray->freq = NULL;
+	AudioArray->freqRight = NULL;
 }
 
 void ReleaseBlock(AudioBlocks * AudioArray)
@@ -606,9 +614,24 @@ void ReleaseBlock(AudioBlocks * AudioArray)
 
 void ReleasePCM(AudioSignal *Signal)
 {
+	int i = 0;
+
 	if(!Signal)
 		return;
 
+	if(Signal->mappedPCM)
+	{
+		ReleasePCMCache(Signal);
+		return;
+	}
+
+	for(i = 0; i < PLANAR_COUNT; i++)
+	{
+		if(Signal->Planar[i] && Signal->Planar[i] != Signal->Samples)
+			free(Signal->Planar[i]);
+		Signal->Planar[i] = NULL;
+	}
+
 	if(Signal->Samples)
 	{
 		free(Signal->Samples);
@@ -637,6 +660,207 @@ void ReleaseAudio(AudioSignal *Signal, parameters *config)
 	InitAudio(Signal, config);
 }
 
+double *CloneSampleArray(double *samples, long int size)
+{
+	double *copy = NULL;
+
+	copy = (double*)malloc(sizeof(double)*size);
+	if(!copy)
+		return NULL;
+	memcpy(copy, samples, sizeof(double)*size);
+	return copy;
+}
+
+int CloneBlockSamples(BlockSamples *target, BlockSamples *source)
+{
+	*target = *source;
+	target->samples = NULL;
+	target->windowed_samples = NULL;
+
+	if(source->samples)
+	{
+		target->samples = CloneSampleArray(source->samples, source->size+1);
+		if(!target->samples)
+			return 0;
+	}
+	if(source->windowed_samples)
+	{
+		target->windowed_samples = CloneSampleArray(source->windowed_samples, source->size+1);
+		if(!target->windowed_samples)
+			return 0;
+	}
+	return 1;
+}
+
+int CloneSpectrum(FFTWSpectrum *target, FFTWSpectrum *source)
+{
+	*target = *source;
+	target->spectrum = NULL;
+
+	if(!source->spectrum)
+		return 1;
+
+	target->spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(source->size/2+1));
+	if(!target->spectrum)
+		return 0;
+	memcpy(target->spectrum, source->spectrum, sizeof(fftw_complex)*(source->size/2+1));
+	return 1;
+}
+
+Frequency *CloneFrequencies(Frequency *freq, long int size, memoryArena *arena)
+{
+	Frequency *copy = NULL;
+
+	copy = (Frequency*)ArenaAlloc(arena, sizeof(Frequency)*size);
+	if(!copy)
+		return NULL;
+	memcpy(copy, freq, sizeof(Frequency)*size);
+	return copy;
+}
+
+// Silence blocks hold the whole range once processed, see FillFrequencyStructuresInternal
+long int GetBlockFrequencyCount(AudioBlocks *AudioArray, char channel, parameters *config)
+{
+	long int size = 0;
+
+	if(AudioArray->type != TYPE_SILENCE)
+		return config->MaxFreq;
+
+	size = channel == CHANNEL_RIGHT ? AudioArray->SilenceSizeRight : AudioArray->SilenceSizeLeft;
+	return(size ? size : config->MaxFreq);
+}
+
+int CloneAudioBlock(AudioBlocks *target, AudioBlocks *source, memoryArena *arena, parameters *config)
+{
+
+	*target = *source;
+	target->freq = NULL;
+	target->freqRight = NULL;
+	target->fftwValues.spectrum = NULL;
+	target->fftwValuesRight.spectrum = NULL;
+	target->audio.samples = NULL;
+	target->audio.windowed_samples = NULL;
+	target->audioRight.samples = NULL;
+	target->audioRight.windowed_samples = NULL;
+	target->internalSync = NULL;
+	target->internalSyncCount = 0;
+
+	if(source->freq)
+	{
+		target->freq = CloneFrequencies(source->freq, GetBlockFrequencyCount(source, CHANNEL_LEFT, config), arena);
+		if(!target->freq)
+			return 0;
+	}
+	if(source->freqRight)
+	{
+		target->freqRight = CloneFrequencies(source->freqRight, GetBlockFrequencyCount(source, CHANNEL_RIGHT, config), arena);
+		if(!target->freqRight)
+			return 0;
+	}
+
+	if(!CloneSpectrum(&target->fftwValues, &source->fftwValues))
+		return 0;
+	if(!CloneSpectrum(&target->fftwValuesRight, &source->fftwValuesRight))
+		return 0;
+	if(!CloneBlockSamples(&target->audio, &source->audio))
+		return 0;
+	if(!CloneBlockSamples(&target->audioRight, &source->audioRight))
+		return 0;
+
+	if(source->internalSync)
+	{
+		if(!initInternalSync(target, source->internalSyncCount))
+			return 0;
+		for(int i = 0; i < source->internalSyncCount; i++)
+		{
+			if(!CloneBlockSamples(&target->internalSync[i], &source->internalSync[i]))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+int CloneSignalData(AudioSignal *Clone, AudioSignal *Signal, memoryArena *arena, parameters *config)
+{
+	long int frames = 0;
+
+	if(Signal->Samples)
+	{
+		Clone->Samples = CloneSampleArray(Signal->Samples, Signal->numSamples);
+		if(!Clone->Samples)
+			return 0;
+	}
+
+	// a processed signal may only have its planar channels left
+	frames = Signal->numSamples/Signal->AudioChannels;
+	for(int i = 0; i < PLANAR_COUNT; i++)
+	{
+		if(!Signal->Planar[i])
+			continue;
+		if(Signal->Planar[i] == Signal->Samples)
+			Clone->Planar[i] = Clone->Samples;
+		else
+		{
+			Clone->Planar[i] = CloneSampleArray(Signal->Planar[i], frames+1);
+			if(!Clone->Planar[i])
+				return 0;
+		}
+	}
+
+	if(Signal->Blocks)
+	{
+		Clone->Blocks = (AudioBlocks*)calloc(config->types.totalBlocks, sizeof(AudioBlocks));
+		if(!Clone->Blocks)
+			return 0;
+		for(int n = 0; n < config->types.totalBlocks; n++)
+		{
+			if(!CloneAudioBlock(&Clone->Blocks[n], &Signal->Blocks[n], arena, config))
+				return 0;
+		}
+	}
+
+	if(config->clkMeasure)
+	{
+		if(!CloneAudioBlock(&Clone->clkFrequencies, &Signal->clkFrequencies, arena, config))
+			return 0;
+	}
+	return 1;
+}
+
+/* Deep copy of a signal, samples are always copied so the clone owns them */
+AudioSignal *CloneAudioSignal(AudioSignal *Signal, memoryArena *arena, parameters *config)
+{
+	AudioSignal	*Clone = NULL;
+
+	if(!Signal)
+		return NULL;
+
+	Clone = (AudioSignal*)malloc(sizeof(AudioSignal));
+	if(!Clone)
+	{
+		logmsg("\tERROR: Not enough memory to copy the %s signal\n", getRoleText(Signal));
+		return NULL;
+	}
+
+	*Clone = *Signal;
+	Clone->Samples = NULL;
+	for(int i = 0; i < PLANAR_COUNT; i++)
+		Clone->Planar[i] = NULL;
+	Clone->mappedPCM = NULL;
+	Clone->mappedPCMSize = 0;
+	Clone->Blocks = NULL;
+	memset(&Clone->clkFrequencies, 0, sizeof(AudioBlocks));
+
+	if(!CloneSignalData(Clone, Signal, arena, config))
+	{
+		logmsg("\tERROR: Not enough memory to copy the %s signal\n", getRoleText(Signal));
+		ReleaseAudio(Clone, config);
+		free(Clone);
+		return NULL;
+	}
+	return Clone;
+}
+
 void ReleaseAudioBlockStructure(parameters *config)
 {
 	if(config->types.typeCount && config->types.typeArray)
@@ -646,10 +870,11 @@ void ReleaseAudioBlockStructure(parameters *config)
 		config->types.typeCount = 0;
 	}
 
+	if(config->model_plan || config->plans.misses)
+		SaveWisdom(config);
+
 	if(config->model_plan)
 	{
-		fftw_export_wisdom_to_filename("wisdom.fftw");
-
 		fftw_destroy_plan(config->model_plan);
 		config->model_plan = NULL;
 	}
@@ -658,11 +883,9 @@ void ReleaseAudioBlockStructure(parameters *config)
 		fftw_destroy_plan(config->reverse_plan);
 		config->reverse_plan = NULL;
 	}
-	if(config->sync_plan)
-	{
-		fftw_destroy_plan(config->sync_plan);
-		config->sync_plan = NULL;
-	}
+	ReleasePlanCache(&config->plans);
+	ReleaseArena(&config->arena);
+	ReleaseScratchArenas();
 	if(config->clkBlocksAdjust)
 	{
 		free(config->clkBlocksAdjust);
@@ -705,6 +928,20 @@ double GetMSPerFrameRole(int role, parameters *config)
 	return(roundFloat(getMSPerFrameInternal(role, config)));
 }
 
+// Phase is plotted, compared with -x and printed in verbose frequency lists
+int NeedsPhase(parameters *config)
+{
+	return(config->plotPhase || config->extendedResults || config->verbose);
+}
+
+// Same condition LoadAndProcessAudioFiles uses to run CheckBalance
+int NeedsBalanceCheck(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	if(!config->channelBalance || config->noSyncProfile)
+		return 0;
+	return(ReferenceSignal->AudioChannels == 2 || ComparisonSignal->AudioChannels == 2);
+}
+
 double GetLowerFrameRate(double framerateA, double framerateB)
 {
 	if(framerateA > framerateB)
@@ -2582,6 +2819,11 @@ inline double CalculateFrequency(double boxindex, double boxsize)
 	return Hertz;
 }
 
+inline long int GetFrequencyBin(double hertz, double boxsize)
+{
+	return (long int)floor(hertz*boxsize + 0.5);
+}
+
 int FillFrequencyStructures(AudioSignal *Signal, AudioBlocks *AudioArray, parameters *config)
 {
 	char channel = CHANNEL_LEFT;
@@ -2601,12 +2843,14 @@ int FillFrequencyStructures(AudioSignal *Signal, AudioBlocks *AudioArray, parame
 
 int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray, char channel, parameters *config)
 {
-	long int 		i = 0, startBin= 0, endBin = 0, count = 0, size = 0, amount = 0;
+	long int 		i = 0, startBin= 0, endBin = 0, count = 0, size = 0;
 	double 			boxsize = 0;
 	int				nyquistLimit = 0;
 	long int		*SilenceSize = NULL;
-	double			ENBW = 0;
+	double			ENBW = 0, *span = NULL, *phases = NULL;
 	Frequency		*f_array = NULL, **targetFreq = NULL;
+	memoryArena		*scratch = NULL;
+	arenaMark		mark;
 	FFTWSpectrum	*fftw = NULL;
 
 	if(channel == CHANNEL_LEFT)
@@ -2654,49 +2898,154 @@ int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray
 	logmsgFileOnly("Size: %ld BoxSize: %g StartBin: %ld EndBin %ld\n",
 		 size, boxsize, startBin, endBin);
 	*/
-	f_array = (Frequency*)malloc(sizeof(Frequency)*(endBin-startBin));
+	if(AudioArray->type != TYPE_SILENCE)
+		return(FillTopFrequencies(fftw, *targetFreq, startBin, endBin, boxsize, ENBW, config));
+
+	f_array = (Frequency*)ArenaCalloc(&config->arena, sizeof(Frequency)*(endBin-startBin));
 	if(!f_array)
 	{
 		logmsg("ERROR: Not enough memory (f_array)\n");
 		return 0;
 	}
-	memset(f_array, 0, sizeof(Frequency)*(endBin-startBin));
 
+	scratch = GetScratchArena();
+	mark = GetArenaMark(scratch);
+	span = (double*)ArenaAlloc(scratch, sizeof(double)*(endBin-startBin)*2);
+	if(!span)
+	{
+		logmsg("ERROR: Not enough memory (span)\n");
+		return 0;
+	}
+	phases = span + (endBin-startBin);
+
+	CalculateMagnitudeSpan(fftw->spectrum + startBin, span, endBin-startBin, ENBW);
+	if(NeedsPhase(config))
+		CalculatePhaseSpan(fftw->spectrum + startBin, phases, endBin-startBin);
 	for(i = startBin; i < endBin; i++)
 	{
 		f_array[count].hertz = CalculateFrequency(i, boxsize);
-		f_array[count].magnitude = CalculateMagnitude(&fftw->spectrum[i], ENBW);
+		f_array[count].magnitude = span[count];
 		f_array[count].amplitude = NO_AMPLITUDE;
-		f_array[count].phase = CalculatePhase(&fftw->spectrum[i]);
+		f_array[count].phase = NeedsPhase(config) ? phases[count] : 0;
 		f_array[count].matched = 0;
 		count++;
 	}
-
-	if(config->MaxFreq > count)
-		amount = count;
-	else
-		amount = config->MaxFreq;
+	RewindArena(scratch, mark);
 
 	// Sort the array by top magnitudes
 	FFT_Frequency_Magnitude_tim_sort(f_array, count);
 
-	if(AudioArray->type != TYPE_SILENCE)
+	// We use the whole frequency range for Noise floor analysis
+	// the MaxFreq array it replaces stays in the run arena
+	*targetFreq = f_array;
+	*SilenceSize = count;	
+
+	return 1;
+}
+
+/*
+	Leaves the k largest magnitudes in the first k positions, in no
+	particular order. Quickselect with Hoare partitioning.
+*/
+void SelectTopBinMagnitudes(BinMagnitude *array, long int count, long int k)
+{
+	long int left = 0, right = count - 1;
+
+	if(k <= 0 || k >= count)
+		return;
+
+	while(right > left)
 	{
-		// Only copy Top amount frequencies
-		memcpy(*targetFreq, f_array, sizeof(Frequency)*amount);
+		long int		i = left, j = right;
+		BinMagnitude	pivot;
+
+		pivot = array[left + (right - left)/2];
+		while(i <= j)
+		{
+			while(BIN_MAGNITUDE_CMP(array[i], pivot) < 0)
+				i++;
+			while(BIN_MAGNITUDE_CMP(array[j], pivot) > 0)
+				j--;
+			if(i <= j)
+			{
+				BinMagnitude tmp = array[i];
+
+				array[i] = array[j];
+				array[j] = tmp;
+				i++;
+				j--;
+			}
+		}
 
-		// release temporal storage
-		free(f_array);
-		f_array = NULL;
+		if(k - 1 <= j)
+			right = j;
+		else if(k - 1 >= i)
+			left = i;
+		else
+			break;
 	}
+}
+
+/*
+	Only the top MaxFreq bins are kept for non silence blocks, so they are
+	selected by magnitude first and just those are sorted and get their
+	frequency and phase calculated. Phase is only needed for the phase
+	plots.
+*/
+int FillTopFrequencies(FFTWSpectrum *fftw, Frequency *targetFreq, long int startBin, long int endBin, double boxsize, double ENBW, parameters *config)
+{
+	long int		i = 0, count = 0, amount = 0;
+	BinMagnitude	*bins = NULL;
+	double			*span = NULL;
+	memoryArena		*scratch = NULL;
+	arenaMark		mark;
+
+	scratch = GetScratchArena();
+	mark = GetArenaMark(scratch);
+	bins = (BinMagnitude*)ArenaAlloc(scratch, sizeof(BinMagnitude)*(endBin-startBin));
+	if(!bins)
+	{
+		logmsg("ERROR: Not enough memory (bins)\n");
+		return 0;
+	}
+
+	span = (double*)ArenaAlloc(scratch, sizeof(double)*(endBin-startBin));
+	if(!span)
+	{
+		logmsg("ERROR: Not enough memory (span)\n");
+		RewindArena(scratch, mark);
+		return 0;
+	}
+
+	CalculateMagnitudeSpan(fftw->spectrum + startBin, span, endBin-startBin, ENBW);
+	for(i = startBin; i < endBin; i++)
+	{
+		bins[count].magnitude = span[count];
+		bins[count].bin = i;
+		count++;
+	}
+
+	if(config->MaxFreq > count)
+		amount = count;
 	else
+		amount = config->MaxFreq;
+
+	SelectTopBinMagnitudes(bins, count, amount);
+	BinMagnitude_Top_tim_sort(bins, amount);
+
+	for(i = 0; i < amount; i++)
 	{
-		// We use the whole frequency range for Noise floor analysis
-		free(*targetFreq);
-		*targetFreq = f_array;
-		*SilenceSize = count;	
+		targetFreq[i].hertz = CalculateFrequency(bins[i].bin, boxsize);
+		targetFreq[i].magnitude = bins[i].magnitude;
+		targetFreq[i].amplitude = NO_AMPLITUDE;
+		if(NeedsPhase(config))
+			targetFreq[i].phase = CalculatePhase(&fftw->spectrum[bins[i].bin]);
+		else
+			targetFreq[i].phase = 0;
+		targetFreq[i].matched = 0;
 	}
 
+	RewindArena(scratch, mark);
 	return 1;
 }
 
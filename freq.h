@@ -102,9 +102,19 @@ int InitFreqStruc(Frequency **freq, parameters *config);
 int InitAudioBlock(AudioBlocks* block, char channel, char maskType, parameters *config);
 int initInternalSync(AudioBlocks * AudioArray, int size);
 void ReleaseAudio(AudioSignal *Signal, parameters *config);
+double *CloneSampleArray(double *samples, long int size);
+int CloneBlockSamples(BlockSamples *target, BlockSamples *source);
+int CloneSpectrum(FFTWSpectrum *target, FFTWSpectrum *source);
+Frequency *CloneFrequencies(Frequency *freq, long int size, memoryArena *arena);
+long int GetBlockFrequencyCount(AudioBlocks *AudioArray, char channel, parameters *config);
+int CloneAudioBlock(AudioBlocks *target, AudioBlocks *source, memoryArena *arena, parameters *config);
+int CloneSignalData(AudioSignal *Clone, AudioSignal *Signal, memoryArena *arena, parameters *config);
+AudioSignal *CloneAudioSignal(AudioSignal *Signal, memoryArena *arena, parameters *config);
 void CleanMatched(AudioSignal *ReferenceSignal, AudioSignal *TestSignal, parameters *config);
 int FillFrequencyStructures(AudioSignal *Signal, AudioBlocks *AudioArray, parameters *config);
 int FillFrequencyStructuresInternal(AudioSignal *Signal, AudioBlocks *AudioArray, char channel, parameters *config);
+int FillTopFrequencies(FFTWSpectrum *fftw, Frequency *targetFreq, long int startBin, long int endBin, double boxsize, double ENBW, parameters *config);
+void SelectTopBinMagnitudes(BinMagnitude *array, long int count, long int k);
 void PrintFrequencies(AudioSignal *Signal, parameters *config);
 void PrintFrequenciesWMagnitudes(AudioSignal *Signal, parameters *config);
 void PrintFrequenciesBlock(AudioSignal *Signal, Frequency *freq, long int size, int type, parameters *config);
@@ -114,7 +124,10 @@ void FindMaxMagnitude(AudioSignal *Signal, parameters *config);
 void CalculateAmplitudes(AudioSignal *Signal, double ZeroDbMagReference, parameters *config);
 void FindFloor(AudioSignal *Signal, parameters *config);
 void FindStandAloneFloor(AudioSignal *Signal, parameters *config);
+int NeedsPhase(parameters *config);
+int NeedsBalanceCheck(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
 double GetLowerFrameRate(double framerateA, double framerateB);
+double GetHigherFrameRate(double framerateA, double framerateB);
 void CompareFrameRates(AudioSignal *Signal1, AudioSignal *Signal2, parameters *config);
 void CompareFrameRatesMDW(AudioSignal *Signal, double framerate, parameters *config);
 double CalculatePCMMagnitude(double amplitude, double MaxMagnitude);
@@ -147,6 +160,7 @@ double CalculateAmplitude(double magnitude, double MaxMagnitude);
 double CalculateAmplitudeInternal(double magnitude, double MaxMagnitude);
 double CalculatePhase(fftw_complex *value);
 double CalculateFrequency(double boxindex, double boxsize);
+long int GetFrequencyBin(double hertz, double boxsize);
 double CalculateFrameRate(AudioSignal *Signal, parameters *config);
 double CalculateFrameRateNS(AudioSignal *Signal, double Frames, parameters *config);
 double CalculateFrameRateAndCheckSamplerate(AudioSignal *Signal, parameters *config);
@@ -0,0 +1,135 @@
+/*
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library:
+ *	  http://www.fftw.org/
+ *
+ */
+
+/*
+	Times the magnitude kernels on each level the CPU supports, over the
+	same span of bins, and checks every level against the scalar output.
+	Built with "make bench", takes the span size and passes as arguments.
+*/
+
+#include "mdfourier.h"
+#include "log.h"
+#include "kernels.h"
+
+#define BENCH_BINS		(1024*1024)
+#define BENCH_PASSES	50
+
+double BenchSeconds(struct timespec *start, struct timespec *end)
+{
+	return((double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec)/1e9);
+}
+
+// Best of passes, the first ones pay for page faults and frequency ramp up
+double BenchMagnitudeSpan(fftw_complex *spectrum, double *magnitudes, long int bins, int passes)
+{
+	double best = 0;
+
+	for(int pass = 0; pass < passes; pass++)
+	{
+		struct timespec	start, end;
+		double			elapsed = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		CalculateMagnitudeSpan(spectrum, magnitudes, bins, (double)bins);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		elapsed = BenchSeconds(&start, &end);
+		if(!pass || elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	char			*names[] = { "scalar", "SSE2", "AVX2" };
+	fftw_complex	*spectrum = NULL;
+	double			*magnitudes = NULL, *reference = NULL;
+	long int		bins = BENCH_BINS, i = 0;
+	int				passes = BENCH_PASSES, level = 0, failed = 0;
+
+	if(argc > 1)
+		bins = atol(argv[1]);
+	if(argc > 2)
+		passes = atoi(argv[2]);
+	if(bins < 1 || passes < 1)
+	{
+		printf("usage: kernelbench [bins] [passes]\n");
+		return 1;
+	}
+
+	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*bins);
+	magnitudes = (double*)malloc(sizeof(double)*bins);
+	reference = (double*)malloc(sizeof(double)*bins);
+	if(!spectrum || !magnitudes || !reference)
+	{
+		printf("ERROR: Not enough memory for %ld bins\n", bins);
+		return 1;
+	}
+
+	// Fixed seed, runs are comparable
+	srand(240);
+	for(i = 0; i < bins; i++)
+	{
+		double re = 0, im = 0;
+
+		re = (double)rand()/RAND_MAX*2.0 - 1.0;
+		im = (double)rand()/RAND_MAX*2.0 - 1.0;
+		spectrum[i] = re + I*im;
+	}
+
+	printf("Magnitude span of %ld bins, best of %d passes\n", bins, passes);
+	for(level = KERNEL_SCALAR; level <= KERNEL_AVX2; level++)
+	{
+		double	seconds = 0;
+		int		identical = 1;
+
+		if(!SetKernelLevel(level))
+		{
+			printf(" %-6s  not supported by this CPU\n", names[level]);
+			continue;
+		}
+
+		seconds = BenchMagnitudeSpan(spectrum, magnitudes, bins, passes);
+		if(level == KERNEL_SCALAR)
+			memcpy(reference, magnitudes, sizeof(double)*bins);
+		else
+			identical = memcmp(reference, magnitudes, sizeof(double)*bins) == 0;
+
+		printf(" %-6s  %8.3f ms  %6.3f ns/bin%s\n", names[level],
+				seconds*1000.0, seconds*1e9/(double)bins,
+				identical ? "" : "  MISMATCH with scalar");
+		if(!identical)
+			failed = 1;
+	}
+
+	fftw_free(spectrum);
+	free(magnitudes);
+	free(reference);
+	return failed;
+}
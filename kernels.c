@@ -0,0 +1,714 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "kernels.h"
+#include "freq.h"
+#include "log.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/*
+	Batch versions of CalculateMagnitude, CalculatePhase and
+	CalculateAmplitude over a span of bins. Magnitudes are computed
+	with the same operations in the same order as the scalar
+	functions, so all paths give bit identical results.
+
+	There is no vector log10 or atan2 in SSE2/AVX2, those stay on libm
+	and are only batched.
+*/
+
+static int kernelLevel = KERNEL_SCALAR;
+
+static void CalculateMagnitudeSpanScalar(fftw_complex *spectrum, double *magnitudes, long int count, double factor)
+{
+	long int i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		double r1 = 0, i1 = 0;
+
+		r1 = creal(spectrum[i]);
+		i1 = cimag(spectrum[i]);
+		magnitudes[i] = (2*sqrt(r1*r1 + i1*i1))/factor;
+	}
+}
+
+#ifdef KERNELS_X86
+__attribute__((target("sse2")))
+static void CalculateMagnitudeSpanSSE2(fftw_complex *spectrum, double *magnitudes, long int count, double factor)
+{
+	long int	i = 0;
+	double		*values = NULL;
+	__m128d		two, div;
+
+	values = (double*)spectrum;
+	two = _mm_set1_pd(2.0);
+	div = _mm_set1_pd(factor);
+	for(i = 0; i + 2 <= count; i += 2)
+	{
+		__m128d a, b, re, im;
+
+		a = _mm_loadu_pd(values + 2*i);		/* r0 i0 */
+		b = _mm_loadu_pd(values + 2*i + 2);	/* r1 i1 */
+		a = _mm_mul_pd(a, a);
+		b = _mm_mul_pd(b, b);
+		re = _mm_unpacklo_pd(a, b);
+		im = _mm_unpackhi_pd(a, b);
+		a = _mm_sqrt_pd(_mm_add_pd(re, im));
+		_mm_storeu_pd(magnitudes + i, _mm_div_pd(_mm_mul_pd(two, a), div));
+	}
+	if(i < count)
+		CalculateMagnitudeSpanScalar(spectrum + i, magnitudes + i, count - i, factor);
+}
+
+__attribute__((target("avx2")))
+static void CalculateMagnitudeSpanAVX2(fftw_complex *spectrum, double *magnitudes, long int count, double factor)
+{
+	long int	i = 0;
+	double		*values = NULL;
+	__m256d		two, div;
+
+	values = (double*)spectrum;
+	two = _mm256_set1_pd(2.0);
+	div = _mm256_set1_pd(factor);
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m256d a, b, sum;
+
+		a = _mm256_loadu_pd(values + 2*i);		/* r0 i0 r1 i1 */
+		b = _mm256_loadu_pd(values + 2*i + 4);	/* r2 i2 r3 i3 */
+		a = _mm256_mul_pd(a, a);
+		b = _mm256_mul_pd(b, b);
+		sum = _mm256_hadd_pd(a, b);				/* 0 2 1 3 */
+		sum = _mm256_permute4x64_pd(sum, 0xD8);	/* 0 1 2 3 */
+		sum = _mm256_sqrt_pd(sum);
+		_mm256_storeu_pd(magnitudes + i, _mm256_div_pd(_mm256_mul_pd(two, sum), div));
+	}
+	if(i < count)
+		CalculateMagnitudeSpanSSE2(spectrum + i, magnitudes + i, count - i, factor);
+}
+#endif
+
+/* Must be called before any parallel region uses the kernels */
+void SelectKernels(parameters *config)
+{
+	kernelLevel = KERNEL_SCALAR;
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		kernelLevel = KERNEL_AVX2;
+	else if(__builtin_cpu_supports("sse2"))
+		kernelLevel = KERNEL_SSE2;
+#endif
+
+	if(config && config->verbose)
+	{
+		if(kernelLevel == KERNEL_AVX2)
+			logmsg(" - Using AVX2 kernels\n");
+		if(kernelLevel == KERNEL_SSE2)
+			logmsg(" - Using SSE2 kernels\n");
+	}
+}
+
+int GetKernelLevel(void)
+{
+	return kernelLevel;
+}
+
+// Forces a level for benchmarks, fails if the CPU lacks it
+int SetKernelLevel(int level)
+{
+	if(level == KERNEL_SCALAR)
+	{
+		kernelLevel = level;
+		return 1;
+	}
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if((level == KERNEL_AVX2 && __builtin_cpu_supports("avx2")) ||
+		(level == KERNEL_SSE2 && __builtin_cpu_supports("sse2")))
+	{
+		kernelLevel = level;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+void CalculateMagnitudeSpan(fftw_complex *spectrum, double *magnitudes, long int count, double factor)
+{
+	if(!spectrum || !magnitudes || count <= 0)
+		return;
+
+#ifdef KERNELS_X86
+	if(kernelLevel == KERNEL_AVX2)
+	{
+		CalculateMagnitudeSpanAVX2(spectrum, magnitudes, count, factor);
+		return;
+	}
+	if(kernelLevel == KERNEL_SSE2)
+	{
+		CalculateMagnitudeSpanSSE2(spectrum, magnitudes, count, factor);
+		return;
+	}
+#endif
+	CalculateMagnitudeSpanScalar(spectrum, magnitudes, count, factor);
+}
+
+void CalculatePhaseSpan(fftw_complex *spectrum, double *phases, long int count)
+{
+	long int i = 0;
+
+	if(!spectrum || !phases || count <= 0)
+		return;
+
+	for(i = 0; i < count; i++)
+		phases[i] = atan2(cimag(spectrum[i]), creal(spectrum[i]))*180/M_PI;
+}
+
+void CalculateAmplitudeSpan(double *magnitudes, double *amplitudes, long int count, double MaxMagnitude)
+{
+	long int i = 0;
+
+	if(!magnitudes || !amplitudes || count <= 0)
+		return;
+
+	if(MaxMagnitude == 0.0)
+	{
+		for(i = 0; i < count; i++)
+			amplitudes[i] = NO_AMPLITUDE;
+		return;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		if(magnitudes[i] == 0.0 || magnitudes[i] > MaxMagnitude)
+			amplitudes[i] = NO_AMPLITUDE;
+		else
+			amplitudes[i] = CalculateAmplitudeInternal(magnitudes[i], MaxMagnitude);
+	}
+}
+
+/*
+	PCM to double converters, one per sample format. A converter is
+	selected once per file with SelectPCMConverter. Integer and float
+	samples convert exactly to double, so every path gives the same
+	values as the scalar one.
+*/
+
+static void ConvertPCM8Scalar(const uint8_t *bytes, long int count, double *samples)
+{
+	long int i = 0;
+
+	for(i = 0; i < count; i++)
+		samples[i] = (double)(bytes[i] - 0x80);	// 8 bit is unsigned. Convert to signed
+}
+
+static void ConvertPCM16Scalar(const uint8_t *bytes, long int count, double *samples)
+{
+	long int i = 0;
+
+	for(i = 0; i < count; i++)
+		samples[i] = (double)(int16_t)(bytes[2*i] | (bytes[2*i+1] << 8));
+}
+
+static void ConvertPCM24Scalar(const uint8_t *bytes, long int count, double *samples)
+{
+	long int i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		uint32_t sample = 0;
+
+		sample = ((uint32_t)bytes[3*i+2] << 24) | ((uint32_t)bytes[3*i+1] << 16) | ((uint32_t)bytes[3*i] << 8);
+		samples[i] = (double)((int32_t)sample >> 8);
+	}
+}
+
+static void ConvertPCM32Scalar(const uint8_t *bytes, long int count, double *samples)
+{
+	long int i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		uint32_t sample = 0;
+
+		sample = ((uint32_t)bytes[4*i+3] << 24) | ((uint32_t)bytes[4*i+2] << 16) | ((uint32_t)bytes[4*i+1] << 8) | bytes[4*i];
+		samples[i] = (double)(int32_t)sample;
+	}
+}
+
+// no endianess considerations, RIFF is little endian and this code is little endian
+static void ConvertFloat32Scalar(const uint8_t *bytes, long int count, double *samples)
+{
+	long int i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		float sample = 0;
+
+		memcpy(&sample, bytes + 4*i, sizeof(float));
+		samples[i] = (double)sample;
+	}
+}
+
+static void ConvertFloat64(const uint8_t *bytes, long int count, double *samples)
+{
+	memcpy(samples, bytes, sizeof(double)*count);
+}
+
+static void ConvertInt32InterleaveScalar(const int32_t *left, const int32_t *right, long int frames, double *samples)
+{
+	long int i = 0;
+
+	if(!right)
+	{
+		for(i = 0; i < frames; i++)
+			samples[i] = (double)left[i];
+		return;
+	}
+
+	for(i = 0; i < frames; i++)
+	{
+		samples[2*i] = (double)left[i];
+		samples[2*i+1] = (double)right[i];
+	}
+}
+
+static void DeinterleaveScalar(const double *samples, long int frames, double *left, double *right)
+{
+	long int i = 0;
+
+	for(i = 0; i < frames; i++)
+	{
+		left[i] = samples[2*i];
+		right[i] = samples[2*i+1];
+	}
+}
+
+#ifdef KERNELS_X86
+__attribute__((target("sse2")))
+static void ConvertPCM8SSE2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+	__m128i		zero, bias;
+
+	zero = _mm_setzero_si128();
+	bias = _mm_set1_epi32(0x80);
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i	v;
+		int32_t	packed = 0;
+
+		memcpy(&packed, bytes + i, sizeof(int32_t));
+		v = _mm_cvtsi32_si128(packed);
+		v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+		v = _mm_sub_epi32(v, bias);
+		_mm_storeu_pd(samples + i, _mm_cvtepi32_pd(v));
+		_mm_storeu_pd(samples + i + 2, _mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE)));
+	}
+	ConvertPCM8Scalar(bytes + i, count - i, samples + i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertPCM16SSE2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		__m128i	v, lo, hi;
+
+		v = _mm_loadu_si128((const __m128i*)(bytes + 2*i));
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_pd(samples + i, _mm_cvtepi32_pd(lo));
+		_mm_storeu_pd(samples + i + 2, _mm_cvtepi32_pd(_mm_shuffle_epi32(lo, 0xEE)));
+		_mm_storeu_pd(samples + i + 4, _mm_cvtepi32_pd(hi));
+		_mm_storeu_pd(samples + i + 6, _mm_cvtepi32_pd(_mm_shuffle_epi32(hi, 0xEE)));
+	}
+	ConvertPCM16Scalar(bytes + 2*i, count - i, samples + i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertPCM32SSE2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i	v;
+
+		v = _mm_loadu_si128((const __m128i*)(bytes + 4*i));
+		_mm_storeu_pd(samples + i, _mm_cvtepi32_pd(v));
+		_mm_storeu_pd(samples + i + 2, _mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE)));
+	}
+	ConvertPCM32Scalar(bytes + 4*i, count - i, samples + i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertFloat32SSE2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m128	v;
+
+		v = _mm_loadu_ps((const float*)(bytes + 4*i));
+		_mm_storeu_pd(samples + i, _mm_cvtps_pd(v));
+		_mm_storeu_pd(samples + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+	ConvertFloat32Scalar(bytes + 4*i, count - i, samples + i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertInt32InterleaveSSE2(const int32_t *left, const int32_t *right, long int frames, double *samples)
+{
+	long int	i = 0;
+
+	if(!right)
+	{
+		ConvertPCM32SSE2((const uint8_t*)left, frames, samples);
+		return;
+	}
+
+	for(i = 0; i + 2 <= frames; i += 2)
+	{
+		__m128d	l, r;
+
+		l = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(left + i)));
+		r = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(right + i)));
+		_mm_storeu_pd(samples + 2*i, _mm_unpacklo_pd(l, r));
+		_mm_storeu_pd(samples + 2*i + 2, _mm_unpackhi_pd(l, r));
+	}
+	ConvertInt32InterleaveScalar(left + i, right + i, frames - i, samples + 2*i);
+}
+
+__attribute__((target("sse2")))
+static void DeinterleaveSSE2(const double *samples, long int frames, double *left, double *right)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 2 <= frames; i += 2)
+	{
+		__m128d	a, b;
+
+		a = _mm_loadu_pd(samples + 2*i);		/* l0 r0 */
+		b = _mm_loadu_pd(samples + 2*i + 2);	/* l1 r1 */
+		_mm_storeu_pd(left + i, _mm_unpacklo_pd(a, b));
+		_mm_storeu_pd(right + i, _mm_unpackhi_pd(a, b));
+	}
+	DeinterleaveScalar(samples + 2*i, frames - i, left + i, right + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertPCM8AVX2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+	__m256i		bias;
+
+	bias = _mm256_set1_epi32(0x80);
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		__m256i	v;
+
+		v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(bytes + i)));
+		v = _mm256_sub_epi32(v, bias);
+		_mm256_storeu_pd(samples + i, _mm256_cvtepi32_pd(_mm256_castsi256_si128(v)));
+		_mm256_storeu_pd(samples + i + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)));
+	}
+	ConvertPCM8Scalar(bytes + i, count - i, samples + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertPCM16AVX2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		__m256i	v;
+
+		v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(bytes + 2*i)));
+		_mm256_storeu_pd(samples + i, _mm256_cvtepi32_pd(_mm256_castsi256_si128(v)));
+		_mm256_storeu_pd(samples + i + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)));
+	}
+	ConvertPCM16Scalar(bytes + 2*i, count - i, samples + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertPCM24AVX2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+	__m128i		shuffle;
+
+	/* each 3 byte sample goes to the top of an int32, then shifted down with its sign */
+	shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	/* loads are 16 bytes for 12 used, stay clear of the end */
+	for(i = 0; 3*i + 16 <= 3*count; i += 4)
+	{
+		__m128i	v;
+
+		v = _mm_loadu_si128((const __m128i*)(bytes + 3*i));
+		v = _mm_srai_epi32(_mm_shuffle_epi8(v, shuffle), 8);
+		_mm256_storeu_pd(samples + i, _mm256_cvtepi32_pd(v));
+	}
+	ConvertPCM24Scalar(bytes + 3*i, count - i, samples + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertPCM32AVX2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i	v;
+
+		v = _mm_loadu_si128((const __m128i*)(bytes + 4*i));
+		_mm256_storeu_pd(samples + i, _mm256_cvtepi32_pd(v));
+	}
+	ConvertPCM32Scalar(bytes + 4*i, count - i, samples + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertFloat32AVX2(const uint8_t *bytes, long int count, double *samples)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 4 <= count; i += 4)
+		_mm256_storeu_pd(samples + i, _mm256_cvtps_pd(_mm_loadu_ps((const float*)(bytes + 4*i))));
+	ConvertFloat32Scalar(bytes + 4*i, count - i, samples + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertInt32InterleaveAVX2(const int32_t *left, const int32_t *right, long int frames, double *samples)
+{
+	long int	i = 0;
+
+	if(!right)
+	{
+		ConvertPCM32AVX2((const uint8_t*)left, frames, samples);
+		return;
+	}
+
+	for(i = 0; i + 4 <= frames; i += 4)
+	{
+		__m256d	l, r, lo, hi;
+
+		l = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(left + i)));
+		r = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(right + i)));
+		lo = _mm256_unpacklo_pd(l, r);	/* l0 r0 l2 r2 */
+		hi = _mm256_unpackhi_pd(l, r);	/* l1 r1 l3 r3 */
+		_mm256_storeu_pd(samples + 2*i, _mm256_permute2f128_pd(lo, hi, 0x20));
+		_mm256_storeu_pd(samples + 2*i + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+	}
+	ConvertInt32InterleaveScalar(left + i, right + i, frames - i, samples + 2*i);
+}
+
+__attribute__((target("avx2")))
+static void DeinterleaveAVX2(const double *samples, long int frames, double *left, double *right)
+{
+	long int	i = 0;
+
+	for(i = 0; i + 4 <= frames; i += 4)
+	{
+		__m256d	a, b, lo, hi;
+
+		a = _mm256_loadu_pd(samples + 2*i);		/* l0 r0 l1 r1 */
+		b = _mm256_loadu_pd(samples + 2*i + 4);	/* l2 r2 l3 r3 */
+		lo = _mm256_permute2f128_pd(a, b, 0x20);	/* l0 r0 l2 r2 */
+		hi = _mm256_permute2f128_pd(a, b, 0x31);	/* l1 r1 l3 r3 */
+		_mm256_storeu_pd(left + i, _mm256_unpacklo_pd(lo, hi));
+		_mm256_storeu_pd(right + i, _mm256_unpackhi_pd(lo, hi));
+	}
+	DeinterleaveScalar(samples + 2*i, frames - i, left + i, right + i);
+}
+#endif
+
+int SelectPCMConverter(pcmConverter *converter, int audioFormat, int bitsPerSample, int channels)
+{
+	if(!converter)
+		return 0;
+
+	memset(converter, 0, sizeof(pcmConverter));
+	converter->bytesPerSample = bitsPerSample/8;
+	converter->channels = channels;
+
+	if(audioFormat == WAVE_FORMAT_PCM)
+	{
+		switch(bitsPerSample)
+		{
+			case 8:
+				converter->convert = ConvertPCM8Scalar;
+				break;
+			case 16:
+				converter->convert = ConvertPCM16Scalar;
+				break;
+			case 24:
+				converter->convert = ConvertPCM24Scalar;
+				break;
+			case 32:
+				converter->convert = ConvertPCM32Scalar;
+				break;
+		}
+#ifdef KERNELS_X86
+		if(kernelLevel == KERNEL_SSE2)
+		{
+			if(bitsPerSample == 8)
+				converter->convert = ConvertPCM8SSE2;
+			if(bitsPerSample == 16)
+				converter->convert = ConvertPCM16SSE2;
+			if(bitsPerSample == 32)
+				converter->convert = ConvertPCM32SSE2;
+		}
+		if(kernelLevel == KERNEL_AVX2)
+		{
+			if(bitsPerSample == 8)
+				converter->convert = ConvertPCM8AVX2;
+			if(bitsPerSample == 16)
+				converter->convert = ConvertPCM16AVX2;
+			if(bitsPerSample == 24)
+				converter->convert = ConvertPCM24AVX2;
+			if(bitsPerSample == 32)
+				converter->convert = ConvertPCM32AVX2;
+		}
+#endif
+	}
+
+	if(audioFormat == WAVE_FORMAT_IEEE_FLOAT)
+	{
+		if(bitsPerSample == 32)
+		{
+			converter->convert = ConvertFloat32Scalar;
+#ifdef KERNELS_X86
+			if(kernelLevel == KERNEL_SSE2)
+				converter->convert = ConvertFloat32SSE2;
+			if(kernelLevel == KERNEL_AVX2)
+				converter->convert = ConvertFloat32AVX2;
+#endif
+		}
+		if(bitsPerSample == 64)
+			converter->convert = ConvertFloat64;
+	}
+
+	converter->deinterleave = DeinterleaveScalar;
+#ifdef KERNELS_X86
+	if(kernelLevel == KERNEL_SSE2)
+		converter->deinterleave = DeinterleaveSSE2;
+	if(kernelLevel == KERNEL_AVX2)
+		converter->deinterleave = DeinterleaveAVX2;
+#endif
+
+	if(!converter->convert)
+	{
+		logmsg("ERROR: Unsupported audio format, samples were not loaded\n");
+		return 0;
+	}
+	return 1;
+}
+
+/* count is in samples, all channels interleaved */
+void ConvertPCM(pcmConverter *converter, const uint8_t *bytes, long int count, double *samples)
+{
+	converter->convert(bytes, count, samples);
+}
+
+/*
+	Splits the channels in the same pass, in blocks small enough to stay
+	in cache. Mono goes to left.
+*/
+void ConvertPCMPlanar(pcmConverter *converter, const uint8_t *bytes, long int frames, double *left, double *right)
+{
+	long int	frame = 0;
+	double		block[2*PCM_PLANAR_BLOCK];
+
+	if(converter->channels != 2 || !right)
+	{
+		converter->convert(bytes, frames*converter->channels, left);
+		return;
+	}
+
+	for(frame = 0; frame < frames; frame += PCM_PLANAR_BLOCK)
+	{
+		long int count = 0;
+
+		count = frames - frame;
+		if(count > PCM_PLANAR_BLOCK)
+			count = PCM_PLANAR_BLOCK;
+
+		converter->convert(bytes + frame*2*converter->bytesPerSample, count*2, block);
+		converter->deinterleave(block, count, left + frame, right + frame);
+	}
+}
+
+/* FLAC decodes to one int32 buffer per channel, right is NULL for mono */
+void ConvertInt32Interleave(const int32_t *left, const int32_t *right, long int frames, double *samples)
+{
+#ifdef KERNELS_X86
+	if(kernelLevel == KERNEL_AVX2)
+	{
+		ConvertInt32InterleaveAVX2(left, right, frames, samples);
+		return;
+	}
+	if(kernelLevel == KERNEL_SSE2)
+	{
+		ConvertInt32InterleaveSSE2(left, right, frames, samples);
+		return;
+	}
+#endif
+	ConvertInt32InterleaveScalar(left, right, frames, samples);
+}
+
+/*
+	Splits interleaved stereo samples into per channel buffers, mid gets
+	(L+R)/2 when not NULL
+*/
+void DeinterleaveSamples(const double *samples, long int frames, double *left, double *right, double *mid)
+{
+	long int i = 0;
+
+#ifdef KERNELS_X86
+	if(kernelLevel == KERNEL_AVX2)
+		DeinterleaveAVX2(samples, frames, left, right);
+	else if(kernelLevel == KERNEL_SSE2)
+		DeinterleaveSSE2(samples, frames, left, right);
+	else
+#endif
+		DeinterleaveScalar(samples, frames, left, right);
+
+	if(!mid)
+		return;
+
+	for(i = 0; i < frames; i++)
+		mid[i] = (left[i]+right[i])/2.0;
+}
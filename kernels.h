@@ -0,0 +1,63 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_KERNELS_H
+#define MDFOURIER_KERNELS_H
+
+#include "mdfourier.h"
+
+#define KERNEL_SCALAR	0
+#define KERNEL_SSE2	1
+#define KERNEL_AVX2	2
+
+#define PCM_PLANAR_BLOCK	512
+
+typedef void (*pcmConvertFunc)(const uint8_t *bytes, long int count, double *samples);
+typedef void (*pcmDeinterleaveFunc)(const double *samples, long int frames, double *left, double *right);
+
+typedef struct pcm_converter_st {
+	pcmConvertFunc		convert;
+	pcmDeinterleaveFunc	deinterleave;
+	int					bytesPerSample;
+	int					channels;
+} pcmConverter;
+
+void SelectKernels(parameters *config);
+int GetKernelLevel(void);
+int SetKernelLevel(int level);
+void CalculateMagnitudeSpan(fftw_complex *spectrum, double *magnitudes, long int count, double factor);
+void CalculatePhaseSpan(fftw_complex *spectrum, double *phases, long int count);
+void CalculateAmplitudeSpan(double *magnitudes, double *amplitudes, long int count, double MaxMagnitude);
+
+int SelectPCMConverter(pcmConverter *converter, int audioFormat, int bitsPerSample, int channels);
+void ConvertPCM(pcmConverter *converter, const uint8_t *bytes, long int count, double *samples);
+void ConvertPCMPlanar(pcmConverter *converter, const uint8_t *bytes, long int frames, double *left, double *right);
+void ConvertInt32Interleave(const int32_t *left, const int32_t *right, long int frames, double *samples);
+void DeinterleaveSamples(const double *samples, long int frames, double *left, double *right, double *mid);
+
+#endif
@@ -34,9 +34,23 @@
 #include "loadfile.h"
 #include "profile.h"
 #include "sync.h"
+#include "kernels.h"
+#include "pcmcache.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WAV_LOAD_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define WAV_LOAD_CHUNK	(8*1024*1024)
 
 int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 {
+	int			useCache = 0, cached = 0;
+	uint64_t	cacheKey = 0, fileSize = 0;
+
 	*Signal = CreateAudioSignal(config);
 	if(!*Signal)
 		return 0;
@@ -44,7 +58,19 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 
 	logmsg("\n* Loading '%s' audio file %s\n", role == ROLE_REF ? "Reference" : "Comparison", fileName);
 
-	if(IsFlac(fileName))
+	if(config->pcmCachePath[0])
+	{
+		useCache = GetPCMCacheKey(fileName, &cacheKey, &fileSize);
+		if(useCache)
+			cached = LoadPCMCache(*Signal, cacheKey, fileSize, config);
+	}
+
+	if(cached)
+	{
+		if(config->verbose)
+			logmsg(" - Using decoded samples from the PCM cache\n");
+	}
+	else if(IsFlac(fileName))
 	{
 		struct	timespec	start, end;
 
@@ -52,7 +78,7 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 			clock_gettime(CLOCK_MONOTONIC, &start);
 
 		if(config->verbose) { logmsg(" - Decoding FLAC\n"); }
-		if(!FLACtoSignal(fileName, *Signal))
+		if(!FLACtoSignal(fileName, *Signal, config->flacSlices))
 		{
 			char *error  = NULL;
 
@@ -94,9 +120,16 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 		file = NULL;
 	}
 
+	// a failed write only costs the next run the decode again
+	if(useCache && !cached)
+		SavePCMCache(*Signal, cacheKey, fileSize, config);
+
 	if(!AdjustSignalValues(*Signal, config))
 		return 0;
 
+	if(!CreatePlanarSamples(*Signal, config))
+		return 0;
+
 	sprintf((*Signal)->SourceFile, "%s", fileName);
 
 	if(!DetectSync(*Signal, config))
@@ -104,32 +137,133 @@ int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config)
 	return 1;
 }
 
-// no endianess considerations, PCM in RIFF is little endian and this code is little endian
-void ConvertByteArrayToIEEE32Sample(const void *buf, void *target)
+/*
+	Transforms and sync detection read one channel at a time, so each channel
+	is also kept in its own contiguous buffer. Samples stays interleaved and
+	is the one that gets moved and scaled, UpdatePlanarSamples must be called
+	for any range that changes. Mono files just point to Samples.
+	Once nothing else moves or scales them, ReleaseInterleavedSamples leaves
+	only the planar copies.
+*/
+int CreatePlanarSamples(AudioSignal *Signal, parameters *config)
+{
+	long int	frames = 0;
+	int			i = 0, mid = 0;
+
+	// already mapped from the PCM cache
+	if(Signal->Planar[PLANAR_LEFT])
+		return 1;
+
+	if(Signal->AudioChannels == 1)
+	{
+		Signal->Planar[PLANAR_LEFT] = Signal->Samples;
+		Signal->Planar[PLANAR_MID] = Signal->Samples;
+		return 1;
+	}
+
+	// Anything that is not a stereo block is analyzed as (L+R)/2
+	mid = config->clkMeasure;
+	for(i = 0; i < config->types.typeCount; i++)
+	{
+		if(config->types.typeArray[i].channel != CHANNEL_STEREO ||
+			config->types.typeArray[i].type == TYPE_INTERNAL_KNOWN ||
+			config->types.typeArray[i].type == TYPE_INTERNAL_UNKNOWN)
+			mid = 1;
+	}
+
+	frames = Signal->numSamples/Signal->AudioChannels;
+	for(i = 0; i < PLANAR_COUNT; i++)
+	{
+		if(i == PLANAR_MID && !mid)
+			break;
+
+		Signal->Planar[i] = (double*)malloc(sizeof(double)*(frames+1));
+		if(!Signal->Planar[i])
+		{
+			logmsg("\tERROR: Planar sample array malloc failed! [Signal->numSamples]\n");
+			return 0;
+		}
+	}
+
+	UpdatePlanarSamples(Signal, 0, Signal->numSamples);
+	return 1;
+}
+
+/* pos and size are in interleaved samples, as used everywhere else */
+void UpdatePlanarSamples(AudioSignal *Signal, long int pos, long int size)
+{
+	if(Signal->AudioChannels == 1 || !Signal->Planar[PLANAR_LEFT] || !Signal->Samples)
+		return;
+
+	if(pos < 0)
+		pos = 0;
+	if(pos + size > Signal->numSamples)
+		size = Signal->numSamples - pos;
+	if(size <= 0)
+		return;
+
+	// round outwards to whole frames
+	size = (pos + size + Signal->AudioChannels - 1)/Signal->AudioChannels;
+	pos /= Signal->AudioChannels;
+	size -= pos;
+	if(pos + size > Signal->numSamples/Signal->AudioChannels)
+		size = Signal->numSamples/Signal->AudioChannels - pos;
+	DeinterleaveSamples(Signal->Samples + pos*Signal->AudioChannels, size,
+		Signal->Planar[PLANAR_LEFT] + pos, Signal->Planar[PLANAR_RIGHT] + pos,
+		Signal->Planar[PLANAR_MID] ? Signal->Planar[PLANAR_MID] + pos : NULL);
+}
+
+/*
+	The DFFTs only read the planar channels, a stereo file would otherwise
+	carry its samples twice (two and a half times with the mid channel)
+	through the whole analysis. Mono files have a single buffer for both.
+*/
+void ReleaseInterleavedSamples(AudioSignal *Signal)
+{
+	if(!Signal || !Signal->Samples || Signal->AudioChannels == 1 || !Signal->Planar[PLANAR_LEFT])
+		return;
+
+	if(Signal->mappedPCM)
+	{
+		DiscardPCMCacheSamples(Signal);
+		return;
+	}
+
+	free(Signal->Samples);
+	Signal->Samples = NULL;
+}
+
+// pos is in interleaved samples, returns NULL if the channel is not kept
+double *GetPlanarSamples(AudioSignal *Signal, int channel, long int pos)
 {
-	const unsigned char *b = (const unsigned char *)buf;
-	unsigned char *t = (unsigned char *)target;
+	if(!Signal->Planar[channel])
+		return NULL;
+	return(Signal->Planar[channel] + pos/Signal->AudioChannels);
+}
+
+/*
+	Views into the loaded signal, pos and size are in interleaved samples and
+	the view size is per channel. Planar views are contiguous, interleaved ones
+	point to Samples, where the channels are AudioChannels apart.
+*/
+blockView GetBlockView(AudioSignal *Signal, int channel, long int pos, long int size)
+{
+	blockView	view;
 
-	t[0] = b[0];
-	t[1] = b[1];
-	t[2] = b[2];
-	t[3] = b[3];
+	view.samples = GetPlanarSamples(Signal, channel, pos);
+	view.size = size/Signal->AudioChannels;
+	view.stride = 1;
+	return view;
 }
 
-// no endianess considerations, PCM in RIFF is little endian and this code is little endian
-void ConvertByteArrayToIEEE64Sample(const void *buf, void *target)
+blockView GetInterleavedView(AudioSignal *Signal, long int pos, long int size)
 {
-	const unsigned char *b = (const unsigned char *)buf;
-	unsigned char *t = (unsigned char *)target;
-
-	t[0] = b[0];
-	t[1] = b[1];
-	t[2] = b[2];
-	t[3] = b[3];
-	t[4] = b[4];
-	t[5] = b[5];
-	t[6] = b[6];
-	t[7] = b[7];
+	blockView	view;
+
+	view.samples = Signal->Samples + pos;
+	view.size = size/Signal->AudioChannels;
+	view.stride = Signal->AudioChannels;
+	return view;
 }
 
 // For future(?) Endianess compatibility
@@ -196,13 +330,131 @@ int CheckFactChunk(FILE *file, AudioSignal *Signal)
 	return 1;
 }
 
+#ifdef WAV_LOAD_MMAP
+/*
+	Maps the data chunk and converts it WAV_LOAD_CHUNK bytes at a time,
+	pages already converted are dropped so resident memory stays bounded
+	by the chunk size plus the sample array.
+*/
+int LoadWAVSamplesMapped(FILE *file, AudioSignal *Signal, pcmConverter *converter, long int byteOffset, long int dataBytes)
+{
+	struct stat	st;
+	uint8_t		*mapped = NULL, *data = NULL;
+	long int	pageSize = 0, mapOffset = 0, mapSize = 0, chunkSamples = 0, samplePos = 0;
+
+	if(fstat(fileno(file), &st) != 0)
+		return -1;
+
+	if(byteOffset + dataBytes > (long int)st.st_size)
+	{
+		logmsg("\tERROR: Corrupt RIFF Header\n\tCould not read the whole sample block from disk to RAM.\n\tBytes Read: %ld Expected: %ld\n",
+			(long int)st.st_size - byteOffset, dataBytes);
+		return 0;
+	}
+
+	pageSize = sysconf(_SC_PAGESIZE);
+	if(pageSize <= 0)
+		return -1;
+	mapOffset = byteOffset - byteOffset % pageSize;
+	mapSize = byteOffset + dataBytes - mapOffset;
+
+	mapped = (uint8_t*)mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fileno(file), mapOffset);
+	if(mapped == MAP_FAILED)
+		return -1;
+	madvise(mapped, mapSize, MADV_SEQUENTIAL);
+
+	data = mapped + (byteOffset - mapOffset);
+	chunkSamples = WAV_LOAD_CHUNK/Signal->bytesPerSample;
+	for(samplePos = 0; samplePos < Signal->numSamples; samplePos += chunkSamples)
+	{
+		long int	count = 0, done = 0;
+
+		count = Signal->numSamples - samplePos;
+		if(count > chunkSamples)
+			count = chunkSamples;
+
+		ConvertPCM(converter, data + samplePos*Signal->bytesPerSample, count, Signal->Samples + samplePos);
+
+		done = (data - mapped) + (samplePos + count)*Signal->bytesPerSample;
+		done -= done % pageSize;
+		if(done)
+			madvise(mapped, done, MADV_DONTNEED);
+	}
+
+	munmap(mapped, mapSize);
+	return 1;
+}
+#endif
+
+/* Fallback when the file can't be mapped, reads bounded chunks */
+int LoadWAVSamplesChunked(FILE *file, AudioSignal *Signal, pcmConverter *converter, long int byteOffset, long int dataBytes)
+{
+	uint8_t		*fileBytes = NULL;
+	long int	chunkSamples = 0, samplePos = 0;
+
+	if(fseek(file, byteOffset, SEEK_SET) != 0)
+		return 0;
+
+	chunkSamples = WAV_LOAD_CHUNK/Signal->bytesPerSample;
+	fileBytes = (uint8_t*)malloc(sizeof(uint8_t)*chunkSamples*Signal->bytesPerSample);
+	if(!fileBytes)
+	{
+		logmsg("\tERROR: All Chunks malloc failed! [WAV_LOAD_CHUNK]\n");
+		return(0);
+	}
+
+	for(samplePos = 0; samplePos < Signal->numSamples; samplePos += chunkSamples)
+	{
+		long int	count = 0;
+		size_t		bytesRead = 0;
+
+		count = Signal->numSamples - samplePos;
+		if(count > chunkSamples)
+			count = chunkSamples;
+
+		bytesRead = fread(fileBytes, 1, sizeof(uint8_t)*count*Signal->bytesPerSample, file);
+		if(bytesRead != sizeof(uint8_t)*count*Signal->bytesPerSample)
+		{
+			free(fileBytes);
+			logmsg("\tERROR: Corrupt RIFF Header\n\tCould not read the whole sample block from disk to RAM.\n\tBytes Read: %ld Expected: %ld\n",
+				samplePos*Signal->bytesPerSample + (long int)bytesRead, dataBytes);
+			return(0);
+		}
+
+		ConvertPCM(converter, fileBytes, count, Signal->Samples + samplePos);
+	}
+
+	free(fileBytes);
+	return 1;
+}
+
+int LoadWAVSamples(FILE *file, AudioSignal *Signal, long int byteOffset)
+{
+	long int		dataBytes = 0;
+	pcmConverter	converter;
+
+	// selected once for the whole file
+	if(!SelectPCMConverter(&converter, Signal->header.fmt.AudioFormat, Signal->header.fmt.bitsPerSample, Signal->AudioChannels))
+		return 0;
+
+	dataBytes = Signal->numSamples*Signal->bytesPerSample;
+#ifdef WAV_LOAD_MMAP
+	{
+		int	loaded = 0;
+
+		loaded = LoadWAVSamplesMapped(file, Signal, &converter, byteOffset, dataBytes);
+		if(loaded != -1)
+			return loaded;
+	}
+#endif
+	return(LoadWAVSamplesChunked(file, Signal, &converter, byteOffset, dataBytes));
+}
+
 int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config)
 {
-	int					found = 0, samplesLoaded = 0, validformat = 0;
-	size_t				bytesRead = 0;
+	int					found = 0, validformat = 0;
 	struct timespec		start, end;
-	long int			samplePos = 0, srcPos = 0, byteOffset = 0;
-	uint8_t				*fileBytes = NULL;
+	long int			byteOffset = 0;
 
 	if(config->clock)
 		clock_gettime(CLOCK_MONOTONIC, &start);
@@ -400,38 +652,17 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config)
 	byteOffset = ftell(file);
 	Signal->SamplesStart = byteOffset;
 
-	fileBytes = (uint8_t*)malloc(sizeof(uint8_t)*Signal->header.data.DataSize);
-	if(!fileBytes)
-	{
-		logmsg("\tERROR: All Chunks malloc failed! [Signal->header.data.DataSize]\n");
-		return(0);
-	}
-
-	memset(fileBytes, 0, sizeof(uint8_t)*Signal->header.data.DataSize);
-
-	bytesRead = fread(fileBytes, 1, sizeof(uint8_t)*Signal->header.data.DataSize, file);
-	if(bytesRead != sizeof(uint8_t)*Signal->header.data.DataSize)
-	{
-		free(fileBytes);
-		logmsg("\tERROR: Corrupt RIFF Header\n\tCould not read the whole sample block from disk to RAM.\n\tBytes Read: %ld Expected: %ld\n",
-			bytesRead, sizeof(int8_t)*Signal->header.data.DataSize);
-		return(0);
-	}
-
 	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_EXTENSIBLE)
 	{
-		if(!CheckFactChunk(file, Signal))
-		{
-			free(fileBytes);
+		// the fact chunk follows the samples
+		if(fseek(file, Signal->header.data.DataSize, SEEK_CUR) != 0 || !CheckFactChunk(file, Signal))
 			return 0;
-		}
 		validformat = 1;
 	}
 
 	if(Signal->header.fmt.AudioFormat != WAVE_FORMAT_PCM && /* If fact chunk check didn't remove EXTENSIBLE... */
 		Signal->header.fmt.AudioFormat != WAVE_FORMAT_IEEE_FLOAT)
 	{
-		free(fileBytes);
 		logmsg("\tERROR: Only 8/16/24/32bit PCM or 32/64 bit IEEE float supported.\n\tPlease convert file sample format.\n");
 		return(0);
 	}
@@ -440,89 +671,12 @@ int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config)
 	Signal->Samples = (double*)malloc(sizeof(double)*Signal->numSamples);
 	if(!Signal->Samples)
 	{
-		free(fileBytes);
 		logmsg("\tERROR: Internal sample array malloc failed! [Signal->numSamples]\n");
 		return(0);
 	}
-	memset(Signal->Samples, 0, sizeof(double)*Signal->numSamples);
-
-	// no endianess considerations, PCM in RIFF is little endian and this code is little endian
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_PCM)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			int32_t	sample = 0;
-			int8_t	signSample = 0;
-	
-			switch(Signal->bytesPerSample)
-			{
-				case 1:
-					sample = fileBytes[srcPos]-0x80;	// 8 bit is unsigned. Convert to signed
-					break;
-				case 2:
-					signSample = fileBytes[srcPos+1];
-					if(signSample < 0)
-						sample = 0xffff0000;
-					sample |= (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				case 3:
-					signSample = fileBytes[srcPos+2];
-					if(signSample < 0)
-						sample = 0xff000000;
-					sample |= (fileBytes[srcPos+2] << 16) | (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				case 4:
-					sample = (fileBytes[srcPos+3] << 24) | (fileBytes[srcPos+2] << 16) | (fileBytes[srcPos+1] << 8) | fileBytes[srcPos];
-					break;
-				default:
-					logmsg("ERROR: Unsupported audio format (bytes sample %d)\n", Signal->bytesPerSample);
-					free(fileBytes);
-					return 0;
-			}
-			srcPos += Signal->bytesPerSample;
-	
-			Signal->Samples[samplePos] = (double)sample;
-		}
-
-		samplesLoaded = 1;
-	}
-
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT && Signal->header.fmt.bitsPerSample == 32)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			float	sample = 0;
-	
-			ConvertByteArrayToIEEE32Sample(fileBytes+srcPos, &sample);
-			Signal->Samples[samplePos] = (double)sample;
-			srcPos += 4;
-		}
-
-		samplesLoaded = 1;
-	}
-
-	if(Signal->header.fmt.AudioFormat == WAVE_FORMAT_IEEE_FLOAT && Signal->header.fmt.bitsPerSample == 64)
-	{
-		for(samplePos = 0; samplePos < Signal->numSamples; samplePos++)
-		{
-			double	sample = 0;
-	
-			ConvertByteArrayToIEEE64Sample(fileBytes+srcPos, &sample);
-			Signal->Samples[samplePos] = (double)sample;
-			srcPos += 8;
-		}
-
-		samplesLoaded = 1;
-	}
-
-	free(fileBytes);
-	fileBytes = NULL;
 
-	if(!samplesLoaded)
-	{
-		logmsg("ERROR: Unsupported audio format, samples were not loaded\n");
+	if(!LoadWAVSamples(file, Signal, byteOffset))
 		return 0;
-	}
 
 	if(config->clock)
 	{
@@ -607,7 +761,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 		if(config->verbose) { 
 			logmsg(" - Sync pulse train: "); 
 		}
-		Signal->startOffset = DetectPulse(Signal->Samples, Signal->header, Signal->role, config);
+		Signal->startOffset = DetectPulse(Signal->Planar[PLANAR_LEFT], Signal->header, Signal->role, config);
 		if(Signal->startOffset == -1)
 		{
 			int format = 0;
@@ -632,8 +786,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				logmsg(" - Leading/tailing silence too long, if sync detection fails please consider trimming\n");
 			return 0;
 		}
-		config->syncAlignIterator++;
-		
+
 		if(config->verbose || config->debugSync) {
 			logmsg("\n\t   %gs [%ld samples", 
 				SamplesToSeconds(Signal->SampleRate, Signal->startOffset, Signal->AudioChannels),
@@ -652,7 +805,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 			if(config->verbose) { 
 				logmsg("\t to");
 			}
-			Signal->endOffset = DetectEndPulse(Signal->Samples, Signal->startOffset, Signal->header, Signal->role, config);
+			Signal->endOffset = DetectEndPulse(Signal->Planar[PLANAR_LEFT], Signal->startOffset, Signal->header, Signal->role, config);
 			if(Signal->endOffset == -1)
 			{
 				int format = 0;
@@ -670,8 +823,6 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				return 0;
 			}
 
-			config->syncAlignIterator++;
-
 			if(config->verbose) {
 				logmsg(" %gs [%ld samples", 
 					SamplesToSeconds(Signal->SampleRate, Signal->endOffset, Signal->AudioChannels),
@@ -736,7 +887,7 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 				/* Find the start offset */
 				
 				logmsg(" - Detecting audio signal: ");
-				Signal->startOffset = DetectSignalStart(Signal->Samples, Signal->header, 0, 0, 0, NULL, NULL, config);
+				Signal->startOffset = DetectSignalStart(Signal->Planar[PLANAR_LEFT], Signal->header, 0, 0, 0, NULL, NULL, config);
 				if(Signal->startOffset == -1)
 				{
 					logmsg("\nERROR: Starting position was not detected.\n");
@@ -853,6 +1004,9 @@ int DetectSync(AudioSignal *Signal, parameters *config)
 										GetSignalTotalDuration(Signal->framerate, config), 
 										Signal->AudioChannels, NULL, NULL);
 			}
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic write
+#endif
 			config->significantAmplitude = -90;
 			break;
 			default:
@@ -908,6 +1062,9 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 	{
 		logmsg(" - WARNING: Estimated file length is shorter than the expected %g seconds\n",
 				GetSignalTotalDuration(Signal->framerate, config));
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic
+#endif
 		config->smallFile |= Signal->role;
 	}
 
@@ -915,6 +1072,9 @@ int AdjustSignalValues(AudioSignal *Signal, parameters *config)
 	{
 		if(!config->allowStereoVsMono)
 		{
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic
+#endif
 			config->stereoNotFound |= Signal->role;
 			logmsg(" - ERROR: Profile requests Stereo and file is Mono\n");
 			return 0;
@@ -983,6 +1143,8 @@ int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos,
 	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(double));
 	memset(Signal->Samples + pos + signalStartOffset, 0, signalLengthSamples*sizeof(double));
 	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(double));
+	UpdatePlanarSamples(Signal, pos + signalStartOffset, signalLengthSamples);
+	UpdatePlanarSamples(Signal, pos, signalLengthSamples);
 
 	free(sampleBuffer);
 	return 1;
@@ -1045,6 +1207,7 @@ int MoveSampleBlockExternal(AudioSignal *Signal, long int element, long int pos,
 	memcpy(sampleBuffer, Signal->Samples + pos + signalStartOffset, signalLengthSamples*sizeof(double));
 	memset(Signal->Samples + pos, 0, (Signal->numSamples-pos)*sizeof(double));
 	memcpy(Signal->Samples + pos, sampleBuffer, signalLengthSamples*sizeof(double));
+	UpdatePlanarSamples(Signal, pos, Signal->numSamples-pos);
 
 	free(sampleBuffer);
 	return 1;
@@ -1075,7 +1238,7 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	syncLengthSamples = SecondsToSamples(Signal->SampleRate, syncLenSeconds, Signal->AudioChannels, NULL, NULL);
 
 	// we send , syncLengthSamples/2 since it is half silence half pulse
-	internalSyncOffset = DetectSignalStart(Signal->Samples, Signal->header, pos, syncToneFreq, syncLengthSamples/2, &endPulseSamples, &toleranceIssue, config);
+	internalSyncOffset = DetectSignalStart(Signal->Planar[PLANAR_LEFT], Signal->header, pos, syncToneFreq, syncLengthSamples/2, &endPulseSamples, &toleranceIssue, config);
 	if(internalSyncOffset == -1)
 	{
 		logmsg("\tERROR: No signal found while in internal sync detection.\n");
@@ -1084,7 +1247,12 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	*syncinternal = 1;
 
 	if(toleranceIssue)
+	{
+#ifdef OPENMP_ENABLE
+		#pragma omp atomic
+#endif
 		config->internalSyncTolerance |= Signal->role;
+	}
 	
 	pulseLengthSamples = endPulseSamples - internalSyncOffset;
 	internalSyncOffset -= pos;
@@ -1133,19 +1301,19 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 				return 0;
 		
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos), 
 					internalSyncOffset, 0, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos + internalSyncOffset), 
 					pulseLengthSamples, 1, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset + pulseLengthSamples), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos + internalSyncOffset + pulseLengthSamples), 
 					syncLengthSamples/2, 2, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
@@ -1218,19 +1386,19 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 				return 0;
 		
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos), 
 					internalSyncOffset, 0, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos + internalSyncOffset), 
 					pulseLengthSamples, 1, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
 
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + internalSyncOffset + pulseLengthSamples), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos + internalSyncOffset + pulseLengthSamples), 
 					silenceLengthSamples/2, 2, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
@@ -1238,7 +1406,7 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 			/*
 			oneframe = SecondsToSamples(Signal->SampleRate, FramesToSeconds(1, config->referenceFramerate), Signal->AudioChannels, NULL, NULL);
 			if(!CopySamplesForTimeDomainPlotInternalSync(&Signal->Blocks[element], 
-					(Signal->Samples + pos + signalStart), 
+					GetPlanarSamples(Signal, PLANAR_MID, pos + signalStart), 
 					(oneframe*2), 3, 
 					NULL, Signal->AudioChannels, config))
 				return 0;
@@ -1259,9 +1427,9 @@ int ProcessInternalSync(AudioSignal *Signal, long int element, long int pos, int
 	return 1;
 }
 
+/* samples is the mono or (L+R)/2 planar channel, size counts all channels */
 int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *samples, size_t size, int slotForSamples, double *window, int AudioChannels, parameters *config)
 {
-	char			channel = 0;
 	long			stereoSignalSize = 0;	
 	long			i = 0, monoSignalSize = 0;
 	double			*signal = NULL, *windowed_samples = NULL;
@@ -1312,20 +1480,7 @@ int CopySamplesForTimeDomainPlotInternalSync(AudioBlocks *AudioArray, double *sa
 		memset(windowed_samples, 0, sizeof(double)*(monoSignalSize+1));
 	}
 
-	if(AudioChannels == 1)
-		channel = CHANNEL_LEFT;
-	else
-		channel = CHANNEL_STEREO;
-
-	for(i = 0; i < monoSignalSize; i++)
-	{
-		if(channel == CHANNEL_LEFT)
-			signal[i] = (double)samples[i*AudioChannels];
-		if(channel == CHANNEL_RIGHT)
-			signal[i] = (double)samples[i*AudioChannels+1];
-		if(channel == CHANNEL_STEREO)
-			signal[i] = (double)((double)samples[i*AudioChannels]+(double)samples[i*AudioChannels+1])/2.0;
-	}
+	memcpy(signal, samples, sizeof(double)*monoSignalSize);
 
 	AudioArray->internalSync[slotForSamples].samples = signal;
 	AudioArray->internalSync[slotForSamples].size = monoSignalSize;
@@ -30,8 +30,15 @@
 
 int LoadFile(AudioSignal **Signal, char *fileName, int role, parameters *config);
 int LoadWAVFile(FILE *file, AudioSignal *Signal, parameters *config);
+int LoadWAVSamples(FILE *file, AudioSignal *Signal, long int byteOffset);
 int DetectSync(AudioSignal *Signal, parameters *config);
 int AdjustSignalValues(AudioSignal *Signal, parameters *config);
+int CreatePlanarSamples(AudioSignal *Signal, parameters *config);
+void UpdatePlanarSamples(AudioSignal *Signal, long int pos, long int size);
+void ReleaseInterleavedSamples(AudioSignal *Signal);
+double *GetPlanarSamples(AudioSignal *Signal, int channel, long int pos);
+blockView GetBlockView(AudioSignal *Signal, int channel, long int pos, long int size);
+blockView GetInterleavedView(AudioSignal *Signal, long int pos, long int size);
 
 /* Functions that deal with samples */
 int MoveSampleBlockInternal(AudioSignal *Signal, long int element, long int pos, long int signalStartOffset, parameters *config);
@@ -33,10 +33,30 @@
 
 #define	CONSOLE_ENABLED		1
 
+#define	LOG_CAPTURE_CHUNK	4096
+#define	LOG_CAPTURE_ALL		'a'
+#define	LOG_CAPTURE_FILE	'f'
+#define	LOG_CAPTURE_DEPTH	4
+
 int do_log = 0;
 char log_file[T_BUFFER_SIZE];
 FILE *logfile = NULL;
 
+/*
+	Per thread capture, used while reference and comparison are processed
+	concurrently. Captures nest: a comparison running as a task captures its
+	whole output, and the loads and plots inside it capture theirs on top.
+*/
+char *logCapture = NULL;
+size_t logCaptureLen = 0, logCaptureMax = 0;
+char *logCaptureSaved[LOG_CAPTURE_DEPTH];
+size_t logCaptureSavedLen[LOG_CAPTURE_DEPTH], logCaptureSavedMax[LOG_CAPTURE_DEPTH];
+int logCaptureDepth = 0;
+#ifdef OPENMP_ENABLE
+	#pragma omp threadprivate(logCapture, logCaptureLen, logCaptureMax)
+	#pragma omp threadprivate(logCaptureSaved, logCaptureSavedLen, logCaptureSavedMax, logCaptureDepth)
+#endif
+
 void EnableLog(void) { do_log = CONSOLE_ENABLED; }
 void DisableLog(void) { do_log = 0; }
 int IsLogEnabled(void) { return do_log; }
@@ -47,10 +67,131 @@ void initLog(void)
 	logfile = NULL;
 }
 
+// Each entry is stored as a type byte followed by the null terminated text,
+// always leaving room for the empty entry that terminates the list
+void logCaptureAppend(char type, char *fmt, va_list arguments)
+{
+	int		len = 0;
+	va_list	arguments_c;
+
+	va_copy(arguments_c, arguments);
+	len = vsnprintf(NULL, 0, fmt, arguments_c);
+	va_end(arguments_c);
+	if(len < 0)
+		return;
+
+	if(logCaptureLen + len + 3 > logCaptureMax)
+	{
+		char	*newCapture = NULL;
+		size_t	newMax = 0;
+
+		newMax = logCaptureMax + len + 3 + LOG_CAPTURE_CHUNK;
+		newCapture = (char*)realloc(logCapture, sizeof(char)*newMax);
+		if(!newCapture)
+			return;
+		logCapture = newCapture;
+		logCaptureMax = newMax;
+	}
+
+	logCapture[logCaptureLen++] = type;
+	vsnprintf(logCapture + logCaptureLen, len + 1, fmt, arguments);
+	logCaptureLen += len + 1;
+}
+
+int StartLogCapture(void)
+{
+	char	*newCapture = NULL;
+
+	newCapture = (char*)malloc(sizeof(char)*LOG_CAPTURE_CHUNK);
+	if(!newCapture)
+		return 0;
+
+	if(logCapture)
+	{
+		if(logCaptureDepth == LOG_CAPTURE_DEPTH)
+		{
+			free(newCapture);
+			return 0;
+		}
+		logCaptureSaved[logCaptureDepth] = logCapture;
+		logCaptureSavedLen[logCaptureDepth] = logCaptureLen;
+		logCaptureSavedMax[logCaptureDepth] = logCaptureMax;
+		logCaptureDepth++;
+	}
+
+	logCapture = newCapture;
+	logCaptureLen = 0;
+	logCaptureMax = LOG_CAPTURE_CHUNK;
+	return 1;
+}
+
+char *EndLogCapture(void)
+{
+	char *captured = NULL;
+
+	if(!logCapture)
+		return NULL;
+
+	logCapture[logCaptureLen] = '\0';
+	captured = logCapture;
+
+	logCapture = NULL;
+	logCaptureLen = 0;
+	logCaptureMax = 0;
+
+	// Back to the capture this one was started on top of
+	if(logCaptureDepth)
+	{
+		logCaptureDepth--;
+		logCapture = logCaptureSaved[logCaptureDepth];
+		logCaptureLen = logCaptureSavedLen[logCaptureDepth];
+		logCaptureMax = logCaptureSavedMax[logCaptureDepth];
+	}
+	return captured;
+}
+
+// Writes a capture again without releasing it, fileOnly keeps it off the console
+void ReplayLogCapture(char *captured, int fileOnly)
+{
+	char *entry = NULL;
+
+	if(!captured)
+		return;
+
+	entry = captured;
+	while(*entry)
+	{
+		char type = *entry++;
+
+		if(type == LOG_CAPTURE_ALL && !fileOnly)
+			logmsg("%s", entry);
+		else
+			logmsgFileOnly("%s", entry);
+		entry += strlen(entry) + 1;
+	}
+}
+
+void FlushLogCapture(char *captured)
+{
+	if(!captured)
+		return;
+
+	ReplayLogCapture(captured, 0);
+	free(captured);
+}
+
 void logmsg(char *fmt, ... )
 {
 	va_list arguments;
 
+	if(logCapture)
+	{
+		va_start(arguments, fmt);
+		logCaptureAppend(LOG_CAPTURE_ALL, fmt, arguments);
+		va_end(arguments);
+		return;
+	}
+
 	va_start(arguments, fmt);
 	vprintf(fmt, arguments);
 	fflush(stdout);  // output to Front end ASAP
@@ -71,6 +212,16 @@ void logmsg(char *fmt, ... )
 
 void logmsgFileOnly(char *fmt, ... )
 {
+	if(logCapture)
+	{
+		va_list arguments;
+
+		va_start(arguments, fmt);
+		logCaptureAppend(LOG_CAPTURE_FILE, fmt, arguments);
+		va_end(arguments);
+		return;
+	}
+
 	if(do_log && logfile)
 	{
 		va_list arguments;
@@ -160,7 +311,7 @@ int SaveWAVEChunk(char *filename, AudioSignal *Signal, double *buffer, long int
 {
 	FILE 		*chunk = NULL;
 	wav_hdr		cheader;
-	char 		*samples = NULL, FName[4096];
+	char 		*samples = NULL, FName[BUFFER_SIZE*4];
 	long int	i = 0;
 	int			convertedSamples = 0;
 
@@ -39,6 +39,11 @@ int IsLogEnabled(void);
 void logmsg(char *fmt, ... );
 void logmsgFileOnly(char *fmt, ... );
 
+int StartLogCapture(void);
+char *EndLogCapture(void);
+void FlushLogCapture(char *captured);
+void ReplayLogCapture(char *captured, int fileOnly);
+
 int setLogName(char *name);
 void endLog(void);
 
@@ -37,13 +37,37 @@
 #include "balance.h"
 #include "loadfile.h"
 #include "profile.h"
+#include "plans.h"
+#include "kernels.h"
+#include "arena.h"
+#include "refcache.h"
+#include "serve.h"
+
+#ifdef OPENMP_ENABLE
+#include <omp.h>
+#endif
 
 int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 int ProcessSignal(AudioSignal *Signal, parameters *config);
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, int AudioChannels, int ZeroPad, parameters *config);
+int ProcessSignalBlock(AudioSignal *Signal, long int block, double *windowUsed, float *windowFloat, double *deviation, parameters *config);
+int ValidateFloatBlock(AudioSignal *Signal, long int block, float *windowFloat, double *deviation, parameters *config);
+double GetSpectrumDeviation(FFTWSpectrum *reference, FFTWSpectrum *test, double significant);
+void ReportFloatDeviation(double *deviation, long int processed, parameters *config);
+int ProcessSignalCLK(AudioSignal *Signal, double framerate, parameters *config);
+int ProcessSignalBatch(AudioSignal *Signal, dfftBatch *batch, double **windowArray, float **windowFloatArray, double *deviation, parameters *config);
+dfftBatch *CreateDFFTBatches(AudioSignal *Signal, long int processed, int *batchCount, parameters *config);
+int ExecuteDFFTBatch(AudioSignal *Signal, dfftBatch *batch, double **windowArray, parameters *config);
+int ExecuteDFFT(AudioBlocks *AudioArray, AudioSignal *Signal, long int offset, size_t size, double *window, int ZeroPad, parameters *config);
 int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, char channel, int AudioChannels, int ZeroPad, parameters *config);
+int ExecuteDFFTStereo(AudioBlocks *AudioArray, double *left, double *right, size_t size, double samplerate, double *window, int ZeroPad, parameters *config);
+long int GetDFFTSize(size_t size, double samplerate, int AudioChannels, int ZeroPad, long int *zeropadding, double *seconds, parameters *config);
+int ExecuteDFFTFloat(AudioBlocks *AudioArray, AudioSignal *Signal, long int offset, size_t size, float *window, int ZeroPad, parameters *config);
+int ExecuteDFFTFloatInternal(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, float *window, char channel, int AudioChannels, int ZeroPad, parameters *config);
 int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
-int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_t size, size_t diff, double *window, int AudioChannels, int forcecopy, parameters *config);
+int CompareAudioBlock(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, int block, parameters *config);
+int *CreateFrequencyBinIndex(memoryArena *scratch, Frequency *freq, int size, double boxsize, long int *maxBin);
+int FindFrequencyMatch(Frequency *freqRef, int freq, Frequency *freqComp, int testSize, int *binIndex, long int maxBin, double boxsize);
+int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *left, double *right, size_t size, size_t diff, double *window, int AudioChannels, int forcecopy, parameters *config);
 void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 void NormalizeTimeDomainByFrequencyRatio(AudioSignal *Signal, double normalizationRatio, parameters *config);
 double FindRatio(AudioSignal *Signal, double normalizationRatio, parameters *config);
@@ -59,6 +83,28 @@ int NormalizeAndFinishProcess(AudioSignal **ReferenceSignal, AudioSignal **Compa
 int FrequencyDomainNormalize(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
 void AdjustTimeDomainData(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
 void printTextResults(parameters *config);
+int CompareSignals(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
+void ReleaseSignals(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config);
+int ExecuteBatchComparisons(parameters *config);
+int CreateBatchComparison(batchComparison *comparison, char *file, parameters *config);
+void RunBatchComparison(batchComparison *comparison);
+void ReleaseBatchComparison(batchComparison *comparison);
+int ExecuteBatchComparison(parameters *config);
+int LoadBatchReference(char **referenceLog, parameters *config);
+void RestoreBatchParameters(parameters *snapshot, AudioBlockType *typeArray, parameters *config);
+int CloneReferenceForComparison(AudioSignal **ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+int StoreProcessedReference(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+int IsReferenceReused(parameters *config);
+void ReleaseReferenceCache(parameters *config);
+int ServeComparisons(parameters *config);
+serveTemplate *GetServeTemplate(serveTemplate **templates, serveJob *job);
+serveTemplate *CreateServeTemplate(serveJob *job);
+int IsServeTemplateCurrent(serveTemplate *Template, serveJob *job);
+size_t GetServeTemplateMemory(serveTemplate *Template);
+size_t GetServeResidentMemory(serveTemplate *templates);
+void EvictServeTemplates(serveTemplate **templates, size_t budget);
+void ReleaseServeTemplate(serveTemplate *Template);
+void RunServeJob(serveTemplate *Template, serveJob *job);
 
 // Time domain
 MaxSample FindMaxSampleAmplitude(AudioSignal *Signal);
@@ -90,76 +136,80 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
-
-	if(!SetupFolders(config.outputFolder, "Log", &config))
+	if(config.trainWisdom)
 	{
-		logmsg("Aborting\n");
-		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
-		return 1;
-	}
+		int trained = 0;
 
-	if(!EndProfileLoad(&config))
-	{
-		logmsg("Aborting\n");
+		if(EndProfileLoad(&config))
+			trained = TrainWisdom(&config);
 		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
-		return 1;
+		fftw_cleanup();
+		return trained ? 0 : 1;
 	}
 
-	if(strcmp(config.referenceFile, config.comparisonFile) == 0)
+	if(config.serveSocket[0])
 	{
+		int served = 0;
+
+		served = ServeComparisons(&config);
 		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
-		logmsg("Both inputs are the same file %s, skipping to save time\n",
-			 config.referenceFile);
-		return 1;
+		fftw_cleanup();
+		return served ? 0 : 1;
 	}
 
-	if(!LoadAndProcessAudioFiles(&ReferenceSignal, &ComparisonSignal, &config))
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if(!SetupFolders(config.outputFolder, "Log", &config))
 	{
 		logmsg("Aborting\n");
-		if(config.debugSync)
-			printf("\nResults stored in %s%s\n",
-				config.outputPath,
-				config.folderName);
 		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
 		return 1;
 	}
 
-	ReleasePCM(ReferenceSignal);
-	ReleasePCM(ComparisonSignal);
-
-	AdjustTimeDomainData(ReferenceSignal, ComparisonSignal, &config);
-
-	logmsg("\n* Comparing frequencies: ");
-	if(!CompareAudioBlocks(ReferenceSignal, ComparisonSignal, &config))
+	if(!EndProfileLoad(&config))
 	{
 		logmsg("Aborting\n");
 		CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
 		return 1;
 	}
 
-	config.averageDifference = FindDifferenceAverage(&config);
-	logmsg("Average difference is %g dB\n", config.averageDifference);
-	if(config.substractAveragePlot)
+	LoadWisdom(&config);
+	SelectKernels(&config);
+
+	if(config.comparisonCount > 1)
 	{
-		config.averageDifferenceOrig = config.averageDifference;
-		SubstractDifferenceAverageFromResults(&config);
-		config.averageDifference = FindDifferenceAverage(&config);
-		logmsg(" - Adjusted plots around average, the new average is %g dB\n", config.averageDifference);
+		if(!ExecuteBatchComparisons(&config))
+		{
+			CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
+			fftw_cleanup();
+			return 1;
+		}
 	}
+	else
+	{
+		if(strcmp(config.referenceFile, config.comparisonFile) == 0)
+		{
+			CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
+			logmsg("Both inputs are the same file %s, skipping to save time\n",
+				 config.referenceFile);
+			return 1;
+		}
 
-	FindViewPort(&config);
-
-	logmsg("* Plotting results to PNGs:\n");
-	PlotResults(ReferenceSignal, ComparisonSignal, &config);
+		if(!CompareSignals(&ReferenceSignal, &ComparisonSignal, &config))
+		{
+			CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
+			return 1;
+		}
 
-	printTextResults(&config);
+		if(IsLogEnabled())
+			endLog();
 
-	if(IsLogEnabled())
-		endLog();
+		if(config.clock)
+			ReportArenas(&config);
 
-	/* Clear up everything */
-	ReleaseDifferenceArray(&config);
+		/* Clear up everything */
+		ReleaseDifferenceArray(&config);
+	}
 
 	CleanUp(&ReferenceSignal, &ComparisonSignal, &config);
 	fftw_cleanup();
@@ -177,13 +227,795 @@ int main(int argc, char *argv[])
 		logmsg("\n");
 	}
 
-	printf("\nResults stored in %s%s\n",
-			config.outputPath,
-			config.folderName);
+	if(config.comparisonCount <= 1)
+		printf("\nResults stored in %s%s\n",
+				config.outputPath,
+				config.folderName);
 
 	return(0);
 }
 
+int CompareSignals(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+{
+	if(!LoadAndProcessAudioFiles(ReferenceSignal, ComparisonSignal, config))
+	{
+		logmsg("Aborting\n");
+		if(config->debugSync)
+			printf("\nResults stored in %s%s\n",
+				config->outputPath,
+				config->folderName);
+		return 0;
+	}
+
+	ReleasePCM(*ReferenceSignal);
+	ReleasePCM(*ComparisonSignal);
+
+	if(config->clock)
+		ReportPlanCache(config);
+
+	AdjustTimeDomainData(*ReferenceSignal, *ComparisonSignal, config);
+
+	logmsg("\n* Comparing frequencies: ");
+	if(!CompareAudioBlocks(*ReferenceSignal, *ComparisonSignal, config))
+	{
+		logmsg("Aborting\n");
+		return 0;
+	}
+
+	config->averageDifference = FindDifferenceAverage(config);
+	logmsg("Average difference is %g dB\n", config->averageDifference);
+	if(config->substractAveragePlot)
+	{
+		config->averageDifferenceOrig = config->averageDifference;
+		SubstractDifferenceAverageFromResults(config);
+		config->averageDifference = FindDifferenceAverage(config);
+		logmsg(" - Adjusted plots around average, the new average is %g dB\n", config->averageDifference);
+	}
+
+	FindViewPort(config);
+
+	logmsg("* Plotting results to PNGs:\n");
+	PlotResults(*ReferenceSignal, *ComparisonSignal, config);
+
+	printTextResults(config);
+	return 1;
+}
+
+/*
+	One reference against many comparisons. The reference is loaded once and
+	its transforms are reused by every comparison that ends up with the same
+	frame rates, normalization only touches a per comparison copy.
+	Comparisons run concurrently as tasks, each with its own parameters,
+	differences, plan cache and arena. Their output is captured and written
+	in order, to the console and to the log of each one, once all are done.
+	Nested regions are not enabled, a comparison runs its parallel stages on
+	the thread that took it.
+*/
+int ExecuteBatchComparisons(parameters *config)
+{
+	referenceCache	cache;
+	batchComparison	*batch = NULL;
+	char			*referenceLog = NULL;
+	int				i = 0, logEnabled = 0, compared = 0, skipped = 0;
+
+	memset(&cache, 0, sizeof(referenceCache));
+	InitArena(&cache.arena, config->arena.hugePages, 0);
+	config->refCache = &cache;
+
+	logEnabled = IsLogEnabled();
+	if(!LoadBatchReference(&referenceLog, config))
+	{
+		ReleaseReferenceCache(config);
+		return 0;
+	}
+
+	batch = (batchComparison*)calloc(config->comparisonCount, sizeof(batchComparison));
+	if(!batch)
+	{
+		logmsg("\tERROR: Not enough memory for batch comparison\n");
+		free(referenceLog);
+		ReleaseReferenceCache(config);
+		return 0;
+	}
+
+	// The first output folder and log were created at start up, the rest are opened when written
+	DisableLog();
+	for(i = 0; i < config->comparisonCount; i++)
+	{
+		if(!CreateBatchComparison(&batch[i], config->comparisonList[i], config))
+		{
+			logmsg("- ERROR: Not enough memory to compare \"%s\", skipping\n", config->comparisonList[i]);
+			continue;
+		}
+		if(i != 0 && !SetupFolders(batch[i].config.outputFolder, "Log", &batch[i].config))
+		{
+			logmsg("- ERROR: Could not create output for \"%s\", skipping\n", config->comparisonList[i]);
+			continue;
+		}
+		batch[i].ready = 1;
+	}
+	if(logEnabled)
+		EnableLog();
+
+#ifdef OPENMP_ENABLE
+	{
+		int workers = 0;
+
+		workers = omp_get_max_threads();
+		if(workers > config->comparisonCount)
+			workers = config->comparisonCount;
+
+		#pragma omp parallel num_threads(workers)
+		#pragma omp single
+		for(i = 0; i < config->comparisonCount; i++)
+		{
+			if(!batch[i].ready)
+				continue;
+			#pragma omp task firstprivate(i)
+			RunBatchComparison(&batch[i]);
+		}
+	}
+#else
+	for(i = 0; i < config->comparisonCount; i++)
+	{
+		if(batch[i].ready)
+			RunBatchComparison(&batch[i]);
+	}
+#endif
+
+	for(i = 0; i < config->comparisonCount; i++)
+	{
+		if(batch[i].ready)
+		{
+			if(i != 0 && logEnabled)
+			{
+				EnableLog();
+				SetupLogFile("Log", &batch[i].config);
+			}
+
+			logmsg("\n* Comparison %d of %d: %s\n", i + 1, config->comparisonCount, batch[i].config.comparisonFile);
+			ReplayLogCapture(referenceLog, i != 0);
+			FlushLogCapture(batch[i].log);
+			batch[i].log = NULL;
+
+			if(IsLogEnabled())
+				endLog();
+
+			if(batch[i].result == BATCH_COMPARED)
+			{
+				compared++;
+				printf("\nResults stored in %s%s\n",
+						batch[i].config.outputPath,
+						batch[i].config.folderName);
+			}
+			if(batch[i].result == BATCH_SKIPPED)
+				skipped++;
+
+			// Wisdom is saved at exit if any of them planned
+			config->plans.hits += batch[i].config.plans.hits;
+			config->plans.misses += batch[i].config.plans.misses;
+		}
+		ReleaseBatchComparison(&batch[i]);
+	}
+
+	logmsg("\n* Compared %d of %d files against the reference", compared, config->comparisonCount);
+	if(skipped)
+		logmsg(", %d skipped", skipped);
+	logmsg("\n");
+
+	free(batch);
+	batch = NULL;
+	free(referenceLog);
+	referenceLog = NULL;
+	ReleaseReferenceCache(config);
+
+	return(compared + skipped == config->comparisonCount);
+}
+
+// Block types are changed while processing, each comparison gets its own
+int CreateBatchComparison(batchComparison *comparison, char *file, parameters *config)
+{
+	AudioBlockType	*typeArray = NULL;
+
+	typeArray = (AudioBlockType*)malloc(sizeof(AudioBlockType)*config->types.typeCount);
+	if(!typeArray)
+		return 0;
+	memcpy(typeArray, config->types.typeArray, sizeof(AudioBlockType)*config->types.typeCount);
+
+	comparison->config = *config;
+	comparison->config.types.typeArray = typeArray;
+	InitPlanCache(&comparison->config.plans);
+	comparison->config.plans.wisdomLoaded = config->plans.wisdomLoaded;
+	InitArena(&comparison->config.arena, config->arena.hugePages, 1);
+	comparison->config.model_plan = NULL;
+	comparison->config.reverse_plan = NULL;
+	sprintf(comparison->config.comparisonFile, "%s", file);
+	comparison->log = NULL;
+	comparison->ready = 0;
+	comparison->result = BATCH_FAILED;
+	return 1;
+}
+
+void RunBatchComparison(batchComparison *comparison)
+{
+	StartLogCapture();
+	comparison->result = ExecuteBatchComparison(&comparison->config);
+	comparison->log = EndLogCapture();
+}
+
+void ReleaseBatchComparison(batchComparison *comparison)
+{
+	if(comparison->log)
+	{
+		free(comparison->log);
+		comparison->log = NULL;
+	}
+	if(comparison->config.types.typeArray)
+	{
+		free(comparison->config.types.typeArray);
+		comparison->config.types.typeArray = NULL;
+	}
+	ReleasePlanCache(&comparison->config.plans);
+	ReleaseArena(&comparison->config.arena);
+}
+
+// Returns BATCH_COMPARED, BATCH_SKIPPED or BATCH_FAILED
+int ExecuteBatchComparison(parameters *config)
+{
+	AudioSignal	*ReferenceSignal = NULL;
+	AudioSignal	*ComparisonSignal = NULL;
+	int			result = BATCH_FAILED;
+
+	if(strcmp(config->referenceFile, config->comparisonFile) == 0)
+	{
+		logmsg("Both inputs are the same file %s, skipping to save time\n",
+			 config->referenceFile);
+		result = BATCH_SKIPPED;
+	}
+	else if(CompareSignals(&ReferenceSignal, &ComparisonSignal, config))
+		result = BATCH_COMPARED;
+
+	if(config->clock)
+		ReportArenas(config);
+
+	ReleaseDifferenceArray(config);
+	ReleaseSignals(&ReferenceSignal, &ComparisonSignal, config);
+	ResetArena(&config->arena);
+
+	return result;
+}
+
+int LoadBatchReference(char **referenceLog, parameters *config)
+{
+	AudioSignal	*ReferenceSignal = NULL;
+	int			loaded = 0;
+
+	StartLogCapture();
+	loaded = LoadFile(&ReferenceSignal, config->referenceFile, ROLE_REF, config);
+	*referenceLog = EndLogCapture();
+	if(loaded)
+	{
+		// Its frequency arrays have to outlive the arena of each comparison
+		config->refCache->loaded = CloneAudioSignal(ReferenceSignal, &config->refCache->arena, config);
+	}
+
+	if(ReferenceSignal)
+	{
+		ReleaseAudio(ReferenceSignal, config);
+		free(ReferenceSignal);
+		ReferenceSignal = NULL;
+	}
+	ResetArena(&config->arena);
+
+	if(!loaded || !config->refCache->loaded)
+	{
+		FlushLogCapture(*referenceLog);
+		*referenceLog = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+// Keeps what outlives a single comparison: plans, the run arena and the cache
+void RestoreBatchParameters(parameters *snapshot, AudioBlockType *typeArray, parameters *config)
+{
+	planManager		plans;
+	memoryArena		arena;
+	fftw_plan		model_plan = NULL, reverse_plan = NULL;
+
+	plans = config->plans;
+	arena = config->arena;
+	model_plan = config->model_plan;
+	reverse_plan = config->reverse_plan;
+
+	*config = *snapshot;
+
+	config->plans = plans;
+	config->arena = arena;
+	config->model_plan = model_plan;
+	config->reverse_plan = reverse_plan;
+	memcpy(config->types.typeArray, typeArray, sizeof(AudioBlockType)*config->types.typeCount);
+}
+
+/* The processed copy is used when nothing the DFFTs depend on has changed */
+int CloneReferenceForComparison(AudioSignal **ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	referenceCache	*cache = NULL;
+	AudioSignal		*source = NULL;
+
+	cache = config->refCache;
+	source = cache->loaded;
+	config->referenceReused = 0;
+
+	// Comparisons run concurrently, the first one to finish its DFFTs stores them
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (reference_cache)
+#endif
+	{
+		if(cache->processed && config->normType != max_time &&
+			cache->smallerFramerate == GetLowerFrameRate(cache->loaded->framerate, ComparisonSignal->framerate) &&
+			cache->biggerFramerate == GetHigherFrameRate(cache->loaded->framerate, ComparisonSignal->framerate) &&
+			cache->balanceChecked == NeedsBalanceCheck(cache->loaded, ComparisonSignal, config))
+		{
+			source = cache->processed;
+			config->referenceReused = 1;
+			config->noBalance |= cache->noBalance;
+			config->smallFile |= cache->smallFile;
+		}
+	}
+
+	*ReferenceSignal = CloneAudioSignal(source, &config->arena, config);
+	if(!*ReferenceSignal)
+		return 0;
+	return 1;
+}
+
+int StoreProcessedReference(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	referenceCache	*cache = NULL;
+	int				stored = 1;
+
+	cache = config->refCache;
+	if(!cache || config->normType == max_time)
+		return 1;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (reference_cache)
+#endif
+	{
+		if(!cache->processed)
+		{
+			cache->processed = CloneAudioSignal(ReferenceSignal, &cache->arena, config);
+			if(cache->processed)
+			{
+				cache->smallerFramerate = config->smallerFramerate;
+				cache->biggerFramerate = config->biggerFramerate;
+				cache->balanceChecked = NeedsBalanceCheck(ReferenceSignal, ComparisonSignal, config);
+				cache->noBalance = config->noBalance & ROLE_REF;
+				cache->smallFile = config->smallFile & ROLE_REF;
+			}
+			else
+				stored = 0;
+		}
+	}
+	return stored;
+}
+
+int IsReferenceReused(parameters *config)
+{
+	if(config->referenceFromCache)
+		return 1;
+	return config->referenceReused;
+}
+
+void ReleaseReferenceCache(parameters *config)
+{
+	referenceCache	*cache = NULL;
+
+	cache = config->refCache;
+	if(!cache)
+		return;
+
+	if(cache->processed)
+	{
+		ReleaseAudio(cache->processed, config);
+		free(cache->processed);
+		cache->processed = NULL;
+	}
+	if(cache->loaded)
+	{
+		ReleaseAudio(cache->loaded, config);
+		free(cache->loaded);
+		cache->loaded = NULL;
+	}
+	ReleaseArena(&cache->arena);
+	config->refCache = NULL;
+}
+
+/*
+	Daemon mode: jobs arrive over a UNIX socket and each one runs in a forked
+	worker, the same isolation separate runs had. What the worker starts from
+	stays resident here: FFTW wisdom, and per distinct set of arguments the
+	parsed profile with its reference loaded and synced. Those are kept most
+	recently used first while they fit in the memory budget.
+*/
+int ServeComparisons(parameters *config)
+{
+	serveState		state;
+	serveTemplate	*templates = NULL;
+	size_t			budget = 0;
+	long int		jobs = 0;
+
+	if(!OpenServeSocket(&state, config->serveSocket, config->serveWorkers))
+		return 0;
+
+	LoadWisdom(config);
+	budget = (size_t)config->serveMemoryMB*1024*1024;
+	logmsg("* Serving comparisons on %s, %d worker%s", config->serveSocket,
+			config->serveWorkers, config->serveWorkers == 1 ? "" : "s");
+	if(budget)
+		logmsg(" within %ld MB\n", config->serveMemoryMB);
+	else
+		logmsg(" without a memory limit\n");
+
+	while(!IsServeStopping())
+	{
+		serveJob		job;
+		serveTemplate	*Template = NULL;
+		size_t			jobMemory = 0, resident = 0;
+
+		ReapServeWorkers(&state, 0);
+		if(!AcceptServeJob(&state, &job))
+			continue;
+
+		jobs++;
+		logmsg("* Job %ld from %s: %d comparison%s\n", jobs, job.workDir,
+				job.fileCount, job.fileCount == 1 ? "" : "s");
+
+		Template = GetServeTemplate(&templates, &job);
+		if(!Template)
+		{
+			logmsg(" - Job %ld failed to load its profile or reference\n", jobs);
+			ServeReply(job.client, "DONE 0 %d\n", job.fileCount);
+			ReleaseServeJob(&job);
+			continue;
+		}
+		EvictServeTemplates(&templates, budget);
+
+		// The worker copies the reference and loads a comparison of about the same size
+		jobMemory = 2*Template->memory;
+		resident = GetServeResidentMemory(templates);
+		while(!IsServeStopping() && state.activeWorkers &&
+			(state.activeWorkers >= state.maxWorkers ||
+			(budget && resident + state.workerMemory + jobMemory > budget)))
+			ReapServeWorkers(&state, 1);
+
+		if(IsServeStopping())
+		{
+			ServeReply(job.client, "FAILED server is shutting down\nDONE 0 %d\n", job.fileCount);
+			ReleaseServeJob(&job);
+			break;
+		}
+
+		switch(StartServeWorker(&state, &job, jobMemory))
+		{
+			case 0:
+				RunServeJob(Template, &job);
+				break;
+			case -1:
+				ServeReply(job.client, "FAILED could not start a worker\nDONE 0 %d\n", job.fileCount);
+				break;
+			default:
+				break;
+		}
+		ReleaseServeJob(&job);
+	}
+
+	logmsg("* Stopping, waiting for %d running job%s\n", state.activeWorkers,
+			state.activeWorkers == 1 ? "" : "s");
+	CloseServeSocket(&state);
+
+	while(templates)
+	{
+		serveTemplate *next = templates->next;
+
+		ReleaseServeTemplate(templates);
+		templates = next;
+	}
+	return 1;
+}
+
+// Moves the template of the job to the front of the list, creating it if needed
+serveTemplate *GetServeTemplate(serveTemplate **templates, serveJob *job)
+{
+	serveTemplate	*Template = NULL, *previous = NULL;
+
+	for(Template = *templates; Template; previous = Template, Template = Template->next)
+	{
+		if(Template->keySize == job->keySize &&
+			memcmp(Template->key, job->payload, job->keySize) == 0)
+			break;
+	}
+
+	if(Template)
+	{
+		if(previous)
+			previous->next = Template->next;
+		else
+			*templates = Template->next;
+		Template->next = NULL;
+
+		if(!IsServeTemplateCurrent(Template, job))
+		{
+			logmsg(" - Profile or reference changed, reloading\n");
+			ReleaseServeTemplate(Template);
+			Template = NULL;
+		}
+		else
+			logmsg(" - Reusing loaded reference %s\n", Template->config.referenceFile);
+	}
+
+	if(!Template)
+	{
+		Template = CreateServeTemplate(job);
+		if(!Template)
+			return NULL;
+		logmsg(" - Loaded reference %s (%ld MB)\n", Template->config.referenceFile,
+				(long int)(Template->memory/(1024*1024)));
+	}
+
+	Template->next = *templates;
+	*templates = Template;
+	return Template;
+}
+
+/*
+	Does in the daemon what a run does before its comparison is loaded, with
+	the working directory and console of the client. The first comparison of
+	the job only satisfies the checks in commandline.
+*/
+serveTemplate *CreateServeTemplate(serveJob *job)
+{
+	serveTemplate	*Template = NULL;
+	int				saved = -1, parsed = 0, loaded = 0;
+
+	Template = (serveTemplate*)malloc(sizeof(serveTemplate));
+	if(!Template)
+	{
+		ServeReply(job->client, "FAILED not enough memory\n");
+		return NULL;
+	}
+	memset(Template, 0, sizeof(serveTemplate));
+
+	Template->key = (char*)malloc(sizeof(char)*job->keySize);
+	if(!Template->key)
+	{
+		ServeReply(job->client, "FAILED not enough memory\n");
+		free(Template);
+		return NULL;
+	}
+	memcpy(Template->key, job->payload, job->keySize);
+	Template->keySize = job->keySize;
+
+	saved = RedirectServeOutput(job->client);
+
+	// Relative paths are taken from the folder of the job, the daemon never leaves its own
+	ResetCommandLineParser();
+	SetCommandLineFolder(job->workDir);
+	StartLogCapture();
+	parsed = commandline(GetServeJobArguments(job), job->argv, &Template->config);
+	SetCommandLineFolder(NULL);
+	if(parsed && Template->config.serveSocket[0])
+	{
+		logmsg("\tERROR: A job can't start another server\n");
+		parsed = 0;
+	}
+	if(parsed && Template->config.trainWisdom)
+	{
+		logmsg("\tERROR: A job can't train FFTW wisdom\n");
+		parsed = 0;
+	}
+	if(parsed)
+		parsed = EndProfileLoad(&Template->config);
+	Template->profileLog = EndLogCapture();
+	ReleaseComparisonList(&Template->config);
+
+	// The log file belongs to each comparison, the daemon has none
+	Template->logEnabled = IsLogEnabled();
+	DisableLog();
+
+	if(parsed)
+	{
+		Template->config.plans.wisdomLoaded = 1;
+		SelectKernels(&Template->config);
+
+		InitArena(&Template->cache.arena, Template->config.arena.hugePages, 0);
+		Template->config.refCache = &Template->cache;
+		loaded = LoadBatchReference(&Template->referenceLog, &Template->config);
+
+		GetServeFileTime(job->workDir, Template->config.referenceFile, &Template->referenceTime, &Template->referenceSize);
+		GetServeFileTime(job->workDir, Template->config.profileFile, &Template->profileTime, NULL);
+	}
+	else
+	{
+		FlushLogCapture(Template->profileLog);
+		Template->profileLog = NULL;
+	}
+
+	RestoreServeOutput(saved);
+
+	if(!loaded)
+	{
+		ReleaseServeTemplate(Template);
+		return NULL;
+	}
+
+	Template->memory = GetServeTemplateMemory(Template);
+	return Template;
+}
+
+int IsServeTemplateCurrent(serveTemplate *Template, serveJob *job)
+{
+	time_t	referenceTime = 0, profileTime = 0;
+	off_t	referenceSize = 0;
+
+	if(!GetServeFileTime(job->workDir, Template->config.referenceFile, &referenceTime, &referenceSize))
+		return 0;
+	if(!GetServeFileTime(job->workDir, Template->config.profileFile, &profileTime, NULL))
+		return 0;
+
+	return(referenceTime == Template->referenceTime &&
+			referenceSize == Template->referenceSize &&
+			profileTime == Template->profileTime);
+}
+
+// Samples and frequency arrays, the rest is small next to them
+size_t GetServeTemplateMemory(serveTemplate *Template)
+{
+	AudioSignal	*Signal = NULL;
+	size_t		memory = 0;
+
+	memory = Template->cache.arena.reserved;
+	Signal = Template->cache.loaded;
+	if(!Signal)
+		return memory;
+
+	if(Signal->Samples)
+		memory += sizeof(double)*Signal->numSamples;
+	for(int p = 0; p < PLANAR_COUNT; p++)
+	{
+		if(Signal->Planar[p] && Signal->Planar[p] != Signal->Samples)
+			memory += sizeof(double)*(Signal->numSamples/Signal->AudioChannels);
+	}
+	return memory;
+}
+
+size_t GetServeResidentMemory(serveTemplate *templates)
+{
+	size_t	memory = 0;
+
+	for(; templates; templates = templates->next)
+		memory += templates->memory;
+	return memory;
+}
+
+// The list is most recently used first, the first one is always kept
+void EvictServeTemplates(serveTemplate **templates, size_t budget)
+{
+	serveTemplate	*Template = NULL, *previous = NULL;
+	size_t			resident = 0;
+
+	if(!budget || !*templates)
+		return;
+
+	previous = *templates;
+	resident = previous->memory;
+	Template = previous->next;
+	while(Template)
+	{
+		if(resident + Template->memory > budget)
+		{
+			logmsg(" - Releasing reference %s\n", Template->config.referenceFile);
+			previous->next = Template->next;
+			ReleaseServeTemplate(Template);
+			Template = previous->next;
+			continue;
+		}
+		resident += Template->memory;
+		previous = Template;
+		Template = Template->next;
+	}
+}
+
+void ReleaseServeTemplate(serveTemplate *Template)
+{
+	if(!Template)
+		return;
+
+	ReleaseReferenceCache(&Template->config);
+	ReleaseComparisonList(&Template->config);
+	ReleaseAudioBlockStructure(&Template->config);
+	if(Template->profileLog)
+	{
+		free(Template->profileLog);
+		Template->profileLog = NULL;
+	}
+	if(Template->referenceLog)
+	{
+		free(Template->referenceLog);
+		Template->referenceLog = NULL;
+	}
+	if(Template->key)
+	{
+		free(Template->key);
+		Template->key = NULL;
+	}
+	free(Template);
+}
+
+// Runs in the worker, its console is the client and it never returns
+void RunServeJob(serveTemplate *Template, serveJob *job)
+{
+	parameters		config;
+	AudioBlockType	*typeArray = NULL;
+	int				i = 0, compared = 0, skipped = 0, result = BATCH_FAILED;
+
+	config = Template->config;
+	typeArray = (AudioBlockType*)malloc(sizeof(AudioBlockType)*config.types.typeCount);
+	if(!typeArray)
+	{
+		ServeReply(STDOUT_FILENO, "FAILED not enough memory\nDONE 0 %d\n", job->fileCount);
+		EndServeWorker(1);
+	}
+	memcpy(typeArray, config.types.typeArray, sizeof(AudioBlockType)*config.types.typeCount);
+
+	for(i = 0; i < job->fileCount; i++)
+	{
+		if(i != 0)
+			RestoreBatchParameters(&Template->config, typeArray, &config);
+		sprintf(config.comparisonFile, "%s", job->files[i]);
+		if(Template->logEnabled)
+			EnableLog();
+		if(!SetupFolders(config.outputFolder, "Log", &config))
+		{
+			fflush(stdout);
+			ServeReply(STDOUT_FILENO, "FAILED %s\n", config.comparisonFile);
+			continue;
+		}
+
+		ReplayLogCapture(Template->profileLog, i != 0);
+		if(job->fileCount > 1)
+			logmsg("\n* Comparison %d of %d: %s\n", i + 1, job->fileCount, config.comparisonFile);
+		ReplayLogCapture(Template->referenceLog, i != 0);
+
+		result = ExecuteBatchComparison(&config);
+		if(IsLogEnabled())
+			endLog();
+
+		if(result == BATCH_COMPARED)
+		{
+			compared++;
+			printf("\nResults stored in %s%s\n", config.outputPath, config.folderName);
+			fflush(stdout);
+			ServeReply(STDOUT_FILENO, "RESULT %s%s\n", config.outputPath, config.folderName);
+		}
+		else if(result == BATCH_SKIPPED)
+		{
+			skipped++;
+			fflush(stdout);
+			ServeReply(STDOUT_FILENO, "SKIPPED %s\n", config.comparisonFile);
+		}
+		else
+		{
+			fflush(stdout);
+			ServeReply(STDOUT_FILENO, "FAILED %s\n", config.comparisonFile);
+		}
+	}
+
+	ServeReply(STDOUT_FILENO, "DONE %d %d\n", compared, job->fileCount);
+	EndServeWorker(compared + skipped == job->fileCount ? 0 : 1);
+}
+
 void printTextResults(parameters *config)
 {
 	double lowest = 100.0f;
@@ -412,11 +1244,75 @@ int LoadAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal
 {
 	AudioSignal *higher = NULL;
 
-	if(!LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config))
-		return 0;
+	if(config->refCache && config->refCache->loaded)
+	{
+		// Batch run, the reference was loaded before the first comparison
+		if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
+			return 0;
 
-	if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
-		return 0;
+		if(!CloneReferenceForComparison(ReferenceSignal, *ComparisonSignal, config))
+			return 0;
+	}
+	else if(PrepareAnalysisCache(config))
+	{
+		// The stored analysis depends on the comparison frame rate, load it first
+		if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
+			return 0;
+
+		if(!LoadAnalysisCache(ReferenceSignal, *ComparisonSignal, config))
+		{
+			if(!LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config))
+				return 0;
+		}
+	}
+	else if(config->noSyncProfile)
+	{
+		// Comparison frame rate is derived from the Reference file
+		if(!LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config))
+			return 0;
+
+		if(!LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config))
+			return 0;
+	}
+	else
+	{
+		int		loaded[2] = { 0, 0 }, i = 0;
+		char	*captured[2] = { NULL, NULL };
+
+		/*
+			Both files are loaded and synced concurrently, log output is kept
+			in order. They are tasks of a full team, so the rest of the threads
+			can take the FLAC slices of either file.
+		*/
+#ifdef OPENMP_ENABLE
+		#pragma omp parallel
+		#pragma omp single
+#endif
+		for(i = 0; i < 2; i++)
+		{
+#ifdef OPENMP_ENABLE
+			#pragma omp task firstprivate(i)
+#endif
+			{
+				int capturing = 0;
+
+				// Every End must pop its own Start, a batch comparison is captured already
+				capturing = StartLogCapture();
+				if(i == 0)
+					loaded[i] = LoadFile(ReferenceSignal, config->referenceFile, ROLE_REF, config);
+				else
+					loaded[i] = LoadFile(ComparisonSignal, config->comparisonFile, ROLE_COMP, config);
+				if(capturing)
+					captured[i] = EndLogCapture();
+			}
+		}
+
+		FlushLogCapture(captured[0]);
+		FlushLogCapture(captured[1]);
+
+		if(!loaded[0] || !loaded[1])
+			return 0;
+	}
 
 	if(GetSignalMaxInt(*ReferenceSignal) >= GetSignalMaxInt(*ComparisonSignal))
 		higher = *ReferenceSignal;
@@ -863,14 +1759,35 @@ int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **Compar
 			}
 			if(block != NO_INDEX)
 			{
+				int		balanced[2] = { 0, 0 }, i = 0;
+				char	*captured[2] = { NULL, NULL };
+
 				logmsg("\n* Comparing Stereo channel amplitude\n");
 				if(config->verbose) {
 					logmsg(" - Mono block used for balance: %s# %d\n",
 						name, GetBlockSubIndex(config, block));
 				}
-				if(CheckBalance(*ReferenceSignal, block, config) == 0)
-					return 0;
-				if(CheckBalance(*ComparisonSignal, block, config) == 0)
+
+#ifdef OPENMP_ENABLE
+				#pragma omp parallel for num_threads(2)
+#endif
+				for(i = 0; i < 2; i++)
+				{
+					int capturing = 0;
+
+					capturing = StartLogCapture();
+					if(i == 0 && IsReferenceReused(config))
+						balanced[i] = 1;
+					else
+						balanced[i] = CheckBalance(i == 0 ? *ReferenceSignal : *ComparisonSignal, block, config);
+					if(capturing)
+						captured[i] = EndLogCapture();
+				}
+
+				FlushLogCapture(captured[0]);
+				FlushLogCapture(captured[1]);
+
+				if(balanced[0] == 0 || balanced[1] == 0)
 					return 0;
 			}
 			else
@@ -887,19 +1804,35 @@ int LoadAndProcessAudioFiles(AudioSignal **ReferenceSignal, AudioSignal **Compar
 			return 0;
 	}
 
+	// Nothing moves or scales the samples from here on, the DFFTs read the planar channels
+	ReleaseInterleavedSamples(*ReferenceSignal);
+	ReleaseInterleavedSamples(*ComparisonSignal);
+
 	SetAmplitudeMatchByDuration(*ReferenceSignal, config);
 
-	logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
-	if(!ProcessSignal(*ReferenceSignal, config))
-		return 0;
+	if(IsReferenceReused(config))
+		logmsg("\n* Reusing Discrete Fast Fourier Transforms from 'Reference' file\n");
+	else
+	{
+		logmsg("\n* Executing Discrete Fast Fourier Transforms on 'Reference' file\n");
+		if(!ProcessSignal(*ReferenceSignal, config))
+			return 0;
+	}
 
 	logmsg("* Executing Discrete Fast Fourier Transforms on 'Comparison' file\n");
 	if(!ProcessSignal(*ComparisonSignal, config))
 		return 0;
 
-	CalculateFrequencyBrackets(*ReferenceSignal, config);
+	if(!IsReferenceReused(config))
+		CalculateFrequencyBrackets(*ReferenceSignal, config);
 	CalculateFrequencyBrackets(*ComparisonSignal, config);
 
+	// Batch runs and the analysis cache keep it before normalization changes its magnitudes
+	if(!StoreProcessedReference(*ReferenceSignal, *ComparisonSignal, config))
+		return 0;
+	if(config->analysisCacheKey && !IsReferenceReused(config))
+		SaveAnalysisCache(*ReferenceSignal, *ComparisonSignal, config);
+
     if(!ReportClockResults(*ReferenceSignal, *ComparisonSignal, config))
 	{
 		if(config->doClkAdjust)
@@ -1005,7 +1938,7 @@ int NormalizeAndFinishProcess(AudioSignal **ReferenceSignal, AudioSignal **Compa
 	return 1;
 }
 
-void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+void ReleaseSignals(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
 {
 	if(*ReferenceSignal)
 	{
@@ -1020,7 +1953,12 @@ void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, para
 		free(*ComparisonSignal);
 		*ComparisonSignal = NULL;
 	}
+}
 
+void CleanUp(AudioSignal **ReferenceSignal, AudioSignal **ComparisonSignal, parameters *config)
+{
+	ReleaseSignals(ReferenceSignal, ComparisonSignal, config);
+	ReleaseComparisonList(config);
 	ReleaseAudioBlockStructure(config);
 }
 
@@ -1107,7 +2045,8 @@ int CopySamplesForTimeDomainPlotWindowOnly(AudioBlocks *AudioArray, double *wind
 	return(1);
 }
 
-int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_t size, size_t diff, double *window, int AudioChannels, int copywindow, parameters *config)
+// left and right are planar, right is only used with two channels
+int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *left, double *right, size_t size, size_t diff, double *window, int AudioChannels, int copywindow, parameters *config)
 {
 	long			stereoSignalSize = 0;
 	long			i = 0, monoSignalSize = 0, diffSize = 0, difference = 0;
@@ -1149,8 +2088,7 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 		memset(window_samples, 0, sizeof(double)*(monoSignalSize+1));
 	}
 
-	for(i = 0; i < monoSignalSize; i++)
-		signal[i] = samples[i*AudioChannels];
+	memcpy(signal, left, sizeof(double)*monoSignalSize);
 
 	AudioArray->audio.samples = signal;
 	AudioArray->audio.size = monoSignalSize;
@@ -1167,8 +2105,7 @@ int CopySamplesForTimeDomainPlot(AudioBlocks *AudioArray, double *samples, size_
 		}
 		memset(signalRight, 0, sizeof(double)*(monoSignalSize+1));
 
-		for(i = 0; i < monoSignalSize; i++)
-			signalRight[i] = samples[i*AudioChannels+1];
+		memcpy(signalRight, right, sizeof(double)*monoSignalSize);
 
 		AudioArray->audioRight.samples = signalRight;
 		AudioArray->audioRight.size = monoSignalSize;
@@ -1305,23 +2242,12 @@ int IsTypeInCLKLArray(int type, parameters *config)
 int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 {
 	long int		i = 0;	
-	double			*sampleBuffer = NULL;
-	long int		sampleBufferSize = 0;
-	double			*windowUsed = NULL, longest = 0;
+	double			*windowUsed = NULL;
 	windowManager	windows;
 
 	if(!config->doClkAdjust)
 		return 0;
 
-	longest = FramesToSeconds(Signal->framerate, GetLongestElementFrames(config));
-	sampleBufferSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsg("\tERROR: malloc failed RecalculateFFTW.\n");
-		return(0);
-	}
-
 	if(!initWindows(&windows, Signal->SampleRate, config->window, config))
 		return 0;
 
@@ -1339,26 +2265,20 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 
 			currSamplesSize = Signal->Blocks[i].loadSize - Signal->Blocks[i].difference;
 
-			memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-			memcpy(sampleBuffer, Signal->Samples + Signal->Blocks[i].offset, currSamplesSize*sizeof(double));
-
 			CleanFrequenciesInBlock(&Signal->Blocks[i], config);
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, currSamplesSize, Signal->SampleRate, windowUsed, Signal->AudioChannels, config->ZeroPad, config))
+			if(!ExecuteDFFT(&Signal->Blocks[i], Signal, Signal->Blocks[i].offset, currSamplesSize, windowUsed, config->ZeroPad, config))
 			{
-				free(sampleBuffer);
 				freeWindows(&windows);
 				return 0;
 			}
 			if(!FillFrequencyStructures(Signal, &Signal->Blocks[i], config))
 			{
-				free(sampleBuffer);
 				freeWindows(&windows);
 				return 0;
 			}
 
 			if(config->plotAllNotesWindowed && !CopySamplesForTimeDomainPlotWindowOnly(&Signal->Blocks[i], windowUsed, Signal->AudioChannels, config))
 			{
-				free(sampleBuffer);
 				freeWindows(&windows);
 				return 0;
 			}
@@ -1371,7 +2291,6 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 				// Force a Hamming window for the clock signal
 				if(!initWindows(&clockWindows, Signal->SampleRate, 'm', config))
 				{
-					free(sampleBuffer);
 					freeWindows(&windows);
 					freeWindows(&clockWindows);
 					return 0;
@@ -1380,9 +2299,8 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 				// We only use ZeroPadFactor for the CLK, the rest is zero padded to 1hz
 				windowUsed = getWindowByLength(&clockWindows, config->ZeroPadFactor*1000.0/Signal->framerate, 0, Signal->framerate, config);
 				CleanFrequenciesInBlock(&Signal->clkFrequencies, config);
-				if(!ExecuteDFFT(&Signal->clkFrequencies, sampleBuffer, currSamplesSize, Signal->SampleRate, windowUsed, Signal->AudioChannels, 1*config->ZeroPadFactor , config)) // zeropad on 
+				if(!ExecuteDFFT(&Signal->clkFrequencies, Signal, Signal->Blocks[i].offset, currSamplesSize, windowUsed, 1*config->ZeroPadFactor , config)) // zeropad on 
 				{
-					free(sampleBuffer);
 					freeWindows(&windows);
 					freeWindows(&clockWindows);
 					return 0;
@@ -1390,7 +2308,6 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 
 				if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
 				{
-					free(sampleBuffer);
 					freeWindows(&windows);
 					freeWindows(&clockWindows);
 					return 0;
@@ -1408,7 +2325,6 @@ int RecalculateFFTW(AudioSignal *Signal, parameters *config)
 	if(config->drawWindows)
 		VisualizeWindows(&windows, "CLK-RECALC", Signal->role, config);
 
-	free(sampleBuffer);
 	freeWindows(&windows);
 
 	if(config->normType != max_frequency)
@@ -1523,14 +2439,16 @@ int DuplicateSamplesForWaveformPlots(AudioSignal *Signal, long int element, long
 
 		oneFrameSamples = SecondsToSamples(Signal->SampleRate, FramesToSeconds(framerate, 1), Signal->AudioChannels, NULL, NULL);
 		if(pos > oneFrameSamples) {
-			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], Signal->Samples + pos - oneFrameSamples, loadedBlockSize+oneFrameSamples, difference, windowUsed, Signal->AudioChannels, 0, config))
+			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], GetPlanarSamples(Signal, PLANAR_LEFT, pos - oneFrameSamples),
+					GetPlanarSamples(Signal, PLANAR_RIGHT, pos - oneFrameSamples), loadedBlockSize+oneFrameSamples, difference, windowUsed, Signal->AudioChannels, 0, config))
 				return 0;
 			Signal->Blocks[element].audio.sampleOffset = pos - oneFrameSamples + syncAdvance;
 			if(Signal->AudioChannels == 2)
 				Signal->Blocks[element].audioRight.sampleOffset = pos - oneFrameSamples + syncAdvance;
 		}
 		else {
-			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], Signal->Samples + pos, loadedBlockSize, difference, windowUsed, Signal->AudioChannels, 0, config))
+			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], GetPlanarSamples(Signal, PLANAR_LEFT, pos),
+					GetPlanarSamples(Signal, PLANAR_RIGHT, pos), loadedBlockSize, difference, windowUsed, Signal->AudioChannels, 0, config))
 				return 0;
 			Signal->Blocks[element].audio.sampleOffset = pos + syncAdvance;
 			if(Signal->AudioChannels == 2)
@@ -1547,7 +2465,8 @@ int DuplicateSamplesForWaveformPlots(AudioSignal *Signal, long int element, long
 
 			if(Signal->Blocks[element].type == TYPE_SILENCE)
 				forcecopy = 1;
-			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], Signal->Samples + pos, loadedBlockSize, difference, windowUsed, Signal->AudioChannels, forcecopy, config))
+			if(!CopySamplesForTimeDomainPlot(&Signal->Blocks[element], GetPlanarSamples(Signal, PLANAR_LEFT, pos),
+					GetPlanarSamples(Signal, PLANAR_RIGHT, pos), loadedBlockSize, difference, windowUsed, Signal->AudioChannels, forcecopy, config))
 				return 0;
 			Signal->Blocks[element].audio.sampleOffset = pos + syncAdvance;
 			if(Signal->AudioChannels == 2)
@@ -1559,17 +2478,299 @@ int DuplicateSamplesForWaveformPlots(AudioSignal *Signal, long int element, long
 }
 
 
+/*
+	deviation is only given when validating the single precision transforms,
+	which has to happen before FillFrequencyStructures releases the spectrum
+*/
+int ProcessSignalBlock(AudioSignal *Signal, long int block, double *windowUsed, float *windowFloat, double *deviation, parameters *config)
+{
+	AudioBlocks	*AudioArray = NULL;
+
+	AudioArray = &Signal->Blocks[block];
+	if(AudioArray->type < TYPE_SILENCE && AudioArray->type != TYPE_WATERMARK)
+		return 1;
+
+	if(config->floatPipeline == FLOAT_PIPELINE_ON)
+	{
+		if(!ExecuteDFFTFloat(AudioArray, Signal, AudioArray->offset, AudioArray->loadSize-AudioArray->difference, windowFloat, config->ZeroPad, config))
+			return 0;
+	}
+	else
+	{
+		if(!ExecuteDFFT(AudioArray, Signal, AudioArray->offset, AudioArray->loadSize-AudioArray->difference, windowUsed, config->ZeroPad, config))
+			return 0;
+		if(deviation && !ValidateFloatBlock(Signal, block, windowFloat, &deviation[block], config))
+			return 0;
+	}
+#ifdef DEBUG
+	if(config->verbose >= 3)
+		logmsg("estimated %g (difference %ld)\n", AudioArray->frames*Signal->framerate/1000.0, AudioArray->difference);
+#endif
+	if(!FillFrequencyStructures(Signal, AudioArray, config))
+		return 0;
+	return 1;
+}
+
+void ReportFloatDeviation(double *deviation, long int processed, parameters *config)
+{
+	long int	block = 0, maxBlock = NO_INDEX;
+	double		maxDeviation = 0;
+
+	for(block = 0; block < processed; block++)
+	{
+		if(deviation[block] > maxDeviation)
+		{
+			maxDeviation = deviation[block];
+			maxBlock = block;
+		}
+	}
+
+	if(maxBlock != NO_INDEX)
+		logmsg(" - Single precision max deviation: %gdB at %s# %d\n", maxDeviation,
+			GetBlockName(config, maxBlock), GetBlockSubIndex(config, maxBlock));
+	else
+		logmsg(" - Single precision max deviation: 0dB\n");
+}
+
+/*
+	Runs the single precision transform for a block already processed in
+	double precision, and returns the largest difference in dB between both
+	spectra for the bins above the significant amplitude
+*/
+int ValidateFloatBlock(AudioSignal *Signal, long int block, float *windowFloat, double *deviation, parameters *config)
+{
+	AudioBlocks	*AudioArray = NULL, test;
+	double		channelDeviation = 0;
+
+	*deviation = 0;
+	AudioArray = &Signal->Blocks[block];
+	if(AudioArray->type < TYPE_SILENCE && AudioArray->type != TYPE_WATERMARK)
+		return 1;
+
+	memset(&test, 0, sizeof(AudioBlocks));
+	test.channel = AudioArray->channel;
+
+	if(!ExecuteDFFTFloat(&test, Signal, AudioArray->offset, AudioArray->loadSize-AudioArray->difference, windowFloat, config->ZeroPad, config))
+		return 0;
+
+	if(test.fftwValues.spectrum)
+	{
+		*deviation = GetSpectrumDeviation(&AudioArray->fftwValues, &test.fftwValues, config->significantAmplitude);
+		fftw_free(test.fftwValues.spectrum);
+	}
+	if(test.fftwValuesRight.spectrum)
+	{
+		channelDeviation = GetSpectrumDeviation(&AudioArray->fftwValuesRight, &test.fftwValuesRight, config->significantAmplitude);
+		if(channelDeviation > *deviation)
+			*deviation = channelDeviation;
+		fftw_free(test.fftwValuesRight.spectrum);
+	}
+	return 1;
+}
+
+double GetSpectrumDeviation(FFTWSpectrum *reference, FFTWSpectrum *test, double significant)
+{
+	long int	i = 0, bins = 0;
+	double		peak = 0, deviation = 0;
+
+	if(!reference->spectrum || !test->spectrum || reference->size != test->size)
+		return 0;
+
+	bins = reference->size/2+1;
+	for(i = 0; i < bins; i++)
+	{
+		double magnitude = cabs(reference->spectrum[i]);
+
+		if(magnitude > peak)
+			peak = magnitude;
+	}
+	if(peak == 0)
+		return 0;
+
+	for(i = 0; i < bins; i++)
+	{
+		double magnitude = 0, testMagnitude = 0, difference = 0;
+
+		magnitude = cabs(reference->spectrum[i]);
+		if(magnitude == 0 || 20*log10(magnitude/peak) < significant)
+			continue;
+
+		testMagnitude = cabs(test->spectrum[i]);
+		if(testMagnitude == 0)
+			difference = fabs(significant);
+		else
+			difference = fabs(20*log10(testMagnitude/magnitude));
+		if(difference > deviation)
+			deviation = difference;
+	}
+	return deviation;
+}
+
+int ProcessSignalCLK(AudioSignal *Signal, double framerate, parameters *config)
+{
+	AudioBlocks		*AudioArray = NULL;
+	windowManager	clockWindows;
+	double			*windowUsed = NULL;
+
+	AudioArray = &Signal->Blocks[config->clkBlock];
+
+	// Force a Hamming window for the clock signal
+	if(!initWindows(&clockWindows, Signal->SampleRate, 'm', config))
+		return 0;
+
+	// We only use ZeroPadFactor for the CLK, the rest is zero padded to 1hz
+	windowUsed = getWindowByLength(&clockWindows, config->ZeroPadFactor*1000.0/framerate, 0, framerate, config);
+	if(!ExecuteDFFT(&Signal->clkFrequencies, Signal, AudioArray->offset, AudioArray->loadSize-AudioArray->difference, windowUsed, 1*config->ZeroPadFactor /* force ZeroPad */, config))
+	{
+		freeWindows(&clockWindows);
+		return 0;
+	}
+
+	if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
+	{
+		freeWindows(&clockWindows);
+		return 0;
+	}
+	if(config->drawWindows)
+		VisualizeWindows(&clockWindows, "CLK", Signal->role, config);
+
+	freeWindows(&clockWindows);
+	return 1;
+}
+
+/*
+	Groups the processed blocks that share a transform length, so they can be
+	executed as a single batched real transform. Stereo blocks use the packed
+	complex transform and blocks without a DFT are kept as batches of one,
+	as are all blocks when using single precision transforms.
+	Batches are always DFFT_BATCH_MAX wide, plans are cached by width and
+	every other width would be measured again. The blocks left over run as
+	batches of one with the regular plan.
+*/
+dfftBatch *CreateDFFTBatches(AudioSignal *Signal, long int processed, int *batchCount, parameters *config)
+{
+	long int	block = 0, next = 0, zeropadding = 0, *sizes = NULL, *same = NULL;
+	long int	sameCount = 0, member = 0;
+	double		seconds = 0;
+	dfftBatch	*batches = NULL;
+	int			count = 0;
+
+	*batchCount = 0;
+	sizes = (long int*)malloc(sizeof(long int)*(processed+1));
+	same = (long int*)malloc(sizeof(long int)*(processed+1));
+	batches = (dfftBatch*)malloc(sizeof(dfftBatch)*(processed+1));
+	if(!sizes || !same || !batches)
+	{
+		logmsg("\tERROR: malloc failed.\n");
+		if(sizes)
+			free(sizes);
+		if(same)
+			free(same);
+		if(batches)
+			free(batches);
+		return NULL;
+	}
+
+	for(block = 0; block < processed; block++)
+	{
+		AudioBlocks *AudioArray = &Signal->Blocks[block];
+
+		sizes[block] = 0;
+		if(AudioArray->type < TYPE_SILENCE && AudioArray->type != TYPE_WATERMARK)
+			continue;
+		if(Signal->AudioChannels == 2 && AudioArray->channel == CHANNEL_STEREO)
+			continue;
+		if(config->floatPipeline == FLOAT_PIPELINE_ON)
+			continue;
+		sizes[block] = GetDFFTSize(AudioArray->loadSize-AudioArray->difference, Signal->SampleRate,
+							Signal->AudioChannels, config->ZeroPad, &zeropadding, &seconds, config);
+	}
+
+	for(block = 0; block < processed; block++)
+	{
+		if(sizes[block] < 0)
+			continue;
+
+		same[0] = block;
+		sameCount = 1;
+		if(sizes[block])
+		{
+			for(next = block + 1; next < processed; next++)
+			{
+				if(sizes[next] == sizes[block])
+				{
+					same[sameCount++] = next;
+					sizes[next] = -1;
+				}
+			}
+		}
+
+		for(member = 0; member < sameCount; )
+		{
+			batches[count].count = 0;
+			batches[count].size = sizes[block];
+			if(sameCount - member >= DFFT_BATCH_MAX)
+			{
+				while(batches[count].count < DFFT_BATCH_MAX)
+					batches[count].blocks[batches[count].count++] = same[member++];
+			}
+			else
+				batches[count].blocks[batches[count].count++] = same[member++];
+			count++;
+		}
+		sizes[block] = -1;
+	}
+
+	free(sizes);
+	free(same);
+	*batchCount = count;
+	return batches;
+}
+
+int ProcessSignalBatch(AudioSignal *Signal, dfftBatch *batch, double **windowArray, float **windowFloatArray, double *deviation, parameters *config)
+{
+	int	b = 0;
+
+	if(!ExecuteDFFTBatch(Signal, batch, windowArray, config))
+		return 0;
+
+	for(b = 0; deviation && b < batch->count; b++)
+	{
+		long int block = batch->blocks[b];
+
+		if(!ValidateFloatBlock(Signal, block, windowFloatArray[block], &deviation[block], config))
+			return 0;
+	}
+
+	for(b = 0; b < batch->count; b++)
+	{
+		if(!FillFrequencyStructures(Signal, &Signal->Blocks[batch->blocks[b]], config))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+	Processing is done in two passes. The first one walks the blocks in order,
+	resolving offsets, sizes and windows and handling the internal sync points,
+	since those move samples around. Once every block is located, they are
+	independent and the transforms run in parallel, with blocks of the same
+	transform length batched together.
+*/
 int ProcessSignal(AudioSignal *Signal, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*sampleBuffer = NULL;
-	long int		sampleBufferSize = 0;
+	double			**windowArray = NULL;
+	float			**windowFloatArray = NULL;
+	long int		longestBlockSize = 0;
 	windowManager	windows;
 	long int		loadedBlockSize = 0, i = 0, syncAdvance = 0;
 	struct timespec	start, end;
-	int				discardSamples = 0, syncinternal = 0;
-	double			leftDecimals = 0;
+	int				discardSamples = 0, syncinternal = 0, errors = 0;
+	int				batch = 0, batchCount = 0;
+	dfftBatch		*batches = NULL;
+	double			leftDecimals = 0, clkFramerate = 0, *deviation = NULL;
 #ifdef DEBUG
 	long int		totalDiscarded = 0, totalProcessed = 0, totalDifference = 0;
 	double			totalTimeEst = 0, totalTimeReal = 0;
@@ -1584,17 +2785,29 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		return 0;
 	}
 
-	sampleBufferSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
+	longestBlockSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
+
+	windowArray = (double**)malloc(sizeof(double*)*config->types.totalBlocks);
+	if(!windowArray)
+	{
+		logmsg("\tERROR: malloc failed.\n");
+		return(0);
+	}
+	memset(windowArray, 0, sizeof(double*)*config->types.totalBlocks);
+
+	windowFloatArray = (float**)malloc(sizeof(float*)*config->types.totalBlocks);
+	if(!windowFloatArray)
 	{
+		free(windowArray);
 		logmsg("\tERROR: malloc failed.\n");
 		return(0);
 	}
+	memset(windowFloatArray, 0, sizeof(float*)*config->types.totalBlocks);
 
 	if(!initWindows(&windows, Signal->SampleRate, config->window, config))
 	{
-		free(sampleBuffer);
+		free(windowArray);
+		free(windowFloatArray);
 		logmsg("\tERROR: Could not create FFTW windows.\n");
 		return 0;
 	}
@@ -1652,7 +2865,8 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 
 		if(!DuplicateSamplesForWaveformPlots(Signal, i, pos, loadedBlockSize, difference, framerate, windowUsed, config, syncAdvance))
 		{
-			free(sampleBuffer);
+			free(windowArray);
+			free(windowFloatArray);
 			freeWindows(&windows);
 			return 0;
 		}
@@ -1661,15 +2875,18 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		{
 #ifdef DEBUG
 			logmsg("WARNING: End of File load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n", 
-				loadedBlockSize, sampleBufferSize, pos + loadedBlockSize, pos, Signal->numSamples);
+				loadedBlockSize, longestBlockSize, pos + loadedBlockSize, pos, Signal->numSamples);
 #endif
 			if(i != config->types.totalBlocks - 1)
 			{
+#ifdef OPENMP_ENABLE
+				#pragma omp atomic
+#endif
 				config->smallFile |= Signal->role;
 				logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite.\n");
 				if(config->verbose)
 					logmsg("load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n",
-						loadedBlockSize, sampleBufferSize, pos + loadedBlockSize, pos, Signal->numSamples);
+						loadedBlockSize, longestBlockSize, pos + loadedBlockSize, pos, Signal->numSamples);
 			}
 			break;
 		}
@@ -1685,68 +2902,16 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 				SamplesForDisplay(discardSamples, Signal->AudioChannels), leftDecimals/(double)Signal->AudioChannels,
 				GetTypeName(config, Signal->Blocks[i].type), i);
 #endif
-		
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Signal->Samples + pos, (loadedBlockSize-difference)*sizeof(double));
 
 		Signal->Blocks[i].offset = pos;
 		Signal->Blocks[i].loadSize = loadedBlockSize;
 		Signal->Blocks[i].difference = difference;
-		if(Signal->Blocks[i].type >= TYPE_SILENCE || Signal->Blocks[i].type == TYPE_WATERMARK)
-		{
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, Signal->AudioChannels, config->ZeroPad, config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				return 0;
-			}
-#ifdef DEBUG
-			if(config->verbose >= 3)
-				logmsg("estimated %g (difference %ld)\n", Signal->Blocks[i].frames*Signal->framerate/1000.0, difference);
-#endif
-			if(!FillFrequencyStructures(Signal, &Signal->Blocks[i], config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				return 0;
-			}
-		}
+		windowArray[i] = windowUsed;
+		if(config->floatPipeline != FLOAT_PIPELINE_OFF)
+			windowFloatArray[i] = getFloatWindow(&windows, windowUsed);
 
 		if(config->clkMeasure && config->clkBlock == i)
-		{
-			windowManager clockWindows;
-
-			// Force a Hamming window for the clock signal
-			if(!initWindows(&clockWindows, Signal->SampleRate, 'm', config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				freeWindows(&clockWindows);
-				return 0;
-			}
-
-			// We only use ZeroPadFactor for the CLK, the rest is zero padded to 1hz
-			windowUsed = getWindowByLength(&clockWindows, config->ZeroPadFactor*1000.0/framerate, 0, framerate, config);
-			if(!ExecuteDFFT(&Signal->clkFrequencies, sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, Signal->AudioChannels, 1*config->ZeroPadFactor /* force ZeroPad */, config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				freeWindows(&clockWindows);
-				return 0;
-			}
-
-			if(!FillFrequencyStructures(Signal, &Signal->clkFrequencies, config))
-			{
-				free(sampleBuffer);
-				freeWindows(&windows);
-				freeWindows(&clockWindows);
-				return 0;
-			}
-			if(config->drawWindows)
-				VisualizeWindows(&clockWindows, "CLK", Signal->role, config);
-
-			freeWindows(&clockWindows);
-		}
+			clkFramerate = framerate;
 
 		pos += loadedBlockSize;
 		pos += discardSamples;
@@ -1763,7 +2928,8 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		{
 			if(!ProcessInternalSync(Signal, i, pos, &syncinternal, &syncAdvance, TYPE_INTERNAL_KNOWN, config))
 			{
-				free(sampleBuffer);
+				free(windowArray);
+				free(windowFloatArray);
 				freeWindows(&windows);
 				return 0;
 			}
@@ -1773,7 +2939,8 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		{
 			if(!ProcessInternalSync(Signal, i, pos, &syncinternal, &syncAdvance, TYPE_INTERNAL_UNKNOWN, config))
 			{
-				free(sampleBuffer);
+				free(windowArray);
+				free(windowFloatArray);
 				freeWindows(&windows);
 				return 0;
 			}
@@ -1782,6 +2949,75 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 		i++;
 	}
 
+	batches = CreateDFFTBatches(Signal, i, &batchCount, config);
+	if(!batches)
+	{
+		free(windowArray);
+		free(windowFloatArray);
+		freeWindows(&windows);
+		return 0;
+	}
+
+	if(config->floatPipeline == FLOAT_PIPELINE_VALIDATE)
+	{
+		deviation = (double*)calloc(i+1, sizeof(double));
+		if(!deviation)
+		{
+			logmsg("\tERROR: malloc failed.\n");
+			free(windowArray);
+			free(windowFloatArray);
+			free(batches);
+			freeWindows(&windows);
+			return 0;
+		}
+	}
+
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for schedule(dynamic) reduction(+:errors)
+#endif
+	for(batch = 0; batch < batchCount; batch++)
+	{
+		if(batches[batch].count > 1)
+		{
+			if(!ProcessSignalBatch(Signal, &batches[batch], windowArray, windowFloatArray, deviation, config))
+				errors++;
+		}
+		else
+		{
+			if(!ProcessSignalBlock(Signal, batches[batch].blocks[0],
+					windowArray[batches[batch].blocks[0]], windowFloatArray[batches[batch].blocks[0]], deviation, config))
+				errors++;
+		}
+	}
+
+	if(deviation)
+	{
+		if(!errors)
+			ReportFloatDeviation(deviation, i, config);
+		free(deviation);
+		deviation = NULL;
+	}
+
+	if(!errors && config->clkMeasure && config->clkBlock >= 0 && config->clkBlock < i)
+	{
+		if(!ProcessSignalCLK(Signal, clkFramerate, config))
+			errors++;
+	}
+
+	free(windowArray);
+	windowArray = NULL;
+	free(windowFloatArray);
+	windowFloatArray = NULL;
+	free(batches);
+	batches = NULL;
+
+	if(errors)
+	{
+		logmsg("\tERROR: Could not process %s blocks.\n", getRoleText(Signal));
+		freeWindows(&windows);
+		return 0;
+	}
+
 #ifdef DEBUG
 	logmsg("Total discarded %s samples: %ld of %d bytes each (%ld bytes total)\n", 
 		Signal->AudioChannels == 2 ? "stereo" : "mono",	SamplesForDisplay(totalDiscarded, Signal->AudioChannels),
@@ -1805,55 +3041,177 @@ int ProcessSignal(AudioSignal *Signal, parameters *config)
 	if(config->normType != max_frequency)
 		FindMaxMagnitude(Signal, config);
 
-	if(config->clock)
+	if(config->clock)
+	{
+		double	elapsedSeconds;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
+		logmsg(" - clk: Processing took %0.2fs\n", elapsedSeconds);
+	}
+
+	if(config->drawWindows)
+	{
+		VisualizeWindows(&windows, "MAIN", Signal->role, config);
+		PlotBetaFunctions(config);
+	}
+
+	freeWindows(&windows);
+
+	return i;
+}
+
+/*
+	offset and size are in interleaved samples, the transforms read
+	the planar channels starting at the same position
+*/
+int ExecuteDFFT(AudioBlocks *AudioArray, AudioSignal *Signal, long int offset, size_t size, double *window, int ZeroPad, parameters *config)
+{
+	long int	frame = 0;
+
+	frame = offset/Signal->AudioChannels;
+	if(Signal->AudioChannels == 1)
+		return(ExecuteDFFTInternal(AudioArray, Signal->Planar[PLANAR_LEFT] + frame, size, Signal->SampleRate, window, CHANNEL_LEFT, 1, ZeroPad, config));
+
+	if(AudioArray->channel == CHANNEL_STEREO)
+		return(ExecuteDFFTStereo(AudioArray, Signal->Planar[PLANAR_LEFT] + frame, Signal->Planar[PLANAR_RIGHT] + frame,
+					size, Signal->SampleRate, window, ZeroPad, config));
+
+	// If we are procesing a mono signal in a stereo file, use both channels
+	return(ExecuteDFFTInternal(AudioArray, Signal->Planar[PLANAR_MID] + frame, size, Signal->SampleRate, window, CHANNEL_STEREO, 2, ZeroPad, config));
+}
+
+// Transform length for a block of size samples, including zero padding
+long int GetDFFTSize(size_t size, double samplerate, int AudioChannels, int ZeroPad, long int *zeropadding, double *seconds, parameters *config)
+{
+	long int	monoSignalSize = 0;
+
+	monoSignalSize = (long)size/AudioChannels;
+	*seconds = (double)size/(samplerate*(double)AudioChannels);
+	*zeropadding = 0;
+
+	if(config->padBlockSizes)
+		*zeropadding = GetBlockZeroPadValues(&monoSignalSize, seconds, config->maxBlockSeconds, samplerate);
+
+	if(ZeroPad)  /* disabled by default */
+		*zeropadding += GetZeroPadValues(&monoSignalSize, seconds, samplerate, ZeroPad);
+
+	return monoSignalSize;
+}
+
+int ExecuteDFFTFloat(AudioBlocks *AudioArray, AudioSignal *Signal, long int offset, size_t size, float *window, int ZeroPad, parameters *config)
+{
+	long int	frame = 0;
+
+	frame = offset/Signal->AudioChannels;
+	if(Signal->AudioChannels == 1)
+		return(ExecuteDFFTFloatInternal(AudioArray, Signal->Planar[PLANAR_LEFT] + frame, size, Signal->SampleRate, window, CHANNEL_LEFT, 1, ZeroPad, config));
+
+	if(AudioArray->channel == CHANNEL_STEREO)
+	{
+		if(!ExecuteDFFTFloatInternal(AudioArray, Signal->Planar[PLANAR_RIGHT] + frame, size, Signal->SampleRate, window, CHANNEL_RIGHT, 2, ZeroPad, config))
+			return 0;
+		return(ExecuteDFFTFloatInternal(AudioArray, Signal->Planar[PLANAR_LEFT] + frame, size, Signal->SampleRate, window, CHANNEL_LEFT, 2, ZeroPad, config));
+	}
+	return(ExecuteDFFTFloatInternal(AudioArray, Signal->Planar[PLANAR_MID] + frame, size, Signal->SampleRate, window, CHANNEL_STEREO, 2, ZeroPad, config));
+}
+
+/*
+	Single precision version of ExecuteDFFTInternal, the spectrum is widened
+	back to double so the rest of the analysis is unchanged
+*/
+int ExecuteDFFTFloatInternal(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, float *window, char channel, int AudioChannels, int ZeroPad, parameters *config)
+{
+	fftwf_plan		p = NULL;
+	planBuffer		buffer;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0;
+	float			*signal = NULL;
+	fftwf_complex	*spectrumf = NULL;
+	fftw_complex	*spectrum = NULL;
+	double			seconds = 0, S2 = 0;
+
+	if(!AudioArray)
 	{
-		double	elapsedSeconds;
-		clock_gettime(CLOCK_MONOTONIC, &end);
-		elapsedSeconds = TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start);
-		logmsg(" - clk: Processing took %0.2fs\n", elapsedSeconds);
+		logmsg("No Array for results\n");
+		return 0;
 	}
 
-	if(config->drawWindows)
+	monoSignalSize = GetDFFTSize(size, samplerate, AudioChannels, ZeroPad, &zeropadding, &seconds, config);
+
+	memset(&buffer, 0, sizeof(planBuffer));
+	if(!AcquirePlanBuffer(&buffer, monoSignalSize, config))
+		return 0;
+
+	p = GetFloatPlanForSize(monoSignalSize, &buffer, config);
+	if(!p)
 	{
-		VisualizeWindows(&windows, "MAIN", Signal->role, config);
-		PlotBetaFunctions(config);
+		ReleasePlanBuffer(&buffer, config);
+		return 0;
 	}
 
-	free(sampleBuffer);
-	freeWindows(&windows);
-
-	return i;
-}
+	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	if(!spectrum)
+	{
+		ReleasePlanBuffer(&buffer, config);
+		logmsg("Not enough memory\n");
+		return(0);
+	}
 
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, int AudioChannels, int ZeroPad, parameters *config)
-{
-	char channel = CHANNEL_STEREO;
+	signal = (float*)buffer.signal;
+	spectrumf = (fftwf_complex*)buffer.spectrum;
+	memset(signal, 0, sizeof(float)*(monoSignalSize+1));
 
-	if(AudioChannels == 1)
-		channel = CHANNEL_LEFT;
-	else
+	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
-		// If we are procesing a mono signal in a stereo file, use both channels
-		if(AudioArray->channel == CHANNEL_MONO)
-			channel = CHANNEL_STEREO;
+		signal[i] = (float)samples[i];
 
-		if(AudioArray->channel == CHANNEL_STEREO)
+		if(window)
 		{
-			channel = CHANNEL_RIGHT;
-			if(!ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, config))
+			signal[i] *= window[i];
+			S2 += window[i]*window[i];
+			if(isinf(S2)) {
+				logmsg("i: %ld S2: %g window[i]: %g\n", i, S2, window[i]);
+				logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
+					monoSignalSize, zeropadding, monoSignalSize - zeropadding);
+				logmsg("ERROR: Window error in code detected\n");
+				fftw_free(spectrum);
+				ReleasePlanBuffer(&buffer, config);
 				return 0;
-			channel = CHANNEL_LEFT;
+			}
 		}
 	}
-	return(ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, AudioChannels, ZeroPad, config));
+
+	fftwf_execute_dft_r2c(p, signal, spectrumf);
+	p = NULL;
+
+	for(i = 0; i < monoSignalSize/2+1; i++)
+		spectrum[i] = spectrumf[i];
+
+	if(channel != CHANNEL_RIGHT)
+	{
+		AudioArray->fftwValues.spectrum = spectrum;
+		AudioArray->fftwValues.size = monoSignalSize;
+		AudioArray->fftwValues.ENBW = samplerate*S2;
+	}
+	else
+	{
+		AudioArray->fftwValuesRight.spectrum = spectrum;
+		AudioArray->fftwValuesRight.size = monoSignalSize;
+		AudioArray->fftwValuesRight.ENBW = samplerate*S2;
+	}
+	AudioArray->seconds = seconds;
+	ReleasePlanBuffer(&buffer, config);
+	signal = NULL;
+
+	return(1);
 }
 
 // we use this for normalization now that we zeropad
 // https://holometer.fnal.gov/GH_FFT.pdf
+// samples is a single planar channel, channel only selects where the result goes
 int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, double samplerate, double *window, char channel, int AudioChannels, int ZeroPad, parameters *config)
 {
 	fftw_plan		p = NULL;
-	long			stereoSignalSize = 0;
+	planBuffer		buffer;
 	long			i = 0, monoSignalSize = 0, zeropadding = 0;
 	double			*signal = NULL;
 	fftw_complex	*spectrum = NULL;
@@ -1865,59 +3223,35 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 		return 0;
 	}
 
-	stereoSignalSize = (long)size;
-	monoSignalSize = stereoSignalSize/AudioChannels;
-	seconds = (double)size/(samplerate*(double)AudioChannels);
-
-	if(config->padBlockSizes)
-		zeropadding = GetBlockZeroPadValues(&monoSignalSize, &seconds, config->maxBlockSeconds, samplerate);
-	
-	if(ZeroPad)  /* disabled by default */
-		zeropadding = GetZeroPadValues(&monoSignalSize, &seconds, samplerate, ZeroPad);
+	monoSignalSize = GetDFFTSize(size, samplerate, AudioChannels, ZeroPad, &zeropadding, &seconds, config);
 
 #ifdef DEBUG
 	if(config->verbose >= 2)
 		logmsg("ExecuteDFFTInternal> stereoSignalSize: %ld monoSignalSize: %ld zeropadding: %ld windowed: %ld seconds: %g\n", 
-			stereoSignalSize, monoSignalSize, zeropadding, monoSignalSize - zeropadding, seconds);
+			(long)size, monoSignalSize, zeropadding, monoSignalSize - zeropadding, seconds);
 #endif
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
-	if(!signal)
+	memset(&buffer, 0, sizeof(planBuffer));
+	if(!AcquirePlanBuffer(&buffer, monoSignalSize, config))
+		return 0;
+
+	p = GetPlanForSize(monoSignalSize, &buffer, config);
+	if(!p)
 	{
-		logmsg("Not enough memory\n");
-		return(0);
+		ReleasePlanBuffer(&buffer, config);
+		return 0;
 	}
+
 	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
 	if(!spectrum)
 	{
-		free(signal);
+		ReleasePlanBuffer(&buffer, config);
 		logmsg("Not enough memory\n");
 		return(0);
 	}
 
-	if(!config->model_plan)
-	{
-		config->model_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->model_plan)
-		{
-			logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			return 0;
-		}
-	}
-
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-	if(!p)
-	{
-		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
-		free(signal);
-		signal = NULL;
-		return 0;
-	}
-
+	signal = buffer.signal;
 	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
 
 #ifdef DEBUG
 	if(config->verbose >= 3)
@@ -1927,12 +3261,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
-		if(channel == CHANNEL_LEFT)
-			signal[i] = samples[i*AudioChannels];
-		if(channel == CHANNEL_RIGHT)
-			signal[i] = samples[i*AudioChannels+1];
-		if(channel == CHANNEL_STEREO)
-			signal[i] = (samples[i*AudioChannels]+samples[i*AudioChannels+1])/2.0;
+		signal[i] = samples[i];
 
 		if(window)
 		{
@@ -1943,13 +3272,14 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 				logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
 					monoSignalSize, zeropadding, monoSignalSize - zeropadding);
 				logmsg("ERROR: Window error in code detected\n");
+				fftw_free(spectrum);
+				ReleasePlanBuffer(&buffer, config);
 				return 0;
 			}
 		}
 	}
 
-	fftw_execute(p);
-	fftw_destroy_plan(p);
+	fftw_execute_dft_r2c(p, signal, spectrum);
 	p = NULL;
 
 #ifdef DEBUG
@@ -1970,8 +3300,209 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, size_t size, d
 		AudioArray->fftwValuesRight.ENBW = samplerate*S2;
 	}
 	AudioArray->seconds = seconds;
-	free(signal);
+	ReleasePlanBuffer(&buffer, config);
+	signal = NULL;
+
+	return(1);
+}
+
+/*
+	Same as ExecuteDFFTInternal, for blocks with equal transform lengths that
+	are executed as a single batched transform. Each block gets its own copy
+	of the spectrum.
+*/
+int ExecuteDFFTBatch(AudioSignal *Signal, dfftBatch *batch, double **windowArray, parameters *config)
+{
+	fftw_plan		p = NULL;
+	planBuffer		buffer;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0, spectrumSize = 0;
+	int				b = 0, AudioChannels = 0;
+	double			seconds[DFFT_BATCH_MAX], S2[DFFT_BATCH_MAX];
+	double			*planar = NULL;
+	fftw_complex	*spectrum[DFFT_BATCH_MAX];
+
+	AudioChannels = Signal->AudioChannels;
+	planar = Signal->Planar[AudioChannels == 1 ? PLANAR_LEFT : PLANAR_MID];
+	monoSignalSize = batch->size;
+	spectrumSize = monoSignalSize/2+1;
+
+	memset(&buffer, 0, sizeof(planBuffer));
+	if(!AcquirePlanBuffer(&buffer, GetBatchBufferSize(monoSignalSize, batch->count), config))
+		return 0;
+
+	p = GetBatchPlanForSize(monoSignalSize, batch->count, &buffer, config);
+	if(!p)
+	{
+		ReleasePlanBuffer(&buffer, config);
+		return 0;
+	}
+
+	memset(buffer.signal, 0, sizeof(double)*monoSignalSize*batch->count);
+	for(b = 0; b < batch->count; b++)
+	{
+		AudioBlocks	*AudioArray = NULL;
+		double		*samples = NULL, *signal = NULL, *window = NULL;
+
+		AudioArray = &Signal->Blocks[batch->blocks[b]];
+		samples = planar + AudioArray->offset/AudioChannels;
+		signal = buffer.signal + b*monoSignalSize;
+		window = windowArray[batch->blocks[b]];
+
+		GetDFFTSize(AudioArray->loadSize-AudioArray->difference, Signal->SampleRate, AudioChannels, config->ZeroPad, &zeropadding, &seconds[b], config);
+		S2[b] = 0;
+		spectrum[b] = NULL;
+
+		for(i = 0; i < monoSignalSize - zeropadding; i++)
+		{
+			signal[i] = samples[i];
+
+			if(window)
+			{
+				signal[i] *= window[i];
+				S2[b] += window[i]*window[i];
+				if(isinf(S2[b])) {
+					logmsg("i: %ld S2: %g window[i]: %g\n", i, S2[b], window[i]);
+					logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
+						monoSignalSize, zeropadding, monoSignalSize - zeropadding);
+					logmsg("ERROR: Window error in code detected\n");
+					ReleasePlanBuffer(&buffer, config);
+					return 0;
+				}
+			}
+		}
+	}
+
+	for(b = 0; b < batch->count; b++)
+	{
+		spectrum[b] = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*spectrumSize);
+		if(!spectrum[b])
+		{
+			while(b--)
+				fftw_free(spectrum[b]);
+			ReleasePlanBuffer(&buffer, config);
+			logmsg("Not enough memory\n");
+			return(0);
+		}
+	}
+
+	fftw_execute_dft_r2c(p, buffer.signal, buffer.spectrum);
+	p = NULL;
+
+	for(b = 0; b < batch->count; b++)
+	{
+		AudioBlocks	*AudioArray = NULL;
+
+		AudioArray = &Signal->Blocks[batch->blocks[b]];
+		memcpy(spectrum[b], buffer.spectrum + b*spectrumSize, sizeof(fftw_complex)*spectrumSize);
+
+		AudioArray->fftwValues.spectrum = spectrum[b];
+		AudioArray->fftwValues.size = monoSignalSize;
+		AudioArray->fftwValues.ENBW = Signal->SampleRate*S2[b];
+		AudioArray->seconds = seconds[b];
+	}
+	ReleasePlanBuffer(&buffer, config);
+
+	return(1);
+}
+
+/*
+	Both channels of a stereo block are real, so they are
+	transformed together as z = L + iR with a single complex FFT of the
+	same length. Since Z[N-k]* = L[k] - iR[k], each spectrum is recovered with
+	L[k] = (Z[k] + Z[N-k]*)/2 and R[k] = (Z[k] - Z[N-k]*)/2i
+*/
+int ExecuteDFFTStereo(AudioBlocks *AudioArray, double *left, double *right, size_t size, double samplerate, double *window, int ZeroPad, parameters *config)
+{
+	fftw_plan		p = NULL;
+	planBuffer		buffer;
+	long			i = 0, monoSignalSize = 0, zeropadding = 0;
+	fftw_complex	*signal = NULL, *packed = NULL;
+	fftw_complex	*spectrumLeft = NULL, *spectrumRight = NULL;
+	double			seconds = 0, S2 = 0;
+
+	if(!AudioArray)
+	{
+		logmsg("No Array for results\n");
+		return 0;
+	}
+
+	monoSignalSize = GetDFFTSize(size, samplerate, 2, ZeroPad, &zeropadding, &seconds, config);
+
+	memset(&buffer, 0, sizeof(planBuffer));
+	if(!AcquirePlanBuffer(&buffer, 2*monoSignalSize, config))
+		return 0;
+
+	p = GetComplexPlanForSize(monoSignalSize, &buffer, config);
+	if(!p)
+	{
+		ReleasePlanBuffer(&buffer, config);
+		return 0;
+	}
+
+	spectrumLeft = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	spectrumRight = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
+	if(!spectrumLeft || !spectrumRight)
+	{
+		if(spectrumLeft)
+			fftw_free(spectrumLeft);
+		if(spectrumRight)
+			fftw_free(spectrumRight);
+		ReleasePlanBuffer(&buffer, config);
+		logmsg("Not enough memory\n");
+		return(0);
+	}
+
+	signal = (fftw_complex*)buffer.signal;
+	packed = buffer.spectrum;
+	memset(signal, 0, sizeof(fftw_complex)*monoSignalSize);
+
+	for(i = 0; i < monoSignalSize - zeropadding; i++)
+	{
+		if(window)
+		{
+			signal[i] = left[i]*window[i] + I*right[i]*window[i];
+			S2 += window[i]*window[i];
+			if(isinf(S2)) {
+				logmsg("i: %ld S2: %g window[i]: %g\n", i, S2, window[i]);
+				logmsg("monoSignalSize: %ld zeropadding: %ld monoSignalSize - zeropadding: %ld\n",
+					monoSignalSize, zeropadding, monoSignalSize - zeropadding);
+				logmsg("ERROR: Window error in code detected\n");
+				fftw_free(spectrumLeft);
+				fftw_free(spectrumRight);
+				ReleasePlanBuffer(&buffer, config);
+				return 0;
+			}
+		}
+		else
+			signal[i] = left[i] + I*right[i];
+	}
+
+	fftw_execute_dft(p, signal, packed);
+	p = NULL;
+
+	for(i = 0; i < monoSignalSize/2+1; i++)
+	{
+		fftw_complex	z = 0, zc = 0;
+
+		z = packed[i];
+		zc = conj(packed[i == 0 ? 0 : monoSignalSize - i]);
+
+		spectrumLeft[i] = 0.5*(z + zc);
+		spectrumRight[i] = -0.5*I*(z - zc);
+	}
+
+	AudioArray->fftwValues.spectrum = spectrumLeft;
+	AudioArray->fftwValues.size = monoSignalSize;
+	AudioArray->fftwValues.ENBW = samplerate*S2;
+
+	AudioArray->fftwValuesRight.spectrum = spectrumRight;
+	AudioArray->fftwValuesRight.size = monoSignalSize;
+	AudioArray->fftwValuesRight.ENBW = samplerate*S2;
+
+	AudioArray->seconds = seconds;
+	ReleasePlanBuffer(&buffer, config);
 	signal = NULL;
+	packed = NULL;
 
 	return(1);
 }
@@ -2010,9 +3541,77 @@ int CalculateMaxCompare(int block, AudioSignal *Signal, double significant, char
 	return size;
 }
 
+/*
+	Both spectra are on the same bin grid when their block lengths round to
+	the same boxsize, so each comparison frequency can be found directly by
+	its bin. The table holds index+1, 0 means no frequency at that bin.
+*/
+int *CreateFrequencyBinIndex(memoryArena *scratch, Frequency *freq, int size, double boxsize, long int *maxBin)
+{
+	int			*binIndex = NULL;
+	long int	bin = 0;
+
+	*maxBin = 0;
+	for(int i = 0; i < size; i++)
+	{
+		bin = GetFrequencyBin(freq[i].hertz, boxsize);
+		if(bin > *maxBin)
+			*maxBin = bin;
+	}
+
+	binIndex = (int*)ArenaCalloc(scratch, sizeof(int)*(*maxBin+1));
+	if(!binIndex)
+	{
+		logmsg("ERROR: Not enough memory (binIndex)\n");
+		return NULL;
+	}
+
+	for(int i = 0; i < size; i++)
+	{
+		bin = GetFrequencyBin(freq[i].hertz, boxsize);
+		if(bin >= 0 && !binIndex[bin])
+			binIndex[bin] = i + 1;
+	}
+	return binIndex;
+}
+
+/* Returns the index of the matching comparison frequency or -1 */
+int FindFrequencyMatch(Frequency *freqRef, int freq, Frequency *freqComp, int testSize, int *binIndex, long int maxBin, double boxsize)
+{
+	if(freqRef[freq].matched)
+		return -1;
+
+	if(binIndex)
+	{
+		long int	bin = 0;
+		int			comp = 0;
+
+		bin = GetFrequencyBin(freqRef[freq].hertz, boxsize);
+		if(bin < 0 || bin > maxBin || !binIndex[bin])
+			return -1;
+
+		comp = binIndex[bin] - 1;
+		if(!freqComp[comp].matched && areDoublesEqual(freqRef[freq].hertz, freqComp[comp].hertz))
+			return comp;
+		return -1;
+	}
+
+	for(int comp = 0; comp < testSize; comp++)
+	{
+		if(!freqComp[comp].matched && areDoublesEqual(freqRef[freq].hertz, freqComp[comp].hertz))
+			return comp;
+	}
+	return -1;
+}
+
 int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, char channel, int block, int refSize, int testSize, parameters *config)
 {
 	Frequency	*freqRef = NULL, *freqComp = NULL;
+	int			*binIndex = NULL;
+	long int	maxBin = 0;
+	double		refBoxsize = 0, compBoxsize = 0;
+	memoryArena	*scratch = NULL;
+	arenaMark	mark;
 
 	if(channel == CHANNEL_LEFT)
 	{
@@ -2031,6 +3630,18 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		return 0;
 	}
 
+	/* Same rounding as FillFrequencyStructuresInternal */
+	refBoxsize = RoundFloat(ReferenceSignal->Blocks[block].seconds, 3);
+	compBoxsize = RoundFloat(ComparisonSignal->Blocks[block].seconds, 3);
+	scratch = GetScratchArena();
+	mark = GetArenaMark(scratch);
+	if(testSize && refBoxsize > 0 && refBoxsize == compBoxsize)
+	{
+		binIndex = CreateFrequencyBinIndex(scratch, freqComp, testSize, compBoxsize, &maxBin);
+		if(!binIndex)
+			return 0;
+	}
+
 	for(int freq = 0; freq < refSize; freq++)
 	{
 		int found = 0, index = 0;
@@ -2038,22 +3649,17 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 		if(!IncrementCompared(block, channel, config))
 		{
 			logmsg("Internal consistency failure, please send error log (compare)\n");
+			RewindArena(scratch, mark);
 			return 0;
 		}
 
-		for(int comp = 0; comp < testSize; comp++)
+		index = FindFrequencyMatch(freqRef, freq, freqComp, testSize, binIndex, maxBin, compBoxsize);
+		if(index >= 0)
 		{
-			if(!freqRef[freq].matched && !freqComp[comp].matched &&
-				areDoublesEqual(freqRef[freq].hertz, freqComp[comp].hertz))
-			{
-				freqComp[comp].matched = freq + 1;
-				freqRef[freq].matched = comp + 1;
-
-				found = 1;
-				index = comp;
+			freqComp[index].matched = freq + 1;
+			freqRef[freq].matched = index + 1;
 
-				break;
-			}
+			found = 1;
 		}
 
   		/* Now in either case, compare amplitude and phase */
@@ -2064,6 +3670,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!InsertAmplDifference(block, freqRef[freq], freqComp[index], channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (AmplDiff)\n");
+					RewindArena(scratch, mark);
 					return 0;
 				}
 			}
@@ -2072,6 +3679,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!IncrementPerfectMatch(block, channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (perfect)\n");
+					RewindArena(scratch, mark);
 					return 0;
 				}
 			}
@@ -2081,6 +3689,7 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 				if(!InsertPhaseDifference(block, freqRef[freq], freqComp[index], channel, config))
 				{
 					logmsg("Internal consistency failure, please send error log (PhaseDiff)\n");
+					RewindArena(scratch, mark);
 					return 0;
 				}
 			}
@@ -2093,16 +3702,47 @@ int CompareFrequencies(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 			if(!InsertFreqNotFound(block, freqRef[freq].hertz, freqRef[freq].amplitude, channel, config))
 			{
 				logmsg("Internal consistency failure, please send error log (Not found)\n");
+				RewindArena(scratch, mark);
 				return 0;
 			}
 		}
 	}
+	RewindArena(scratch, mark);
+	return 1;
+}
+
+int CompareAudioBlock(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, int block, parameters *config)
+{
+	char	channel = CHANNEL_MONO;
+	int 	refSize = 0, testSize = 0, type = 0;
+
+	type = GetBlockType(config, block);
+	channel = GetBlockChannel(config, block);
+
+	/* Ignore Control blocks */
+	if(type < TYPE_CONTROL)
+		return 1;
+
+	refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
+	testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
+
+	if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_LEFT, block, refSize, testSize, config))
+		return 0;
+
+	if(channel == CHANNEL_STEREO)
+	{
+		refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_RIGHT, config);
+		testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_RIGHT, config);
+
+		if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_RIGHT, block, refSize, testSize, config))
+			return 0;
+	}
 	return 1;
 }
 
 int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
 {
-	int		block = 0, warn = 0;
+	int		block = 0, warn = 0, errors = 0;
 	struct	timespec	start, end;
 
 	if(config->clock)
@@ -2114,40 +3754,42 @@ int CompareAudioBlocks(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSign
 	if(config->extendedResults || config->showAll)
 		logmsg("\n");
 
+	// Each block only writes to its own BlockDifference, totals are reduced after
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel for schedule(dynamic) reduction(+:errors)
+#endif
+	for(block = 0; block < config->types.totalBlocks; block++)
+	{
+		if(!CompareAudioBlock(ReferenceSignal, ComparisonSignal, block, config))
+			errors++;
+	}
+
+	if(errors)
+		return 0;
+
+	ReduceDifferenceArray(config);
+
 	for(block = 0; block < config->types.totalBlocks; block++)
 	{
-		char	channel = CHANNEL_MONO;
-		int 	refSize = 0, testSize = 0, type = 0;
+		int 	type = 0;
 
 		type = GetBlockType(config, block);
-		channel = GetBlockChannel(config, block);
  
 		/* Ignore Control blocks */
 		if(type < TYPE_CONTROL)
 			continue;
 
-		refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
-		testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
-
 		if(config->verbose)
 		{
+			int 	refSize = 0, testSize = 0;
+
+			refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
+			testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_LEFT, config);
 			logmsgFileOnly("Comparing %s# %d (%d) %ld vs %ld\n",
 					GetBlockName(config, block), GetBlockSubIndex(config, block), block,
 					refSize, testSize);
 		}
 
-		if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_LEFT, block, refSize, testSize, config))
-			return 0;
-
-		if(channel == CHANNEL_STEREO)
-		{
-			refSize = CalculateMaxCompare(block, ReferenceSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_RIGHT, config);
-			testSize = CalculateMaxCompare(block, ComparisonSignal, type != TYPE_SILENCE ? config->significantAmplitude : SILENCE_LIMIT, CHANNEL_RIGHT, config);
-
-			if(!CompareFrequencies(ReferenceSignal, ComparisonSignal, CHANNEL_RIGHT, block, refSize, testSize, config))
-				return 0;
-		}
-
 		if(type > TYPE_CONTROL)
 		{
 			if(config->Differences.BlockDiffArray[block].cntFreqBlkDiff)
@@ -2251,6 +3893,7 @@ void NormalizeAudioByRatio(AudioSignal *Signal, double ratio)
 	// Removed the * 0.5 since we changed to internal double representation)
 	for(i = start; i < end; i++)
 		samples[i] = samples[i]*ratio;
+	UpdatePlanarSamples(Signal, start, end - start);
 }
 
 // This is used to Normalize in the time domain, after finding the
@@ -45,6 +45,9 @@
 #include <complex.h>
 #include <fftw3.h>
 #include <libgen.h>
+#ifdef OPENMP_ENABLE
+#include <omp.h>
+#endif
 
 #include "incbeta.h"
 
@@ -151,6 +154,11 @@
 #define CHANNEL_LEFT	'l'
 #define CHANNEL_RIGHT	'r'
 
+#define PLANAR_LEFT		0
+#define PLANAR_RIGHT	1
+#define PLANAR_MID		2	// (L+R)/2, used by blocks that mix both channels
+#define PLANAR_COUNT	3
+
 #define NO_SYNC_AUTO_C		'A'
 #define NO_SYNC_MANUAL_C	'M'
 #define NO_SYNC_DIGITAL_C	'D'
@@ -374,6 +382,11 @@ typedef struct FrequencySt {
 	short	matched;
 } Frequency;
 
+typedef struct bin_magnitude_st {
+	double		magnitude;
+	long int	bin;
+} BinMagnitude;
+
 typedef struct fftw_spectrum_st {
 	fftw_complex  	*spectrum;
 	size_t			size;
@@ -420,6 +433,13 @@ typedef struct AudioBlock_st {
 	double			extraPercent;
 } AudioBlocks;
 
+/* One channel of a block inside the loaded signal, samples are stride apart */
+typedef struct block_view_st {
+	double		*samples;
+	long int	size;
+	int			stride;
+} blockView;
+
 typedef struct AudioSt {
 	char		SourceFile[BUFFER_SIZE];
 	int			AudioChannels;
@@ -430,12 +450,16 @@ typedef struct AudioSt {
 	double		floorAmplitude;
 
 	double		*Samples;
+	double		*Planar[PLANAR_COUNT];	// per channel, mono files point to Samples
+	void		*mappedPCM;				// Samples and Planar come from the PCM cache
+	size_t		mappedPCMSize;
 	double		SampleRate;
 	int			bytesPerSample;
 	long int	numSamples;
 	long int	SamplesStart;
 	long int	samplesPosFLAC;
 	int			errorFLAC;
+	int			seekTableFLAC;
 	double		framerate;
 	wav_hdr		header;
 	uint8_t		fmtExtra[24];
@@ -482,6 +506,7 @@ typedef struct AudioSt {
 
 typedef struct window_unit_st {
 	double		*window;
+	float		*windowf;
 	long int	frames;
 	double		seconds;
 	long int	size;
@@ -500,6 +525,100 @@ typedef struct window_st {
 
 /********************************************************/
 
+typedef struct plan_unit_st {
+	fftw_plan	plan;
+	fftwf_plan	planf;
+	long int	size;
+	int			type;
+	int			howmany;
+} planUnit;
+
+typedef struct plan_buffer_st {
+	double			*signal;
+	fftw_complex	*spectrum;
+	long int		size;
+	int				inUse;
+	int				slot;
+} planBuffer;
+
+typedef struct plan_st {
+	planUnit	*planArray;
+	int			planCount;
+	int			MaxPlan;
+	planBuffer	*bufferArray;
+	int			bufferCount;
+	int			MaxBuffer;
+	long int	hits;
+	long int	misses;
+	int			wisdomLoaded;
+} planManager;
+
+/********************************************************/
+
+typedef struct arena_chunk_st {
+	struct arena_chunk_st	*next;
+	size_t					size;
+	size_t					used;
+	int						mapped;
+} arenaChunk;
+
+typedef struct arena_mark_st {
+	arenaChunk	*chunk;
+	size_t		used;
+	size_t		allocated;
+} arenaMark;
+
+typedef struct arena_st {
+	arenaChunk	*first;
+	arenaChunk	*current;
+	size_t		allocated;
+	size_t		reserved;
+	size_t		highWater;
+	int			hugePages;
+	int			shared;
+#ifdef OPENMP_ENABLE
+	omp_lock_t	lock;		// held by ArenaAlloc when shared
+#endif
+} memoryArena;
+
+#define DFFT_BATCH_MAX	16	// blocks per batched transform
+
+#define FLOAT_PIPELINE_OFF		0
+#define FLOAT_PIPELINE_ON		1
+#define FLOAT_PIPELINE_VALIDATE	2
+
+#define SYNC_ENGINE_FFT			0
+#define SYNC_ENGINE_GOERTZEL	1
+
+typedef struct dfft_batch_st {
+	long int	blocks[DFFT_BATCH_MAX];
+	int			count;
+	long int	size;
+} dfftBatch;
+
+/* Reference of a batch run, loaded once and shared by every comparison */
+typedef struct reference_cache_st {
+	AudioSignal	*loaded;			// as loaded and synced
+	AudioSignal	*processed;			// after the DFFTs, before normalization
+	memoryArena	arena;				// frequency arrays of both copies
+	double		smallerFramerate;	// processed is only valid for these
+	double		biggerFramerate;
+	int			balanceChecked;
+	int			noBalance;
+	int			smallFile;
+} referenceCache;
+
+/* How plots are encoded when written as PNG */
+typedef struct png_profile_st {
+	int		level;		// zlib compression level
+	int		filter;		// PNG_PROFILE_FILTER_*
+	int		palette;	// indexed color when the plot has 256 colors or less
+	int		threads;	// IDAT compressed in this many segments at once
+	int		enabled;	// every plot goes through our encoder
+} pngProfile;
+
+/********************************************************/
+
 typedef struct freq_diff_st {
 	double	hertz;
 	double	amplitude;
@@ -686,7 +805,6 @@ typedef struct parameters_st {
 	double			warningRatioTooHigh;
 	double			syncAlignPct[4];
 	int				syncAlignTolerance[4];
-	int				syncAlignIterator;
 
 	int				substractAveragePlot;
 	double			averageDifference;
@@ -695,9 +813,27 @@ typedef struct parameters_st {
 	double 			plotResX;
 	double			plotResY;
 
-	fftw_plan		sync_plan;
+	planManager		plans;
+	memoryArena		arena;
+	int				trainWisdom;
+	int				floatPipeline;
+	int				syncEngine;
+	char			pcmCachePath[BUFFER_SIZE];
+	long int		pcmCacheMaxMB;
+	int				flacSlices;
+	char			analysisCachePath[BUFFER_SIZE];
+	uint64_t		analysisCacheKey;
+	int				referenceFromCache;
+	int				referenceReused;	// processed copy from refCache, per comparison
 	fftw_plan		model_plan;
 	fftw_plan		reverse_plan;
+	char			**comparisonList;
+	int				comparisonCount;
+	referenceCache	*refCache;
+	char			serveSocket[BUFFER_SIZE];
+	int				serveWorkers;
+	long int		serveMemoryMB;
+	pngProfile		png;
 
 	double			refNoiseMin;
 	double			refNoiseMax;
@@ -752,5 +888,17 @@ typedef struct parameters_st {
 	int				executefft;
 } parameters;
 
+#define BATCH_FAILED	0
+#define BATCH_COMPARED	1
+#define BATCH_SKIPPED	2
+
+/* One comparison of a batch run, with its own copy of the parameters */
+typedef struct batch_comparison_st {
+	parameters	config;
+	char		*log;		// its output, written in order once all are done
+	int			ready;		// output folder created
+	int			result;		// BATCH_*
+} batchComparison;
+
 
 #endif
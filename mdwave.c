@@ -40,10 +40,13 @@
 #include "balance.h"
 #include "loadfile.h"
 #include "profile.h"
+#include "plans.h"
+#include "kernels.h"
+#include "arena.h"
 
 int ProcessSignalMDW(AudioSignal *Signal, parameters *config);
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal);
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal);
+int ExecuteDFFT(AudioBlocks *AudioArray, long int pos, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal);
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, blockView *input, blockView *output, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal);
 int commandline_wave(int argc , char *argv[], parameters *config);
 void PrintUsage_wave(void);
 void Header_wave(int log);
@@ -83,6 +86,9 @@ int main(int argc , char *argv[])
 		return 1;
 	}
 
+	LoadWisdom(&config);
+	SelectKernels(&config);
+
 	if(ExecuteMDWave(&config, 0) == 1)
 	{
 		logmsg("Aborting\n");
@@ -91,6 +97,8 @@ int main(int argc , char *argv[])
 
 	if(config.executefft)
 	{
+		// CleanUp released the arena and its lock with the first pass
+		InitArena(&config.arena, config.arena.hugePages, 1);
 		if(!LoadProfile(&config))
 			return 1;
 
@@ -124,7 +132,6 @@ int main(int argc , char *argv[])
 int ExecuteMDWave(parameters *config, int discardMDW)
 {
 	AudioSignal  		*ReferenceSignal = NULL;
-	char 				*MainPath = NULL;
 
 	if(discardMDW)
 	{
@@ -190,14 +197,11 @@ int ExecuteMDWave(parameters *config, int discardMDW)
 	SetAmplitudeMatchByDurationMDW(ReferenceSignal, config);
 
 	logmsg("\n* Processing Audio\n");
-	MainPath = PushMainPath(config);
 	if(!ProcessSignalMDW(ReferenceSignal, config))
 	{
 		CleanUp(&ReferenceSignal, config);
-		PopMainPath(&MainPath);
 		return 1;
 	}
-	PopMainPath(&MainPath);
 
 	//logmsg("* Max blanked frequencies per block %d\n", config->maxBlanked);
 	CleanUp(&ReferenceSignal, config);
@@ -229,17 +233,19 @@ char *GenerateFileNamePrefix(parameters *config)
 
 int CreateChunksFolder(parameters *config)
 {
-	char name[BUFFER_SIZE*4];
+	char name[BUFFER_SIZE*4], subname[BUFFER_SIZE/8];
 
-	sprintf(name, "%s%cChunks", config->folderName, FOLDERCHAR);
+	ComposeFileName(name, "Chunks", "", config);
 	if(!CreateFolder(name))
 		return 0;
 
-	sprintf(name, "%s%cChunks%cProcessed", config->folderName, FOLDERCHAR, FOLDERCHAR);
+	sprintf(subname, "Chunks%cProcessed", FOLDERCHAR);
+	ComposeFileName(name, subname, "", config);
 	if(!CreateFolder(name))
 		return 0;
 
-	sprintf(name, "%s%cChunks%cSource", config->folderName, FOLDERCHAR, FOLDERCHAR);
+	sprintf(subname, "Chunks%cSource", FOLDERCHAR);
+	ComposeFileName(name, subname, "", config);
 	if(!CreateFolder(name))
 		return 0;
 	return 1;
@@ -249,13 +255,12 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 {
 	long int		pos = 0;
 	double			longest = 0;
-	double			*sampleBuffer;
-	long int		sampleBufferSize = 0;
+	long int		longestBlockSize = 0;
 	windowManager	windows;
 	double			*windowUsed = NULL;
 	long int		loadedBlockSize = 0, i = 0, syncAdvance = 0;
 	struct timespec	start, end;
-	char			Name[BUFFER_SIZE*2+256], tempName[BUFFER_SIZE];
+	char			Name[BUFFER_SIZE*4+256], tempName[BUFFER_SIZE];
 	int				discardSamples = 0, syncinternal = 0, hadSync = 0;
 	double			leftDecimals = 0;
 	FILE			*processed = NULL;
@@ -269,13 +274,7 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		return 0;
 	}
 
-	sampleBufferSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsg("\tERROR: malloc failed.\n");
-		return(0);
-	}
+	longestBlockSize = SecondsToSamples(Signal->SampleRate, longest, Signal->AudioChannels, NULL, NULL);
 
 	if(!initWindows(&windows, Signal->SampleRate, config->window, config))
 	{
@@ -330,28 +329,25 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 				config->smallFile |= Signal->role;
 				logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite.\n");
 				if(config->verbose)
-					logmsg("load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n", loadedBlockSize, sampleBufferSize, pos + loadedBlockSize, pos, Signal->numSamples);
+					logmsg("load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n", loadedBlockSize, longestBlockSize, pos + loadedBlockSize, pos, Signal->numSamples);
 			}
 			break;
 		}
 
-		// Clean Buffer and fill it
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
-
 		if(Signal->Blocks[i].type >= TYPE_SILENCE && config->executefft)
 		{
-			if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, FORWARD_FFTW, Signal))
+			if(!ExecuteDFFT(&Signal->Blocks[i], pos, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, FORWARD_FFTW, Signal))
 				return 0;
 		}
 		
 		if(config->chunks && !config->discardMDW)
 		{
-			sprintf(Name, "%s%cChunks%cSource%c%03ld_0_%010ld_%s_%03d_chunk.wav", 
-				config->folderName, FOLDERCHAR, FOLDERCHAR, FOLDERCHAR,
+			sprintf(tempName, "Chunks%cSource%c%03ld_0_%010ld_%s_%03d_chunk", 
+				FOLDERCHAR, FOLDERCHAR,
 				i, SamplesForDisplay(pos+syncAdvance, Signal->AudioChannels), 
 				GetBlockName(config, i), GetBlockSubIndex(config, i));
-			SaveWAVEChunk(Name, Signal, sampleBuffer, 0, loadedBlockSize, 0, config); 
+			ComposeFileName(Name, tempName, ".wav", config);
+			SaveWAVEChunk(Name, Signal, Signal->Samples + pos, 0, loadedBlockSize, 0, config); 
 		}
 
 		pos += loadedBlockSize;
@@ -458,37 +454,28 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 					config->smallFile |= Signal->role;
 					logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite.\n");
 					if(config->verbose)
-						logmsg("load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n", loadedBlockSize, sampleBufferSize, pos + loadedBlockSize, pos, Signal->numSamples);
+						logmsg("load: %ld size: %ld exceed: %ld pos: %ld limit: %ld\n", loadedBlockSize, longestBlockSize, pos + loadedBlockSize, pos, Signal->numSamples);
 				}
 				break;
 			}
 
-			// Clean Buffer and fill it
-			memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-			memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
-			// Empty original signal, and overlap
+			// Empty the overlap, the block itself is rewritten in place below
 			if(pos > 4 && pos+loadedBlockSize+discardSamples+4 <= Signal->numSamples)
-				memset(Signal->Samples + pos-4, 0, (loadedBlockSize+discardSamples+4)*sizeof(double));
-			else
-				memset(Signal->Samples + pos, 0, loadedBlockSize*sizeof(double));
+			{
+				memset(Signal->Samples + pos-4, 0, 4*sizeof(double));
+				memset(Signal->Samples + pos+loadedBlockSize, 0, discardSamples*sizeof(double));
+			}
 		
+			// The iFFTW reads the untouched planar copy and writes over the block
 			if(Signal->Blocks[i].type >= TYPE_SILENCE)
 			{
-				if(!ExecuteDFFT(&Signal->Blocks[i], sampleBuffer, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, REVERSE_FFTW, Signal))
+				if(!ExecuteDFFT(&Signal->Blocks[i], pos, loadedBlockSize-difference, Signal->SampleRate, windowUsed, config, REVERSE_FFTW, Signal))
 					return 0;
 			}
 
-			if(Signal->Blocks[i].type < TYPE_SILENCE && !config->discardMDW)
-			{
-				if(Signal->Blocks[i].type != TYPE_SYNC)  // Copy control notes to discarded for reference
-					memcpy(sampleBuffer, Signal->Samples + pos, loadedBlockSize*sizeof(double));
-			}
-
-			// Fill back original signal with whatever we have in sampleBuffer
-			memcpy(Signal->Samples + pos, sampleBuffer, loadedBlockSize*sizeof(double));
-	
-			pos += loadedBlockSize;
-			pos += discardSamples;
+			// Sync tones are kept, and control notes too when discarding for reference
+			if(Signal->Blocks[i].type < TYPE_SILENCE && !config->discardMDW && Signal->Blocks[i].type != TYPE_SYNC)
+				memset(Signal->Samples + pos, 0, loadedBlockSize*sizeof(double));
 	
 			if(config->chunks && (Signal->Blocks[i].type >= TYPE_SILENCE || Signal->Blocks[i].type == TYPE_WATERMARK))
 			{
@@ -496,9 +483,12 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 					GenerateFileNamePrefix(config), GetBlockName(config, i), 
 					GetBlockSubIndex(config, i));
 				ComposeFileName(Name, tempName, ".wav", config);
-				SaveWAVEChunk(Name, Signal, sampleBuffer, 0, loadedBlockSize, 0, config);
+				SaveWAVEChunk(Name, Signal, Signal->Samples + pos, 0, loadedBlockSize, 0, config);
 			}
 
+			pos += loadedBlockSize;
+			pos += discardSamples;
+
 			// Use original framerate for CD-DA chunks
 			if(Signal->Blocks[i].type == TYPE_INTERNAL_KNOWN || Signal->Blocks[i].type == TYPE_INTERNAL_UNKNOWN)
 				syncinternal = !syncinternal;
@@ -552,16 +542,19 @@ int ProcessSignalMDW(AudioSignal *Signal, parameters *config)
 		logmsg(" - clk: iFFTW on Audio chunks took %0.2fs\n", elapsedSeconds);
 	}
 
-	free(sampleBuffer);
 	freeWindows(&windows);
 
 	return 1;
 }
 
-int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal)
+int ExecuteDFFT(AudioBlocks *AudioArray, long int pos, long int size, double samplerate, double *window, parameters *config, int fftw_direction, AudioSignal *Signal)
 {
-	int AudioChannels = Signal->AudioChannels;
-	char channel = CHANNEL_STEREO;
+	int			AudioChannels = Signal->AudioChannels;
+	char		channel = CHANNEL_STEREO;
+	blockView	input, output;
+
+	// Read from the planar channels, the iFFTW writes back to the interleaved samples
+	output = GetInterleavedView(Signal, pos, size);
 
 	if(AudioChannels == 1)
 		channel = CHANNEL_LEFT;
@@ -574,13 +567,21 @@ int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double
 		if(AudioArray->channel == CHANNEL_STEREO)
 		{
 			channel = CHANNEL_RIGHT;
-			if(!ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, config, fftw_direction, Signal))
+			input = GetBlockView(Signal, PLANAR_RIGHT, pos, size);
+			if(!ExecuteDFFTInternal(AudioArray, &input, &output, size, samplerate, window, channel, config, fftw_direction, Signal))
 				return 0;
 			channel = CHANNEL_LEFT;
 		}
 	}
 
-	if(!ExecuteDFFTInternal(AudioArray, samples, size, samplerate, window, channel, config, fftw_direction, Signal))
+	input = GetBlockView(Signal, channel == CHANNEL_STEREO ? PLANAR_MID : PLANAR_LEFT, pos, size);
+	if(!input.samples)
+	{
+		logmsg("\tERROR: Channel data is not available.\n");
+		return 0;
+	}
+
+	if(!ExecuteDFFTInternal(AudioArray, &input, &output, size, samplerate, window, channel, config, fftw_direction, Signal))
 		return 0;
 
 	if(fftw_direction == FORWARD_FFTW)
@@ -592,7 +593,7 @@ int ExecuteDFFT(AudioBlocks *AudioArray, double *samples, long int size, double
 	return 1;
 }
 
-int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal)
+int ExecuteDFFTInternal(AudioBlocks *AudioArray, blockView *input, blockView *output, long int size, double samplerate, double *window, char channel, parameters *config, int fftw_direction, AudioSignal *Signal)
 {
 	fftw_plan		p = NULL, pBack = NULL;
 	long int		stereoSignalSize = 0, blanked = 0;	
@@ -604,7 +605,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 	long int		startBin = 0, endBin = 0;
 	int				AudioChannels = Signal->AudioChannels;
 	
-	if(!AudioArray)
+	if(!AudioArray || !input || !output)
 	{
 		logmsg("No Array for results\n");
 		return 0;
@@ -689,13 +690,7 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 
 	for(i = 0; i < monoSignalSize - zeropadding; i++)
 	{
-		if(channel == CHANNEL_LEFT)
-			signal[i] = samples[i*AudioChannels];
-		if(channel == CHANNEL_RIGHT)
-			signal[i] = samples[i*AudioChannels+1];
-		if(channel == CHANNEL_STEREO)
-			signal[i] = (samples[i*AudioChannels]+samples[i*AudioChannels+1])/2.0;
-
+		signal[i] = input->samples[i*input->stride];
 		if(window)
 			signal[i] = signal[i]*window[i];
 	}
@@ -760,13 +755,19 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 		if(endBinLimit > monoSignalSize/2)
 			endBinLimit = monoSignalSize/2;
 		
+		// signal is only written back by the iFFTW, use it for the amplitudes
+		if(endBinLimit > 1)
+		{
+			CalculateMagnitudeSpan(spectrum + 1, signal + 1, endBinLimit - 1, monoSignalSize);
+			CalculateAmplitudeSpan(signal + 1, signal + 1, endBinLimit - 1, Signal->MaxMagnitude.magnitude);
+		}
+
 		for(i = 1; i < endBinLimit; i++)
 		{
-			double amplitude = 0, magnitude = 0;
+			double amplitude = 0;
 			int blank = 0;
 	
-			magnitude = CalculateMagnitude(&spectrum[i], monoSignalSize);
-			amplitude = CalculateAmplitude(magnitude, Signal->MaxMagnitude.magnitude);
+			amplitude = signal[i];
 
 			// limit by noise cut frequncy count/amplitude
 			if(amplitude <= CutOff)
@@ -811,9 +812,9 @@ int ExecuteDFFTInternal(AudioBlocks *AudioArray, double *samples, long int size,
 			//else
 			value = signal[i]/monoSignalSize; /* check CalculateMagnitude if changed */
 			if(channel == CHANNEL_LEFT || channel == CHANNEL_STEREO || channel == CHANNEL_MONO)
-				samples[i*AudioChannels] = value;
+				output->samples[i*output->stride] = value;
 			if(channel == CHANNEL_RIGHT || channel == CHANNEL_STEREO)
-				samples[i*AudioChannels+1] = value;
+				output->samples[i*output->stride+1] = value;
 		}
 
 		//logmsg("Blanked %ld frequencies from a total of %ld\n", blanked, monoSignalSize/2);
@@ -0,0 +1,437 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "pcmcache.h"
+#include "log.h"
+#include "cline.h"
+#include "kernels.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PCM_CACHE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define PCM_CACHE_READ_CHUNK	(8*1024*1024)
+#define PCM_CACHE_FRAMES		65536
+
+/*
+	Decoded samples are kept on disk keyed by a hash of the source file
+	contents. An entry has the header fields LoadFile fills, the converted
+	interleaved samples and, for stereo files, the planar channels as
+	CreatePlanarSamples lays them out. Later runs map it copy on write, so
+	moves and normalization never touch the file.
+	The WAV headers are stored as they are in memory, so the build that
+	wrote the entry is part of both its name and its header.
+*/
+
+typedef struct pcm_cache_build_st {
+	char		version[16];
+	char		bits[8];
+	uint32_t	wavHeaderSize;
+	uint32_t	factSize;
+	uint32_t	fmtExtraSize;
+	uint32_t	planarCount;
+} pcmCacheBuild;
+
+typedef struct pcm_cache_hdr_st {
+	char			magic[8];
+	pcmCacheBuild	build;
+	uint64_t		key;
+	uint64_t		sourceSize;
+	wav_hdr			header;
+	uint8_t			fmtExtra[FMT_EXTRA_SIZE];
+	int32_t			fmtType;
+	fact_ck			fact;
+	int32_t			factExists;
+	int32_t			bytesPerSample;
+	int64_t			numSamples;
+	int64_t			SamplesStart;
+	int64_t			planarFrames;	// 0 for mono files
+} pcmCacheHeader;
+
+static void GetPCMCacheBuild(pcmCacheBuild *build)
+{
+	memset(build, 0, sizeof(pcmCacheBuild));
+	snprintf(build->version, sizeof(build->version), "%s", MDVERSION);
+	snprintf(build->bits, sizeof(build->bits), "%s", BITS_MDF);
+	build->wavHeaderSize = sizeof(wav_hdr);
+	build->factSize = sizeof(fact_ck);
+	build->fmtExtraSize = FMT_EXTRA_SIZE;
+	build->planarCount = PLANAR_COUNT;
+}
+
+// Entries are named after the contents key mixed with the build
+static uint64_t GetPCMCacheEntryKey(uint64_t key)
+{
+	pcmCacheBuild	build;
+	uint8_t			*bytes = NULL;
+
+	GetPCMCacheBuild(&build);
+	bytes = (uint8_t*)&build;
+	for(size_t i = 0; i < sizeof(pcmCacheBuild); i++)
+		key = (key ^ bytes[i])*0x100000001b3ULL;
+	return key;
+}
+
+static void GetPCMCacheName(char *name, uint64_t key, parameters *config)
+{
+	sprintf(name, "%s%c%016llx.pcm", config->pcmCachePath, FOLDERCHAR, (unsigned long long)key);
+}
+
+// FNV-1a over 64 bit words, we only need to tell captures apart
+int GetPCMCacheKey(char *fileName, uint64_t *key, uint64_t *size)
+{
+	FILE		*file = NULL;
+	uint8_t		*buffer = NULL;
+	size_t		bytes = 0, i = 0;
+	uint64_t	hash = 0xcbf29ce484222325ULL, word = 0;
+
+	*key = 0;
+	*size = 0;
+	file = fopen(fileName, "rb");
+	if(!file)
+		return 0;
+
+	buffer = (uint8_t*)malloc(PCM_CACHE_READ_CHUNK);
+	if(!buffer)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	while((bytes = fread(buffer, 1, PCM_CACHE_READ_CHUNK, file)) > 0)
+	{
+		for(i = 0; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t))
+		{
+			memcpy(&word, buffer + i, sizeof(uint64_t));
+			hash = (hash ^ word)*0x100000001b3ULL;
+		}
+		for(; i < bytes; i++)
+			hash = (hash ^ buffer[i])*0x100000001b3ULL;
+		*size += bytes;
+	}
+
+	if(ferror(file))
+	{
+		free(buffer);
+		fclose(file);
+		return 0;
+	}
+
+	free(buffer);
+	fclose(file);
+
+	*key = (hash ^ *size)*0x100000001b3ULL;
+	return 1;
+}
+
+#ifdef PCM_CACHE_MMAP
+static int IsPCMCacheFile(char *name)
+{
+	size_t len = 0;
+
+	len = strlen(name);
+	return(len > 4 && strcmp(name + len - 4, ".pcm") == 0);
+}
+
+// Remove the least recently used entries until the cache fits
+static void EnforcePCMCacheLimit(parameters *config)
+{
+	uint64_t		limit = 0;
+
+	if(config->pcmCacheMaxMB <= 0)
+		return;
+
+	limit = (uint64_t)config->pcmCacheMaxMB*1024*1024;
+	while(1)
+	{
+		DIR				*dir = NULL;
+		struct dirent	*entry = NULL;
+		struct stat		st;
+		uint64_t		total = 0;
+		time_t			oldestTime = 0;
+		char			name[BUFFER_SIZE*2], oldest[BUFFER_SIZE*2];
+
+		dir = opendir(config->pcmCachePath);
+		if(!dir)
+			return;
+
+		oldest[0] = '\0';
+		while((entry = readdir(dir)) != NULL)
+		{
+			if(!IsPCMCacheFile(entry->d_name))
+				continue;
+
+			sprintf(name, "%s%c%s", config->pcmCachePath, FOLDERCHAR, entry->d_name);
+			if(stat(name, &st) != 0)
+				continue;
+
+			total += st.st_size;
+			if(!oldest[0] || st.st_mtime < oldestTime)
+			{
+				oldestTime = st.st_mtime;
+				sprintf(oldest, "%s", name);
+			}
+		}
+		closedir(dir);
+
+		if(total <= limit || !oldest[0])
+			return;
+
+		if(config->verbose)
+			logmsg(" - Removing '%s' from the PCM cache\n", oldest);
+		if(remove(oldest) != 0)
+			return;
+	}
+}
+#endif
+
+int LoadPCMCache(AudioSignal *Signal, uint64_t key, uint64_t size, parameters *config)
+{
+#ifdef PCM_CACHE_MMAP
+	int				fd = -1, i = 0;
+	char			name[BUFFER_SIZE*2];
+	struct stat		st;
+	pcmCacheHeader	hdr;
+	pcmCacheBuild	build;
+	uint8_t			*map = NULL;
+	size_t			mapSize = 0;
+
+	key = GetPCMCacheEntryKey(key);
+	GetPCMCacheBuild(&build);
+	GetPCMCacheName(name, key, config);
+	fd = open(name, O_RDONLY);
+	if(fd == -1)
+		return 0;
+
+	if(fstat(fd, &st) != 0 || read(fd, &hdr, sizeof(pcmCacheHeader)) != sizeof(pcmCacheHeader))
+	{
+		close(fd);
+		return 0;
+	}
+
+	if(memcmp(hdr.magic, PCM_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+		memcmp(&hdr.build, &build, sizeof(pcmCacheBuild)) != 0 || hdr.key != key ||
+		hdr.sourceSize != size || hdr.numSamples <= 0 || hdr.header.fmt.NumOfChan < 1 ||
+		hdr.planarFrames != (hdr.header.fmt.NumOfChan == 2 ? hdr.numSamples/2 : 0))
+	{
+		close(fd);
+		return 0;
+	}
+
+	mapSize = PCM_CACHE_DATA_OFFSET + sizeof(double)*hdr.numSamples;
+	if(hdr.planarFrames)
+		mapSize += sizeof(double)*PLANAR_COUNT*(hdr.planarFrames+1);
+	if((size_t)st.st_size != mapSize)
+	{
+		close(fd);
+		return 0;
+	}
+
+	map = (uint8_t*)mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return 0;
+
+	Signal->header = hdr.header;
+	memcpy(Signal->fmtExtra, hdr.fmtExtra, sizeof(uint8_t)*FMT_EXTRA_SIZE);
+	Signal->fmtType = hdr.fmtType;
+	Signal->fact = hdr.fact;
+	Signal->factExists = hdr.factExists;
+	Signal->bytesPerSample = hdr.bytesPerSample;
+	Signal->numSamples = hdr.numSamples;
+	Signal->SamplesStart = hdr.SamplesStart;
+
+	Signal->mappedPCM = map;
+	Signal->mappedPCMSize = mapSize;
+	Signal->Samples = (double*)(map + PCM_CACHE_DATA_OFFSET);
+	for(i = 0; hdr.planarFrames && i < PLANAR_COUNT; i++)
+		Signal->Planar[i] = Signal->Samples + hdr.numSamples + i*(hdr.planarFrames+1);
+
+	// the modification time tells eviction which entries are in use
+	utime(name, NULL);
+	return 1;
+#else
+	(void)Signal;
+	(void)key;
+	(void)size;
+	(void)config;
+	return 0;
+#endif
+}
+
+int SavePCMCache(AudioSignal *Signal, uint64_t key, uint64_t size, parameters *config)
+{
+#ifdef PCM_CACHE_MMAP
+	int				i = 0, ok = 1;
+	char			name[BUFFER_SIZE*2], tmpName[BUFFER_SIZE*2+64];
+	uint8_t			*page = NULL;
+	double			*planar[PLANAR_COUNT] = { NULL, NULL, NULL }, padding = 0;
+	long int		frames = 0, pos = 0, count = 0;
+	off_t			planarStart = 0, planeSize = 0;
+	pcmCacheHeader	hdr;
+	FILE			*file = NULL;
+
+	if(!CreateFolder(config->pcmCachePath))
+	{
+		logmsg(" - WARNING: Could not create PCM cache folder %s\n", config->pcmCachePath);
+		return 0;
+	}
+
+	key = GetPCMCacheEntryKey(key);
+	memset(&hdr, 0, sizeof(pcmCacheHeader));
+	memcpy(hdr.magic, PCM_CACHE_MAGIC, sizeof(hdr.magic));
+	GetPCMCacheBuild(&hdr.build);
+	hdr.key = key;
+	hdr.sourceSize = size;
+	hdr.header = Signal->header;
+	memcpy(hdr.fmtExtra, Signal->fmtExtra, sizeof(uint8_t)*FMT_EXTRA_SIZE);
+	hdr.fmtType = Signal->fmtType;
+	hdr.fact = Signal->fact;
+	hdr.factExists = Signal->factExists;
+	hdr.bytesPerSample = Signal->bytesPerSample;
+	hdr.numSamples = Signal->numSamples;
+	hdr.SamplesStart = Signal->SamplesStart;
+	if(Signal->header.fmt.NumOfChan == 2)
+		hdr.planarFrames = Signal->numSamples/2;
+	frames = hdr.planarFrames;
+
+	page = (uint8_t*)calloc(1, PCM_CACHE_DATA_OFFSET);
+	if(frames)
+		planar[0] = (double*)malloc(sizeof(double)*PCM_CACHE_FRAMES*PLANAR_COUNT);
+	if(!page || (frames && !planar[0]))
+	{
+		free(page);
+		free(planar[0]);
+		return 0;
+	}
+	for(i = 1; frames && i < PLANAR_COUNT; i++)
+		planar[i] = planar[0] + i*PCM_CACHE_FRAMES;
+	memcpy(page, &hdr, sizeof(pcmCacheHeader));
+
+	// write aside and rename, a concurrent run never maps a partial entry
+	GetPCMCacheName(name, key, config);
+	sprintf(tmpName, "%s.%ld.%d.tmp", name, (long)getpid(), Signal->role);
+	file = fopen(tmpName, "wb");
+	if(!file)
+	{
+		free(page);
+		free(planar[0]);
+		return 0;
+	}
+
+	if(fwrite(page, 1, PCM_CACHE_DATA_OFFSET, file) != PCM_CACHE_DATA_OFFSET ||
+		fwrite(Signal->Samples, sizeof(double), Signal->numSamples, file) != (size_t)Signal->numSamples)
+		ok = 0;
+
+	// each channel is stored whole, a chunk is deinterleaved once and each plane written at its place
+	planarStart = (off_t)PCM_CACHE_DATA_OFFSET + (off_t)sizeof(double)*Signal->numSamples;
+	planeSize = (off_t)sizeof(double)*(frames+1);
+	for(pos = 0; ok && pos < frames; pos += count)
+	{
+		count = frames - pos;
+		if(count > PCM_CACHE_FRAMES)
+			count = PCM_CACHE_FRAMES;
+		DeinterleaveSamples(Signal->Samples + pos*2, count, planar[PLANAR_LEFT], planar[PLANAR_RIGHT], planar[PLANAR_MID]);
+		for(i = 0; ok && i < PLANAR_COUNT; i++)
+		{
+			if(fseeko(file, planarStart + i*planeSize + (off_t)sizeof(double)*pos, SEEK_SET) != 0 ||
+				fwrite(planar[i], sizeof(double), count, file) != (size_t)count)
+				ok = 0;
+		}
+	}
+
+	for(i = 0; ok && frames && i < PLANAR_COUNT; i++)
+	{
+		if(fseeko(file, planarStart + i*planeSize + (off_t)sizeof(double)*frames, SEEK_SET) != 0 ||
+			fwrite(&padding, sizeof(double), 1, file) != 1)
+			ok = 0;
+	}
+
+	free(page);
+	free(planar[0]);
+	if(fclose(file) != 0)
+		ok = 0;
+
+	if(!ok || rename(tmpName, name) != 0)
+	{
+		remove(tmpName);
+		logmsg(" - WARNING: Could not write PCM cache entry %s\n", name);
+		return 0;
+	}
+
+	EnforcePCMCacheLimit(config);
+	return 1;
+#else
+	(void)Signal;
+	(void)key;
+	(void)size;
+	(void)config;
+	return 0;
+#endif
+}
+
+// Drops the pages moves and normalization copied, the planar ones stay mapped
+void DiscardPCMCacheSamples(AudioSignal *Signal)
+{
+#ifdef PCM_CACHE_MMAP
+	uintptr_t	page = 0, start = 0, end = 0;
+
+	if(!Signal->mappedPCM || !Signal->Samples)
+		return;
+
+	// only whole pages, the planar channels start right after the samples
+	page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	start = ((uintptr_t)Signal->Samples + page - 1) & ~(page - 1);
+	end = ((uintptr_t)(Signal->Samples + Signal->numSamples)) & ~(page - 1);
+	if(end > start)
+		madvise((void*)start, (size_t)(end - start), MADV_DONTNEED);
+#endif
+	Signal->Samples = NULL;
+}
+
+void ReleasePCMCache(AudioSignal *Signal)
+{
+	int i = 0;
+
+#ifdef PCM_CACHE_MMAP
+	if(Signal->mappedPCM)
+		munmap(Signal->mappedPCM, Signal->mappedPCMSize);
+#endif
+	Signal->mappedPCM = NULL;
+	Signal->mappedPCMSize = 0;
+	Signal->Samples = NULL;
+	for(i = 0; i < PLANAR_COUNT; i++)
+		Signal->Planar[i] = NULL;
+}
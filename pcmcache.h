@@ -0,0 +1,44 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_PCMCACHE_H
+#define MDFOURIER_PCMCACHE_H
+
+#include "mdfourier.h"
+
+#define PCM_CACHE_MAGIC			"MDFPCM02"
+#define PCM_CACHE_DATA_OFFSET	4096
+#define PCM_CACHE_DEFAULT_MB	4096
+
+int GetPCMCacheKey(char *fileName, uint64_t *key, uint64_t *size);
+int LoadPCMCache(AudioSignal *Signal, uint64_t key, uint64_t size, parameters *config);
+int SavePCMCache(AudioSignal *Signal, uint64_t key, uint64_t size, parameters *config);
+void DiscardPCMCacheSamples(AudioSignal *Signal);
+void ReleasePCMCache(AudioSignal *Signal);
+
+#endif
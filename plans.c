@@ -0,0 +1,822 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "mdfourier.h"
+#include "plans.h"
+#include "log.h"
+#include "freq.h"
+#include "sync.h"
+#include "cline.h"
+
+#define MAX_PLANS			32
+#define MAX_PLAN_BUFFERS	8
+
+#define WISDOM_FOLDER		"mdfourier"
+#define WISDOM_SIZE_SPREAD	1	// detected frame rates drift a sample or so from the profile
+
+/*
+	Plans are cached by transform length and executed with the new-array
+	interface, which is thread safe. Buffers are checked out by each caller
+	for the duration of a transform, so concurrent callers never share one.
+	All planner access goes through the same critical section, since the
+	FFTW planner itself is not thread safe.
+*/
+
+void InitPlanCache(planManager *pm)
+{
+	if(!pm)
+		return;
+
+	pm->planArray = NULL;
+	pm->planCount = 0;
+	pm->MaxPlan = 0;
+	pm->bufferArray = NULL;
+	pm->bufferCount = 0;
+	pm->MaxBuffer = 0;
+	pm->hits = 0;
+	pm->misses = 0;
+	pm->wisdomLoaded = 0;
+}
+
+int AllocatePlanBuffer(planBuffer *unit, long int size)
+{
+	if(unit->signal)
+	{
+		fftw_free(unit->signal);
+		unit->signal = NULL;
+	}
+	if(unit->spectrum)
+	{
+		fftw_free(unit->spectrum);
+		unit->spectrum = NULL;
+	}
+	unit->size = 0;
+
+	unit->signal = (double*)fftw_malloc(sizeof(double)*(size+1));
+	if(!unit->signal)
+		return 0;
+	unit->spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(size/2+1));
+	if(!unit->spectrum)
+	{
+		fftw_free(unit->signal);
+		unit->signal = NULL;
+		return 0;
+	}
+	unit->size = size;
+	return 1;
+}
+
+int AcquirePlanBufferInternal(planBuffer *buffer, long int size, planManager *pm)
+{
+	int i = 0, freeSlot = -1;
+
+	for(i = 0; i < pm->bufferCount; i++)
+	{
+		if(pm->bufferArray[i].inUse)
+			continue;
+		if(pm->bufferArray[i].size >= size)
+		{
+			freeSlot = i;
+			break;
+		}
+		if(freeSlot == -1)
+			freeSlot = i;
+	}
+
+	if(freeSlot == -1)
+	{
+		if(pm->bufferCount == pm->MaxBuffer)
+		{
+			planBuffer *tmp = NULL;
+
+			tmp = (planBuffer*)realloc(pm->bufferArray, sizeof(planBuffer)*(pm->MaxBuffer+MAX_PLAN_BUFFERS));
+			if(!tmp)
+				return 0;
+			pm->bufferArray = tmp;
+			memset(pm->bufferArray+pm->MaxBuffer, 0, sizeof(planBuffer)*MAX_PLAN_BUFFERS);
+			pm->MaxBuffer += MAX_PLAN_BUFFERS;
+		}
+		freeSlot = pm->bufferCount++;
+		pm->bufferArray[freeSlot].slot = freeSlot;
+	}
+
+	if(pm->bufferArray[freeSlot].size < size)
+	{
+		if(!AllocatePlanBuffer(&pm->bufferArray[freeSlot], size))
+			return 0;
+	}
+
+	pm->bufferArray[freeSlot].inUse = 1;
+	*buffer = pm->bufferArray[freeSlot];
+	return 1;
+}
+
+int AcquirePlanBuffer(planBuffer *buffer, long int size, parameters *config)
+{
+	int success = 0;
+
+	if(!buffer || !config)
+		return 0;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_plans)
+#endif
+	success = AcquirePlanBufferInternal(buffer, size, &config->plans);
+
+	if(!success)
+	{
+		logmsg("ERROR: Not enough memory for FFTW buffers\n");
+		return 0;
+	}
+	return 1;
+}
+
+void ReleasePlanBuffer(planBuffer *buffer, parameters *config)
+{
+	if(!buffer || !config || !buffer->inUse)
+		return;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_plans)
+#endif
+	config->plans.bufferArray[buffer->slot].inUse = 0;
+
+	buffer->signal = NULL;
+	buffer->spectrum = NULL;
+	buffer->inUse = 0;
+}
+
+fftw_plan GetPlanForSizeInternal(long int size, int type, int howmany, planBuffer *buffer, planManager *pm)
+{
+	int			i = 0;
+	fftw_plan	plan = NULL;
+
+	for(i = 0; i < pm->planCount; i++)
+	{
+		if(pm->planArray[i].size == size && pm->planArray[i].type == type &&
+			pm->planArray[i].howmany == howmany)
+		{
+			pm->hits++;
+			return pm->planArray[i].plan;
+		}
+	}
+
+	if(pm->planCount == pm->MaxPlan)
+	{
+		planUnit *tmp = NULL;
+
+		tmp = (planUnit*)realloc(pm->planArray, sizeof(planUnit)*(pm->MaxPlan+MAX_PLANS));
+		if(!tmp)
+			return NULL;
+		pm->planArray = tmp;
+		pm->MaxPlan += MAX_PLANS;
+	}
+
+	if(!pm->wisdomLoaded)
+	{
+		ImportWisdom(WISDOM_DOUBLE);
+		ImportWisdom(WISDOM_FLOAT);
+		pm->wisdomLoaded = 1;
+	}
+
+	switch(type)
+	{
+		case PLAN_COMPLEX:
+			plan = fftw_plan_dft_1d(size, (fftw_complex*)buffer->signal, buffer->spectrum, FFTW_FORWARD, FFTW_MEASURE);
+			break;
+		case PLAN_REAL_MANY:
+		{
+			int n = (int)size;
+
+			// Contiguous transforms, size samples in and size/2+1 values out each
+			plan = fftw_plan_many_dft_r2c(1, &n, howmany,
+						buffer->signal, NULL, 1, n,
+						buffer->spectrum, NULL, 1, n/2+1, FFTW_MEASURE);
+		}
+			break;
+		default:
+			plan = fftw_plan_dft_r2c_1d(size, buffer->signal, buffer->spectrum, FFTW_MEASURE);
+			break;
+	}
+	if(!plan)
+		return NULL;
+
+	pm->planArray[pm->planCount].plan = plan;
+	pm->planArray[pm->planCount].planf = NULL;
+	pm->planArray[pm->planCount].size = size;
+	pm->planArray[pm->planCount].type = type;
+	pm->planArray[pm->planCount].howmany = howmany;
+	pm->planCount++;
+	pm->misses++;
+
+	return plan;
+}
+
+// The buffer contents are overwritten while planning
+fftw_plan GetPlanForSize(long int size, planBuffer *buffer, parameters *config)
+{
+	fftw_plan	plan = NULL;
+
+	if(!buffer || !config || buffer->size < size)
+		return NULL;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_plans)
+#endif
+	plan = GetPlanForSizeInternal(size, PLAN_REAL, 1, buffer, &config->plans);
+
+	if(!plan)
+		logmsg("FFTW failed to create FFTW_MEASURE plan\n");
+	return plan;
+}
+
+/*
+	Complex to complex forward plan of size points. The buffer must have been
+	acquired for 2*size samples, so its signal holds size complex values and
+	its spectrum at least as many.
+*/
+fftw_plan GetComplexPlanForSize(long int size, planBuffer *buffer, parameters *config)
+{
+	fftw_plan	plan = NULL;
+
+	if(!buffer || !config || buffer->size < 2*size)
+		return NULL;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_plans)
+#endif
+	plan = GetPlanForSizeInternal(size, PLAN_COMPLEX, 1, buffer, &config->plans);
+
+	if(!plan)
+		logmsg("FFTW failed to create complex FFTW_MEASURE plan\n");
+	return plan;
+}
+
+/*
+	Single precision plans share the cache, the double buffers are large
+	enough to hold the float signal and spectrum of the same size.
+	FFTW keeps their wisdom apart from the double one, it has its own file.
+*/
+fftwf_plan GetFloatPlanForSizeInternal(long int size, planBuffer *buffer, planManager *pm)
+{
+	int			i = 0;
+	fftwf_plan	plan = NULL;
+
+	for(i = 0; i < pm->planCount; i++)
+	{
+		if(pm->planArray[i].size == size && pm->planArray[i].type == PLAN_REAL_FLOAT)
+		{
+			pm->hits++;
+			return pm->planArray[i].planf;
+		}
+	}
+
+	if(pm->planCount == pm->MaxPlan)
+	{
+		planUnit *tmp = NULL;
+
+		tmp = (planUnit*)realloc(pm->planArray, sizeof(planUnit)*(pm->MaxPlan+MAX_PLANS));
+		if(!tmp)
+			return NULL;
+		pm->planArray = tmp;
+		pm->MaxPlan += MAX_PLANS;
+	}
+
+	if(!pm->wisdomLoaded)
+	{
+		ImportWisdom(WISDOM_DOUBLE);
+		ImportWisdom(WISDOM_FLOAT);
+		pm->wisdomLoaded = 1;
+	}
+
+	plan = fftwf_plan_dft_r2c_1d(size, (float*)buffer->signal, (fftwf_complex*)buffer->spectrum, FFTW_MEASURE);
+	if(!plan)
+		return NULL;
+
+	pm->planArray[pm->planCount].plan = NULL;
+	pm->planArray[pm->planCount].planf = plan;
+	pm->planArray[pm->planCount].size = size;
+	pm->planArray[pm->planCount].type = PLAN_REAL_FLOAT;
+	pm->planArray[pm->planCount].howmany = 1;
+	pm->planCount++;
+	pm->misses++;
+
+	return plan;
+}
+
+fftwf_plan GetFloatPlanForSize(long int size, planBuffer *buffer, parameters *config)
+{
+	fftwf_plan	plan = NULL;
+
+	if(!buffer || !config || buffer->size < size)
+		return NULL;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_plans)
+#endif
+	plan = GetFloatPlanForSizeInternal(size, buffer, &config->plans);
+
+	if(!plan)
+		logmsg("FFTW failed to create single precision FFTW_MEASURE plan\n");
+	return plan;
+}
+
+// A buffer acquired for this size holds howmany signals and their spectra
+long int GetBatchBufferSize(long int size, int howmany)
+{
+	return((size+2)*howmany);
+}
+
+fftw_plan GetBatchPlanForSize(long int size, int howmany, planBuffer *buffer, parameters *config)
+{
+	fftw_plan	plan = NULL;
+
+	if(!buffer || !config || howmany < 1 || buffer->size < GetBatchBufferSize(size, howmany))
+		return NULL;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical (fftw_plans)
+#endif
+	plan = GetPlanForSizeInternal(size, PLAN_REAL_MANY, howmany, buffer, &config->plans);
+
+	if(!plan)
+		logmsg("FFTW failed to create batched FFTW_MEASURE plan\n");
+	return plan;
+}
+
+void ReportPlanCache(parameters *config)
+{
+	if(!config)
+		return;
+
+	logmsg(" - clk: FFTW plan cache %ld hits %ld misses (%d plans, %d buffers)\n",
+		config->plans.hits, config->plans.misses,
+		config->plans.planCount, config->plans.bufferCount);
+}
+
+void ReleasePlanCache(planManager *pm)
+{
+	int i = 0;
+
+	if(!pm)
+		return;
+
+	if(pm->planArray)
+	{
+		for(i = 0; i < pm->planCount; i++)
+		{
+			if(pm->planArray[i].plan)
+			{
+				fftw_destroy_plan(pm->planArray[i].plan);
+				pm->planArray[i].plan = NULL;
+			}
+			if(pm->planArray[i].planf)
+			{
+				fftwf_destroy_plan(pm->planArray[i].planf);
+				pm->planArray[i].planf = NULL;
+			}
+		}
+		free(pm->planArray);
+	}
+
+	if(pm->bufferArray)
+	{
+		for(i = 0; i < pm->bufferCount; i++)
+		{
+			if(pm->bufferArray[i].signal)
+				fftw_free(pm->bufferArray[i].signal);
+			if(pm->bufferArray[i].spectrum)
+				fftw_free(pm->bufferArray[i].spectrum);
+		}
+		free(pm->bufferArray);
+	}
+
+	InitPlanCache(pm);
+}
+
+/*
+	Wisdom is only valid for the machine and FFTW build that created it,
+	so it is kept in a per user cache folder and named after the host, the
+	MDFourier version and the pointer size. Single precision wisdom is a
+	separate file next to it.
+*/
+int GetWisdomPath(char *path, int size, int precision, int create)
+{
+	char	folder[BUFFER_SIZE], host[256];
+	char	*base = NULL;
+	int		len = 0;
+
+	if(!path || size <= 0)
+		return 0;
+
+	memset(host, 0, sizeof(char)*256);
+#if defined (WIN32)
+	base = getenv("LOCALAPPDATA");
+	if(!base)
+		return 0;
+	len = snprintf(folder, BUFFER_SIZE, "%s%c%s", base, FOLDERCHAR, WISDOM_FOLDER);
+	if(getenv("COMPUTERNAME"))
+		snprintf(host, 256, "%s", getenv("COMPUTERNAME"));
+#else
+	base = getenv("XDG_CACHE_HOME");
+	if(base && strlen(base))
+		len = snprintf(folder, BUFFER_SIZE, "%s%c%s", base, FOLDERCHAR, WISDOM_FOLDER);
+	else
+	{
+		base = getenv("HOME");
+		if(!base)
+			return 0;
+		if(create)
+		{
+			len = snprintf(folder, BUFFER_SIZE, "%s%c.cache", base, FOLDERCHAR);
+			if(len >= BUFFER_SIZE || !CreateFolder(folder))
+				return 0;
+		}
+		len = snprintf(folder, BUFFER_SIZE, "%s%c.cache%c%s", base, FOLDERCHAR, FOLDERCHAR, WISDOM_FOLDER);
+	}
+	gethostname(host, 255);
+#endif
+	if(len >= BUFFER_SIZE)
+		return 0;
+
+	if(!strlen(host))
+		sprintf(host, "localhost");
+
+	if(create && !CreateFolder(folder))
+	{
+		logmsg("WARNING: Could not create FFTW wisdom folder %s\n", folder);
+		return 0;
+	}
+
+	len = snprintf(path, size, "%s%cwisdom_%s_%s_%s%s.fftw", folder, FOLDERCHAR, host, MDVERSION, BITS_MDF,
+				precision == WISDOM_FLOAT ? "_float" : "");
+	if(len >= size)
+		return 0;
+	return 1;
+}
+
+int ImportWisdom(int precision)
+{
+	char	path[BUFFER_SIZE];
+
+	if(!GetWisdomPath(path, BUFFER_SIZE, precision, 0))
+		return 0;
+
+	if(precision == WISDOM_FLOAT)
+		return(fftwf_import_wisdom_from_filename(path));
+	return(fftw_import_wisdom_from_filename(path));
+}
+
+int LoadWisdom(parameters *config)
+{
+	char	path[BUFFER_SIZE];
+	int		loaded = 0, loadedFloat = 0;
+
+	if(!config)
+		return 0;
+
+	if(config->plans.wisdomLoaded)
+		return 1;
+
+	config->plans.wisdomLoaded = 1;
+	if(!GetWisdomPath(path, BUFFER_SIZE, WISDOM_DOUBLE, 0))
+		return 0;
+
+	loaded = ImportWisdom(WISDOM_DOUBLE);
+	loadedFloat = ImportWisdom(WISDOM_FLOAT);
+	if(config->verbose)
+	{
+		if(loaded)
+			logmsg(" - Loaded FFTW wisdom from %s%s\n", path, loadedFloat ? " and its single precision file" : "");
+		else
+			logmsg(" - No FFTW wisdom found, use --train-wisdom to create it\n");
+	}
+	return loaded;
+}
+
+int ExportWisdom(int precision)
+{
+	char	path[BUFFER_SIZE], tmpPath[BUFFER_SIZE+8];
+	int		exported = 0;
+
+	if(!GetWisdomPath(path, BUFFER_SIZE, precision, 1))
+		return 0;
+
+	// Write aside and rename, so concurrent runs never read a partial file
+	sprintf(tmpPath, "%s.%d", path, (int)getpid());
+	if(precision == WISDOM_FLOAT)
+		exported = fftwf_export_wisdom_to_filename(tmpPath);
+	else
+		exported = fftw_export_wisdom_to_filename(tmpPath);
+	if(!exported)
+	{
+		logmsg("WARNING: Could not save FFTW wisdom to %s\n", tmpPath);
+		return 0;
+	}
+	remove(path);
+	if(rename(tmpPath, path) != 0)
+	{
+		remove(tmpPath);
+		logmsg("WARNING: Could not save FFTW wisdom to %s\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+int SaveWisdom(parameters *config)
+{
+	if(!config)
+		return 0;
+
+	if(!ExportWisdom(WISDOM_DOUBLE))
+		return 0;
+	return(ExportWisdom(WISDOM_FLOAT));
+}
+
+int AddWisdomSize(long int **sizes, int *count, int *max, long int size)
+{
+	int i = 0;
+
+	if(size < 2)
+		return 1;
+
+	for(i = 0; i < *count; i++)
+	{
+		if((*sizes)[i] == size)
+			return 1;
+	}
+
+	if(*count == *max)
+	{
+		long int *tmp = NULL;
+
+		tmp = (long int*)realloc(*sizes, sizeof(long int)*(*max+MAX_PLANS));
+		if(!tmp)
+		{
+			logmsg("ERROR: Not enough memory for wisdom sizes\n");
+			return 0;
+		}
+		*sizes = tmp;
+		*max += MAX_PLANS;
+	}
+
+	(*sizes)[(*count)++] = size;
+	return 1;
+}
+
+int AddWisdomSizeSpread(long int **sizes, int *count, int *max, long int size)
+{
+	long int spread = 0;
+
+	for(spread = -WISDOM_SIZE_SPREAD; spread <= WISDOM_SIZE_SPREAD; spread++)
+	{
+		if(!AddWisdomSize(sizes, count, max, size+spread))
+			return 0;
+	}
+	return 1;
+}
+
+int CollectWisdomSizes(long int **sizes, int *count, parameters *config)
+{
+	double			sampleRates[] = { 44100, 48000, 96000 };
+	int				factors[] = { FACTOR_LFEXPL, FACTOR_EXPLORE, FACTOR_DETECT };
+	int				max = 0, format = 0, s = 0, i = 0;
+
+	for(format = 0; format < config->types.syncCount; format++)
+	{
+		double framerate = 0;
+
+		framerate = config->types.SyncFormat[format].MSPerFrame;
+		if(framerate <= 0)
+			continue;
+
+		for(s = 0; s < (int)(sizeof(sampleRates)/sizeof(double)); s++)
+		{
+			double samplerate = sampleRates[s];
+
+			// Sync pulse detection chunks
+			for(i = 0; i < (int)(sizeof(factors)/sizeof(int)); i++)
+			{
+				if(!AddWisdomSize(sizes, count, &max, SecondsToSamples(samplerate, 1.0/((double)factors[i]*1000.0), 1, NULL, NULL)))
+					return 0;
+			}
+
+			// Block transforms, also used for channel balance
+			for(i = 0; i < config->types.totalBlocks; i++)
+			{
+				int			type = 0;
+				long int	frames = 0;
+
+				type = GetBlockType(config, i);
+				if(type < TYPE_SILENCE && type != TYPE_WATERMARK)
+					continue;
+
+				frames = GetBlockFrames(config, i);
+				if(!AddWisdomSizeSpread(sizes, count, &max, SecondsToSamples(samplerate, FramesToSeconds(framerate, frames), 1, NULL, NULL)))
+					return 0;
+			}
+
+			// Zero padded block sizes
+			if(config->padBlockSizes)
+			{
+				if(!AddWisdomSizeSpread(sizes, count, &max, SecondsToSamples(samplerate, FramesToSeconds(framerate, config->maxBlockFrameCount), 1, NULL, NULL)))
+					return 0;
+			}
+
+			if(config->ZeroPad)
+			{
+				if(!AddWisdomSize(sizes, count, &max, (long int)(samplerate*config->ZeroPadFactor)))
+					return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*
+	Plans every transform length a run with this profile will request, for each
+	video format in the profile and the usual sample rates, and stores the
+	result as FFTW_PATIENT wisdom. Later runs plan with FFTW_MEASURE, which
+	reuses the more rigorous wisdom without measuring again.
+	Each length is trained as a single transform, as a batch of
+	DFFT_BATCH_MAX blocks, in single precision and packed stereo if the
+	profile has stereo blocks.
+*/
+int TrainWisdom(parameters *config)
+{
+	long int		*sizes = NULL, longest = 0;
+	int				count = 0, i = 0;
+	wisdomBuffers	buffers;
+	char			path[BUFFER_SIZE];
+	struct timespec	start, end;
+
+	if(!config)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	LoadWisdom(config);
+
+	if(!CollectWisdomSizes(&sizes, &count, config) || !count)
+	{
+		if(!count)
+			logmsg("ERROR: Profile has no transform sizes to train\n");
+		if(sizes)
+			free(sizes);
+		return 0;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		if(sizes[i] > longest)
+			longest = sizes[i];
+	}
+
+	if(!AllocateWisdomBuffers(&buffers, longest, config->usesStereo))
+	{
+		logmsg("ERROR: Not enough memory for wisdom training\n");
+		free(sizes);
+		return 0;
+	}
+
+	logmsg("* Training FFTW wisdom for %d transform sizes, this can take a while\n", count);
+	for(i = 0; i < count; i++)
+	{
+		if(config->verbose)
+			logmsg(" - [%d/%d] %ld samples\n", i+1, count, sizes[i]);
+		if(!TrainWisdomSize(&buffers, sizes[i], config->usesStereo))
+			break;
+	}
+
+	ReleaseWisdomBuffers(&buffers);
+	free(sizes);
+
+	if(i != count)
+		return 0;
+
+	if(!SaveWisdom(config) || !GetWisdomPath(path, BUFFER_SIZE, WISDOM_DOUBLE, 0))
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	logmsg("* FFTW wisdom stored in %s (%0.2fs)\n", path, TimeSpecToSeconds(&end) - TimeSpecToSeconds(&start));
+	return 1;
+}
+
+// Planning layouts must match the ones requested at run time, see GetPlanForSizeInternal
+int TrainWisdomSize(wisdomBuffers *buffers, long int size, int usesStereo)
+{
+	fftw_plan	p = NULL;
+	fftwf_plan	pf = NULL;
+	int			n = (int)size;
+
+	p = fftw_plan_dft_r2c_1d(size, buffers->signal, buffers->spectrum, FFTW_PATIENT);
+	if(!p)
+	{
+		logmsg("ERROR: FFTW failed to create FFTW_PATIENT plan for %ld samples\n", size);
+		return 0;
+	}
+	fftw_destroy_plan(p);
+
+	p = fftw_plan_many_dft_r2c(1, &n, DFFT_BATCH_MAX,
+				buffers->batchSignal, NULL, 1, n,
+				buffers->batchSpectrum, NULL, 1, n/2+1, FFTW_PATIENT);
+	if(!p)
+	{
+		logmsg("ERROR: FFTW failed to create batched FFTW_PATIENT plan for %ld samples\n", size);
+		return 0;
+	}
+	fftw_destroy_plan(p);
+
+	pf = fftwf_plan_dft_r2c_1d(size, buffers->floatSignal, buffers->floatSpectrum, FFTW_PATIENT);
+	if(!pf)
+	{
+		logmsg("ERROR: FFTW failed to create single precision FFTW_PATIENT plan for %ld samples\n", size);
+		return 0;
+	}
+	fftwf_destroy_plan(pf);
+
+	// Stereo blocks transform both channels packed as one complex signal
+	if(usesStereo)
+	{
+		p = fftw_plan_dft_1d(size, buffers->complexSignal, buffers->complexSpectrum, FFTW_FORWARD, FFTW_PATIENT);
+		if(!p)
+		{
+			logmsg("ERROR: FFTW failed to create complex FFTW_PATIENT plan for %ld samples\n", size);
+			return 0;
+		}
+		fftw_destroy_plan(p);
+	}
+	return 1;
+}
+
+int AllocateWisdomBuffers(wisdomBuffers *buffers, long int longest, int usesStereo)
+{
+	memset(buffers, 0, sizeof(wisdomBuffers));
+
+	buffers->signal = (double*)fftw_malloc(sizeof(double)*(longest+1));
+	buffers->spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(longest/2+1));
+	buffers->batchSignal = (double*)fftw_malloc(sizeof(double)*GetBatchBufferSize(longest, DFFT_BATCH_MAX));
+	buffers->batchSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*GetBatchBufferSize(longest, DFFT_BATCH_MAX));
+	buffers->floatSignal = (float*)fftwf_malloc(sizeof(float)*(longest+1));
+	buffers->floatSpectrum = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*(longest/2+1));
+	if(usesStereo)
+	{
+		buffers->complexSignal = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*longest);
+		buffers->complexSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*longest);
+	}
+
+	if(!buffers->signal || !buffers->spectrum || !buffers->batchSignal || !buffers->batchSpectrum ||
+		!buffers->floatSignal || !buffers->floatSpectrum ||
+		(usesStereo && (!buffers->complexSignal || !buffers->complexSpectrum)))
+	{
+		ReleaseWisdomBuffers(buffers);
+		return 0;
+	}
+	return 1;
+}
+
+void ReleaseWisdomBuffers(wisdomBuffers *buffers)
+{
+	if(buffers->signal)
+		fftw_free(buffers->signal);
+	if(buffers->spectrum)
+		fftw_free(buffers->spectrum);
+	if(buffers->batchSignal)
+		fftw_free(buffers->batchSignal);
+	if(buffers->batchSpectrum)
+		fftw_free(buffers->batchSpectrum);
+	if(buffers->floatSignal)
+		fftwf_free(buffers->floatSignal);
+	if(buffers->floatSpectrum)
+		fftwf_free(buffers->floatSpectrum);
+	if(buffers->complexSignal)
+		fftw_free(buffers->complexSignal);
+	if(buffers->complexSpectrum)
+		fftw_free(buffers->complexSpectrum);
+	memset(buffers, 0, sizeof(wisdomBuffers));
+}
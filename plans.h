@@ -0,0 +1,75 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_PLANS_H
+#define MDFOURIER_PLANS_H
+
+#include "mdfourier.h"
+
+#define PLAN_REAL		0
+#define PLAN_COMPLEX	1
+#define PLAN_REAL_MANY	2
+#define PLAN_REAL_FLOAT	3
+
+#define WISDOM_DOUBLE	0
+#define WISDOM_FLOAT	1
+
+/* Largest buffers of every layout trained, see TrainWisdom */
+typedef struct wisdom_buffers_st {
+	double			*signal;
+	fftw_complex	*spectrum;
+	double			*batchSignal;
+	fftw_complex	*batchSpectrum;
+	float			*floatSignal;
+	fftwf_complex	*floatSpectrum;
+	fftw_complex	*complexSignal;
+	fftw_complex	*complexSpectrum;
+} wisdomBuffers;
+
+void InitPlanCache(planManager *pm);
+fftw_plan GetPlanForSize(long int size, planBuffer *buffer, parameters *config);
+fftw_plan GetComplexPlanForSize(long int size, planBuffer *buffer, parameters *config);
+fftw_plan GetBatchPlanForSize(long int size, int howmany, planBuffer *buffer, parameters *config);
+fftwf_plan GetFloatPlanForSize(long int size, planBuffer *buffer, parameters *config);
+long int GetBatchBufferSize(long int size, int howmany);
+int AcquirePlanBuffer(planBuffer *buffer, long int size, parameters *config);
+void ReleasePlanBuffer(planBuffer *buffer, parameters *config);
+void ReportPlanCache(parameters *config);
+void ReleasePlanCache(planManager *pm);
+
+int GetWisdomPath(char *path, int size, int precision, int create);
+int ImportWisdom(int precision);
+int ExportWisdom(int precision);
+int LoadWisdom(parameters *config);
+int SaveWisdom(parameters *config);
+int TrainWisdom(parameters *config);
+int TrainWisdomSize(wisdomBuffers *buffers, long int size, int usesStereo);
+int AllocateWisdomBuffers(wisdomBuffers *buffers, long int longest, int usesStereo);
+void ReleaseWisdomBuffers(wisdomBuffers *buffers);
+
+#endif
@@ -151,485 +151,300 @@
 //#define TESTWARNINGS
 #define SYNC_DEBUG_SCALE	8
 
-char *GetCurrentPathAndChangeToResultsFolder(parameters *config)
+/*
+	Plots are written by path below the results folder, the working directory
+	is never changed so any of them can be drawn in parallel. A group that
+	goes in a subfolder gets "<folder>/" as the prefix of its names.
+*/
+int SetPlotFolder(char *prefix, char *folder, parameters *config)
 {
-	char 	*CurrentPath = NULL;
-
-	CurrentPath = (char*)malloc(sizeof(char)*FILENAME_MAX);
-	if(!CurrentPath)
-		return NULL;
+	char	path[T_BUFFER_SIZE*2];
 
-	if(!GetCurrentDir(CurrentPath, sizeof(char)*FILENAME_MAX))
+	prefix[0] = '\0';
+	ComposeFileName(path, folder, "", config);
+	if(!CreateFolder(path))
 	{
-		free(CurrentPath);
-		logmsg("Could not get current path\n");
-		return NULL;
+		logmsg("ERROR: Could not create %s subfolder\n", folder);
+		return 0;
 	}
+	sprintf(prefix, "%s%c", folder, FOLDERCHAR);
+	return 1;
+}
 
-	if(chdir(config->folderName) == -1)
+/*
+	Every plot group is an independent task, each one captures its own log
+	so the console output is flushed in the usual order once all are done.
+*/
+void PlotMissingSignal(AudioSignal *Signal, parameters *config)
+{
+	if(config->usesStereo && Signal->AudioChannels == 2)
 	{
-		free(CurrentPath);
-		logmsg("Could not open folder %s for results\n", config->folderName);
-		return NULL;
+		PlotTimeSpectrogramUnMatchedContent(Signal, CHANNEL_LEFT, config);
+		logmsg(PLOT_ADVANCE_CHAR);
+		PlotTimeSpectrogramUnMatchedContent(Signal, CHANNEL_RIGHT, config);
+		logmsg(PLOT_ADVANCE_CHAR);
 	}
-	return CurrentPath;
+
+	PlotTimeSpectrogramUnMatchedContent(Signal, CHANNEL_STEREO, config);
+	logmsg(PLOT_ADVANCE_CHAR);
 }
 
-void ReturnToMainPath(char **CurrentPath)
+void PlotSpectrogramSignal(AudioSignal *Signal, int noiseFloor, parameters *config)
 {
-	if(!*CurrentPath)
-		return;
+	char			tmpName[BUFFER_SIZE/2];
+	long int		size = 0;
+	FlatFrequency	*freqs = NULL;
 
-	if(chdir(*CurrentPath) == -1)
-		logmsg("Could not open working folder %s\n", CurrentPath);
-
-	free(*CurrentPath);
-	*CurrentPath = NULL;
-}
+	freqs = CreateSpectrogramFrequencies(Signal, &size, noiseFloor, config);
+	ShortenFileName(basename(Signal->SourceFile), tmpName, BUFFER_SIZE/2);
+	if(noiseFloor)
+	{
+		if(freqs)
+		{
+			PlotNoiseFloorSpectrogram(freqs, size, tmpName, Signal->role, config, Signal);
+			logmsg(PLOT_ADVANCE_CHAR);
+		}
+	}
+	else
+	{
+		if(PlotEachTypeSpectrogram(freqs, size, tmpName, Signal->role, config, Signal) > 1)
+		{
+			PlotAllSpectrogram(freqs, size, tmpName, Signal->role, config);
+			logmsg(PLOT_ADVANCE_CHAR);
+		}
+	}
 
-void StartPlot(char *name, struct timespec* start, parameters *config)
-{
-	logmsg(name);
-	if(config->clock)
-		clock_gettime(CLOCK_MONOTONIC, start);
+	if(freqs)
+	{
+		free(freqs);
+		freqs = NULL;
+	}
 }
 
-void EndPlot(char *name, struct timespec* start, struct timespec* end, parameters *config)
+void PlotTimeSpectrogramSignal(AudioSignal *Signal, parameters *config)
 {
-	logmsg("\n");
+	if(config->usesStereo && Signal->AudioChannels == 2)
+	{
+		PlotTimeSpectrogram(Signal, CHANNEL_LEFT, config);
+		logmsg(PLOT_ADVANCE_CHAR);
+		PlotTimeSpectrogram(Signal, CHANNEL_RIGHT, config);
+		logmsg(PLOT_ADVANCE_CHAR);
+	}
 
-	if(config->clock)
+	for (int i = 0; i < config->types.typeCount; i++)
 	{
-		double	elapsedSeconds;
-		clock_gettime(CLOCK_MONOTONIC, end);
-		elapsedSeconds = TimeSpecToSeconds(end) - TimeSpecToSeconds(start);
-		logmsg(" - clk: %s took %0.2fs\n", name, elapsedSeconds);
+		int type = 0;
+
+		type = config->types.typeArray[i].type;
+		if (type > TYPE_CONTROL && !config->types.typeArray[i].IsaddOnData)
+		{
+			PlotSingleTypeTimeSpectrogram(Signal, CHANNEL_STEREO, type, config);
+			logmsg(PLOT_ADVANCE_CHAR);
+		}
 	}
+
+	PlotTimeSpectrogram(Signal, CHANNEL_STEREO, config);
+	logmsg(PLOT_ADVANCE_CHAR);
 }
 
-char *PushFolder(char *name)
+void ExecutePlotTask(int task, plotTask *tasks, AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
 {
-	char 	*CurrentPath = NULL;
+	int capturing = 0;
+
+	capturing = StartLogCapture();
+	clock_gettime(CLOCK_MONOTONIC, &tasks[task].start);
+	switch(task)
+	{
+		case PLOT_TASK_DIFFERENCES:
+			PlotAmpDifferences(config);
+			//PlotDifferenceTimeSpectrogram(config);
+			logmsg(" - Preliminary results in %s%s\n",
+					config->outputPath,
+					config->folderName);
+			break;
+		case PLOT_TASK_MISSING_REF:
+			PlotMissingSignal(ReferenceSignal, config);
+			break;
+		case PLOT_TASK_MISSING_COMP:
+			PlotMissingSignal(ComparisonSignal, config);
+			break;
+		case PLOT_TASK_SPECTROGRAM_REF:
+			PlotSpectrogramSignal(ReferenceSignal, 0, config);
+			break;
+		case PLOT_TASK_SPECTROGRAM_COMP:
+			PlotSpectrogramSignal(ComparisonSignal, 0, config);
+			break;
+		case PLOT_TASK_NF_SPECTROGRAM_REF:
+			PlotSpectrogramSignal(ReferenceSignal, 1, config);
+			break;
+		case PLOT_TASK_NF_SPECTROGRAM_COMP:
+			PlotSpectrogramSignal(ComparisonSignal, 1, config);
+			break;
+		case PLOT_TASK_CLK_REF:
+			PlotCLKSpectrogram(ReferenceSignal, config);
+			break;
+		case PLOT_TASK_CLK_COMP:
+			PlotCLKSpectrogram(ComparisonSignal, config);
+			break;
+		case PLOT_TASK_TIMESPECTROGRAM_REF:
+			PlotTimeSpectrogramSignal(ReferenceSignal, config);
+			break;
+		case PLOT_TASK_TIMESPECTROGRAM_COMP:
+			PlotTimeSpectrogramSignal(ComparisonSignal, config);
+			break;
+		case PLOT_TASK_PHASE:
+			PlotPhaseDifferences(config);
+			//PlotPhaseFromSignal(ReferenceSignal, config);
+			//PlotPhaseFromSignal(ComparisonSignal, config);
+			logmsg(PLOT_ADVANCE_CHAR);
+			break;
+		case PLOT_TASK_NOISEFLOOR:
+			PlotNoiseFloor(ReferenceSignal, config);
+			break;
+		case PLOT_TASK_WAVEFORM_REF:
+			PlotTimeDomainGraphs(ReferenceSignal, config);
+			break;
+		case PLOT_TASK_WAVEFORM_COMP:
+			PlotTimeDomainGraphs(ComparisonSignal, config);
+			break;
+		case PLOT_TASK_HIDIFF_REF:
+			PlotTimeDomainHighDifferenceGraphs(ReferenceSignal, config);
+			break;
+		case PLOT_TASK_HIDIFF_COMP:
+			PlotTimeDomainHighDifferenceGraphs(ComparisonSignal, config);
+			break;
+		default:
+			break;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tasks[task].end);
+	if(capturing)
+		tasks[task].log = EndLogCapture();
+}
 
-	CurrentPath = (char*)malloc(sizeof(char)*FILENAME_MAX);
-	if(!CurrentPath)
-		return NULL;
+void FlushPlotGroup(char *title, char *name, plotTask *tasks, int count, parameters *config)
+{
+	int		flushed = 0;
+	double	first = 0, last = 0;
 
-	if(!GetCurrentDir(CurrentPath, sizeof(char)*FILENAME_MAX))
+	for(int i = 0; i < count; i++)
 	{
-		free(CurrentPath);
-		logmsg("ERROR: Could not get current path\n");
-		return NULL;
-	}
+		double	start = 0, end = 0;
 
-	if(!CreateFolder(name))
-	{
-		free(CurrentPath);
-		logmsg("ERROR: Could not create %s subfolder\n", name);
-		return NULL;
-	}
-	if(chdir(name) == -1)
-	{
-		free(CurrentPath);
-		logmsg("ERROR: Could not open folder %s for results\n", name);
-		return NULL;
+		if(!tasks[i].requested)
+			continue;
+
+		if(!flushed)
+			logmsg("%s", title);
+		FlushLogCapture(tasks[i].log);
+		tasks[i].log = NULL;
+
+		start = TimeSpecToSeconds(&tasks[i].start);
+		end = TimeSpecToSeconds(&tasks[i].end);
+		if(!flushed || start < first)
+			first = start;
+		if(!flushed || end > last)
+			last = end;
+		flushed++;
 	}
-	return CurrentPath;
+
+	if(!flushed)
+		return;
+
+	logmsg("\n");
+	if(config->clock)
+		logmsg(" - clk: %s took %0.2fs\n", name, last - first);
 }
 
 void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
 {
+	int					noiseFloor = 0;
 	struct	timespec	start, end;
-	char 	*CurrentPath = NULL, *MainPath = NULL;
+	plotTask			tasks[PLOT_TASK_COUNT];
 
 	if(config->clock)
 		clock_gettime(CLOCK_MONOTONIC, &start);
 
-	MainPath = PushMainPath(config);
-	CurrentPath = GetCurrentPathAndChangeToResultsFolder(config);
+	memset(tasks, 0, sizeof(plotTask)*PLOT_TASK_COUNT);
+	noiseFloor = config->plotNoiseFloor && !config->noSyncProfile &&
+				ReferenceSignal->hasSilenceBlock && ComparisonSignal->hasSilenceBlock;
 
 	if(config->plotDifferences || config->averagePlot)
+		tasks[PLOT_TASK_DIFFERENCES].requested = 1;
+	if(config->plotMissing && !config->FullTimeSpectroScale)
 	{
-		struct	timespec lstart, lend;
-
-		StartPlot(" - Difference", &lstart, config);
-		PlotAmpDifferences(config);
-		//PlotDifferenceTimeSpectrogram(config);
-		EndPlot("Differences", &lstart, &lend, config);
-
-		printf(" - Preliminary results in %s%s\n",
-				config->outputPath,
-				config->folderName);
+		tasks[PLOT_TASK_MISSING_REF].requested = 1;
+		tasks[PLOT_TASK_MISSING_COMP].requested = 1;
 	}
-
-	if(config->plotMissing)
-	{
-		if(!config->FullTimeSpectroScale)
-		{
-			struct	timespec	lstart, lend;
-	
-			StartPlot(" - Missing and Extra Frequencies", &lstart, config);
-	
-			if(config->usesStereo)
-			{
-				char	*returnFolder = NULL;
-			
-				returnFolder = PushFolder(MISSING_FOLDER);
-				if(!returnFolder)
-					return;
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-				for (int i = 0; i < 2; i++)
-				{
-					if (i == 0 && ReferenceSignal->AudioChannels == 2)
-					{
-						PlotTimeSpectrogramUnMatchedContent(ReferenceSignal, CHANNEL_LEFT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-						PlotTimeSpectrogramUnMatchedContent(ReferenceSignal, CHANNEL_RIGHT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-					}
-
-					if (i == 1 && ComparisonSignal->AudioChannels == 2)
-					{
-						PlotTimeSpectrogramUnMatchedContent(ComparisonSignal, CHANNEL_LEFT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-						PlotTimeSpectrogramUnMatchedContent(ComparisonSignal, CHANNEL_RIGHT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-					}
-				}
-
-				ReturnToMainPath(&returnFolder);
-			}
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-			for (int i = 0; i < 2; i++)
-			{
-				if (i == 0)
-				{
-					PlotTimeSpectrogramUnMatchedContent(ReferenceSignal, CHANNEL_STEREO, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-				}
-				else
-				{
-					PlotTimeSpectrogramUnMatchedContent(ComparisonSignal, CHANNEL_STEREO, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-				}
-			}
-	
-			EndPlot("Missing and Extra", &lstart, &lend, config);
-		}
-		else
-			logmsg(" X Skipped: Missing and Extra Frequencies, due to range\n");
-	}
-
 	if(config->plotSpectrogram)
 	{
-		int					typeCount = 0, someStereo = 0, doRefAll = 0, doCompAll = 0;
-		struct	timespec	lstart, lend;
-		char				*returnFolder = NULL;
-		char				tmpNameRef[BUFFER_SIZE/2], tmpNameComp[BUFFER_SIZE/2];
-		long int			sizeRef = 0, sizeComp = 0;
-		FlatFrequency		*freqsRef = NULL, *freqsComp = NULL;
-
-		StartPlot(" - Spectrograms", &lstart, config);
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-		for(int i = 0; i < 2; i++)
-		{
-			if(i == 0)
-				freqsRef = CreateSpectrogramFrequencies(ReferenceSignal, &sizeRef, 0, config);
-			else
-				freqsComp = CreateSpectrogramFrequencies(ComparisonSignal, &sizeComp, 0, config);
-		}
-
-		//Create subfolder if needed
-		typeCount = GetActiveBlockTypesNoRepeat(config);
-		someStereo = config->referenceSignal->AudioChannels == 2 || config->comparisonSignal->AudioChannels == 2;
-		if (typeCount > 1 || someStereo)
-		{
-			returnFolder = PushFolder(SPECTROGRAM_FOLDER);
-			if (!returnFolder)
-				return;
-		}
-
-		ShortenFileName(basename(ReferenceSignal->SourceFile), tmpNameRef, BUFFER_SIZE/2);
-		ShortenFileName(basename(ComparisonSignal->SourceFile), tmpNameComp, BUFFER_SIZE/2);
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-		for(int i = 0; i < 2; i++)
-		{
-			if(i == 0)
-			{
-				if(PlotEachTypeSpectrogram(freqsRef, sizeRef, tmpNameRef, ReferenceSignal->role, config, ReferenceSignal) > 1)
-					doRefAll = 1;
-			}
-			else
-			{
-				if(PlotEachTypeSpectrogram(freqsComp, sizeComp, tmpNameComp, ComparisonSignal->role, config, ComparisonSignal) > 1)
-					doCompAll = 1;
-			}
-		}
-
-		if (typeCount > 1 || someStereo)
-		{
-			ReturnToMainPath(&returnFolder);
-			returnFolder = NULL;
-		}
-
-		if(doRefAll && doCompAll)
-		{
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-			for(int i = 0; i < 2; i++)
-			{
-				if(i == 0)
-				{
-					PlotAllSpectrogram(freqsRef, sizeRef, tmpNameRef, ReferenceSignal->role, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-				}
-				else
-				{
-					PlotAllSpectrogram(freqsComp, sizeComp, tmpNameComp, ComparisonSignal->role, config);
-					logmsg(PLOT_ADVANCE_CHAR);				
-				}
-			}
-		}
-
-		if(freqsRef)
-		{
-			free(freqsRef);
-			freqsRef = NULL;
-		}
-
-		if(freqsComp)
-		{
-			free(freqsComp);
-			freqsComp = NULL;
-		}
-		EndPlot("Spectrogram", &lstart, &lend, config);
-
+		tasks[PLOT_TASK_SPECTROGRAM_REF].requested = 1;
+		tasks[PLOT_TASK_SPECTROGRAM_COMP].requested = 1;
 		if(config->plotNoiseFloor)
 		{
-			StartPlot(" - Noise Floor Spectrograms", &lstart, config);
-#ifdef OPENMP_ENABLE
-			#pragma omp parallel for
-#endif
-			for(int i = 0; i < 2; i++)
-			{
-				if(i == 0)
-					freqsRef = CreateSpectrogramFrequencies(ReferenceSignal, &sizeRef, 1, config);
-				else
-					freqsComp = CreateSpectrogramFrequencies(ComparisonSignal, &sizeComp, 1, config);
-			}
-			if(freqsRef)
-			{
-				PlotNoiseFloorSpectrogram(freqsRef, sizeRef, tmpNameRef, ReferenceSignal->role, config, ReferenceSignal);
-				logmsg(PLOT_ADVANCE_CHAR);
-				free(freqsRef);
-			}
-			if(freqsComp)
-			{
-				PlotNoiseFloorSpectrogram(freqsComp, sizeComp, tmpNameComp, ComparisonSignal->role, config, ComparisonSignal);
-				logmsg(PLOT_ADVANCE_CHAR);
-				free(freqsComp);
-			}
-
-			EndPlot("Noise Floor Spectrogram", &lstart, &lend, config);
+			tasks[PLOT_TASK_NF_SPECTROGRAM_REF].requested = 1;
+			tasks[PLOT_TASK_NF_SPECTROGRAM_COMP].requested = 1;
 		}
 	}
-
 	if(config->clkMeasure)
 	{
-		struct	timespec lstart, lend;
-		char	*returnFolder = NULL;
-
-		StartPlot(" - Clocks", &lstart, config);
-	
-		returnFolder = PushFolder(CLK_FOLDER);
-		if(!returnFolder)
-			return;
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-		for (int i = 0; i < 2; i++)
-		{
-			if (i == 0)
-				PlotCLKSpectrogram(ReferenceSignal, config);
-			else
-				PlotCLKSpectrogram(ComparisonSignal, config);
-		}
-
-		ReturnToMainPath(&returnFolder);
-
-		EndPlot("Clocks", &lstart, &lend, config);
+		tasks[PLOT_TASK_CLK_REF].requested = 1;
+		tasks[PLOT_TASK_CLK_COMP].requested = 1;
 	}
-
 	if(config->plotTimeSpectrogram)
 	{
-		struct	timespec	lstart, lend;
-		char*	returnFolder = NULL;
-
-		StartPlot(" - Time Spectrogram", &lstart, config);
-
-		if(config->usesStereo)
-		{
-			returnFolder = PushFolder(T_SPECTR_FOLDER);
-			if(!returnFolder)
-				return;
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-			for (int i = 0; i < 2; i++)
-			{
-				if (i == 0)
-				{
-					if (ReferenceSignal->AudioChannels == 2)
-					{
-						PlotTimeSpectrogram(ReferenceSignal, CHANNEL_LEFT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-						PlotTimeSpectrogram(ReferenceSignal, CHANNEL_RIGHT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-					}
-				}
-				else
-				{
-					if (ComparisonSignal->AudioChannels == 2)
-					{
-						PlotTimeSpectrogram(ComparisonSignal, CHANNEL_LEFT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-						PlotTimeSpectrogram(ComparisonSignal, CHANNEL_RIGHT, config);
-						logmsg(PLOT_ADVANCE_CHAR);
-					}
-				}
-			}
-			ReturnToMainPath(&returnFolder);
-		}
-
-		if (GetActiveBlockTypesNoRepeat(config))
-		{
-			returnFolder = PushFolder(T_SPECTR_FOLDER);
-			if (!returnFolder)
-				return;
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-			for (int i = 0; i < config->types.typeCount; i++)
-			{
-				int type = 0;
-				
-				type = config->types.typeArray[i].type;
-				if (type > TYPE_CONTROL && !config->types.typeArray[i].IsaddOnData)
-				{
-					PlotSingleTypeTimeSpectrogram(ReferenceSignal, CHANNEL_STEREO, type, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-					
-					PlotSingleTypeTimeSpectrogram(ComparisonSignal, CHANNEL_STEREO, type, config);
-					logmsg(PLOT_ADVANCE_CHAR);
-				}
-			}
-			ReturnToMainPath(&returnFolder);
-		}
-#ifdef OPENMP_ENABLE
-	#pragma omp parallel for
-#endif
-		for (int i = 0; i < 2; i++)
-		{
-			if (i == 0)
-			{
-				PlotTimeSpectrogram(ReferenceSignal, CHANNEL_STEREO, config);
-				logmsg(PLOT_ADVANCE_CHAR);
-			}
-			else
-			{
-				PlotTimeSpectrogram(ComparisonSignal, CHANNEL_STEREO, config);
-				logmsg(PLOT_ADVANCE_CHAR);
-			}
-		}
-		EndPlot("Time Spectrogram", &lstart, &lend, config);
+		tasks[PLOT_TASK_TIMESPECTROGRAM_REF].requested = 1;
+		tasks[PLOT_TASK_TIMESPECTROGRAM_COMP].requested = 1;
 	}
-
 	if(config->plotPhase)
+		tasks[PLOT_TASK_PHASE].requested = 1;
+	if(noiseFloor)
+		tasks[PLOT_TASK_NOISEFLOOR].requested = 1;
+	if((config->hasTimeDomain && config->plotTimeDomain) || config->plotAllNotes)
 	{
-		struct	timespec	lstart, lend;
-
-		StartPlot(" - Phase", &lstart, config);
-
-		PlotPhaseDifferences(config);
-		//PlotPhaseFromSignal(ReferenceSignal, config);
-		//PlotPhaseFromSignal(ComparisonSignal, config);
-		
-		logmsg(PLOT_ADVANCE_CHAR);
-		EndPlot("Phase", &lstart, &lend, config);
+		tasks[PLOT_TASK_WAVEFORM_REF].requested = 1;
+		tasks[PLOT_TASK_WAVEFORM_COMP].requested = 1;
 	}
-
-	if(config->plotNoiseFloor)
+	// Marks the blocks to graph, must be done before any plot runs
+	if(config->plotTimeDomainHiDiff &&
+		FindDifferenceAveragesperBlock(config->thresholdAmplitudeHiDif, config->thresholdMissingHiDif, config->thresholdExtraHiDif, config))
 	{
-		if(!config->noSyncProfile)
-		{
-			if(ReferenceSignal->hasSilenceBlock && ComparisonSignal->hasSilenceBlock)
-			{
-				struct	timespec	lstart, lend;
-		
-				StartPlot(" - Noise Floor", &lstart, config);
-
-				PlotNoiseFloor(ReferenceSignal, config);
-				EndPlot("Noise Floor", &lstart, &lend, config);
-			}
-			else
-				logmsg(" X Noise Floor graphs ommited: no noise floor value found.\n");
-		}
-		else
-			logmsg(" X Noise floor plots make no sense with current parameters.\n");
+		tasks[PLOT_TASK_HIDIFF_REF].requested = 1;
+		tasks[PLOT_TASK_HIDIFF_COMP].requested = 1;
 	}
 
-	if((config->hasTimeDomain && config->plotTimeDomain) || config->plotAllNotes)
+#ifdef OPENMP_ENABLE
+	#pragma omp parallel
+	#pragma omp single
+#endif
+	for(int task = 0; task < PLOT_TASK_COUNT; task++)
 	{
-		struct	timespec	lstart, lend;
-		char 				*returnFolder = NULL;
-
-		returnFolder = PushFolder(WAVEFORM_FOLDER);
-		if(!returnFolder)
-		{
-			ReturnToMainPath(&CurrentPath);
-			return;
-		}
-
-		StartPlot(" - Waveform Graphs ", &lstart, config);
+		if(!tasks[task].requested)
+			continue;
 #ifdef OPENMP_ENABLE
-	#pragma omp parallel for
+		#pragma omp task firstprivate(task)
 #endif
-		for (int i = 0; i < 2; i++)
-		{
-			if (i == 0)
-				PlotTimeDomainGraphs(ReferenceSignal, config);
-			else
-				PlotTimeDomainGraphs(ComparisonSignal, config);
-		}
-		EndPlot("Waveform", &lstart, &lend, config);
-
-		ReturnToMainPath(&returnFolder);
+		ExecutePlotTask(task, tasks, ReferenceSignal, ComparisonSignal, config);
 	}
 
-	if(config->plotTimeDomainHiDiff)
+	FlushPlotGroup(" - Difference", "Differences", tasks+PLOT_TASK_DIFFERENCES, 1, config);
+	if(config->plotMissing && config->FullTimeSpectroScale)
+		logmsg(" X Skipped: Missing and Extra Frequencies, due to range\n");
+	FlushPlotGroup(" - Missing and Extra Frequencies", "Missing and Extra", tasks+PLOT_TASK_MISSING_REF, 2, config);
+	FlushPlotGroup(" - Spectrograms", "Spectrogram", tasks+PLOT_TASK_SPECTROGRAM_REF, 2, config);
+	FlushPlotGroup(" - Noise Floor Spectrograms", "Noise Floor Spectrogram", tasks+PLOT_TASK_NF_SPECTROGRAM_REF, 2, config);
+	FlushPlotGroup(" - Clocks", "Clocks", tasks+PLOT_TASK_CLK_REF, 2, config);
+	FlushPlotGroup(" - Time Spectrogram", "Time Spectrogram", tasks+PLOT_TASK_TIMESPECTROGRAM_REF, 2, config);
+	FlushPlotGroup(" - Phase", "Phase", tasks+PLOT_TASK_PHASE, 1, config);
+	if(config->plotNoiseFloor && !noiseFloor)
 	{
-		if(FindDifferenceAveragesperBlock(config->thresholdAmplitudeHiDif, config->thresholdMissingHiDif, config->thresholdExtraHiDif, config))
-		{
-			struct	timespec	lstart, lend;
-
-			StartPlot(" - Time Domain Graphs from highly different notes\n  ", &lstart, config);
-			PlotTimeDomainHighDifferenceGraphs(ReferenceSignal, config);
-			PlotTimeDomainHighDifferenceGraphs(ComparisonSignal, config);
-			EndPlot("Time Domain Graphs", &lstart, &lend, config);
-		}
+		if(!config->noSyncProfile)
+			logmsg(" X Noise Floor graphs ommited: no noise floor value found.\n");
+		else
+			logmsg(" X Noise floor plots make no sense with current parameters.\n");
 	}
-
-	ReturnToMainPath(&CurrentPath);
-	PopMainPath(&MainPath);
+	FlushPlotGroup(" - Noise Floor", "Noise Floor", tasks+PLOT_TASK_NOISEFLOOR, 1, config);
+	FlushPlotGroup(" - Waveform Graphs ", "Waveform", tasks+PLOT_TASK_WAVEFORM_REF, 2, config);
+	FlushPlotGroup(" - Time Domain Graphs from highly different notes\n  ", "Time Domain Graphs", tasks+PLOT_TASK_HIDIFF_REF, 2, config);
 
 	if(config->clock)
 	{
@@ -675,21 +490,18 @@ void PlotAmpDifferences(parameters *config)
 			if(config->channelBalance == 0 && config->referenceSignal->AudioChannels == 2 && config->comparisonSignal->AudioChannels == 2)
 			{
 				char		name[2*BUFFER_SIZE];
-				char		*returnFolder = NULL;
+				char		folder[BUFFER_SIZE/8];
 
-				returnFolder = PushFolder(DIFFERENCE_FOLDER);
-				if (!returnFolder)
+				if (!SetPlotFolder(folder, DIFFERENCE_FOLDER, config))
 					return;
 
-				sprintf(name, "%s_%c", config->compareName, CHANNEL_LEFT);
+				sprintf(name, "%s%s_%c", folder, config->compareName, CHANNEL_LEFT);
 				PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_LEFT, name, config);
 				logmsg(PLOT_ADVANCE_CHAR);
 
-				sprintf(name, "%s_%c", config->compareName, CHANNEL_RIGHT);
+				sprintf(name, "%s%s_%c", folder, config->compareName, CHANNEL_RIGHT);
 				PlotAllDifferentAmplitudes(amplDiff, size, CHANNEL_RIGHT, name, config);
 				logmsg(PLOT_ADVANCE_CHAR);
-
-				ReturnToMainPath(&returnFolder);
 			}
 
 			logmsg(PLOT_ADVANCE_CHAR);
@@ -806,8 +618,8 @@ int FillPlotExtra(PlotFile *plot, char *name, int sizex, int sizey, double x0, d
 #if defined (WIN32)
 int checkPathLen(char* file, parameters* config)
 {
-	int len = 0;
-	char* CurrentPath = NULL;
+	int len = 0, folders = 0;
+	char* CurrentPath = NULL, *name = NULL;
 
 	if (!config)
 		return 0;
@@ -822,22 +634,27 @@ int checkPathLen(char* file, parameters* config)
 		return 0;
 	}
 
+	// Only the file name is shortened, the folders are kept
+	name = strrchr(file, FOLDERCHAR);
+	name = name ? name + 1 : file;
+	folders = name - file;
+
 	len = strlen(CurrentPath) + strlen(file) + 1;
 	if(len >= MAX_PATH)
 	{
-		int lfile = strlen(file);
+		int lfile = strlen(name);
 		int third = lfile/3;
 
 		logmsg("\nWARNING: Path + file exceeds OS MAX_PATH: ");
-		if(MAX_PATH > strlen(CurrentPath) + third*2 + 1)
+		if(MAX_PATH > strlen(CurrentPath) + folders + third*2 + 1)
 		{
 			int pos = 0;
 
 			for(pos = 0; pos < third; pos++)
-				file[third + pos] = file[lfile - third + pos];
+				name[third + pos] = name[lfile - third + pos];
 
-			file[third] = '_';
-			file[third + pos] = '\0';
+			name[third] = '_';
+			name[third + pos] = '\0';
 
 			len = strlen(CurrentPath) + strlen(file) + 1;
 			logmsg("Shortened to %s\n", file);
@@ -861,8 +678,11 @@ int FillPlot(PlotFile *plot, char *name, double x0, double y0, double x1, double
 	plot->plotter = NULL;
 	plot->plotter_params = NULL;
 	plot->file = NULL;
+	plot->raster = NULL;
+	plot->layer = NULL;
+	plot->png = &config->png;
 
-	ComposeFileNameoPath(plot->FileName, name, ".png", config);
+	ComposeFileName(plot->FileName, name, ".png", config);
 
 #if defined (WIN32)
 	checkPathLen(plot->FileName, config);
@@ -896,33 +716,27 @@ int FillPlot(PlotFile *plot, char *name, double x0, double y0, double x1, double
 	return 1;
 }
 
-int CreatePlotFile(PlotFile *plot, parameters *config)
+int OpenPlotter(PlotFile *plot, char *format, FILE *file, parameters *config)
 {
 	char		size[20];
 
-	plot->file = fopen(plot->FileName, "wb");
-	if(!plot->file)
-	{
-		logmsg("ERROR: Couldn't create graph file %s\n", plot->FileName);
-		return 0;
-	}
-
 	sprintf(size, "%dx%d", plot->sizex, plot->sizey);
 	plot->plotter_params = pl_newplparams ();
 	if(!plot->plotter_params)
 	{
 		logmsg("ERROR: Couldn't create plotter_params\n");
-		fclose(plot->file); 
 		return 0;
 	}
 	pl_setplparam (plot->plotter_params, "BITMAPSIZE", size);
+	if(strcmp(format, "pnm") == 0)
+		pl_setplparam (plot->plotter_params, "PNM_PORTABLE", "no");
 
-	plot->plotter = pl_newpl_r("png", stdin, plot->file, stderr, plot->plotter_params);
+	plot->plotter = pl_newpl_r(format, stdin, file, stderr, plot->plotter_params);
 	if(!plot->plotter)
 	{
 		logmsg("ERROR: Couldn't create Plotter\n");
 		pl_deleteplparams(plot->plotter_params);
-		fclose(plot->file); 
+		plot->plotter_params = NULL;
 		return 0;
 	}
 
@@ -931,12 +745,15 @@ int CreatePlotFile(PlotFile *plot, parameters *config)
 		logmsg("ERROR: Couldn't open Plotter\n");
 		pl_deletepl_r(plot->plotter);
 		pl_deleteplparams(plot->plotter_params);
-		fclose(plot->file); 
+		plot->plotter = NULL;
+		plot->plotter_params = NULL;
 		return 0;
 	}
 	pl_fspace_r(plot->plotter, plot->x0, plot->y0, plot->x1, plot->y1);
 	pl_flinewidth_r(plot->plotter, plot->penWidth);
-	if(config->whiteBG)
+	if(plot->raster && plot->raster->layers)
+		pl_bgcolor_r(plot->plotter, RASTER_KEY_RED*0x101, RASTER_KEY_GREEN*0x101, RASTER_KEY_BLUE*0x101);
+	else if(config->whiteBG)
 		pl_bgcolor_r(plot->plotter, 0xffff, 0xffff, 0xffff);
 	else
 		pl_bgcolor_r(plot->plotter, 0, 0, 0);
@@ -951,7 +768,133 @@ int CreatePlotFile(PlotFile *plot, parameters *config)
 	return 1;
 }
 
-int ClosePlot(PlotFile *plot)
+int CreatePlotFile(PlotFile *plot, parameters *config)
+{
+	// libplot's own PNG writer has no settings, ours does
+	if(config->png.enabled)
+		return CreateRasterPlotFile(plot, config);
+
+	plot->file = fopen(plot->FileName, "wb");
+	if(!plot->file)
+	{
+		logmsg("ERROR: Couldn't create graph file %s\n", plot->FileName);
+		return 0;
+	}
+
+	if(!OpenPlotter(plot, "png", plot->file, config))
+	{
+		fclose(plot->file);
+		plot->file = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+void ReleaseRasterPlot(PlotFile *plot)
+{
+	if(plot->raster)
+	{
+		ReleaseRaster(plot->raster);
+		free(plot->raster);
+		plot->raster = NULL;
+	}
+
+	if(plot->layer)
+	{
+		fclose(plot->layer);
+		plot->layer = NULL;
+	}
+}
+
+/*
+	Plots with dense data draw it through DrawRasterLine into a framebuffer.
+	libplot renders what goes below the data until StartRasterData and what
+	goes above it afterwards, each one as a PNM layer that ClosePlot merges.
+	Plots without dense data use it with a single layer when a PNG profile
+	was requested, StartRasterData is simply never called.
+	If the framebuffer can't be allocated this is a regular libplot PNG.
+*/
+int CreateRasterPlotFile(PlotFile *plot, parameters *config)
+{
+	plot->file = fopen(plot->FileName, "wb");
+	if(!plot->file)
+	{
+		logmsg("ERROR: Couldn't create graph file %s\n", plot->FileName);
+		return 0;
+	}
+
+	plot->raster = (RasterImage*)malloc(sizeof(RasterImage));
+	if(plot->raster)
+	{
+		memset(plot->raster, 0, sizeof(RasterImage));
+		if(CreateRaster(plot->raster, plot->sizex, plot->sizey, plot->x0, plot->y0, plot->x1, plot->y1, config->whiteBG))
+			plot->layer = tmpfile();
+	}
+
+	if(!plot->layer)
+	{
+		ReleaseRasterPlot(plot);
+		if(!OpenPlotter(plot, "png", plot->file, config))
+		{
+			fclose(plot->file);
+			plot->file = NULL;
+			return 0;
+		}
+		return 1;
+	}
+
+	if(!OpenPlotter(plot, "pnm", plot->layer, config))
+	{
+		ReleaseRasterPlot(plot);
+		fclose(plot->file);
+		plot->file = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+int StartRasterData(PlotFile *plot, parameters *config)
+{
+	int		loaded = 0;
+
+	if(!plot->raster)
+		return 1;
+
+	// The layer below the data is complete
+	if(ClosePlotter(plot))
+	{
+		rewind(plot->layer);
+		loaded = ReadRasterLayer(plot->raster, plot->layer, 0);
+	}
+	fclose(plot->layer);
+	plot->layer = NULL;
+
+	if(loaded)
+		plot->layer = tmpfile();
+	if(!plot->layer || !OpenPlotter(plot, "pnm", plot->layer, config))
+	{
+		logmsg("ERROR: Couldn't create plot layers for %s\n", plot->FileName);
+		ReleaseRasterPlot(plot);
+		fclose(plot->file);
+		plot->file = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+void DrawRasterLine(PlotFile *plot, int colorIndex, long int intensity, double x0, double y0, double x1, double y1)
+{
+	if(!plot->raster)
+	{
+		SetPenColor(colorIndex, intensity, plot);
+		pl_fline_r(plot->plotter, x0, y0, x1, y1);
+		pl_endpath_r(plot->plotter);
+		return;
+	}
+	RasterLine(plot->raster, x0, y0, x1, y1, GetRasterColor(colorIndex, intensity));
+}
+
+int ClosePlotter(PlotFile *plot)
 {
 	if(pl_closepl_r(plot->plotter) < 0)
 	{
@@ -972,11 +915,30 @@ int ClosePlot(PlotFile *plot)
 		return 0;
 	}
 	plot->plotter_params = NULL;
+	return 1;
+}
+
+int ClosePlot(PlotFile *plot)
+{
+	int		written = 1;
+
+	if(!ClosePlotter(plot))
+		return 0;
+
+	if(plot->raster)
+	{
+		// Labels and scales go over the data
+		rewind(plot->layer);
+		written = ReadRasterLayer(plot->raster, plot->layer, 1);
+		if(written)
+			written = WriteRasterPNG(plot->raster, plot->file, plot->png);
+		ReleaseRasterPlot(plot);
+	}
 
 	fclose(plot->file);
 	plot->file = NULL;
 
-	return 1;
+	return written;
 }
 
 void DrawBisectionLines(PlotFile *plot, parameters *config)
@@ -2845,7 +2807,7 @@ void DrawLabelsNoise(PlotFile *plot, double hz, AudioSignal *Signal, parameters
 void SaveCSVAmpDiff(FlatAmplDifference *amplDiff, long int size, char *filename, parameters *config)
 {
 	FILE 		*csv = NULL;
-	char		name[BUFFER_SIZE];
+	char		name[T_BUFFER_SIZE];
 
 	if(!config)
 		return;
@@ -2853,7 +2815,7 @@ void SaveCSVAmpDiff(FlatAmplDifference *amplDiff, long int size, char *filename,
 	if(!amplDiff)
 		return;
 
-	sprintf(name, "%s.csv", filename);
+	ComposeFileName(name, filename, ".csv", config);
 	
 	csv = fopen(name, "wb");
 	if(!csv)
@@ -2935,44 +2897,34 @@ int PlotEachTypeDifferentAmplitudes(FlatAmplDifference *amplDiff, long int size,
 
 		if(type > TYPE_CONTROL && !config->types.typeArray[i].IsaddOnData)
 		{
-			char	*returnFolder = NULL;
+			char	folder[BUFFER_SIZE/8];
 		
+			folder[0] = '\0';
 			if(typeCount > 1)
 			{
-				returnFolder = PushFolder(DIFFERENCE_FOLDER);
-				if(!returnFolder)
+				if(!SetPlotFolder(folder, DIFFERENCE_FOLDER, config))
 					return 0;
 			}
 
-			sprintf(name, "DA_%s_%02d%s", filename, 
+			sprintf(name, "%sDA_%s_%02d%s", folder, filename, 
 				type, config->types.typeArray[i].typeName);
 			PlotSingleTypeDifferentAmplitudes(amplDiff, size, type, name, CHANNEL_STEREO, config);
 			logmsg(PLOT_ADVANCE_CHAR);
 
-			if(typeCount > 1)
-				ReturnToMainPath(&returnFolder);
-
 			if(config->types.typeArray[i].channel == CHANNEL_STEREO && someStereo)
 			{
-				if(typeCount > 1 || someStereo)
-				{
-					returnFolder = PushFolder(DIFFERENCE_FOLDER);
-					if(!returnFolder)
-						return 0;
-				}
+				if(!SetPlotFolder(folder, DIFFERENCE_FOLDER, config))
+					return 0;
 
-				sprintf(name, "DA_%s_%02d%s_%c", filename,
+				sprintf(name, "%sDA_%s_%02d%s_%c", folder, filename,
 					type, config->types.typeArray[i].typeName, CHANNEL_LEFT);
 				PlotSingleTypeDifferentAmplitudes(amplDiff, size, type, name, CHANNEL_LEFT, config);
 				logmsg(PLOT_ADVANCE_CHAR);
 
-				sprintf(name, "DA_%s_%02d%s_%c", filename,
+				sprintf(name, "%sDA_%s_%02d%s_%c", folder, filename,
 					type, config->types.typeArray[i].typeName, CHANNEL_RIGHT);
 				PlotSingleTypeDifferentAmplitudes(amplDiff, size, type, name, CHANNEL_RIGHT, config);
 				logmsg(PLOT_ADVANCE_CHAR);
-
-				if(typeCount > 1 || someStereo)
-					ReturnToMainPath(&returnFolder);
 			}
 
 			types ++;
@@ -3134,12 +3086,15 @@ void PlotAllSpectrogram(FlatFrequency *freqs, long int size, char *filename, int
 	sprintf(name, "SP__ALL_%c_%s", signal == ROLE_REF ? 'A' : 'B', filename);
 	FillPlot(&plot, name, config->startHzPlot, significant, config->endHzPlot, 0.0, 1, 1, config);
 
-	if(!CreatePlotFile(&plot, config))
+	if(!CreateRasterPlotFile(&plot, config))
 		return;
 
 	DrawGridZeroToLimit(&plot, significant, VERT_SCALE_STEP, config->endHzPlot, 1000, 0, config);
 	DrawLabelsZeroToLimit(&plot, significant, VERT_SCALE_STEP, config->endHzPlot, 0, config);
 
+	if(!StartRasterData(&plot, config))
+		return;
+
 	if(size)
 	{
 		for(int f = size-1; f >= 0; f--)
@@ -3153,9 +3108,7 @@ void PlotAllSpectrogram(FlatFrequency *freqs, long int size, char *filename, int
 				y = freqs[f].amplitude;
 				intensity = CalculateWeightedError((abs_significant - fabs(y))/abs_significant, config)*0xffff;
 		
-				SetPenColor(freqs[f].color, intensity, &plot);
-				pl_fline_r(plot.plotter, x,	y, x, significant);
-				pl_endpath_r(plot.plotter);
+				DrawRasterLine(&plot, freqs[f].color, intensity, x, y, x, significant);
 			}
 		}
 	}
@@ -3167,27 +3120,36 @@ void PlotAllSpectrogram(FlatFrequency *freqs, long int size, char *filename, int
 
 int PlotEachTypeSpectrogram(FlatFrequency* freqs, long int size, char* filename, int signal, parameters* config, AudioSignal* Signal)
 {
-	int 		i = 0, types = 0;
-	char		name[BUFFER_SIZE];
+	int 		i = 0, types = 0, someStereo = 0;
+	char		name[BUFFER_SIZE], folder[BUFFER_SIZE/8];
+
+	//Create subfolder if needed
+	folder[0] = '\0';
+	someStereo = config->referenceSignal->AudioChannels == 2 || config->comparisonSignal->AudioChannels == 2;
+	if (GetActiveBlockTypesNoRepeat(config) > 1 || someStereo)
+	{
+		if (!SetPlotFolder(folder, SPECTROGRAM_FOLDER, config))
+			return 0;
+	}
 
 	for (i = 0; i < config->types.typeCount; i++)
 	{
 		if (config->types.typeArray[i].type > TYPE_CONTROL && !config->types.typeArray[i].IsaddOnData)
 		{
-			sprintf(name, "SP_%c_%s_%02d%s", signal == ROLE_REF ? 'A' : 'B', filename,
+			sprintf(name, "%sSP_%c_%s_%02d%s", folder, signal == ROLE_REF ? 'A' : 'B', filename,
 				config->types.typeArray[i].type, config->types.typeArray[i].typeName);
 			PlotSingleTypeSpectrogram(freqs, size, config->types.typeArray[i].type, name, signal, CHANNEL_STEREO, config);
 			logmsg(PLOT_ADVANCE_CHAR);
 
 			if (config->types.typeArray[i].channel == CHANNEL_STEREO && Signal->AudioChannels == 2)
 			{
-				sprintf(name, "SP_%c_%s_%02d%s_%c", signal == ROLE_REF ? 'A' : 'B', filename,
+				sprintf(name, "%sSP_%c_%s_%02d%s_%c", folder, signal == ROLE_REF ? 'A' : 'B', filename,
 					config->types.typeArray[i].type, config->types.typeArray[i].typeName,
 					CHANNEL_LEFT);
 				PlotSingleTypeSpectrogram(freqs, size, config->types.typeArray[i].type, name, signal, CHANNEL_LEFT, config);
 				logmsg(PLOT_ADVANCE_CHAR);
 
-				sprintf(name, "SP_%c_%s_%02d%s_%c", signal == ROLE_REF ? 'A' : 'B', filename,
+				sprintf(name, "%sSP_%c_%s_%02d%s_%c", folder, signal == ROLE_REF ? 'A' : 'B', filename,
 					config->types.typeArray[i].type, config->types.typeArray[i].typeName,
 					CHANNEL_RIGHT);
 				PlotSingleTypeSpectrogram(freqs, size, config->types.typeArray[i].type, name, signal, CHANNEL_RIGHT, config);
@@ -3249,12 +3211,15 @@ void PlotSingleTypeSpectrogram(FlatFrequency *freqs, long int size, int type, ch
 
 	FillPlot(&plot, filename, config->startHzPlot, significant, config->endHzPlot, 0.0, 1, 1, config);
 
-	if(!CreatePlotFile(&plot, config))
+	if(!CreateRasterPlotFile(&plot, config))
 		return;
 
 	DrawGridZeroToLimit(&plot, significant, VERT_SCALE_STEP,config->endHzPlot, 1000, 0, config);
 	DrawLabelsZeroToLimit(&plot, significant, VERT_SCALE_STEP,config->endHzPlot, 0, config);
 
+	if(!StartRasterData(&plot, config))
+		return;
+
 	for(int f = 0; f < size; f++)
 	{
 		if(freqs[f].type == type && (channel == CHANNEL_STEREO || freqs[f].channel == channel) && 
@@ -3268,9 +3233,7 @@ void PlotSingleTypeSpectrogram(FlatFrequency *freqs, long int size, int type, ch
 			intensity = CalculateWeightedError((abs_significant - fabs(y)) / abs_significant, config) * 0xffff;
 
 			//pl_flinewidth_r(plot.plotter, 100*range_0_1);
-			SetPenColor(freqs[f].color, intensity, &plot);
-			pl_fline_r(plot.plotter, x, y, x, significant);
-			pl_endpath_r(plot.plotter);
+			DrawRasterLine(&plot, freqs[f].color, intensity, x, y, x, significant);
 		}
 	}
 	
@@ -3386,16 +3349,12 @@ void PlotNoiseSpectrogram(FlatFrequency *freqs, long int size, char channel, cha
 
 void VisualizeWindows(windowManager *wm, char *type, int role, parameters *config)
 {
-	char 	*CurrentPath = NULL, *MainPath = NULL, *returnFolder = NULL;
+	char 	folder[BUFFER_SIZE/8];
 
 	if(!wm)
 		return;
 
-	MainPath = PushMainPath(config);
-	CurrentPath = GetCurrentPathAndChangeToResultsFolder(config);
-			
-	returnFolder = PushFolder(WINDOWS_FOLDER);
-	if(!returnFolder)
+	if(!SetPlotFolder(folder, WINDOWS_FOLDER, config))
 		return;
 	for(int i = 0; i < wm->windowCount; i++)
 	{
@@ -3407,9 +3366,6 @@ void VisualizeWindows(windowManager *wm, char *type, int role, parameters *confi
 
 		PlotWindow(&wm->windowArray[i], i, role, type, wm->winType, config);
 	}
-	ReturnToMainPath(&returnFolder);
-	ReturnToMainPath(&CurrentPath);
-	PopMainPath(&MainPath);
 }
 
 void PlotWindow(windowUnit *windowUnit, int index, int role, char *type, char winType, parameters *config)
@@ -3427,8 +3383,9 @@ void PlotWindow(windowUnit *windowUnit, int index, int role, char *type, char wi
 	size = windowUnit->size;
 	realMemSize = windowUnit->realMemSize;
 
-	sprintf(name, "WindowPlot_%s_%s_%s_ind%03d_fr%g_sz%ld_rlsz%ld",
-		GetWindow(winType), type, role == ROLE_REF ? "0Ref" : "1Comp", index, frames, size, realMemSize);
+	// VisualizeWindows creates the folder
+	sprintf(name, "%s%cWindowPlot_%s_%s_%s_ind%03d_fr%g_sz%ld_rlsz%ld",
+		WINDOWS_FOLDER, FOLDERCHAR, GetWindow(winType), type, role == ROLE_REF ? "0Ref" : "1Comp", index, frames, size, realMemSize);
 	FillPlotExtra(&plot, name, 1024, 1280, 0, -0.1, 1, 1.1, 0.001, 0, config);
 
 	if(!CreatePlotFile(&plot, config))
@@ -3456,18 +3413,14 @@ void PlotWindow(windowUnit *windowUnit, int index, int role, char *type, char wi
 
 void PlotBetaFunctions(parameters *config)
 {
-	char 	*CurrentPath = NULL, *MainPath = NULL, *returnFolder = NULL;
+	char	 folder[BUFFER_SIZE/8];
 	char	 name[BUFFER_SIZE];
 	int		 type = 0;
 
 	if(!config)
 		return;
 
-	MainPath = PushMainPath(config);
-	CurrentPath = GetCurrentPathAndChangeToResultsFolder(config);
-			
-	returnFolder = PushFolder(WINDOWS_FOLDER);
-	if(!returnFolder)
+	if(!SetPlotFolder(folder, WINDOWS_FOLDER, config))
 		return;
 
 	for(type = 0; type <= 5; type ++)
@@ -3475,7 +3428,7 @@ void PlotBetaFunctions(parameters *config)
 		PlotFile plot;
 
 		config->outputFilterFunction = type;
-		sprintf(name, "BetaFunctionPlot_%d", type);
+		sprintf(name, "%sBetaFunctionPlot_%d", folder, type);
 		FillPlotExtra(&plot, name, 320, 384, 0, -0.1, 1, 1.1, 0.001, 0, config);
 	
 		if(!CreatePlotFile(&plot, config))
@@ -3513,9 +3466,6 @@ void PlotBetaFunctions(parameters *config)
 		
 		ClosePlot(&plot);
 	}
-	ReturnToMainPath(&returnFolder);
-	ReturnToMainPath(&CurrentPath);
-	PopMainPath(&MainPath);
 }
 
 int MatchColor(char *color)
@@ -4322,48 +4272,41 @@ int PlotDifferentAmplitudesAveraged(FlatAmplDifference *amplDiff, long int size,
 
 		if(type > TYPE_CONTROL && !config->types.typeArray[i].IsaddOnData)
 		{
-			if(typeCount == 1)
-				sprintf(name, "DA__ALL_%s_AVG", filename);
-			else
-				sprintf(name, "DA_%s_%02d%s_AVG", filename, 
-					config->types.typeArray[i].type, config->types.typeArray[i].typeName);
-
 			averagedArray[types] = CreateFlatDifferencesAveraged(type, CHANNEL_STEREO, &averagedSizes[types], normalPlot, config);
 
 			if(averagedArray[types])
 			{
-				char	*returnFolder = NULL;
+				char	folder[BUFFER_SIZE/8];
 
+				folder[0] = '\0';
 				if(typeCount > 1)
 				{
-					returnFolder = PushFolder(DIFFERENCE_FOLDER);
-					if(!returnFolder)
+					if(!SetPlotFolder(folder, DIFFERENCE_FOLDER, config))
 						return 0;
 				}
 
+				if(typeCount == 1)
+					sprintf(name, "DA__ALL_%s_AVG", filename);
+				else
+					sprintf(name, "%sDA_%s_%02d%s_AVG", folder, filename, 
+						config->types.typeArray[i].type, config->types.typeArray[i].typeName);
+
 				PlotSingleTypeDifferentAmplitudesAveraged(amplDiff, size, type, name, averagedArray[types], averagedSizes[types], config->types.typeArray[i].channel == CHANNEL_STEREO ? CHANNEL_STEREO : CHANNEL_MONO, config);
 				logmsg(PLOT_ADVANCE_CHAR);
 
-				if(typeCount > 1)
-					ReturnToMainPath(&returnFolder);
-
 				if(config->types.typeArray[i].channel == CHANNEL_STEREO && someStereo)
 				{
 					long int sizeLeft = 0, sizeRight = 0;
 					AveragedFrequencies	*averagedArrayLeft = NULL, *averagedArrayRight = NULL;
 
-					if(typeCount > 1 || someStereo)
-					{
-						returnFolder = PushFolder(DIFFERENCE_FOLDER);
-						if(!returnFolder)
-							return 0;
-					}
+					if(!SetPlotFolder(folder, DIFFERENCE_FOLDER, config))
+						return 0;
 
 					averagedArrayLeft = CreateFlatDifferencesAveraged(type, CHANNEL_LEFT, &sizeLeft, normalPlot, config);
 					if(typeCount == 1)
-						sprintf(name, "DA__ALL_%s_%c_AVG", filename, CHANNEL_LEFT);
+						sprintf(name, "%sDA__ALL_%s_%c_AVG", folder, filename, CHANNEL_LEFT);
 					else
-						sprintf(name, "DA_%s_%02d%s_%c_AVG", filename, 
+						sprintf(name, "%sDA_%s_%02d%s_%c_AVG", folder, filename, 
 							config->types.typeArray[i].type, config->types.typeArray[i].typeName, CHANNEL_LEFT);
 					PlotSingleTypeDifferentAmplitudesAveraged(amplDiff, size, type, name, averagedArrayLeft, sizeLeft, CHANNEL_LEFT, config);
 					logmsg(PLOT_ADVANCE_CHAR);
@@ -4371,16 +4314,13 @@ int PlotDifferentAmplitudesAveraged(FlatAmplDifference *amplDiff, long int size,
 
 					averagedArrayRight = CreateFlatDifferencesAveraged(type, CHANNEL_RIGHT, &sizeRight, normalPlot, config);
 					if(typeCount == 1)
-						sprintf(name, "DA__ALL_%s_%c_AVG", filename, CHANNEL_RIGHT);
+						sprintf(name, "%sDA__ALL_%s_%c_AVG", folder, filename, CHANNEL_RIGHT);
 					else
-						sprintf(name, "DA_%s_%02d%s_%c_AVG", filename, 
+						sprintf(name, "%sDA_%s_%02d%s_%c_AVG", folder, filename, 
 							config->types.typeArray[i].type, config->types.typeArray[i].typeName, CHANNEL_RIGHT);
 					PlotSingleTypeDifferentAmplitudesAveraged(amplDiff, size, type, name, averagedArrayRight, sizeRight, CHANNEL_RIGHT, config);
 					logmsg(PLOT_ADVANCE_CHAR);
 
-					if(typeCount > 1 || someStereo)
-						ReturnToMainPath(&returnFolder);
-
 					free(averagedArrayRight);
 				}
 			}
@@ -4938,7 +4878,7 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 	double		frameOffset = 0;
 	long int	block = 0;
 	int			lastType = TYPE_NOTYPE;
-	char		filename[BUFFER_SIZE], name[BUFFER_SIZE/2], *title = NULL;
+	char		filename[BUFFER_SIZE], name[BUFFER_SIZE/2], folder[BUFFER_SIZE/8], *title = NULL;
 
 	if(!Signal || !config)
 		return;
@@ -4948,7 +4888,11 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 	if(channel == CHANNEL_STEREO)
 		sprintf(filename, "T_SP_%c_%s", Signal->role == ROLE_REF ? 'A' : 'B', name);
 	else
-		sprintf(filename, "T_SP_%c_%c_%s", channel, Signal->role == ROLE_REF ? 'A' : 'B', name);
+	{
+		if(!SetPlotFolder(folder, T_SPECTR_FOLDER, config))
+			return;
+		sprintf(filename, "%sT_SP_%c_%c_%s", folder, channel, Signal->role == ROLE_REF ? 'A' : 'B', name);
+	}
 
 	// total frame count minus silence
 	for(int i = 0; i < config->types.typeCount; i++)
@@ -4969,12 +4913,15 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 
 	FillPlot(&plot, filename, 0, 0, config->plotResX, config->endHzPlot, 1, 1, config);
 
-	if(!CreatePlotFile(&plot, config))
+	if(!CreateRasterPlotFile(&plot, config))
 		return;
 
 	DrawFrequencyHorizontalGrid(&plot, config->endHzPlot, 1000, config);
 	DrawLabelsTimeSpectrogram(&plot, floor(config->endHzPlot/1000), 1, config);
 
+	if(!StartRasterData(&plot, config))
+		return;
+
 	// Point to first valid frame
 	frameOffset = SamplesToFrames(Signal->SampleRate, Signal->startOffset, Signal->framerate, Signal->AudioChannels);
 	//logmsg("\nSync Samples: %ld start->Frames %g Seconds %g\n", Signal->startOffset, frameOffset, FramesToSeconds(frameOffset, Signal->framerate));
@@ -5038,9 +4985,7 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 					amplitude = Signal->Blocks[block].freq[i].amplitude;
 						
 					intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-					SetPenColor(color, intensity, &plot);
-					pl_fline_r(plot.plotter, x,	y, xpos, y);
-					pl_endpath_r(plot.plotter);
+					DrawRasterLine(&plot, color, intensity, x, y, xpos, y);
 				}
 
 				if(doright)
@@ -5055,9 +5000,7 @@ void PlotTimeSpectrogram(AudioSignal *Signal, char channel, parameters *config)
 					amplitude = Signal->Blocks[block].freqRight[i].amplitude;
 						
 					intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-					SetPenColor(color, intensity, &plot);
-					pl_fline_r(plot.plotter, x,	y, xpos, y);
-					pl_endpath_r(plot.plotter);
+					DrawRasterLine(&plot, color, intensity, x, y, xpos, y);
 				}
 			}
 
@@ -5099,18 +5042,21 @@ void PlotSingleTypeTimeSpectrogram(AudioSignal* Signal, char channel, int plotTy
 	double		frameOffset = 0;
 	long int	block = 0, i = 0;
 	int			lastType = TYPE_NOTYPE;
-	char		filename[BUFFER_SIZE], name[BUFFER_SIZE/2], * title = NULL;
+	char		filename[BUFFER_SIZE], name[BUFFER_SIZE/2], folder[BUFFER_SIZE/8], * title = NULL;
 
 	if (!Signal || !config)
 		return;
 
+	if (!SetPlotFolder(folder, T_SPECTR_FOLDER, config))
+		return;
+
 	// Name the plot
 	ShortenFileName(basename(Signal->SourceFile), name, BUFFER_SIZE/2);
 	if (channel == CHANNEL_STEREO)
-		sprintf(filename, "T_SP_%02d_%s_%c_%s", 
+		sprintf(filename, "%sT_SP_%02d_%s_%c_%s", folder,
 				plotType, GetTypeName(config, plotType), Signal->role == ROLE_REF ? 'A' : 'B', name);
 	else
-		sprintf(filename, "T_SP_%02d_%s_%c_%c_%s", 
+		sprintf(filename, "%sT_SP_%02d_%s_%c_%c_%s", folder,
 			plotType, GetTypeName(config, plotType), channel, Signal->role == ROLE_REF ? 'A' : 'B', name);
 
 	// total frame count minus silence
@@ -5132,12 +5078,15 @@ void PlotSingleTypeTimeSpectrogram(AudioSignal* Signal, char channel, int plotTy
 
 	FillPlot(&plot, filename, 0, 0, config->plotResX, config->endHzPlot, 1, 1, config);
 
-	if (!CreatePlotFile(&plot, config))
+	if (!CreateRasterPlotFile(&plot, config))
 		return;
 
 	DrawFrequencyHorizontalGrid(&plot, config->endHzPlot, 1000, config);
 	DrawLabelsTimeSpectrogram(&plot, floor(config->endHzPlot / 1000), 1, config);
 
+	if (!StartRasterData(&plot, config))
+		return;
+
 	// Point to first valid frame
 	frameOffset = SamplesToFrames(Signal->SampleRate, Signal->startOffset, Signal->framerate, Signal->AudioChannels);
 	//logmsg("\nSync Samples: %ld start->Frames %g Seconds %g\n", Signal->startOffset, frameOffset, FramesToSeconds(frameOffset, Signal->framerate));
@@ -5183,9 +5132,7 @@ void PlotSingleTypeTimeSpectrogram(AudioSignal* Signal, char channel, int plotTy
 						amplitude = Signal->Blocks[block].freq[i].amplitude;
 
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude)) / abs_significant, config) * 0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x, y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawRasterLine(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 
@@ -5204,9 +5151,7 @@ void PlotSingleTypeTimeSpectrogram(AudioSignal* Signal, char channel, int plotTy
 						amplitude = Signal->Blocks[block].freqRight[i].amplitude;
 
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude)) / abs_significant, config) * 0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x, y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawRasterLine(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 			}
@@ -5249,16 +5194,23 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 	double		frameOffset = 0;
 	long int	block = 0, i = 0;
 	int			lastType = TYPE_NOTYPE;
-	char		filename[BUFFER_SIZE], name[BUFFER_SIZE/2], *title = NULL;
+	char		filename[BUFFER_SIZE], name[BUFFER_SIZE/2], folder[BUFFER_SIZE/8], *title = NULL;
 
 	if(!Signal || !config)
 		return;
 
+	folder[0] = '\0';
+	if(channel != CHANNEL_STEREO)
+	{
+		if(!SetPlotFolder(folder, MISSING_FOLDER, config))
+			return;
+	}
+
 	ShortenFileName(basename(Signal->SourceFile), name, BUFFER_SIZE/2);
 	if(Signal->role == ROLE_REF)
-		sprintf(filename, "MISSING-A-T_SP_%s_%c", name, channel);
+		sprintf(filename, "%sMISSING-A-T_SP_%s_%c", folder, name, channel);
 	else
-		sprintf(filename, "MISSING-EXTRA_T_SP_%s_%c", name, channel);
+		sprintf(filename, "%sMISSING-EXTRA_T_SP_%s_%c", folder, name, channel);
 
 	for(int i = 0; i < config->types.typeCount; i++)
 	{
@@ -5277,12 +5229,15 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 
 	FillPlot(&plot, filename, 0, 0, config->plotResX, config->endHzPlot, 1, 1, config);
 
-	if(!CreatePlotFile(&plot, config))
+	if(!CreateRasterPlotFile(&plot, config))
 		return;
 
 	DrawFrequencyHorizontalGrid(&plot, config->endHzPlot, 1000, config);
 	DrawLabelsTimeSpectrogram(&plot, floor(config->endHzPlot/1000), 1, config);
 
+	if(!StartRasterData(&plot, config))
+		return;
+
 	framewidth = config->plotResX / framecount;
 	frameOffset = SamplesToFrames(Signal->SampleRate, Signal->startOffset, Signal->framerate, Signal->AudioChannels);
 	for(block = 0; block < config->types.totalBlocks; block++)
@@ -5320,9 +5275,7 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 						amplitude = Signal->Blocks[block].freq[i].amplitude;
 						
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x,	y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawRasterLine(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 
@@ -5341,9 +5294,7 @@ void PlotTimeSpectrogramUnMatchedContent(AudioSignal *Signal, char channel, para
 						amplitude = Signal->Blocks[block].freqRight[i].amplitude;
 						
 						intensity = CalculateWeightedError(fabs(abs_significant - fabs(amplitude))/abs_significant, config)*0xffff;
-						SetPenColor(color, intensity, &plot);
-						pl_fline_r(plot.plotter, x,	y, xpos, y);
-						pl_endpath_r(plot.plotter);
+						DrawRasterLine(&plot, color, intensity, x, y, xpos, y);
 					}
 				}
 			}
@@ -5383,7 +5334,7 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 {
 	long int	plots = 0, i = 0;
 	double		output = 0;
-	char		name[BUFFER_SIZE*2];
+	char		name[BUFFER_SIZE*2], folder[BUFFER_SIZE/8];
 
 	if(config->plotAllNotes || config->timeDomainSync)
 	{
@@ -5416,6 +5367,9 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 	if(!plots)
 		return;
 
+	if(!SetPlotFolder(folder, WAVEFORM_FOLDER, config))
+		return;
+
 #ifdef OPENMP_ENABLE
 	output = plots/40;
 #else
@@ -5437,7 +5391,7 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 		{
 			if(config->plotAllNotes != 2 || doPlot)
 			{
-				sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
+				sprintf(name, "%sTD_%05ld_%s_%s_%05d_%s", folder,
 					i, Signal->role == ROLE_REF ? "1" : "2",
 					GetBlockName(config, i), GetBlockSubIndex(config, i), config->compareName);
 
@@ -5449,7 +5403,7 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 				}
 				if(Signal->Blocks[i].type == TYPE_SYNC)
 				{
-					sprintf(name, "ZOOM_Sync_TD_%05ld_%s_%s_%05d_%s", 
+					sprintf(name, "%sZOOM_Sync_TD_%05ld_%s_%s_%05d_%s", folder,
 						i, Signal->role == ROLE_REF ? "1" : "2",
 						GetBlockName(config, i), GetBlockSubIndex(config, i), config->compareName);
 
@@ -5461,7 +5415,7 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 			{
 				for(int slot = 0; slot < Signal->Blocks[i].internalSyncCount; slot++)
 				{
-					sprintf(name, "TD_%05ld_%s_%s_%05d_%s_%02d", 
+					sprintf(name, "%sTD_%05ld_%s_%s_%05d_%s_%02d", folder,
 									i, Signal->role == ROLE_REF ? "1" : "2",
 									GetBlockName(config, i), GetBlockSubIndex(config, i), 
 									config->compareName, slot);
@@ -5471,7 +5425,7 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 
 			if(Signal->Blocks[i].audio.windowed_samples && (config->plotAllNotesWindowed || Signal->Blocks[i].type == TYPE_SILENCE))
 			{
-				sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
+				sprintf(name, "%sTD_%05ld_%s_%s_%05d_%s", folder,
 					i, Signal->role == ROLE_REF ? "3" : "4",
 					GetBlockName(config, i), GetBlockSubIndex(config, i), config->compareName);
 
@@ -5489,27 +5443,25 @@ void PlotTimeDomainGraphs(AudioSignal *Signal, parameters *config)
 
 int ExecutePlotBlockTimeDomainGraph(int waveType, AudioSignal *Signal, long int block, double data, char *folder, parameters *config)
 {
-	char *returnFolder = NULL;
+	char subFolder[BUFFER_SIZE/8], prefix[BUFFER_SIZE/8];
 	char name[BUFFER_SIZE*2];
 
-	returnFolder = PushFolder(folder);
-	if(!returnFolder)
+	sprintf(subFolder, "%s%c%s", WAVEFORMDIFF_FOLDER, FOLDERCHAR, folder);
+	if(!SetPlotFolder(prefix, subFolder, config))
 		return 0;
 	
-	sprintf(name, "TD_%05ld_%s_%s_%05d_%s", 
+	sprintf(name, "%sTD_%05ld_%s_%s_%05d_%s", prefix,
 		block, Signal->role == ROLE_REF ? "1" : "2",
 		GetBlockName(config, block), GetBlockSubIndex(config, block), config->compareName);
 
 	PlotBlockTimeDomainGraph(Signal, block, name, waveType, data, config);
-
-	ReturnToMainPath(&returnFolder);
 	return 1;
 }
 
 void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
 {
 	int		plots = 0;
-	char	*returnFolder = NULL;
+	char	folder[BUFFER_SIZE/8];
 
 	if(!config)
 		return;
@@ -5517,8 +5469,7 @@ void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
 	if(!config->Differences.BlockDiffArray)
 		return;
 
-	returnFolder = PushFolder(WAVEFORMDIFF_FOLDER);
-	if(!returnFolder)
+	if(!SetPlotFolder(folder, WAVEFORMDIFF_FOLDER, config))
 		return;
 
 	for(long int b = 0; b < config->types.totalBlocks; b++)
@@ -5531,10 +5482,7 @@ void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
 			if(diff > 0)
 			{
 				if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_AMPDIFF, Signal, b, diff, WAVEFORMDIR_AMPL, config))
-				{
-					ReturnToMainPath(&returnFolder);
 					return;
-				}
 				logmsg(PLOT_ADVANCE_CHAR);
 				plots++;
 				if(plots == 80)
@@ -5548,10 +5496,7 @@ void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
 			if(diff > 0)
 			{
 				if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_MISSING, Signal, b, diff, WAVEFORMDIR_MISS, config))
-				{
-					ReturnToMainPath(&returnFolder);
 					return;
-				}
 				logmsg(PLOT_ADVANCE_CHAR);
 				plots++;
 				if(plots == 80)
@@ -5565,10 +5510,7 @@ void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
 			if(diff > 0)
 			{
 				if(!ExecutePlotBlockTimeDomainGraph(WAVEFORM_EXTRA, Signal, b, diff, WAVEFORMDIR_EXTRA, config))
-				{
-					ReturnToMainPath(&returnFolder);
 					return;
-				}
 				logmsg(PLOT_ADVANCE_CHAR);
 				plots++;
 				if(plots == 80)
@@ -5580,7 +5522,6 @@ void PlotTimeDomainHighDifferenceGraphs(AudioSignal *Signal, parameters *config)
 		}
 	}
 	logmsg("\n  ");
-	ReturnToMainPath(&returnFolder);
 }
 
 void DrawVerticalFrameGrid(PlotFile *plot, AudioSignal *Signal, double frames, double frameIncrement, double MaxSamples, int forceDrawMS, parameters *config)
@@ -6222,56 +6163,46 @@ int PlotEachTypePhase(FlatPhase *phaseDiff, long int size, char *filename, int p
 
 		if(type > TYPE_CONTROL && !config->types.typeArray[i].IsaddOnData)
 		{
-			char	*returnFolder = NULL;
+			char	folder[BUFFER_SIZE/8];
 
+			folder[0] = '\0';
 			if(typeCount > 1)
 			{
-				returnFolder = PushFolder(PHASE_FOLDER);
-				if(!returnFolder)
+				if(!SetPlotFolder(folder, PHASE_FOLDER, config))
 					return 0;
 			}
 
 			if(pType == PHASE_DIFF)
-				sprintf(name, "PHASE_DIFF_%s_%02d%s", filename, 
+				sprintf(name, "%sPHASE_DIFF_%s_%02d%s", folder, filename, 
 					type, config->types.typeArray[i].typeName);
 			else
-				sprintf(name, "PHASE_%c_%s_%02d%s", pType == PHASE_REF ? 'A' : 'B', filename, 
+				sprintf(name, "%sPHASE_%c_%s_%02d%s", folder, pType == PHASE_REF ? 'A' : 'B', filename, 
 					type, config->types.typeArray[i].typeName);
 			PlotSingleTypePhase(phaseDiff, size, type, name, pType, CHANNEL_STEREO, config);
 			logmsg(PLOT_ADVANCE_CHAR);
 
-			if(typeCount > 1)
-				ReturnToMainPath(&returnFolder);
-
 			if(config->types.typeArray[i].channel == CHANNEL_STEREO && bothStereo)
 			{
-				if(typeCount > 1 || bothStereo)
-				{
-					returnFolder = PushFolder(PHASE_FOLDER);
-					if(!returnFolder)
-						return 0;
-				}
+				if(!SetPlotFolder(folder, PHASE_FOLDER, config))
+					return 0;
 
 				if(pType == PHASE_DIFF)
-					sprintf(name, "PHASE_DIFF_%s_%02d%s_%c", filename, 
+					sprintf(name, "%sPHASE_DIFF_%s_%02d%s_%c", folder, filename, 
 						type, config->types.typeArray[i].typeName, CHANNEL_LEFT);
 				else
-					sprintf(name, "PHASE_%c_%s_%02d%s_%c", pType == PHASE_REF ? 'A' : 'B', filename, 
+					sprintf(name, "%sPHASE_%c_%s_%02d%s_%c", folder, pType == PHASE_REF ? 'A' : 'B', filename, 
 						type, config->types.typeArray[i].typeName, CHANNEL_LEFT);
 				PlotSingleTypePhase(phaseDiff, size, type, name, pType, CHANNEL_LEFT, config);
 				logmsg(PLOT_ADVANCE_CHAR);
 
 				if(pType == PHASE_DIFF)
-					sprintf(name, "PHASE_DIFF_%s_%02d%s_%c", filename, 
+					sprintf(name, "%sPHASE_DIFF_%s_%02d%s_%c", folder, filename, 
 						type, config->types.typeArray[i].typeName, CHANNEL_RIGHT);
 				else
-					sprintf(name, "PHASE_%c_%s_%02d%s_%c", pType == PHASE_REF ? 'A' : 'B', filename, 
+					sprintf(name, "%sPHASE_%c_%s_%02d%s_%c", folder, pType == PHASE_REF ? 'A' : 'B', filename, 
 						type, config->types.typeArray[i].typeName, CHANNEL_RIGHT);
 				PlotSingleTypePhase(phaseDiff, size, type, name, pType, CHANNEL_RIGHT, config);
 				logmsg(PLOT_ADVANCE_CHAR);
-
-				if(typeCount > 1 || bothStereo)
-					ReturnToMainPath(&returnFolder);
 			}
 
 			types ++;
@@ -6414,13 +6345,16 @@ void DrawLabelsZeroAngleCentered(PlotFile *plot, double maxAngle, double angleIn
 
 void PlotCLKSpectrogram(AudioSignal *Signal, parameters *config)
 {
-	char 				tmpName[BUFFER_SIZE/2], name[BUFFER_SIZE];
+	char 				tmpName[BUFFER_SIZE/2], name[BUFFER_SIZE], folder[BUFFER_SIZE/8];
 	long int			size = 0;
 	FlatFrequency		*frequencies = NULL;
 	
+	if(!SetPlotFolder(folder, CLK_FOLDER, config))
+		return;
+
 	ShortenFileName(basename(Signal->SourceFile), tmpName, BUFFER_SIZE/2);
 	frequencies = CreateFlatFrequenciesCLK(Signal, &size, config);
-	sprintf(name, "SP_%c_%s_CLK_%s", Signal->role == ROLE_REF ? 'A' : 'B', tmpName, config->clkName);
+	sprintf(name, "%sSP_%c_%s_CLK_%s", folder, Signal->role == ROLE_REF ? 'A' : 'B', tmpName, config->clkName);
 	PlotCLKSpectrogramInternal(frequencies, size, name, Signal->role, config);
 
 	free(frequencies);
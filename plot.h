@@ -30,6 +30,7 @@
 #define MDFOURIER_PLOT_H
 
 #include "mdfourier.h"
+#include "raster.h"
 #include <plot.h>
 
 #define PLOT_PROCESS_CHAR "-"
@@ -50,8 +51,38 @@ typedef struct plot_st {
 	double			penWidth;
 	double			leftmargin;
 	char			*SpecialWarning;
+	RasterImage		*raster;	// dense data drawn directly, see CreateRasterPlotFile
+	FILE			*layer;		// PNM libplot writes for the raster layers
+	pngProfile		*png;		// encoding used for the raster
 } PlotFile;
 
+enum plotTaskType {
+	PLOT_TASK_DIFFERENCES,
+	PLOT_TASK_MISSING_REF,
+	PLOT_TASK_MISSING_COMP,
+	PLOT_TASK_SPECTROGRAM_REF,
+	PLOT_TASK_SPECTROGRAM_COMP,
+	PLOT_TASK_NF_SPECTROGRAM_REF,
+	PLOT_TASK_NF_SPECTROGRAM_COMP,
+	PLOT_TASK_CLK_REF,
+	PLOT_TASK_CLK_COMP,
+	PLOT_TASK_TIMESPECTROGRAM_REF,
+	PLOT_TASK_TIMESPECTROGRAM_COMP,
+	PLOT_TASK_PHASE,
+	PLOT_TASK_NOISEFLOOR,
+	PLOT_TASK_WAVEFORM_REF,
+	PLOT_TASK_WAVEFORM_COMP,
+	PLOT_TASK_HIDIFF_REF,
+	PLOT_TASK_HIDIFF_COMP,
+	PLOT_TASK_COUNT
+};
+
+typedef struct plot_task_st {
+	int				requested;
+	char			*log;
+	struct timespec	start, end;
+} plotTask;
+
 typedef struct averaged_freq{
 	double		avgfreq;
 	double		avgvol;
@@ -172,6 +203,11 @@ typedef struct flat_phase_St {
 } FlatPhase;
 
 void PlotResults(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+void PlotMissingSignal(AudioSignal *Signal, parameters *config);
+void PlotSpectrogramSignal(AudioSignal *Signal, int noiseFloor, parameters *config);
+void PlotTimeSpectrogramSignal(AudioSignal *Signal, parameters *config);
+void ExecutePlotTask(int task, plotTask *tasks, AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config);
+void FlushPlotGroup(char *title, char *name, plotTask *tasks, int count, parameters *config);
 void PlotAmpDifferences(parameters *config);
 void PlotAllWeightedAmpDifferences(parameters *config);
 //void PlotFreqMissing(parameters *config);
@@ -182,6 +218,12 @@ void PlotNoiseFloor(AudioSignal *Signal, parameters *config);
 int FillPlot(PlotFile *plot, char *name, double x0, double y0, double x1, double y1, double penWidth, double leftMarginSize, parameters *config);
 int FillPlotExtra(PlotFile *plot, char *name, int sizex, int sizey, double x0, double y0, double x1, double y1, double penWidth, double leftMarginSize, parameters *config);
 int CreatePlotFile(PlotFile *plot, parameters *config);
+int OpenPlotter(PlotFile *plot, char *format, FILE *file, parameters *config);
+int CreateRasterPlotFile(PlotFile *plot, parameters *config);
+int StartRasterData(PlotFile *plot, parameters *config);
+void DrawRasterLine(PlotFile *plot, int colorIndex, long int intensity, double x0, double y0, double x1, double y1);
+int ClosePlotter(PlotFile *plot);
+void ReleaseRasterPlot(PlotFile *plot);
 int ClosePlot(PlotFile *plot);
 void SetPenColorStr(char *colorName, long int color, PlotFile *plot);
 void SetPenColor(int colorIndex, long int color, PlotFile *plot);
@@ -230,8 +272,7 @@ void PlotTest(char *filename, parameters *config);
 void PlotTestZL(char *filename, parameters *config);
 void VisualizeWindows(windowManager *wm, char *type, int role, parameters *config);
 
-char *GetCurrentPathAndChangeToResultsFolder(parameters *config);
-void ReturnToMainPath(char **CurrentPath);
+int SetPlotFolder(char *prefix, char *folder, parameters *config);
 
 int PlotNoiseDifferentAmplitudesAveraged(FlatAmplDifference *amplDiff, long int size, char *filename, parameters *config, AudioSignal *Signal);
 void PlotNoiseDifferentAmplitudesAveragedInternal(FlatAmplDifference *amplDiff, long int size, int type, char *filename, AveragedFrequencies *averaged, long int avgsize, parameters *config, AudioSignal *Signal);
@@ -0,0 +1,903 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "raster.h"
+#include "plot.h"
+#include "log.h"
+#include <png.h>
+#include <zlib.h>
+#ifdef OPENMP_ENABLE
+#include <omp.h>
+#endif
+
+/*
+	Dense spectrograms are drawn straight into an RGB framebuffer instead
+	of sending millions of lines through libplot. Colors come from a table
+	built once with the same mapping SetPenColor uses, and libplot still
+	renders grids and labels as PNM layers that are composited here.
+*/
+
+static unsigned char	rasterLUT[RASTER_COLORS][RASTER_LEVELS][3];
+static unsigned char	rasterBlack[3] = { 0, 0, 0 };
+static int				rasterLUTReady = 0;
+
+static void FillRasterLUT(void)
+{
+	for(int c = 0; c < RASTER_COLORS; c++)
+	{
+		for(int l = 0; l < RASTER_LEVELS; l++)
+		{
+			long int	color = 0, r = 0, g = 0, b = 0;
+
+			color = l*257;	// back to 16 bits, as handed to libplot
+			switch(c)
+			{
+				case COLOR_RED:
+					r = color;
+					break;
+				case COLOR_BLUE:
+					b = color;
+					break;
+				case COLOR_YELLOW:
+					r = g = color;
+					break;
+				case COLOR_CYAN:
+					g = b = color;
+					break;
+				case COLOR_MAGENTA:
+					r = b = color;
+					break;
+				case COLOR_PURPLE:
+					r = color/2;
+					b = color;
+					break;
+				case COLOR_ORANGE:
+					r = color;
+					g = color/2;
+					break;
+				case COLOR_GRAY:
+					r = g = b = color;
+					break;
+				default:
+					g = color;
+					break;
+			}
+			rasterLUT[c][l][0] = r >> 8;
+			rasterLUT[c][l][1] = g >> 8;
+			rasterLUT[c][l][2] = b >> 8;
+		}
+	}
+	rasterLUTReady = 1;
+}
+
+int CreateRaster(RasterImage *raster, int width, int height, double x0, double y0, double x1, double y1, int whiteBG)
+{
+	size_t	size = 0;
+
+	if(!raster || width <= 0 || height <= 0)
+		return 0;
+
+#ifdef OPENMP_ENABLE
+	#pragma omp critical(raster_lut)
+#endif
+	{
+		if(!rasterLUTReady)
+			FillRasterLUT();
+	}
+
+	size = (size_t)width*(size_t)height*3;
+	raster->pixels = (unsigned char*)malloc(size);
+	if(!raster->pixels)
+		return 0;
+
+	raster->width = width;
+	raster->height = height;
+	raster->x0 = x0;
+	raster->y0 = y0;
+	raster->x1 = x1;
+	raster->y1 = y1;
+	raster->layers = 0;
+	memset(raster->pixels, whiteBG ? 0xff : 0, size);
+	return 1;
+}
+
+void ReleaseRaster(RasterImage *raster)
+{
+	if(!raster)
+		return;
+
+	if(raster->pixels)
+	{
+		free(raster->pixels);
+		raster->pixels = NULL;
+	}
+	raster->width = 0;
+	raster->height = 0;
+}
+
+unsigned char *GetRasterColor(int colorIndex, long int intensity)
+{
+	if(colorIndex == COLOR_NULL)
+		return rasterBlack;
+	if(colorIndex < 0 || colorIndex >= RASTER_COLORS)
+		colorIndex = COLOR_GREEN;
+
+	if(intensity < 0)
+		intensity = 0;
+	if(intensity > 0xffff)
+		intensity = 0xffff;
+	return rasterLUT[colorIndex][intensity >> 8];
+}
+
+static void RasterSpan(RasterImage *raster, long int row, long int start, long int end, unsigned char *rgb)
+{
+	unsigned char	*pixel = NULL;
+
+	if(row < 0 || row >= raster->height)
+		return;
+	if(start < 0)
+		start = 0;
+	if(end >= raster->width)
+		end = raster->width - 1;
+
+	pixel = raster->pixels + ((size_t)row*raster->width + start)*3;
+	for(long int i = start; i <= end; i++)
+	{
+		pixel[0] = rgb[0];
+		pixel[1] = rgb[1];
+		pixel[2] = rgb[2];
+		pixel += 3;
+	}
+}
+
+void RasterLine(RasterImage *raster, double x0, double y0, double x1, double y1, unsigned char *rgb)
+{
+	double		scaleX = 0, scaleY = 0, steps = 0;
+	long int	px0 = 0, py0 = 0, px1 = 0, py1 = 0;
+
+	if(!raster || !raster->pixels || !rgb)
+		return;
+
+	// Same map libplot uses for a bitmap, y grows downwards
+	scaleX = raster->width/(raster->x1 - raster->x0);
+	scaleY = raster->height/(raster->y1 - raster->y0);
+	px0 = (long int)floor((x0 - raster->x0)*scaleX);
+	px1 = (long int)floor((x1 - raster->x0)*scaleX);
+	py0 = (long int)floor((raster->y1 - y0)*scaleY);
+	py1 = (long int)floor((raster->y1 - y1)*scaleY);
+
+	// Spectrograms only use horizontal and vertical lines
+	if(py0 == py1)
+	{
+		RasterSpan(raster, py0, px0 < px1 ? px0 : px1, px0 < px1 ? px1 : px0, rgb);
+		return;
+	}
+
+	if(px0 == px1)
+	{
+		long int	start = 0, end = 0;
+
+		if(px0 < 0 || px0 >= raster->width)
+			return;
+
+		start = py0 < py1 ? py0 : py1;
+		end = py0 < py1 ? py1 : py0;
+		if(start < 0)
+			start = 0;
+		if(end >= raster->height)
+			end = raster->height - 1;
+		for(long int row = start; row <= end; row++)
+		{
+			unsigned char	*pixel = NULL;
+
+			pixel = raster->pixels + ((size_t)row*raster->width + px0)*3;
+			pixel[0] = rgb[0];
+			pixel[1] = rgb[1];
+			pixel[2] = rgb[2];
+		}
+		return;
+	}
+
+	steps = fmax(labs(px1 - px0), labs(py1 - py0));
+	for(double s = 0; s <= steps; s++)
+	{
+		long int	x = 0, y = 0;
+
+		x = px0 + (long int)round((px1 - px0)*s/steps);
+		y = py0 + (long int)round((py1 - py0)*s/steps);
+		RasterSpan(raster, y, x, x, rgb);
+	}
+}
+
+static int ReadPNMValue(FILE *file, int *value)
+{
+	int c = 0;
+
+	do
+	{
+		c = fgetc(file);
+		if(c == '#')
+		{
+			while(c != '\n' && c != EOF)
+				c = fgetc(file);
+		}
+	}while(c != EOF && isspace(c));
+
+	if(c == EOF || !isdigit(c))
+		return 0;
+
+	*value = 0;
+	while(c != EOF && isdigit(c))
+	{
+		*value = *value*10 + c - '0';
+		c = fgetc(file);
+	}
+	// the single whitespace after the value was consumed
+	return 1;
+}
+
+/*
+	Reads the PNM libplot wrote for a layer. It picks PBM, PGM or PPM by
+	the colors it used, so all raw variants are accepted. The first layer
+	replaces the framebuffer, an overlay only copies what it drew: it was
+	drawn over the RASTER_KEY color, so items in the plot background color
+	still cover the data below them.
+*/
+int ReadRasterLayer(RasterImage *raster, FILE *file, int overlay)
+{
+	int				format = 0, width = 0, height = 0, maxval = 1;
+	size_t			rowBytes = 0;
+	unsigned char	*row = NULL;
+
+	if(!raster || !raster->pixels || !file)
+		return 0;
+
+	if(fgetc(file) != 'P')
+	{
+		logmsg("ERROR: Invalid plot layer\n");
+		return 0;
+	}
+	format = fgetc(file);
+	if(format != '4' && format != '5' && format != '6')
+	{
+		logmsg("ERROR: Unsupported plot layer format P%c\n", format);
+		return 0;
+	}
+
+	if(!ReadPNMValue(file, &width) || !ReadPNMValue(file, &height) ||
+		(format != '4' && !ReadPNMValue(file, &maxval)))
+	{
+		logmsg("ERROR: Invalid plot layer header\n");
+		return 0;
+	}
+
+	if(width != raster->width || height != raster->height || maxval > 255 || maxval < 1)
+	{
+		logmsg("ERROR: Plot layer is %dx%d, expected %dx%d\n", width, height, raster->width, raster->height);
+		return 0;
+	}
+
+	if(format == '4')
+		rowBytes = (width + 7)/8;
+	else if(format == '5')
+		rowBytes = width;
+	else
+		rowBytes = (size_t)width*3;
+
+	row = (unsigned char*)malloc(rowBytes);
+	if(!row)
+	{
+		logmsg("ERROR: Not enough memory for plot layer\n");
+		return 0;
+	}
+
+	for(int y = 0; y < height; y++)
+	{
+		unsigned char	*pixel = NULL;
+
+		if(fread(row, 1, rowBytes, file) != rowBytes)
+		{
+			free(row);
+			logmsg("ERROR: Plot layer is truncated\n");
+			return 0;
+		}
+
+		pixel = raster->pixels + (size_t)y*width*3;
+		for(int x = 0; x < width; x++)
+		{
+			unsigned char	rgb[3];
+
+			if(format == '4')	// set bits are black
+				memset(rgb, row[x/8] & (0x80 >> (x%8)) ? 0 : 0xff, 3);
+			else if(format == '5')
+				memset(rgb, row[x]*255/maxval, 3);
+			else
+			{
+				rgb[0] = row[x*3]*255/maxval;
+				rgb[1] = row[x*3+1]*255/maxval;
+				rgb[2] = row[x*3+2]*255/maxval;
+			}
+
+			if(!overlay || rgb[0] != RASTER_KEY_RED ||
+				rgb[1] != RASTER_KEY_GREEN || rgb[2] != RASTER_KEY_BLUE)
+				memcpy(pixel, rgb, 3);
+			pixel += 3;
+		}
+	}
+
+	free(row);
+	raster->layers++;
+	return 1;
+}
+
+/*
+	PNG encoding follows the profile in the parameters: zlib level, row
+	filter and indexed color, which plots with few colors (everything but
+	the spectrograms) can always use. With more than one thread the IDAT
+	stream is deflated in segments at once, each one primed with the last
+	32K of the one before so matches can still reach back, then joined by
+	flushing the middle segments to a byte boundary as pigz does.
+*/
+
+typedef struct png_palette_st {
+	png_color		colors[256];
+	int				count;
+	unsigned char	*indexes;	// one byte per pixel
+} pngPalette;
+
+typedef struct png_encode_st {
+	unsigned char	*pixels;
+	size_t			rowBytes;
+	int				bpp;
+	int				filter;
+	int				level;
+	unsigned char	*filtered;	// every row with its filter type byte
+} pngEncode;
+
+typedef struct png_segment_st {
+	int				firstRow;
+	int				rows;
+	unsigned char	*filtered;
+	size_t			size;
+	size_t			dictSize;	// filtered bytes before this one used as dictionary
+	unsigned char	*out;		// room for the zlib header and trailer
+	size_t			outSize;
+	uLong			adler;
+	int				last;
+	int				error;
+} pngSegment;
+
+static char *pngFilterNames[] = { "none", "sub", "up", "avg", "paeth", "adaptive" };
+
+void InitPNGProfile(pngProfile *profile)
+{
+	if(!profile)
+		return;
+
+	profile->level = PNG_DEFAULT_LEVEL;
+	profile->filter = PNG_DEFAULT_FILTER;
+	profile->palette = 0;
+	profile->threads = PNG_DEFAULT_THREADS;
+	profile->enabled = 0;
+}
+
+int ParsePNGFilter(char *name)
+{
+	for(int i = 0; i <= PNG_PROFILE_FILTER_ADAPTIVE; i++)
+	{
+		if(strcmp(name, pngFilterNames[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+#define PNG_PALETTE_HASH	1024
+#define PNG_DICTIONARY		32768
+
+static int BuildPNGPalette(RasterImage *raster, pngPalette *palette)
+{
+	uint32_t		keys[PNG_PALETTE_HASH];
+	unsigned char	slots[PNG_PALETTE_HASH];
+	uint32_t		lastKey = 0xffffffff;
+	unsigned char	lastIndex = 0, *pixel = NULL;
+	size_t			count = 0;
+
+	count = (size_t)raster->width*raster->height;
+	palette->count = 0;
+	palette->indexes = (unsigned char*)malloc(count);
+	if(!palette->indexes)
+		return 0;
+
+	memset(keys, 0xff, sizeof(keys));
+	pixel = raster->pixels;
+	for(size_t i = 0; i < count; i++)
+	{
+		uint32_t	key = 0, hash = 0;
+
+		key = (uint32_t)pixel[0] << 16 | (uint32_t)pixel[1] << 8 | pixel[2];
+		pixel += 3;
+		if(key != lastKey)
+		{
+			hash = (key*2654435761u) >> 22 & (PNG_PALETTE_HASH - 1);
+			while(keys[hash] != 0xffffffff && keys[hash] != key)
+				hash = (hash + 1) & (PNG_PALETTE_HASH - 1);
+
+			if(keys[hash] == 0xffffffff)
+			{
+				// Too many colors, stays RGB
+				if(palette->count == 256)
+				{
+					free(palette->indexes);
+					palette->indexes = NULL;
+					return 0;
+				}
+				keys[hash] = key;
+				slots[hash] = palette->count;
+				palette->colors[palette->count].red = key >> 16;
+				palette->colors[palette->count].green = key >> 8 & 0xff;
+				palette->colors[palette->count].blue = key & 0xff;
+				palette->count++;
+			}
+			lastKey = key;
+			lastIndex = slots[hash];
+		}
+		palette->indexes[i] = lastIndex;
+	}
+	return 1;
+}
+
+static unsigned char PaethPredictor(int a, int b, int c)
+{
+	int	p = 0, pa = 0, pb = 0, pc = 0;
+
+	p = a + b - c;
+	pa = abs(p - a);
+	pb = abs(p - b);
+	pc = abs(p - c);
+	if(pa <= pb && pa <= pc)
+		return a;
+	if(pb <= pc)
+		return b;
+	return c;
+}
+
+static void FilterPNGRow(unsigned char *out, unsigned char *row, unsigned char *prev, size_t rowBytes, int bpp, int filter)
+{
+	out[0] = filter;
+	for(size_t i = 0; i < rowBytes; i++)
+	{
+		int	a = 0, b = 0, c = 0;
+
+		a = i >= (size_t)bpp ? row[i-bpp] : 0;
+		b = prev ? prev[i] : 0;
+		c = prev && i >= (size_t)bpp ? prev[i-bpp] : 0;
+		switch(filter)
+		{
+			case PNG_PROFILE_FILTER_SUB:
+				out[i+1] = row[i] - a;
+				break;
+			case PNG_PROFILE_FILTER_UP:
+				out[i+1] = row[i] - b;
+				break;
+			case PNG_PROFILE_FILTER_AVG:
+				out[i+1] = row[i] - (a + b)/2;
+				break;
+			case PNG_PROFILE_FILTER_PAETH:
+				out[i+1] = row[i] - PaethPredictor(a, b, c);
+				break;
+			default:
+				out[i+1] = row[i];
+				break;
+		}
+	}
+}
+
+// Same heuristic as libpng, the filter with the smallest sum of signed bytes
+static void FilterPNGRowAdaptive(unsigned char *out, unsigned char *row, unsigned char *prev, size_t rowBytes, int bpp, unsigned char *scratch)
+{
+	unsigned long	best = 0;
+
+	for(int filter = PNG_PROFILE_FILTER_NONE; filter <= PNG_PROFILE_FILTER_PAETH; filter++)
+	{
+		unsigned long	sum = 0;
+
+		FilterPNGRow(scratch, row, prev, rowBytes, bpp, filter);
+		for(size_t i = 1; i <= rowBytes; i++)
+			sum += abs((signed char)scratch[i]);
+		if(filter == PNG_PROFILE_FILTER_NONE || sum < best)
+		{
+			best = sum;
+			memcpy(out, scratch, rowBytes + 1);
+		}
+	}
+}
+
+static void FilterPNGSegment(pngEncode *enc, pngSegment *segment)
+{
+	unsigned char	*scratch = NULL;
+
+	if(enc->filter == PNG_PROFILE_FILTER_ADAPTIVE)
+	{
+		scratch = (unsigned char*)malloc(enc->rowBytes + 1);
+		if(!scratch)
+		{
+			segment->error = 1;
+			return;
+		}
+	}
+
+	for(int r = 0; r < segment->rows; r++)
+	{
+		unsigned char	*row = NULL, *prev = NULL, *out = NULL;
+		int				y = 0;
+
+		y = segment->firstRow + r;
+		row = enc->pixels + (size_t)y*enc->rowBytes;
+		prev = y ? row - enc->rowBytes : NULL;
+		out = segment->filtered + (size_t)r*(enc->rowBytes + 1);
+		if(scratch)
+			FilterPNGRowAdaptive(out, row, prev, enc->rowBytes, enc->bpp, scratch);
+		else
+			FilterPNGRow(out, row, prev, enc->rowBytes, enc->bpp, enc->filter);
+	}
+
+	if(scratch)
+		free(scratch);
+}
+
+static void CompressPNGSegment(pngEncode *enc, pngSegment *segment)
+{
+	z_stream	strm;
+	size_t		bound = 0;
+	int			ret = 0;
+
+	memset(&strm, 0, sizeof(z_stream));
+	if(deflateInit2(&strm, enc->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		segment->error = 1;
+		return;
+	}
+
+	if(segment->dictSize &&
+		deflateSetDictionary(&strm, segment->filtered - segment->dictSize, segment->dictSize) != Z_OK)
+	{
+		deflateEnd(&strm);
+		segment->error = 1;
+		return;
+	}
+
+	// the sync flush adds an empty stored block to the bound
+	bound = deflateBound(&strm, segment->size) + 16;
+	segment->out = (unsigned char*)malloc(bound + 6);
+	if(!segment->out)
+	{
+		deflateEnd(&strm);
+		segment->error = 1;
+		return;
+	}
+
+	strm.next_in = segment->filtered;
+	strm.avail_in = segment->size;
+	strm.next_out = segment->out + 2;
+	strm.avail_out = bound;
+	ret = deflate(&strm, segment->last ? Z_FINISH : Z_SYNC_FLUSH);
+	if((segment->last && ret != Z_STREAM_END) || (!segment->last && (ret != Z_OK || strm.avail_out == 0)) || strm.avail_in)
+		segment->error = 1;
+	segment->outSize = strm.total_out;
+	deflateEnd(&strm);
+
+	segment->adler = adler32(1L, segment->filtered, segment->size);
+}
+
+static void RunPNGSegment(pngEncode *enc, pngSegment *segment, int compress)
+{
+	if(compress)
+		CompressPNGSegment(enc, segment);
+	else
+		FilterPNGSegment(enc, segment);
+}
+
+static void RunPNGSegments(pngEncode *enc, pngSegment *segments, int count, int threads, int compress)
+{
+#ifdef OPENMP_ENABLE
+	if(omp_in_parallel())
+	{
+		// Called from a plot task, idle threads of the team take segments
+		#pragma omp taskloop grainsize(1)
+		for(int i = 0; i < count; i++)
+			RunPNGSegment(enc, &segments[i], compress);
+	}
+	else
+	{
+		#pragma omp parallel for num_threads(threads) schedule(dynamic)
+		for(int i = 0; i < count; i++)
+			RunPNGSegment(enc, &segments[i], compress);
+	}
+#else
+	(void)threads;
+	for(int i = 0; i < count; i++)
+		RunPNGSegment(enc, &segments[i], compress);
+#endif
+}
+
+static void PutPNG32(unsigned char *buffer, uint32_t value)
+{
+	buffer[0] = value >> 24;
+	buffer[1] = value >> 16 & 0xff;
+	buffer[2] = value >> 8 & 0xff;
+	buffer[3] = value & 0xff;
+}
+
+static int WritePNGChunk(FILE *file, char *type, unsigned char *data, size_t size)
+{
+	unsigned char	header[8], trailer[4];
+	uLong			crc = 0;
+
+	PutPNG32(header, size);
+	memcpy(header + 4, type, 4);
+	crc = crc32(0L, header + 4, 4);
+	if(size)
+		crc = crc32(crc, data, size);
+	PutPNG32(trailer, crc);
+
+	if(fwrite(header, 1, 8, file) != 8)
+		return 0;
+	if(size && fwrite(data, 1, size, file) != size)
+		return 0;
+	return fwrite(trailer, 1, 4, file) == 4;
+}
+
+static int WriteSegmentedPNG(RasterImage *raster, FILE *file, pngProfile *profile, int filter, pngPalette *palette)
+{
+	pngEncode		enc;
+	pngSegment		*segments = NULL;
+	unsigned char	signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	unsigned char	ihdr[13], plte[256*3];
+	int				count = 0, rowsPer = 0, written = 1, flevel = 0;
+	uLong			adler = 1L;
+
+	enc.pixels = palette ? palette->indexes : raster->pixels;
+	enc.bpp = palette ? 1 : 3;
+	enc.rowBytes = (size_t)raster->width*enc.bpp;
+	enc.filter = filter;
+	enc.level = profile->level;
+	enc.filtered = (unsigned char*)malloc((size_t)raster->height*(enc.rowBytes + 1));
+	if(!enc.filtered)
+	{
+		logmsg("ERROR: Not enough memory to encode PNG\n");
+		return 0;
+	}
+
+	count = profile->threads;
+	if(count > raster->height/PNG_SEGMENT_MIN_ROWS)
+		count = raster->height/PNG_SEGMENT_MIN_ROWS;
+	if(count < 1)
+		count = 1;
+	rowsPer = (raster->height + count - 1)/count;
+	count = (raster->height + rowsPer - 1)/rowsPer;
+
+	segments = (pngSegment*)calloc(count, sizeof(pngSegment));
+	if(!segments)
+	{
+		free(enc.filtered);
+		logmsg("ERROR: Not enough memory to encode PNG\n");
+		return 0;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		size_t	offset = 0;
+
+		segments[i].firstRow = i*rowsPer;
+		segments[i].rows = rowsPer;
+		if(segments[i].firstRow + rowsPer > raster->height)
+			segments[i].rows = raster->height - segments[i].firstRow;
+		offset = (size_t)segments[i].firstRow*(enc.rowBytes + 1);
+		segments[i].filtered = enc.filtered + offset;
+		segments[i].size = (size_t)segments[i].rows*(enc.rowBytes + 1);
+		segments[i].dictSize = offset < PNG_DICTIONARY ? offset : PNG_DICTIONARY;
+		segments[i].last = i == count - 1;
+	}
+
+	RunPNGSegments(&enc, segments, count, profile->threads, 0);
+	for(int i = 0; i < count; i++)
+	{
+		if(segments[i].error)
+			written = 0;
+	}
+	if(written)
+		RunPNGSegments(&enc, segments, count, profile->threads, 1);
+
+	for(int i = 0; i < count; i++)
+	{
+		if(segments[i].error)
+			written = 0;
+		adler = adler32_combine(adler, segments[i].adler, (z_off_t)segments[i].size);
+	}
+
+	if(written)
+	{
+		unsigned char	*first = NULL, *last = NULL;
+
+		// zlib header, FLEVEL as zlib would set it and a valid FCHECK
+		if(profile->level >= 7)
+			flevel = 3;
+		else if(profile->level == 6 || profile->level == Z_DEFAULT_COMPRESSION)
+			flevel = 2;
+		else if(profile->level >= 2)
+			flevel = 1;
+		first = segments[0].out;
+		first[0] = 0x78;
+		first[1] = flevel << 6;
+		if((first[0]*256 + first[1]) % 31)
+			first[1] += 31 - (first[0]*256 + first[1]) % 31;
+		last = segments[count-1].out + 2 + segments[count-1].outSize;
+		PutPNG32(last, adler);
+
+		PutPNG32(ihdr, raster->width);
+		PutPNG32(ihdr + 4, raster->height);
+		ihdr[8] = 8;
+		ihdr[9] = palette ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB;
+		ihdr[10] = 0;
+		ihdr[11] = 0;
+		ihdr[12] = 0;
+
+		written = fwrite(signature, 1, 8, file) == 8;
+		if(written)
+			written = WritePNGChunk(file, "IHDR", ihdr, 13);
+		if(written && palette)
+		{
+			for(int i = 0; i < palette->count; i++)
+			{
+				plte[i*3] = palette->colors[i].red;
+				plte[i*3+1] = palette->colors[i].green;
+				plte[i*3+2] = palette->colors[i].blue;
+			}
+			written = WritePNGChunk(file, "PLTE", plte, palette->count*3);
+		}
+		for(int i = 0; written && i < count; i++)
+		{
+			unsigned char	*data = NULL;
+			size_t			size = 0;
+
+			data = segments[i].out + 2;
+			size = segments[i].outSize;
+			if(i == 0)
+			{
+				data -= 2;
+				size += 2;
+			}
+			if(segments[i].last)
+				size += 4;
+			written = WritePNGChunk(file, "IDAT", data, size);
+		}
+		if(written)
+			written = WritePNGChunk(file, "IEND", NULL, 0);
+		if(!written)
+			logmsg("ERROR: Couldn't write PNG\n");
+	}
+	else
+		logmsg("ERROR: Couldn't encode PNG\n");
+
+	for(int i = 0; i < count; i++)
+	{
+		if(segments[i].out)
+			free(segments[i].out);
+	}
+	free(segments);
+	free(enc.filtered);
+	return written;
+}
+
+static int WriteLibPNG(RasterImage *raster, FILE *file, pngProfile *profile, int filter, pngPalette *palette)
+{
+	png_structp	png = NULL;
+	png_infop	info = NULL;
+	int			filterMask[] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP,
+								PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS };
+
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if(!png)
+	{
+		logmsg("ERROR: Couldn't create PNG writer\n");
+		return 0;
+	}
+
+	info = png_create_info_struct(png);
+	if(!info)
+	{
+		png_destroy_write_struct(&png, NULL);
+		logmsg("ERROR: Couldn't create PNG info\n");
+		return 0;
+	}
+
+	// libpng reports errors by jumping back here
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		logmsg("ERROR: Couldn't encode PNG\n");
+		return 0;
+	}
+
+	png_init_io(png, file);
+	png_set_compression_level(png, profile->level);
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, filterMask[filter]);
+	png_set_IHDR(png, info, raster->width, raster->height, 8,
+		palette ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	if(palette)
+		png_set_PLTE(png, info, palette->colors, palette->count);
+	png_write_info(png, info);
+	for(int y = 0; y < raster->height; y++)
+	{
+		if(palette)
+			png_write_row(png, palette->indexes + (size_t)y*raster->width);
+		else
+			png_write_row(png, raster->pixels + (size_t)y*raster->width*3);
+	}
+	png_write_end(png, NULL);
+
+	png_destroy_write_struct(&png, &info);
+	return 1;
+}
+
+int WriteRasterPNG(RasterImage *raster, FILE *file, pngProfile *profile)
+{
+	pngProfile	defaults;
+	pngPalette	palette;
+	int			filter = 0, indexed = 0, written = 0;
+
+	if(!raster || !raster->pixels || !file)
+		return 0;
+
+	if(!profile)
+	{
+		InitPNGProfile(&defaults);
+		profile = &defaults;
+	}
+
+	memset(&palette, 0, sizeof(pngPalette));
+	if(profile->palette)
+		indexed = BuildPNGPalette(raster, &palette);
+
+	// libpng does the same, filters rarely help indexed pixels
+	filter = profile->filter;
+	if(filter < PNG_PROFILE_FILTER_NONE || filter > PNG_PROFILE_FILTER_ADAPTIVE)
+		filter = PNG_DEFAULT_FILTER;
+	if(indexed && filter == PNG_PROFILE_FILTER_ADAPTIVE)
+		filter = PNG_PROFILE_FILTER_NONE;
+
+	if(profile->threads > 1)
+		written = WriteSegmentedPNG(raster, file, profile, filter, indexed ? &palette : NULL);
+	else
+		written = WriteLibPNG(raster, file, profile, filter, indexed ? &palette : NULL);
+
+	if(palette.indexes)
+		free(palette.indexes);
+	return written;
+}
@@ -0,0 +1,74 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_RASTER_H
+#define MDFOURIER_RASTER_H
+
+#include "mdfourier.h"
+
+#define RASTER_LEVELS	256
+#define RASTER_COLORS	10
+
+/*
+	Background of the layers drawn over the first one. Every plot color has
+	a zero component or is a gray, so libplot never draws this one.
+*/
+#define RASTER_KEY_RED		0x10
+#define RASTER_KEY_GREEN	0x20
+#define RASTER_KEY_BLUE		0x30
+
+#define PNG_DEFAULT_LEVEL		6
+#define PNG_DEFAULT_THREADS		1
+#define PNG_MAX_THREADS			64
+#define PNG_SEGMENT_MIN_ROWS	16		// rows below this aren't worth their own segment
+
+#define PNG_PROFILE_FILTER_NONE		0
+#define PNG_PROFILE_FILTER_SUB		1
+#define PNG_PROFILE_FILTER_UP		2
+#define PNG_PROFILE_FILTER_AVG		3
+#define PNG_PROFILE_FILTER_PAETH	4
+#define PNG_PROFILE_FILTER_ADAPTIVE	5
+#define PNG_DEFAULT_FILTER			PNG_PROFILE_FILTER_ADAPTIVE
+
+typedef struct raster_st {
+	int				width, height;
+	unsigned char	*pixels;		// RGB rows, top row first
+	int				layers;			// merged so far, the next ones are overlays
+	double			x0, y0, x1, y1;	// user space covering the whole bitmap
+} RasterImage;
+
+int CreateRaster(RasterImage *raster, int width, int height, double x0, double y0, double x1, double y1, int whiteBG);
+void ReleaseRaster(RasterImage *raster);
+unsigned char *GetRasterColor(int colorIndex, long int intensity);
+void RasterLine(RasterImage *raster, double x0, double y0, double x1, double y1, unsigned char *rgb);
+int ReadRasterLayer(RasterImage *raster, FILE *file, int overlay);
+int WriteRasterPNG(RasterImage *raster, FILE *file, pngProfile *profile);
+void InitPNGProfile(pngProfile *profile);
+int ParsePNGFilter(char *name);
+
+#endif
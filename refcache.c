@@ -0,0 +1,531 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "refcache.h"
+#include "log.h"
+#include "cline.h"
+#include "freq.h"
+#include "arena.h"
+#include "pcmcache.h"
+#include "sync.h"
+
+#if defined (WIN32)
+	#include <process.h>
+	#define getpid _getpid
+#else
+	#include <unistd.h>
+#endif
+
+#define MixOption(hash, field) hash = MixAnalysisKey(hash, &(field), sizeof(field))
+
+/*
+	The reference as it is right before normalization: every block with its
+	frequencies and waveform copies, plus what loading it flagged in the
+	parameters. The key covers the file contents, the profile and the options
+	the analysis depends on. The comparison frame rates are checked on load,
+	since blocks are cut to the smaller one.
+	Samples and spectra are not stored, nothing after this point reads them.
+	Structures are stored as they are in memory, so the build that wrote the
+	entry is part of both the key and the header.
+*/
+
+typedef struct ref_cache_build_st {
+	char		version[16];
+	char		bits[8];
+	uint32_t	signalSize;
+	uint32_t	blocksSize;
+	uint32_t	frequencySize;
+	uint32_t	blockSamplesSize;
+} refCacheBuild;
+
+typedef struct ref_cache_hdr_st {
+	char			magic[8];
+	refCacheBuild	build;
+	uint64_t		key;
+	int32_t			totalBlocks;
+	int32_t			MaxFreq;
+	int32_t			clkMeasure;
+	int32_t			balanceChecked;
+	double			smallerFramerate;
+	double			biggerFramerate;
+	int32_t			smallFile;
+	int32_t			stereoNotFound;
+	int32_t			internalSyncTolerance;
+	int32_t			SRNoMatch;
+	int32_t			noBalance;
+	double			RefCentsDifferenceSR;
+	double			syncAlignPct[2];		// Reference start/end pulse alignment
+	int32_t			syncAlignTolerance[2];
+	AudioSignal		signal;			// pointers are rebuilt on load
+} refCacheHeader;
+
+static void GetAnalysisCacheName(char *name, uint64_t key, parameters *config)
+{
+	sprintf(name, "%s%c%016llx.ref", config->analysisCachePath, FOLDERCHAR, (unsigned long long)key);
+}
+
+static uint64_t MixAnalysisKey(uint64_t hash, void *data, size_t size)
+{
+	uint8_t	*bytes = (uint8_t*)data;
+
+	for(size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i])*0x100000001b3ULL;
+	return hash;
+}
+
+static void GetAnalysisCacheBuild(refCacheBuild *build)
+{
+	memset(build, 0, sizeof(refCacheBuild));
+	snprintf(build->version, sizeof(build->version), "%s", MDVERSION);
+	snprintf(build->bits, sizeof(build->bits), "%s", BITS_MDF);
+	build->signalSize = sizeof(AudioSignal);
+	build->blocksSize = sizeof(AudioBlocks);
+	build->frequencySize = sizeof(Frequency);
+	build->blockSamplesSize = sizeof(BlockSamples);
+}
+
+static uint64_t MixAnalysisOptions(uint64_t hash, parameters *config)
+{
+	refCacheBuild	build;
+	int				needsPhase = 0;
+
+	GetAnalysisCacheBuild(&build);
+	MixOption(hash, build);
+	needsPhase = NeedsPhase(config);
+	MixOption(hash, config->window);
+	MixOption(hash, config->MaxFreq);
+	MixOption(hash, config->startHz);
+	MixOption(hash, config->endHz);
+	MixOption(hash, config->ZeroPad);
+	MixOption(hash, config->FullTimeSpectroScale);
+	MixOption(hash, config->significantAmplitude);
+	MixOption(hash, config->doSamplerateAdjust);
+	MixOption(hash, config->ignoreFrameRateDiff);
+	MixOption(hash, config->syncTolerance);
+	MixOption(hash, config->timeDomainSync);
+	MixOption(hash, config->ManualSyncRef);
+	MixOption(hash, config->ManualSyncRefStart);
+	MixOption(hash, config->ManualSyncRefEnd);
+	MixOption(hash, config->videoFormatRef);
+	MixOption(hash, config->channelBalance);
+	MixOption(hash, config->useExtraData);
+	MixOption(hash, needsPhase);
+	MixOption(hash, config->plotTimeDomain);
+	MixOption(hash, config->plotAllNotes);
+	MixOption(hash, config->plotAllNotesWindowed);
+	MixOption(hash, config->plotTimeDomainHiDiff);
+	MixOption(hash, config->floatPipeline);
+	MixOption(hash, config->syncEngine);
+	return hash;
+}
+
+static int ReadAnalysisCacheHeader(FILE *file, refCacheHeader *hdr, parameters *config)
+{
+	refCacheBuild	build;
+
+	if(fread(hdr, sizeof(refCacheHeader), 1, file) != 1)
+		return 0;
+
+	GetAnalysisCacheBuild(&build);
+	if(memcmp(hdr->magic, REF_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+		memcmp(&hdr->build, &build, sizeof(refCacheBuild)) != 0 ||
+		hdr->key != config->analysisCacheKey ||
+		hdr->totalBlocks != config->types.totalBlocks ||
+		hdr->MaxFreq != config->MaxFreq ||
+		hdr->clkMeasure != config->clkMeasure)
+		return 0;
+	return 1;
+}
+
+/* Computes the key, returns 1 when there is an entry for it */
+int PrepareAnalysisCache(parameters *config)
+{
+	FILE			*file = NULL;
+	char			name[BUFFER_SIZE*2];
+	uint64_t		key = 0, size = 0, profileKey = 0, profileSize = 0;
+	refCacheHeader	hdr;
+	int				found = 0;
+
+	config->analysisCacheKey = 0;
+	if(!config->analysisCachePath[0] || config->refCache)
+		return 0;
+
+	// Normalization in time domain and clock adjustment change the samples first
+	if(config->noSyncProfile || config->normType == max_time || config->doClkAdjust)
+		return 0;
+
+	if(!GetPCMCacheKey(config->referenceFile, &key, &size) ||
+		!GetPCMCacheKey(config->profileFile, &profileKey, &profileSize))
+		return 0;
+
+	key = MixAnalysisKey(key, &profileKey, sizeof(profileKey));
+	config->analysisCacheKey = MixAnalysisOptions(key, config);
+
+	GetAnalysisCacheName(name, config->analysisCacheKey, config);
+	file = fopen(name, "rb");
+	if(!file)
+		return 0;
+	found = ReadAnalysisCacheHeader(file, &hdr, config);
+	fclose(file);
+	return found;
+}
+
+static int WriteCachedSamples(FILE *file, BlockSamples *samples)
+{
+	if(samples->samples && fwrite(samples->samples, sizeof(double), samples->size+1, file) != (size_t)(samples->size+1))
+		return 0;
+	if(samples->windowed_samples && fwrite(samples->windowed_samples, sizeof(double), samples->size+1, file) != (size_t)(samples->size+1))
+		return 0;
+	return 1;
+}
+
+static int WriteCachedBlock(FILE *file, AudioBlocks *AudioArray, parameters *config)
+{
+	long int size = 0;
+
+	if(fwrite(AudioArray, sizeof(AudioBlocks), 1, file) != 1)
+		return 0;
+
+	if(AudioArray->freq)
+	{
+		size = GetBlockFrequencyCount(AudioArray, CHANNEL_LEFT, config);
+		if(fwrite(AudioArray->freq, sizeof(Frequency), size, file) != (size_t)size)
+			return 0;
+	}
+	if(AudioArray->freqRight)
+	{
+		size = GetBlockFrequencyCount(AudioArray, CHANNEL_RIGHT, config);
+		if(fwrite(AudioArray->freqRight, sizeof(Frequency), size, file) != (size_t)size)
+			return 0;
+	}
+
+	if(!WriteCachedSamples(file, &AudioArray->audio) || !WriteCachedSamples(file, &AudioArray->audioRight))
+		return 0;
+
+	if(AudioArray->internalSync)
+	{
+		if(fwrite(AudioArray->internalSync, sizeof(BlockSamples), AudioArray->internalSyncCount, file) != (size_t)AudioArray->internalSyncCount)
+			return 0;
+		for(int i = 0; i < AudioArray->internalSyncCount; i++)
+		{
+			if(!WriteCachedSamples(file, &AudioArray->internalSync[i]))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+// The stored pointers only tell which arrays follow, they are cleared
+// before anything is read so a failed load can always be released
+static void GetCachedSamplesLayout(BlockSamples *samples, int *layout)
+{
+	*layout = (samples->samples ? 1 : 0) | (samples->windowed_samples ? 2 : 0);
+	samples->samples = NULL;
+	samples->windowed_samples = NULL;
+}
+
+static double *ReadCachedArray(FILE *file, long int size)
+{
+	double *array = NULL;
+
+	if(size < 0)
+		return NULL;
+
+	array = (double*)malloc(sizeof(double)*(size+1));
+	if(!array)
+		return NULL;
+	if(fread(array, sizeof(double), size+1, file) != (size_t)(size+1))
+	{
+		free(array);
+		return NULL;
+	}
+	return array;
+}
+
+static int ReadCachedSamples(FILE *file, BlockSamples *samples, int layout)
+{
+	if(layout & 1)
+	{
+		samples->samples = ReadCachedArray(file, samples->size);
+		if(!samples->samples)
+			return 0;
+	}
+	if(layout & 2)
+	{
+		samples->windowed_samples = ReadCachedArray(file, samples->size);
+		if(!samples->windowed_samples)
+			return 0;
+	}
+	return 1;
+}
+
+static int ReadCachedFrequencies(FILE *file, Frequency **freq, long int size, parameters *config)
+{
+	if(size <= 0)
+		return 0;
+
+	*freq = (Frequency*)ArenaAlloc(&config->arena, sizeof(Frequency)*size);
+	if(!*freq || fread(*freq, sizeof(Frequency), size, file) != (size_t)size)
+		return 0;
+	return 1;
+}
+
+static int ReadCachedBlock(FILE *file, AudioBlocks *AudioArray, parameters *config)
+{
+	int		hasFreq = 0, hasFreqRight = 0, syncCount = 0;
+	int		layout = 0, layoutRight = 0;
+
+	if(fread(AudioArray, sizeof(AudioBlocks), 1, file) != 1)
+	{
+		memset(AudioArray, 0, sizeof(AudioBlocks));
+		return 0;
+	}
+
+	hasFreq = AudioArray->freq != NULL;
+	hasFreqRight = AudioArray->freqRight != NULL;
+	syncCount = AudioArray->internalSync ? AudioArray->internalSyncCount : 0;
+	GetCachedSamplesLayout(&AudioArray->audio, &layout);
+	GetCachedSamplesLayout(&AudioArray->audioRight, &layoutRight);
+	AudioArray->freq = NULL;
+	AudioArray->freqRight = NULL;
+	AudioArray->fftwValues.spectrum = NULL;
+	AudioArray->fftwValuesRight.spectrum = NULL;
+	AudioArray->internalSync = NULL;
+	AudioArray->internalSyncCount = 0;
+
+	if(hasFreq && !ReadCachedFrequencies(file, &AudioArray->freq, GetBlockFrequencyCount(AudioArray, CHANNEL_LEFT, config), config))
+		return 0;
+	if(hasFreqRight && !ReadCachedFrequencies(file, &AudioArray->freqRight, GetBlockFrequencyCount(AudioArray, CHANNEL_RIGHT, config), config))
+		return 0;
+
+	if(!ReadCachedSamples(file, &AudioArray->audio, layout) || !ReadCachedSamples(file, &AudioArray->audioRight, layoutRight))
+		return 0;
+
+	if(syncCount > 0)
+	{
+		int	*syncLayout = NULL;
+
+		if(!initInternalSync(AudioArray, syncCount))
+			return 0;
+
+		syncLayout = (int*)malloc(sizeof(int)*syncCount);
+		if(!syncLayout)
+			return 0;
+
+		if(fread(AudioArray->internalSync, sizeof(BlockSamples), syncCount, file) != (size_t)syncCount)
+		{
+			memset(AudioArray->internalSync, 0, sizeof(BlockSamples)*syncCount);
+			free(syncLayout);
+			return 0;
+		}
+		for(int i = 0; i < syncCount; i++)
+			GetCachedSamplesLayout(&AudioArray->internalSync[i], &syncLayout[i]);
+		for(int i = 0; i < syncCount; i++)
+		{
+			if(!ReadCachedSamples(file, &AudioArray->internalSync[i], syncLayout[i]))
+			{
+				free(syncLayout);
+				return 0;
+			}
+		}
+		free(syncLayout);
+	}
+	return 1;
+}
+
+static int ReadCachedSignal(FILE *file, AudioSignal *Signal, parameters *config)
+{
+	Signal->Blocks = (AudioBlocks*)calloc(config->types.totalBlocks, sizeof(AudioBlocks));
+	if(!Signal->Blocks)
+		return 0;
+
+	for(int n = 0; n < config->types.totalBlocks; n++)
+	{
+		if(!ReadCachedBlock(file, &Signal->Blocks[n], config))
+			return 0;
+	}
+
+	if(config->clkMeasure && !ReadCachedBlock(file, &Signal->clkFrequencies, config))
+		return 0;
+
+	// nothing may be left over
+	if(fgetc(file) != EOF)
+		return 0;
+	return 1;
+}
+
+int LoadAnalysisCache(AudioSignal **ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	FILE			*file = NULL;
+	char			name[BUFFER_SIZE*2];
+	refCacheHeader	hdr;
+	AudioSignal		*Signal = NULL;
+
+	if(!config->analysisCacheKey)
+		return 0;
+
+	GetAnalysisCacheName(name, config->analysisCacheKey, config);
+	file = fopen(name, "rb");
+	if(!file)
+		return 0;
+
+	if(!ReadAnalysisCacheHeader(file, &hdr, config))
+	{
+		fclose(file);
+		return 0;
+	}
+
+	// Blocks were cut and padded for these frame rates
+	if(hdr.smallerFramerate != GetLowerFrameRate(hdr.signal.framerate, ComparisonSignal->framerate) ||
+		hdr.biggerFramerate != GetHigherFrameRate(hdr.signal.framerate, ComparisonSignal->framerate) ||
+		hdr.balanceChecked != NeedsBalanceCheck(&hdr.signal, ComparisonSignal, config))
+	{
+		if(config->verbose)
+			logmsg(" - Stored 'Reference' analysis is for another comparison frame rate\n");
+		fclose(file);
+		return 0;
+	}
+
+	Signal = (AudioSignal*)malloc(sizeof(AudioSignal));
+	if(!Signal)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	*Signal = hdr.signal;
+	Signal->Samples = NULL;
+	for(int i = 0; i < PLANAR_COUNT; i++)
+		Signal->Planar[i] = NULL;
+	Signal->mappedPCM = NULL;
+	Signal->mappedPCMSize = 0;
+	Signal->Blocks = NULL;
+	memset(&Signal->clkFrequencies, 0, sizeof(AudioBlocks));
+
+	if(!ReadCachedSignal(file, Signal, config))
+	{
+		logmsg(" - WARNING: Invalid analysis cache entry %s\n", name);
+		fclose(file);
+		ReleaseAudio(Signal, config);
+		free(Signal);
+		return 0;
+	}
+	fclose(file);
+
+	config->smallFile |= hdr.smallFile;
+	config->stereoNotFound |= hdr.stereoNotFound;
+	config->internalSyncTolerance |= hdr.internalSyncTolerance;
+	config->noBalance |= hdr.noBalance;
+	if(hdr.SRNoMatch)
+	{
+		config->SRNoMatch |= hdr.SRNoMatch;
+		config->RefCentsDifferenceSR = hdr.RefCentsDifferenceSR;
+	}
+	// the pulses were not detected again
+	for(int i = 0; i < 2; i++)
+	{
+		config->syncAlignPct[SYNC_ALIGN_SLOT(ROLE_REF, i)] = hdr.syncAlignPct[i];
+		config->syncAlignTolerance[SYNC_ALIGN_SLOT(ROLE_REF, i)] = hdr.syncAlignTolerance[i];
+	}
+	config->referenceFromCache = 1;
+
+	*ReferenceSignal = Signal;
+	logmsg("\n* Loaded 'Reference' analysis for %s from cache\n", config->referenceFile);
+	return 1;
+}
+
+int SaveAnalysisCache(AudioSignal *ReferenceSignal, AudioSignal *ComparisonSignal, parameters *config)
+{
+	FILE			*file = NULL;
+	char			name[BUFFER_SIZE*2], tmpName[BUFFER_SIZE*2+64];
+	refCacheHeader	hdr;
+	int				ok = 1;
+
+	if(!config->analysisCacheKey || config->referenceFromCache)
+		return 0;
+
+	if(!CreateFolder(config->analysisCachePath))
+	{
+		logmsg(" - WARNING: Could not create analysis cache folder %s\n", config->analysisCachePath);
+		return 0;
+	}
+
+	memset(&hdr, 0, sizeof(refCacheHeader));
+	memcpy(hdr.magic, REF_CACHE_MAGIC, sizeof(hdr.magic));
+	GetAnalysisCacheBuild(&hdr.build);
+	hdr.key = config->analysisCacheKey;
+	hdr.totalBlocks = config->types.totalBlocks;
+	hdr.MaxFreq = config->MaxFreq;
+	hdr.clkMeasure = config->clkMeasure;
+	hdr.balanceChecked = NeedsBalanceCheck(ReferenceSignal, ComparisonSignal, config);
+	hdr.smallerFramerate = config->smallerFramerate;
+	hdr.biggerFramerate = config->biggerFramerate;
+	hdr.smallFile = config->smallFile & ROLE_REF;
+	hdr.stereoNotFound = config->stereoNotFound & ROLE_REF;
+	hdr.internalSyncTolerance = config->internalSyncTolerance & ROLE_REF;
+	hdr.SRNoMatch = config->SRNoMatch & ROLE_REF;
+	hdr.noBalance = config->noBalance & ROLE_REF;
+	hdr.RefCentsDifferenceSR = config->RefCentsDifferenceSR;
+	for(int i = 0; i < 2; i++)
+	{
+		hdr.syncAlignPct[i] = config->syncAlignPct[SYNC_ALIGN_SLOT(ROLE_REF, i)];
+		hdr.syncAlignTolerance[i] = config->syncAlignTolerance[SYNC_ALIGN_SLOT(ROLE_REF, i)];
+	}
+	hdr.signal = *ReferenceSignal;
+
+	// write aside and rename, a concurrent run never reads a partial entry
+	GetAnalysisCacheName(name, config->analysisCacheKey, config);
+	sprintf(tmpName, "%s.%ld.tmp", name, (long)getpid());
+	file = fopen(tmpName, "wb");
+	if(!file)
+	{
+		logmsg(" - WARNING: Could not write analysis cache entry %s\n", name);
+		return 0;
+	}
+
+	if(fwrite(&hdr, sizeof(refCacheHeader), 1, file) != 1)
+		ok = 0;
+	for(int n = 0; ok && n < config->types.totalBlocks; n++)
+		ok = WriteCachedBlock(file, &ReferenceSignal->Blocks[n], config);
+	if(ok && config->clkMeasure)
+		ok = WriteCachedBlock(file, &ReferenceSignal->clkFrequencies, config);
+
+	if(fclose(file) != 0)
+		ok = 0;
+
+	if(!ok || rename(tmpName, name) != 0)
+	{
+		remove(tmpName);
+		logmsg(" - WARNING: Could not write analysis cache entry %s\n", name);
+		return 0;
+	}
+
+	if(config->verbose)
+		logmsg(" - Stored 'Reference' analysis in %s\n", name);
+	return 1;
+}
@@ -0,0 +1,546 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#include "serve.h"
+#include "log.h"
+#include "cline.h"
+#include <getopt.h>
+#include <signal.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SERVE_ENABLED
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#endif
+
+#ifdef OPENMP_ENABLE
+#include <omp.h>
+#endif
+
+/*
+	The daemon accepts one request at a time and hands it to a forked worker.
+	Logging, output folders and the working directory are process wide, a
+	worker owns all of them for its job while the daemon keeps the parsed
+	profiles and loaded references they start from.
+*/
+
+volatile sig_atomic_t serveStop = 0;
+char serveProgram[] = "mdfourier";
+char serveCompare[] = "-c";
+
+void ServeSignal(int sig)
+{
+	(void)sig;
+	serveStop = 1;
+}
+
+int IsServeStopping(void)
+{
+	return serveStop;
+}
+
+// getopt keeps its position between calls, every job parses a new argv
+void ResetCommandLineParser(void)
+{
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	optreset = 1;
+	optind = 1;
+#else
+	optind = 0;
+#endif
+}
+
+#ifdef SERVE_ENABLED
+
+int ReadServeBytes(int fd, void *buffer, size_t size)
+{
+	size_t	done = 0;
+
+	while(done < size)
+	{
+		ssize_t	count = 0;
+
+		count = read(fd, (char*)buffer + done, size - done);
+		if(count == -1 && errno == EINTR)
+			continue;
+		if(count <= 0)
+			return 0;
+		done += count;
+	}
+	return 1;
+}
+
+int WriteServeBytes(int fd, void *buffer, size_t size)
+{
+	size_t	done = 0;
+
+	while(done < size)
+	{
+		ssize_t	count = 0;
+
+		count = write(fd, (char*)buffer + done, size - done);
+		if(count == -1 && errno == EINTR)
+			continue;
+		if(count <= 0)
+			return 0;
+		done += count;
+	}
+	return 1;
+}
+
+void ServeReply(int client, char *fmt, ...)
+{
+	char	buffer[BUFFER_SIZE*2];
+	int		len = 0;
+	va_list	arguments;
+
+	va_start(arguments, fmt);
+	len = vsnprintf(buffer, sizeof(buffer), fmt, arguments);
+	va_end(arguments);
+	if(len < 0)
+		return;
+	if(len >= (int)sizeof(buffer))
+		len = sizeof(buffer) - 1;
+
+	WriteServeBytes(client, buffer, len);
+}
+
+// Another daemon answering on the path keeps it, a stale socket is replaced
+int ClaimServeSocketPath(char *path, struct sockaddr_un *address)
+{
+	struct stat	st;
+	int			probe = -1, inUse = 0;
+
+	if(stat(path, &st) != 0)
+		return 1;
+
+	if(!S_ISSOCK(st.st_mode))
+	{
+		logmsg("\tERROR: '%s' exists and is not a socket\n", path);
+		return 0;
+	}
+
+	probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(probe != -1)
+	{
+		inUse = connect(probe, (struct sockaddr*)address, sizeof(struct sockaddr_un)) == 0;
+		close(probe);
+	}
+	if(inUse)
+	{
+		logmsg("\tERROR: Another server is listening on '%s'\n", path);
+		return 0;
+	}
+
+	unlink(path);
+	return 1;
+}
+
+int OpenServeSocket(serveState *state, char *path, int maxWorkers)
+{
+	struct sockaddr_un	address;
+	struct sigaction	action;
+	mode_t				mask = 0;
+	int					bound = 0;
+
+	memset(state, 0, sizeof(serveState));
+	state->server = -1;
+
+	memset(&address, 0, sizeof(struct sockaddr_un));
+	if(strlen(path) >= sizeof(address.sun_path))
+	{
+		logmsg("\tERROR: Socket path '%s' is too long\n", path);
+		return 0;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	if(!ClaimServeSocketPath(path, &address))
+		return 0;
+
+	state->workers = (serveWorker*)calloc(maxWorkers, sizeof(serveWorker));
+	if(!state->workers)
+	{
+		logmsg("\tERROR: Not enough memory for %d workers\n", maxWorkers);
+		return 0;
+	}
+	state->maxWorkers = maxWorkers;
+
+	state->server = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(state->server == -1)
+	{
+		logmsg("\tERROR: Could not create socket: %s\n", strerror(errno));
+		CloseServeSocket(state);
+		return 0;
+	}
+
+	// Jobs write wherever their arguments say, only the owner may submit them
+	mask = umask(077);
+	bound = bind(state->server, (struct sockaddr*)&address, sizeof(struct sockaddr_un)) == 0;
+	umask(mask);
+	if(!bound || listen(state->server, SERVE_BACKLOG) == -1)
+	{
+		logmsg("\tERROR: Could not listen on '%s': %s\n", path, strerror(errno));
+		CloseServeSocket(state);
+		return 0;
+	}
+	sprintf(state->path, "%s", path);
+
+	// No SA_RESTART, accept and waitpid return so the flag is checked
+	memset(&action, 0, sizeof(struct sigaction));
+	action.sa_handler = ServeSignal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	// A client that went away only fails the writes of its job
+	signal(SIGPIPE, SIG_IGN);
+
+#ifdef OPENMP_ENABLE
+	// Forking after OpenMP started its threads leaves the child without them,
+	// the daemon stays single threaded and workers get the threads back
+	state->threads = omp_get_max_threads();
+	omp_set_num_threads(1);
+#endif
+	return 1;
+}
+
+void CloseServeSocket(serveState *state)
+{
+	if(state->server != -1)
+	{
+		close(state->server);
+		state->server = -1;
+	}
+	if(state->path[0])
+	{
+		unlink(state->path);
+		state->path[0] = '\0';
+	}
+
+	while(state->activeWorkers)
+		ReapServeWorkers(state, 1);
+
+	if(state->workers)
+	{
+		free(state->workers);
+		state->workers = NULL;
+	}
+	state->activeWorkers = 0;
+	state->workerMemory = 0;
+}
+
+int ParseServeJob(serveJob *job, size_t size)
+{
+	char	*pos = NULL, *end = NULL;
+	int		count = 0;
+
+	if(job->payload[size - 1] != '\0')
+		return 0;
+
+	end = job->payload + size;
+	for(pos = job->payload; pos < end; pos += strlen(pos) + 1)
+		count++;
+
+	job->argv = (char**)calloc(count + 4, sizeof(char*));
+	job->files = (char**)calloc(count, sizeof(char*));
+	if(!job->argv || !job->files)
+		return 0;
+
+	pos = job->payload;
+	job->workDir = pos;
+	if(!*job->workDir)
+		return 0;
+	pos += strlen(pos) + 1;
+
+	job->argv[job->argc++] = serveProgram;
+	while(pos < end && *pos)
+	{
+		job->argv[job->argc++] = pos;
+		pos += strlen(pos) + 1;
+	}
+	if(pos >= end)
+		return 0;
+
+	job->keySize = pos - job->payload;
+	pos++;
+
+	while(pos < end)
+	{
+		if(!*pos)
+			return 0;
+		job->files[job->fileCount++] = pos;
+		pos += strlen(pos) + 1;
+	}
+	return(job->fileCount > 0);
+}
+
+// commandline requires a comparison, the first one of the job is given
+int GetServeJobArguments(serveJob *job)
+{
+	job->argv[job->argc] = serveCompare;
+	job->argv[job->argc + 1] = job->files[0];
+	job->argv[job->argc + 2] = NULL;
+	return(job->argc + 2);
+}
+
+int AcceptServeJob(serveState *state, serveJob *job)
+{
+	unsigned char	length[4];
+	uint32_t		size = 0;
+	struct timeval	timeout;
+
+	memset(job, 0, sizeof(serveJob));
+	job->client = accept(state->server, NULL, NULL);
+	if(job->client == -1)
+	{
+		if(errno != EINTR)
+			logmsg("\tERROR: Could not accept connection: %s\n", strerror(errno));
+		return 0;
+	}
+
+	// A client that stalls must not hold up the queue
+	timeout.tv_sec = SERVE_READ_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(job->client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(struct timeval));
+
+	if(!ReadServeBytes(job->client, length, 4))
+	{
+		ReleaseServeJob(job);
+		return 0;
+	}
+
+	size = (uint32_t)length[0] << 24 | (uint32_t)length[1] << 16 |
+			(uint32_t)length[2] << 8 | (uint32_t)length[3];
+	if(!size || size > SERVE_MAX_REQUEST)
+	{
+		ServeReply(job->client, "FAILED invalid request size %u\n", size);
+		ReleaseServeJob(job);
+		return 0;
+	}
+
+	job->payload = (char*)malloc(sizeof(char)*size);
+	if(!job->payload)
+	{
+		ServeReply(job->client, "FAILED not enough memory for the request\n");
+		ReleaseServeJob(job);
+		return 0;
+	}
+
+	if(!ReadServeBytes(job->client, job->payload, size))
+	{
+		ReleaseServeJob(job);
+		return 0;
+	}
+
+	if(!ParseServeJob(job, size))
+	{
+		ServeReply(job->client, "FAILED malformed request\n");
+		ReleaseServeJob(job);
+		return 0;
+	}
+	return 1;
+}
+
+void ReleaseServeJob(serveJob *job)
+{
+	if(job->client != -1)
+	{
+		close(job->client);
+		job->client = -1;
+	}
+	if(job->payload)
+	{
+		free(job->payload);
+		job->payload = NULL;
+	}
+	if(job->argv)
+	{
+		free(job->argv);
+		job->argv = NULL;
+	}
+	if(job->files)
+	{
+		free(job->files);
+		job->files = NULL;
+	}
+	job->argc = 0;
+	job->fileCount = 0;
+}
+
+// The client sees what is logged while a template is created for its job
+int RedirectServeOutput(int client)
+{
+	int saved = -1;
+
+	fflush(stdout);
+	saved = dup(STDOUT_FILENO);
+	if(saved == -1)
+		return -1;
+	if(dup2(client, STDOUT_FILENO) == -1)
+	{
+		close(saved);
+		return -1;
+	}
+	return saved;
+}
+
+void RestoreServeOutput(int saved)
+{
+	if(saved == -1)
+		return;
+
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+}
+
+void RemoveServeWorker(serveState *state, pid_t pid)
+{
+	for(int i = 0; i < state->activeWorkers; i++)
+	{
+		if(state->workers[i].pid != pid)
+			continue;
+
+		state->workerMemory -= state->workers[i].memory;
+		state->workers[i] = state->workers[state->activeWorkers - 1];
+		state->activeWorkers--;
+		return;
+	}
+}
+
+// Collects finished workers, block waits for at least one of them
+void ReapServeWorkers(serveState *state, int block)
+{
+	while(state->activeWorkers)
+	{
+		pid_t	pid = 0;
+
+		pid = waitpid(-1, NULL, block ? 0 : WNOHANG);
+		if(pid == -1 && errno == ECHILD)
+		{
+			state->activeWorkers = 0;
+			state->workerMemory = 0;
+			return;
+		}
+		if(pid <= 0)
+			return;
+
+		RemoveServeWorker(state, pid);
+		block = 0;
+	}
+}
+
+// Returns 0 in the worker, 1 in the daemon and -1 if it could not fork
+int StartServeWorker(serveState *state, serveJob *job, size_t memory)
+{
+	pid_t	pid = 0;
+
+	fflush(stdout);
+	pid = fork();
+	if(pid == -1)
+	{
+		logmsg("\tERROR: Could not start a worker: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if(pid == 0)
+	{
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		close(state->server);
+
+		if(dup2(job->client, STDOUT_FILENO) == -1 || chdir(job->workDir) == -1)
+		{
+			ServeReply(job->client, "FAILED could not start the job in %s\n", job->workDir);
+			EndServeWorker(1);
+		}
+#ifdef OPENMP_ENABLE
+		omp_set_num_threads(state->threads);
+#endif
+		return 0;
+	}
+
+	state->workers[state->activeWorkers].pid = pid;
+	state->workers[state->activeWorkers].memory = memory;
+	state->activeWorkers++;
+	state->workerMemory += memory;
+	return 1;
+}
+
+// Workers leave without cleanup, the memory they share is the daemon's
+void EndServeWorker(int status)
+{
+	fflush(stdout);
+	_exit(status);
+}
+
+#else
+
+int OpenServeSocket(serveState *state, char *path, int maxWorkers)
+{
+	(void)path;
+	(void)maxWorkers;
+	memset(state, 0, sizeof(serveState));
+	logmsg("\tERROR: --serve needs UNIX domain sockets, not available on this platform\n");
+	return 0;
+}
+
+void CloseServeSocket(serveState *state) { (void)state; }
+int AcceptServeJob(serveState *state, serveJob *job) { (void)state; memset(job, 0, sizeof(serveJob)); return 0; }
+int GetServeJobArguments(serveJob *job) { (void)job; return 0; }
+void ReleaseServeJob(serveJob *job) { (void)job; }
+void ServeReply(int client, char *fmt, ...) { (void)client; (void)fmt; }
+int RedirectServeOutput(int client) { (void)client; return -1; }
+void RestoreServeOutput(int saved) { (void)saved; }
+void ReapServeWorkers(serveState *state, int block) { (void)state; (void)block; }
+int StartServeWorker(serveState *state, serveJob *job, size_t memory) { (void)state; (void)job; (void)memory; return -1; }
+void EndServeWorker(int status) { _exit(status); }
+
+#endif
+
+// Relative names are resolved against the folder of the job
+int GetServeFileTime(char *workDir, char *name, time_t *mtime, off_t *size)
+{
+	char		path[BUFFER_SIZE*2+2];
+	struct stat	st;
+
+	if(name[0] == FOLDERCHAR)
+		sprintf(path, "%s", name);
+	else
+		sprintf(path, "%s%c%s", workDir, FOLDERCHAR, name);
+
+	if(stat(path, &st) != 0)
+		return 0;
+
+	*mtime = st.st_mtime;
+	if(size)
+		*size = st.st_size;
+	return 1;
+}
@@ -0,0 +1,108 @@
+/* 
+ * MDFourier
+ * A Fourier Transform analysis tool to compare game console audio
+ * http://junkerhq.net/MDFourier/
+ *
+ * Copyright (C)2019-2020 Artemio Urbina
+ *
+ * This file is part of the 240p Test Suite
+ *
+ * You can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA	02111-1307	USA
+ *
+ * Requires the FFTW library: 
+ *	  http://www.fftw.org/
+ * 
+ */
+
+#ifndef MDFOURIER_SERVE_H
+#define MDFOURIER_SERVE_H
+
+#include "mdfourier.h"
+
+#define SERVE_DEFAULT_WORKERS	2
+#define SERVE_DEFAULT_MB		2048
+#define SERVE_MAX_REQUEST		(1024*1024)
+#define SERVE_BACKLOG			16
+#define SERVE_READ_TIMEOUT		10		// seconds a client has to send its request
+
+/*
+	A request is a 32 bit big endian length followed by that many bytes of
+	null terminated strings: the working directory of the client, the
+	analysis arguments as given on the command line (without -c), an empty
+	string and then one or more comparison files.
+	The reply is the console output of the run as it happens, with a
+	"RESULT <folder>", "SKIPPED <file>" or "FAILED <file>" line per
+	comparison and a final "DONE <compared> <requested>" line before the
+	connection is closed.
+*/
+
+typedef struct serve_job_st {
+	int		client;
+	char	*payload;
+	char	*workDir;
+	char	**argv;			// program name, the arguments and room for -c <file>
+	int		argc;
+	char	**files;
+	int		fileCount;
+	size_t	keySize;		// working directory and arguments, the start of payload
+} serveJob;
+
+/* A parsed profile with its reference loaded and synced, shared by jobs */
+typedef struct serve_template_st {
+	char			*key;
+	size_t			keySize;
+	parameters		config;
+	referenceCache	cache;
+	char			*profileLog;
+	char			*referenceLog;
+	int				logEnabled;
+	size_t			memory;
+	time_t			referenceTime;
+	off_t			referenceSize;
+	time_t			profileTime;
+	struct serve_template_st *next;
+} serveTemplate;
+
+typedef struct serve_worker_st {
+	pid_t	pid;
+	size_t	memory;
+} serveWorker;
+
+typedef struct serve_state_st {
+	int			server;
+	char		path[BUFFER_SIZE];
+	serveWorker	*workers;
+	int			maxWorkers;
+	int			activeWorkers;
+	size_t		workerMemory;
+	int			threads;
+} serveState;
+
+int OpenServeSocket(serveState *state, char *path, int maxWorkers);
+void CloseServeSocket(serveState *state);
+int IsServeStopping(void);
+int AcceptServeJob(serveState *state, serveJob *job);
+int GetServeJobArguments(serveJob *job);
+void ReleaseServeJob(serveJob *job);
+void ServeReply(int client, char *fmt, ...);
+void ResetCommandLineParser(void);
+int RedirectServeOutput(int client);
+void RestoreServeOutput(int saved);
+int GetServeFileTime(char *workDir, char *name, time_t *mtime, off_t *size);
+void ReapServeWorkers(serveState *state, int block);
+int StartServeWorker(serveState *state, serveJob *job, size_t memory);
+void EndServeWorker(int status);
+
+#endif
@@ -30,21 +30,20 @@
 #include "sync.h"
 #include "log.h"
 #include "freq.h"
-
-/*
-	There are the number of subdivisions to use. 
-	The higher, the less precise in frequency but more in position and vice versa 
-*/
+#include "plans.h"
+#include "kernels.h"
 
 #define SYNC_LPF		22000   // Sync Low pass filter
-#define	FACTOR_LFEXPL	4
-#define	FACTOR_EXPLORE	8
-#define	FACTOR_DETECT	8
+
+// Share of the chunk energy a tracked bin needs to be taken as the loudest one
+#define SYNC_GOERTZEL_DOMINANCE	0.3
+// Reported for chunks where the sync bins are not the loudest ones
+#define SYNC_OUT_OF_BAND		-1
 
 // Cut off for harmonic search
 #define HARMONIC_TSHLD 6000
 
-long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *config)
+long int DetectPulse(double *LeftSamples, wav_hdr header, int role, parameters *config)
 {
 	int			maxdetected = 0, AudioChannels = 0;
 	long int	sampleOffset = 0, searchOffset = 0;
@@ -54,14 +53,14 @@ long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *c
 
 	AudioChannels = header.fmt.NumOfChan;
 
-	sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, config);
+	sampleOffset = DetectPulseInternal(LeftSamples, header, FACTOR_EXPLORE, 0, &maxdetected, role, AudioChannels, config);
 	if(sampleOffset == -1)
 	{
 		if(config->debugSync)
 			logmsgFileOnly("WARNING SYNC: First round start pulse failed\n");
 
 		// Find out a new starting point where some soudn starts
-		searchOffset = DetectSignalStart(AllSamples, header, 0, 0, 0, NULL, NULL, config);
+		searchOffset = DetectSignalStart(LeftSamples, header, 0, 0, 0, NULL, NULL, config);
 		if (searchOffset > 0)
 		{
 			long int MS_Samples = 0;
@@ -73,12 +72,12 @@ long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *c
 		else
 			return -1;
 
-		sampleOffset = DetectPulseInternal(AllSamples, header, FACTOR_EXPLORE, searchOffset, &maxdetected, role, AudioChannels, config);
+		sampleOffset = DetectPulseInternal(LeftSamples, header, FACTOR_EXPLORE, searchOffset, &maxdetected, role, AudioChannels, config);
 		if(sampleOffset == -1)
 			return -1;
 	}
 
-	searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, sampleOffset, role, AudioChannels, config);
+	searchOffset = AdjustPulseSampleStartByLength(LeftSamples, header, sampleOffset, role, SYNC_ALIGN_SLOT(role, 0), AudioChannels, config);
 	if (searchOffset != -1 && searchOffset != sampleOffset)
 	{
 		if (config->debugSync)
@@ -112,7 +111,7 @@ long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *c
 								-0.9, -0.8, -0.7, -0.6, -1.6, -1.7, -1.8, -1.9,\
 								-0.4, -0.3, -0.2, -0.1, -1.1, -1.2, -1.3, -1.4 }
 
-long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config)
+long int DetectEndPulse(double *LeftSamples, long int startpulse, wav_hdr header, int role, parameters *config)
 {
 	int			maxdetected = 0, frameAdjust = 0, tries = 0, maxtries = END_SYNC_MAX_TRIES;
 	int			factor = 0, AudioChannels = 0, bytesPerSample = 0;
@@ -140,11 +139,11 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 	{
 		if(config->debugSync)
 			logmsgFileOnly("\nStarting CLEAN Detect end pulse with sample offset %ld\n", SamplesForDisplay(sampleOffset, AudioChannels));
-		searchOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
+		searchOffset = DetectPulseInternal(LeftSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
 		if(searchOffset != -1)
 		{
 			sampleOffset = searchOffset;
-			searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, searchOffset, role, AudioChannels, config);
+			searchOffset = AdjustPulseSampleStartByLength(LeftSamples, header, searchOffset, role, SYNC_ALIGN_SLOT(role, 1), AudioChannels, config);
 			if (searchOffset != -1 && searchOffset != sampleOffset)
 			{
 				if (config->debugSync)
@@ -179,7 +178,7 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 			frameAdjust = 0;
 			maxdetected = 0;
 
-			searchOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
+			searchOffset = DetectPulseInternal(LeftSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
 			if(searchOffset == -1 && !maxdetected)
 			{
 				if(config->debugSync)
@@ -212,7 +211,7 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 				frameAdjust = 0;
 				maxdetected = 0;
 
-				searchOffset = DetectPulseInternal(AllSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
+				searchOffset = DetectPulseInternal(LeftSamples, header, factor, sampleOffset, &maxdetected, role, AudioChannels, config);
 				if(searchOffset == -1 && !maxdetected)
 				{
 					if(config->debugSync)
@@ -234,7 +233,7 @@ long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header,
 		return -1;
 
 	sampleOffset = searchOffset;
-	searchOffset = AdjustPulseSampleStartByLength(AllSamples, header, sampleOffset, role, AudioChannels, config);
+	searchOffset = AdjustPulseSampleStartByLength(LeftSamples, header, sampleOffset, role, SYNC_ALIGN_SLOT(role, 1), AudioChannels, config);
 	if (searchOffset != -1 && searchOffset != sampleOffset)
 	{
 		if (config->debugSync)
@@ -601,12 +600,12 @@ long int DetectPulseTrainSequence(Pulses *pulseArray, double targetFrequency, do
 	return -1;
 }
 
-long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters* config)
+long int AdjustPulseSampleStartByLength(double* LeftSamples, wav_hdr header, long int offset, int role, int slot, int AudioChannels, parameters* config)
 {
 	int			samplesNeeded = 0, frequency = 0, startDetectPos = -1, endDetectPos = -1, bytesPerSample = 0;
 	long int	startSearch = 0, endSearch = 0, pos = 0, count = 0, foundPos = -1, totalSamples = 0;
 	long int	synLenInSamples = 0, matchCount = 0, tolerance = 0;
-	double*		buffer = NULL, percentSTD = 0;
+	double		percentSTD = 0;
 	Pulses*		pulseArray = NULL;
 	double		targetFrequency = 0;
 	double		syncLen = 0, averageMag = 0, standardDeviation = 0, compareMag = 0;
@@ -629,13 +628,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 
 	synLenInSamples = RoundToNsamples(((double)header.fmt.SamplesPerSec*syncLen*AudioChannels) / 1000.0, AudioChannels, NULL, NULL);
 
-	buffer = (double*)malloc(samplesNeeded * sizeof(double));
-	if (!buffer)
-	{
-		logmsgFileOnly("\tERROR: Sync Adjust malloc failed\n");
-		return(foundPos);
-	}
-
 	if (offset >= synLenInSamples)
 	{
 		startSearch = offset - synLenInSamples;
@@ -657,7 +649,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	pulseArray = (Pulses*)malloc(sizeof(Pulses) * (endSearch - startSearch));
 	if (!pulseArray)
 	{
-		free(buffer);
 		logmsgFileOnly("\tPulse malloc failed!\n");
 		return(foundPos);
 	}
@@ -666,7 +657,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	// we are counting inn samples, not bytes
 	for (pos = startSearch; pos < endSearch; pos += AudioChannels)
 	{
-		memset(buffer, 0, samplesNeeded * sizeof(double));
 		if (pos + samplesNeeded > totalSamples)
 		{
 			//logmsg("\tUnexpected end of File, please record the full Audio Test from the 240p Test Suite\n");
@@ -674,10 +664,9 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 		}
 
 		pulseArray[count].samples = pos;
-		memcpy(buffer, Samples + pos, samplesNeeded * sizeof(double));
-		ProcessChunkForSyncPulse(buffer, samplesNeeded,
+		ProcessChunkForSyncPulse(LeftSamples + pos/AudioChannels, samplesNeeded,
 			header.fmt.SamplesPerSec, &pulseArray[count],
-			CHANNEL_LEFT, AudioChannels, config);
+			AudioChannels, config);
 		count++;
 	}
 
@@ -694,7 +683,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	if (!matchCount)
 	{
 		logmsgFileOnly("\tERROR: Sync Adjustment, no matches at %g\n", targetFrequency);
-		free(buffer);
 		free(pulseArray);
 		return(foundPos);
 	}
@@ -714,7 +702,6 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 	if (!matchCount)
 	{
 		logmsgFileOnly("\tERROR: Sync Adjustment, no matches at for std dev %g\n", targetFrequency);
-		free(buffer);
 		free(pulseArray);
 		return(foundPos);
 	}
@@ -734,7 +721,7 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 		compareMag = averageMag - standardDeviation/4;
 	if(percentSTD >= 100)						// least common
 		compareMag = averageMag - standardDeviation/5;
-	config->syncAlignPct[config->syncAlignIterator] = percentSTD;
+	config->syncAlignPct[slot] = percentSTD;
 
 	if (config->debugSync)
 		logmsgFileOnly("Adjust Sync %g%% AVG: %g STD: %g Used: %g\n", percentSTD, averageMag, standardDeviation, compareMag);
@@ -857,8 +844,8 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 				if (newFoundPos != foundPos)
 				{
 					foundPos = newFoundPos;
-					config->syncAlignTolerance[config->syncAlignIterator] = 1;
-					config->syncAlignPct[config->syncAlignIterator] = percent;
+					config->syncAlignTolerance[slot] = 1;
+					config->syncAlignPct[slot] = percent;
 					if (config->debugSync)
 						logmsg("WARNING: Had to adjust sync pulse start due to %g%% pulse length difference from %ld samples to %ld samples\n", percent,
 							SamplesForDisplay(pulseArray[startDetectPos].samples, AudioChannels), SamplesForDisplay(foundPos, AudioChannels));
@@ -891,20 +878,19 @@ long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long in
 		}
 	}
 
-	free(buffer);
 	free(pulseArray);
 
 	return foundPos;
 }
 
 // Searches using 1ms/factor blocks
-long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long int offset, int *maxdetected, int role, int AudioChannels, parameters *config)
+long int DetectPulseInternal(double *LeftSamples, wav_hdr header, int factor, long int offset, int *maxdetected, int role, int AudioChannels, parameters *config)
 {
-	int					bytesPerSample = 0, executeCleanSilence = 0;
+	int					bytesPerSample = 0, executeCleanSilence = 0, useGoertzel = 0;
 	long int			i = 0, TotalMS = 0, totalSamples = 0;
-	double				*sampleBuffer = NULL;
 	long int		 	sampleBufferSize = 0, pos = 0, startPos = 0;
 	Pulses				*pulseArray = NULL;
+	SyncBins			bins;
 	double				targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ }, origFrequency = 0, MaxMagnitude = 0;
 
 	bytesPerSample = header.fmt.bitsPerSample/8;
@@ -917,12 +903,6 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			logmsg("ERROR: Invalid parameters for sync detection\n");
 		return -1;
 	}
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsgFileOnly("\tERROR: malloc failed for sample buffer during DetectPulseInternal\n");
-		return -1;
-	}
 
 	totalSamples = header.data.DataSize/bytesPerSample;
 	// calculate how many sampleBufferSize units fit in the available samples from the file
@@ -975,7 +955,12 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			TotalMS = TotalMS - expectedlen + syncLen + silenceLen/2;
 
 		if(expectedlen*1.5 < TotalMS)  // long file
+		{
+#ifdef OPENMP_ENABLE
+			#pragma omp atomic write
+#endif
 			config->trimmingNeeded = 1;
+		}
 	}
 
 	pulseArray = (Pulses*)malloc(sizeof(Pulses)*TotalMS);
@@ -1011,6 +996,9 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			 i, TotalMS-1, totalSamples/sampleBufferSize - 1);
 	}
 
+	if(config->syncEngine == SYNC_ENGINE_GOERTZEL)
+		useGoertzel = InitSyncBins(&bins, targetFrequency, targetFrequencyHarmonic, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels);
+
 	while(i < TotalMS)
 	{
 		if(pos + sampleBufferSize > totalSamples)
@@ -1019,16 +1007,20 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 			break;
 		}
 
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Samples + pos, sampleBufferSize*sizeof(double));
 		pulseArray[i].samples = pos;
 
-		pos += sampleBufferSize;
+		/* We use the left channel, we don't know about channel imbalances yet */
+		if(useGoertzel)
+			ProcessChunkForSyncGoertzel(LeftSamples + pos/AudioChannels, sampleBufferSize, &bins,
+				&pulseArray[i], AudioChannels);
+		else
+		{
+			ProcessChunkForSyncPulse(LeftSamples + pos/AudioChannels, sampleBufferSize, 
+				header.fmt.SamplesPerSec, &pulseArray[i], 
+				AudioChannels, config);
+		}
 
-		/* We use left channel by default, we don't know about channel imbalances yet */
-		ProcessChunkForSyncPulse(sampleBuffer, sampleBufferSize, 
-			header.fmt.SamplesPerSec, &pulseArray[i], 
-			CHANNEL_LEFT, AudioChannels, config);
+		pos += sampleBufferSize;
 
 		if(pulseArray[i].magnitude > MaxMagnitude)
 			MaxMagnitude = pulseArray[i].magnitude;
@@ -1064,14 +1056,15 @@ long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long i
 	offset = DetectPulseTrainSequence(pulseArray, targetFrequency, targetFrequencyHarmonic, TotalMS, factor, maxdetected, startPos, role, AudioChannels, config);
 
 	free(pulseArray);
-	free(sampleBuffer);
 
 	return offset;
 }
 
-double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config)
+/* samples is a single channel, size counts all channels as in the file */
+double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, int AudioChannels, parameters *config)
 {
 	fftw_plan		p = NULL;
+	planBuffer		buffer;
 	long		  	stereoSignalSize = 0;	
 	long		  	i = 0, monoSignalSize = 0; 
 	double		  	*signal = NULL;
@@ -1084,70 +1077,34 @@ double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, P
 	seconds = (double)size/((double)samplerate*AudioChannels);
 	boxsize = seconds;
 
-	signal = (double*)malloc(sizeof(double)*(monoSignalSize+1));
-	if(!signal)
-	{
-		logmsgFileOnly("Not enough memory\n");
-		return(0);
-	}
-	spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*(monoSignalSize/2+1));
-	if(!spectrum)
-	{
-		logmsgFileOnly("Not enough memory\n");
-		return(0);
-	}
-
-	if(!config->sync_plan)
-	{
- 		fftw_import_wisdom_from_filename("wisdom.fftw");
-
-		config->sync_plan = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
-		if(!config->sync_plan)
-		{
-			logmsgFileOnly("FFTW failed to create FFTW_MEASURE plan\n");
-			free(signal);
-			signal = NULL;
-			fftw_free(spectrum);
-			spectrum = NULL;
-			return 0;
-		}
-	}
+	memset(&buffer, 0, sizeof(planBuffer));
+	if(!AcquirePlanBuffer(&buffer, monoSignalSize, config))
+		return 0;
 
-	p = fftw_plan_dft_r2c_1d(monoSignalSize, signal, spectrum, FFTW_MEASURE);
+	p = GetPlanForSize(monoSignalSize, &buffer, config);
 	if(!p)
 	{
-		logmsgFileOnly("FFTW failed to create FFTW_MEASURE plan\n");
-
-		free(signal);
-		signal = NULL;
-
-		fftw_free(spectrum);
-		spectrum = NULL;
+		ReleasePlanBuffer(&buffer, config);
 		return 0;
 	}
 
+	signal = buffer.signal;
+	spectrum = buffer.spectrum;
+
 	memset(signal, 0, sizeof(double)*(monoSignalSize+1));
-	memset(spectrum, 0, sizeof(fftw_complex)*(monoSignalSize/2+1));
 
-	for(i = 0; i < monoSignalSize; i++)
-	{
-		if(channel == CHANNEL_LEFT)
-			signal[i] = (double)samples[i*AudioChannels];
-		if(channel == CHANNEL_RIGHT)
-			signal[i] = (double)samples[i*AudioChannels+1];
-		if(channel == CHANNEL_STEREO)
-			signal[i] = ((double)samples[i*AudioChannels]+(double)samples[i*AudioChannels+1])/2.0;
-	}
+	memcpy(signal, samples, sizeof(double)*monoSignalSize);
 
-	fftw_execute(p); 
-	fftw_destroy_plan(p);
+	fftw_execute_dft_r2c(p, signal, spectrum);
 	p = NULL;
 
+	/* the input is no longer needed, keep the magnitudes there */
+	CalculateMagnitudeSpan(spectrum, signal, monoSignalSize/2+1, size);
 	for(i = 1; i < monoSignalSize/2+1; i++)
 	{
 		double magnitude;
 
-		magnitude = CalculateMagnitude(&spectrum[i], size);
+		magnitude = signal[i];
 		if(magnitude > maxMag)
 		{
 			int		pass = 0;
@@ -1166,11 +1123,9 @@ double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, P
 		}
 	}
 
-	fftw_free(spectrum);
-	spectrum = NULL;
-
-	free(signal);
+	ReleasePlanBuffer(&buffer, config);
 	signal = NULL;
+	spectrum = NULL;
 
 	pulse->hertz = maxHertz;
 	pulse->magnitude = maxMag;
@@ -1179,7 +1134,130 @@ double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, P
 	return(maxHertz);
 }
 
-long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config)
+/*
+	Sets up the bins ProcessChunkForSyncPulse would report for the sync
+	frequency and its harmonics, returns 0 if any of them can't be tracked
+*/
+int InitSyncBins(SyncBins *bins, double targetFrequency, double *targetFrequencyHarmonic, size_t size, long samplerate, int AudioChannels)
+{
+	long	i = 0, monoSignalSize = 0;
+	double	seconds = 0, targets[SYNC_MAX_BINS];
+	int		t = 0, count = 0;
+
+	memset(bins, 0, sizeof(SyncBins));
+
+	monoSignalSize = (long)size/AudioChannels;
+	seconds = (double)size/((double)samplerate*AudioChannels);
+
+	targets[count++] = targetFrequency;
+	for(t = 0; t < 2; t++)
+	{
+		if(targetFrequencyHarmonic[t] != NO_FREQ)
+			targets[count++] = targetFrequencyHarmonic[t];
+	}
+
+	for(t = 0; t < count; t++)
+	{
+		long	bin = 0;
+		double	minDiff = samplerate;
+
+		for(i = 1; i < monoSignalSize/2+1; i++)
+		{
+			double difference = 0;
+
+			difference = fabs(CalculateFrequency(i, seconds) - targets[t]);
+			if(difference < minDiff)
+			{
+				minDiff = difference;
+				bin = i;
+			}
+		}
+		if(!bin || CalculateFrequency(bin, seconds) >= SYNC_LPF)
+			return 0;
+
+		bins->hertz[t] = CalculateFrequency(bin, seconds);
+		bins->omega[t] = 2.0*M_PI*(double)bin/(double)monoSignalSize;
+		bins->coeff[t] = 2.0*cos(bins->omega[t]);
+	}
+	bins->count = count;
+	bins->size = (long)size;
+	return 1;
+}
+
+/*
+	Goertzel version of ProcessChunkForSyncPulse, only the sync bins are
+	evaluated. A tracked bin is reported when it holds a large enough share of
+	the energy in the chunk, which stands in for the loudest bin test. Otherwise
+	the chunk is flagged as out of band, with the magnitude of the tracked bin.
+*/
+double ProcessChunkForSyncGoertzel(double *samples, size_t size, SyncBins *bins, Pulses *pulse, int AudioChannels)
+{
+	long	i = 0, monoSignalSize = 0;
+	double	s1[SYNC_MAX_BINS], s2[SYNC_MAX_BINS];
+	double	energy = 0, dc = 0, bandPower = 0, maxPower = 0;
+	int		t = 0, maxBin = 0;
+
+	monoSignalSize = (long)size/AudioChannels;
+	memset(s1, 0, sizeof(double)*SYNC_MAX_BINS);
+	memset(s2, 0, sizeof(double)*SYNC_MAX_BINS);
+
+	for(i = 0; i < monoSignalSize; i++)
+	{
+		double sample = 0;
+
+		sample = samples[i];
+
+		energy += sample*sample;
+		dc += sample;
+		for(t = 0; t < bins->count; t++)
+		{
+			double s = 0;
+
+			s = sample + bins->coeff[t]*s1[t] - s2[t];
+			s2[t] = s1[t];
+			s1[t] = s;
+		}
+	}
+
+	pulse->hertz = 0;
+	pulse->magnitude = 0;
+	pulse->phase = 0;
+
+	// Parseval, one sided power of every bin but DC
+	bandPower = ((double)monoSignalSize*energy - dc*dc)/2.0;
+	if(bandPower <= 0)
+		return 0;
+
+	for(t = 0; t < bins->count; t++)
+	{
+		double power = 0;
+
+		power = s1[t]*s1[t] + s2[t]*s2[t] - bins->coeff[t]*s1[t]*s2[t];
+		if(power > maxPower)
+		{
+			maxPower = power;
+			maxBin = t;
+		}
+	}
+
+	pulse->magnitude = (2*sqrt(maxPower))/bins->size;
+	if(maxPower >= SYNC_GOERTZEL_DOMINANCE*bandPower)
+	{
+		fftw_complex value = 0;
+
+		// Goertzel output is rotated by the last sample
+		value = (s1[maxBin] - s2[maxBin]*cos(bins->omega[maxBin]) + I*s2[maxBin]*sin(bins->omega[maxBin]))
+				*cexp(-I*bins->omega[maxBin]*(double)(monoSignalSize-1));
+		pulse->hertz = bins->hertz[maxBin];
+		pulse->phase = CalculatePhase(&value);
+	}
+	else
+		pulse->hertz = SYNC_OUT_OF_BAND;
+
+	return(pulse->hertz);
+}
+
+long int DetectSignalStart(double *LeftSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config)
 {
 	int			AudioChannels = 0;
 	long int	position = 0;
@@ -1188,7 +1266,7 @@ long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset,
 		logmsgFileOnly("\nStarting Detect Signal\n");
 
 	AudioChannels = header.fmt.NumOfChan;
-	position = DetectSignalStartInternal(AllSamples, header, FACTOR_DETECT, offset, syncKnow, expectedSyncLen, endPulse, AudioChannels, toleranceIssue, config);
+	position = DetectSignalStartInternal(LeftSamples, header, FACTOR_DETECT, offset, syncKnow, expectedSyncLen, endPulse, AudioChannels, toleranceIssue, config);
 	if(position == -1)
 	{
 		if(config->debugSync)
@@ -1204,11 +1282,10 @@ long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset,
 
 // amount of full length pulses to use
 #define MIN_LEN 4
-long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config)
+long int DetectSignalStartInternal(double *LeftSamples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config)
 {
 	int					bytesPerSample;
 	long int			i = 0, TotalMS = 0, start = 0, totalSamples = 0;
-	double				*sampleBuffer = NULL;
 	long int		 	sampleBufferSize = 0;
 	long int			pos = 0;
 	double				MaxMagnitude = 0;
@@ -1216,6 +1293,8 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	double 				total = 0;
 	long int 			count = 0, length = 0, tolerance = 0, toleranceIssueOffset = -1, MaxTolerance = 4;
 	double 				targetFrequency = 0, targetFrequencyHarmonic[2] = { NO_FREQ, NO_FREQ }, averageAmplitude = 0;
+	SyncBins			bins;
+	int					useGoertzel = 0;
 
 	bytesPerSample = header.fmt.bitsPerSample/8;
 	/* Not a real ms, just approximate */
@@ -1227,12 +1306,6 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 			logmsg("ERROR: Invalid parameters for sync detection\n");
 		return -1;
 	}
-	sampleBuffer = (double*)malloc(sampleBufferSize*sizeof(double));
-	if(!sampleBuffer)
-	{
-		logmsgFileOnly("\tERROR: malloc failed for sample buffer during DetectPulseInternal\n");
-		return -1;
-	}
 
 	totalSamples = header.data.DataSize/bytesPerSample;
 	// calculate how many sampleBufferSize units fit in the available samples from the file
@@ -1257,6 +1330,14 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	else
 		TotalMS /= 6;
 
+	// Only a known sync frequency can be tracked on its own
+	if(syncKnown && config->syncEngine == SYNC_ENGINE_GOERTZEL)
+	{
+		targetFrequency = FindFrequencyBracketForSync(syncKnown, 
+					sampleBufferSize, AudioChannels, header.fmt.SamplesPerSec, config);
+		useGoertzel = InitSyncBins(&bins, targetFrequency, targetFrequencyHarmonic, sampleBufferSize, header.fmt.SamplesPerSec, AudioChannels);
+	}
+
 	while(i < TotalMS)
 	{
 		if(pos + sampleBufferSize > totalSamples)
@@ -1265,16 +1346,20 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 			break;
 		}
 
-		memset(sampleBuffer, 0, sampleBufferSize*sizeof(double));
-		memcpy(sampleBuffer, Samples + pos, sampleBufferSize*sizeof(double));
 		pulseArray[i].samples = pos;
 
-		pos += sampleBufferSize;
+		/* We use the left channel, we don't know about channel imbalances yet */
+		if(useGoertzel)
+			ProcessChunkForSyncGoertzel(LeftSamples + pos/AudioChannels, sampleBufferSize, &bins,
+				&pulseArray[i], AudioChannels);
+		else
+		{
+			ProcessChunkForSyncPulse(LeftSamples + pos/AudioChannels, sampleBufferSize, 
+				header.fmt.SamplesPerSec, &pulseArray[i], 
+				AudioChannels, config);
+		}
 
-		/* We use left channel by default, we don't know about channel imbalances yet */
-		ProcessChunkForSyncPulse(sampleBuffer, sampleBufferSize, 
-			header.fmt.SamplesPerSec, &pulseArray[i], 
-			CHANNEL_LEFT, AudioChannels, config);
+		pos += sampleBufferSize;
 
 		if(pulseArray[i].magnitude > MaxMagnitude)
 			MaxMagnitude = pulseArray[i].magnitude;
@@ -1421,7 +1506,6 @@ long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor,
 	}
 
 	free(pulseArray);
-	free(sampleBuffer);
 
 	return offset;
 }
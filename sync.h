@@ -29,6 +29,15 @@
 #ifndef MDFOURIER_SYNC_H
 #define MDFOURIER_SYNC_H
 
+/*
+	There are the number of subdivisions to use. 
+	The higher, the less precise in frequency but more in position and vice versa 
+*/
+
+#define	FACTOR_LFEXPL	4
+#define	FACTOR_EXPLORE	8
+#define	FACTOR_DETECT	8
+
 typedef struct pulses_st {
 	double	hertz;
 	double	magnitude;
@@ -37,15 +46,30 @@ typedef struct pulses_st {
 	long int samples;
 } Pulses;
 
-long int DetectPulse(double *AllSamples, wav_hdr header, int role, parameters *config);
-long int DetectEndPulse(double *AllSamples, long int startpulse, wav_hdr header, int role, parameters *config);
-long int DetectPulseInternal(double *Samples, wav_hdr header, int factor, long int offset, int *maxDetected, int role, int AudioChannels, parameters *config);
-double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, char channel, int AudioChannels, parameters *config);
+#define SYNC_MAX_BINS	3
+
+// syncAlignPct/syncAlignTolerance slot of a pulse train: Ref start/end, Com start/end
+#define SYNC_ALIGN_SLOT(role, end)	(((role) == ROLE_COMP ? 2 : 0) + ((end) ? 1 : 0))
+
+typedef struct sync_bins_st {
+	int		count;
+	long	size;
+	double	hertz[SYNC_MAX_BINS];
+	double	omega[SYNC_MAX_BINS];
+	double	coeff[SYNC_MAX_BINS];
+} SyncBins;
+
+long int DetectPulse(double *LeftSamples, wav_hdr header, int role, parameters *config);
+long int DetectEndPulse(double *LeftSamples, long int startpulse, wav_hdr header, int role, parameters *config);
+long int DetectPulseInternal(double *LeftSamples, wav_hdr header, int factor, long int offset, int *maxDetected, int role, int AudioChannels, parameters *config);
+double ProcessChunkForSyncPulse(double *samples, size_t size, long samplerate, Pulses *pulse, int AudioChannels, parameters *config);
+int InitSyncBins(SyncBins *bins, double targetFrequency, double *targetFrequencyHarmonic, size_t size, long samplerate, int AudioChannels);
+double ProcessChunkForSyncGoertzel(double *samples, size_t size, SyncBins *bins, Pulses *pulse, int AudioChannels);
 long int DetectPulseTrainSequence(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, int factor, int *maxdetected, long int start, int role, int AudioChannels, parameters *config);
 long int AdjustPulseSampleStartByPhase(double *Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters *config);
-long int AdjustPulseSampleStartByLength(double* Samples, wav_hdr header, long int offset, int role, int AudioChannels, parameters* config);
+long int AdjustPulseSampleStartByLength(double* LeftSamples, wav_hdr header, long int offset, int role, int slot, int AudioChannels, parameters* config);
 
 double findAverageAmplitudeForTarget(Pulses *pulseArray, double targetFrequency, double *targetFrequencyHarmonic, long int TotalMS, long int start, int factor, int AudioChannels, parameters *config);
-long int DetectSignalStart(double *AllSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config);
-long int DetectSignalStartInternal(double *Samples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config);
+long int DetectSignalStart(double *LeftSamples, wav_hdr header, long int offset, int syncKnow, long int expectedSyncLen, long int *endPulse, int *toleranceIssue, parameters *config);
+long int DetectSignalStartInternal(double *LeftSamples, wav_hdr header, int factor, long int offset, int syncKnown, long int expectedSyncLen, long int *endPulse, int AudioChannels, int *toleranceIssue, parameters *config);
 #endif
@@ -105,6 +105,24 @@ double *CreateWindowInternal(windowManager *wm, double *(*createWindow)(long), c
 		memset(window+windowSize, 0, sizeof(double)*(realMemSize-windowSize));
 	}
 
+	// Single precision copy for the float transforms
+	if(config->floatPipeline != FLOAT_PIPELINE_OFF)
+	{
+		long int	i = 0;
+		float		*windowf = NULL;
+
+		windowf = (float*)malloc(sizeof(float)*realMemSize);
+		if(!windowf)
+		{
+			free(window);
+			logmsg ("%s window creation failed, float\n", name);
+			return NULL;
+		}
+		for(i = 0; i < realMemSize; i++)
+			windowf[i] = (float)window[i];
+		wm->windowArray[wm->windowCount].windowf = windowf;
+	}
+
 	wm->windowArray[wm->windowCount].window = window;
 	wm->windowArray[wm->windowCount].frames = frames;
 	wm->windowArray[wm->windowCount].seconds = seconds;
@@ -240,6 +258,19 @@ double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames
 	return CreateWindow(wm, frames, cutFrames, framerate, config);
 }
 
+float *getFloatWindow(windowManager *wm, double *window)
+{
+	if(!wm || !window)
+		return NULL;
+
+	for(int i = 0; i < wm->windowCount; i++)
+	{
+		if(wm->windowArray[i].window == window)
+			return wm->windowArray[i].windowf;
+	}
+	return NULL;
+}
+
 void freeWindows(windowManager *wm)
 {
 	if(!wm)
@@ -252,6 +283,11 @@ void freeWindows(windowManager *wm)
 			free(wm->windowArray[i].window);
 			wm->windowArray[i].window = NULL;
 		}
+		if(wm->windowArray[i].windowf)
+		{
+			free(wm->windowArray[i].windowf);
+			wm->windowArray[i].windowf = NULL;
+		}
 	}
 	if(wm->windowCount)
 	{
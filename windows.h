@@ -39,6 +39,7 @@ double *rectWindow(long int n);
 
 int initWindows(windowManager *wm, double SampleRate, char winType, parameters *config);
 double *getWindowByLength(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
+float *getFloatWindow(windowManager *wm, double *window);
 double *CreateWindow(windowManager *wm, long int frames, long int cutFrames, double framerate, parameters *config);
 void freeWindows(windowManager *windows);
 double CompensateValueForWindow(double value, char winType);